@@ -83,7 +83,9 @@ LOCAL_C_INCLUDES := \
 	deps/Android/libiconv/libcharset/include
 
 LOCAL_SRC_FILES := \
+	../../../src/activeobjectgrid.cpp              \
 	../../../src/ban.cpp                           \
+	../../../src/block_payload_cache.cpp           \
 	../../../src/camera.cpp                        \
 	../../../src/cavegen.cpp                       \
 	../../../src/chat.cpp                          \
@@ -142,9 +144,11 @@ LOCAL_SRC_FILES := \
 	../../../src/log.cpp                           \
 	../../../src/main.cpp                          \
 	../../../src/map.cpp                           \
+	../../../src/map_save_thread.cpp               \
 	../../../src/map_settings_manager.cpp          \
 	../../../src/mapblock.cpp                      \
 	../../../src/mapblock_mesh.cpp                 \
+	../../../src/mapblock_table.cpp                \
 	../../../src/mapgen.cpp                        \
 	../../../src/mapgen_flat.cpp                   \
 	../../../src/mapgen_fractal.cpp                \
@@ -170,6 +174,7 @@ LOCAL_SRC_FILES := \
 	../../../src/nodemetadata.cpp                  \
 	../../../src/nodetimer.cpp                     \
 	../../../src/noise.cpp                         \
+	../../../src/noise_simd.cpp                    \
 	../../../src/objdef.cpp                        \
 	../../../src/object_properties.cpp             \
 	../../../src/particles.cpp                     \
@@ -212,6 +217,7 @@ LOCAL_SRC_FILES := \
 	../../../src/util/sha1.cpp                     \
 	../../../src/util/string.cpp                   \
 	../../../src/util/srp.cpp                      \
+	../../../src/util/thread.cpp                   \
 	../../../src/util/timetaker.cpp                \
 	../../../src/touchscreengui.cpp                \
 	../../../src/database-leveldb.cpp              \
@@ -229,6 +235,7 @@ LOCAL_CFLAGS += #-Werror=shorten-64-to-32
 LOCAL_SRC_FILES += \
 	../../../src/network/connection.cpp            \
 	../../../src/network/networkpacket.cpp         \
+	../../../src/network/nodechanges.cpp           \
 	../../../src/network/clientopcodes.cpp         \
 	../../../src/network/clientpackethandler.cpp   \
 	../../../src/network/serveropcodes.cpp         \
@@ -503,6 +503,64 @@ core.register_chatcommand("emergeblocks", {
 	end,
 })
 
+local function pregen_status_string(status)
+	return string.format("%d/%d mapchunks done, %d generated, %.1f blocks/s",
+		status.chunks_done, status.chunks_total, status.chunks_generated,
+		status.blocks_per_second)
+end
+
+core.register_chatcommand("pregen", {
+	params = "[<radius> | stop]",
+	description = "Generate the map within <radius> mapchunks of the spawn "
+		.. "and the places visited most while the server is idle, "
+		.. "or show the progress",
+	privs = {server=true},
+	func = function(name, param)
+		if param == "stop" then
+			core.stop_pregen()
+			return true, "Pregeneration stopped: " ..
+				pregen_status_string(core.get_pregen_status())
+		elseif param ~= "" then
+			local radius = tonumber(param)
+			if not radius or not core.start_pregen(radius) then
+				return false, "Invalid radius (see /help pregen)."
+			end
+			return true, "Pregeneration started."
+		end
+
+		local status = core.get_pregen_status()
+		return true, (status.active and "Pregenerating: " or
+			"Pregeneration finished: ") .. pregen_status_string(status)
+	end,
+})
+
+core.register_chatcommand("trace", {
+	params = "start | stop | histograms",
+	description = "Write the server profiler zones to a Chrome trace "
+		.. "file or their duration histograms to a file in the world",
+	privs = {server=true},
+	func = function(name, param)
+		local prefix = core.get_worldpath() .. DIR_DELIM
+		if param == "start" then
+			local path = prefix .. "profiler_trace_" .. os.time() .. ".json"
+			if not core.start_profiler_trace(path) then
+				return false, "Could not start a trace, is one running?"
+			end
+			return true, "Tracing to " .. path
+		elseif param == "stop" then
+			return true, "Trace finished with " ..
+				core.stop_profiler_trace() .. " scopes."
+		elseif param == "histograms" then
+			local path = prefix .. "profiler_histograms.txt"
+			if not core.save_profiler_histograms(path) then
+				return false, "Could not write " .. path
+			end
+			return true, "Histograms written to " .. path
+		end
+		return false, "Invalid parameters (see /help trace)."
+	end,
+})
+
 core.register_chatcommand("deleteblocks", {
 	params = "(here [<radius>]) | (<pos1> <pos2>)",
 	description = "Delete map blocks contained in area pos1 to pos2 "
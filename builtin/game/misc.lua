@@ -243,6 +243,57 @@ function core.http_add_fetch(httpenv)
 	return httpenv
 end
 
+-- Queued path searches, spread over server steps
+local path_queue = {}
+local path_queue_first = 1
+local path_queue_last = 0
+local path_step_budget = 3000 -- microseconds per step
+
+function core.find_path_async(pos1, pos2, searchdistance, max_jump, max_drop,
+		algorithm, callback, ...)
+	assert(type(callback) == "function",
+		"core.find_path_async: callback must be a function")
+	path_queue_last = path_queue_last + 1
+	path_queue[path_queue_last] = {
+		pos1 = vector.new(pos1),
+		pos2 = vector.new(pos2),
+		searchdistance = searchdistance,
+		max_jump = max_jump,
+		max_drop = max_drop,
+		algorithm = algorithm,
+		callback = callback,
+		args = {...},
+		nargs = select("#", ...),
+	}
+end
+
+core.register_globalstep(function()
+	if path_queue_first > path_queue_last then
+		return
+	end
+	-- Always answer at least one request, so the queue keeps moving
+	local start = core.get_us_time()
+	local done = {}
+	repeat
+		local req = path_queue[path_queue_first]
+		path_queue[path_queue_first] = nil
+		path_queue_first = path_queue_first + 1
+		req.path = core.find_path(req.pos1, req.pos2, req.searchdistance,
+			req.max_jump, req.max_drop, req.algorithm)
+		done[#done + 1] = req
+	until path_queue_first > path_queue_last or
+		core.get_us_time() - start >= path_step_budget
+	if path_queue_first > path_queue_last then
+		path_queue_first = 1
+		path_queue_last = 0
+	end
+
+	-- Callbacks may queue new searches, answered on a later step
+	for _, req in ipairs(done) do
+		req.callback(req.path, unpack(req.args, 1, req.nargs))
+	end
+end)
+
 function core.close_formspec(player_name, formname)
 	return core.show_formspec(player_name, formname, "")
 end
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "irr_aabb3d.h"
 #include <string>
+#include <vector>
 
 enum ActiveObjectType {
 	ACTIVEOBJECT_TYPE_INVALID = 0,
@@ -54,6 +55,107 @@ struct ActiveObjectMessage
 	std::string datastring;
 };
 
+/*
+	Set of active object ids, stored as a bitmap indexed by id.
+	Lookups are constant time and ids are iterated in ascending order.
+*/
+class ActiveObjectIdSet
+{
+public:
+	class const_iterator
+	{
+	public:
+		u16 operator*() const { return m_id; }
+		const_iterator &operator++()
+		{
+			m_id = m_set->findNext(m_id + 1);
+			return *this;
+		}
+		bool operator==(const const_iterator &other) const
+		{ return m_id == other.m_id; }
+		bool operator!=(const const_iterator &other) const
+		{ return m_id != other.m_id; }
+
+	private:
+		friend class ActiveObjectIdSet;
+		const_iterator(const ActiveObjectIdSet *set, u32 id):
+			m_set(set),
+			m_id(id)
+		{}
+
+		const ActiveObjectIdSet *m_set;
+		u32 m_id;
+	};
+
+	ActiveObjectIdSet():
+		m_count(0)
+	{}
+
+	bool contains(u16 id) const
+	{
+		u32 word = id / 32;
+		return word < m_bits.size() && (m_bits[word] >> (id % 32)) & 1;
+	}
+
+	// Returns false if the id was already in the set
+	bool insert(u16 id)
+	{
+		u32 word = id / 32;
+		if (word >= m_bits.size())
+			m_bits.resize(word + 1, 0);
+		u32 mask = 1U << (id % 32);
+		if (m_bits[word] & mask)
+			return false;
+		m_bits[word] |= mask;
+		m_count++;
+		return true;
+	}
+
+	// Returns false if the id was not in the set
+	bool erase(u16 id)
+	{
+		if (!contains(id))
+			return false;
+		m_bits[id / 32] &= ~(1U << (id % 32));
+		m_count--;
+		return true;
+	}
+
+	void clear()
+	{
+		m_bits.clear();
+		m_count = 0;
+	}
+
+	size_t size() const { return m_count; }
+	bool empty() const { return m_count == 0; }
+
+	const_iterator begin() const { return const_iterator(this, findNext(0)); }
+	const_iterator end() const { return const_iterator(this, m_bits.size() * 32); }
+
+private:
+	// Returns the first id >= from in the set, or the end id
+	u32 findNext(u32 from) const
+	{
+		u32 word = from / 32;
+		if (word >= m_bits.size())
+			return m_bits.size() * 32;
+		u32 bits = m_bits[word] & (~0U << (from % 32));
+		while (bits == 0) {
+			if (++word == m_bits.size())
+				return m_bits.size() * 32;
+			bits = m_bits[word];
+		}
+		u32 id = word * 32;
+		for (; !(bits & 1); bits >>= 1)
+			id++;
+		return id;
+	}
+
+	std::vector<u32> m_bits;
+	size_t m_count;
+};
+
 /*
 	Parent class for ServerActiveObject and ClientActiveObject
 */
@@ -0,0 +1,134 @@
+/*
+Minetest
+Copyright (C) 2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "activeobjectgrid.h"
+#include "mapblock.h"
+#include "util/numeric.h"
+
+u64 ActiveObjectGrid::getCellKey(v3s16 cell)
+{
+	return (u64)(u16)cell.X |
+		((u64)(u16)cell.Y << 16) |
+		((u64)(u16)cell.Z << 32);
+}
+
+v3s16 ActiveObjectGrid::getCell(v3f pos)
+{
+	// Clamp so that far away positions and huge query boxes
+	// can't overflow the node coordinates
+	const f32 limit = S16_MAX * BS;
+	pos.X = rangelim(pos.X, -limit, limit);
+	pos.Y = rangelim(pos.Y, -limit, limit);
+	pos.Z = rangelim(pos.Z, -limit, limit);
+	return getNodeBlockPos(floatToInt(pos, BS));
+}
+
+void ActiveObjectGrid::removeFromCell(u64 key, u16 id)
+{
+	CellMap::iterator it = m_cells.find(key);
+	if (it == m_cells.end())
+		return;
+
+	std::vector<u16> &ids = it->second;
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (ids[i] != id)
+			continue;
+		ids[i] = ids.back();
+		ids.pop_back();
+		break;
+	}
+	if (ids.empty())
+		m_cells.erase(it);
+}
+
+void ActiveObjectGrid::insert(u16 id, v3f pos)
+{
+	u64 key = getCellKey(getCell(pos));
+	UNORDERED_MAP<u16, u64>::iterator it = m_object_cells.find(id);
+	if (it != m_object_cells.end()) {
+		if (it->second == key)
+			return;
+		removeFromCell(it->second, id);
+		it->second = key;
+	} else {
+		m_object_cells[id] = key;
+	}
+	m_cells[key].push_back(id);
+}
+
+void ActiveObjectGrid::remove(u16 id)
+{
+	UNORDERED_MAP<u16, u64>::iterator it = m_object_cells.find(id);
+	if (it == m_object_cells.end())
+		return;
+	removeFromCell(it->second, id);
+	m_object_cells.erase(it);
+}
+
+void ActiveObjectGrid::update(u16 id, v3f pos)
+{
+	UNORDERED_MAP<u16, u64>::iterator it = m_object_cells.find(id);
+	if (it == m_object_cells.end())
+		return;
+
+	u64 key = getCellKey(getCell(pos));
+	if (it->second == key)
+		return;
+
+	removeFromCell(it->second, id);
+	it->second = key;
+	m_cells[key].push_back(id);
+}
+
+void ActiveObjectGrid::getObjectsInArea(const aabb3f &box,
+	std::vector<u16> &ids) const
+{
+	v3s16 minp = getCell(box.MinEdge);
+	v3s16 maxp = getCell(box.MaxEdge);
+
+	u64 volume = (u64)(maxp.X - minp.X + 1) *
+		(u64)(maxp.Y - minp.Y + 1) *
+		(u64)(maxp.Z - minp.Z + 1);
+
+	// Huge areas: walking the occupied cells is cheaper than probing
+	if (volume > m_cells.size()) {
+		for (CellMap::const_iterator it = m_cells.begin();
+				it != m_cells.end(); ++it) {
+			v3s16 cell((s16)(it->first & 0xFFFF),
+				(s16)((it->first >> 16) & 0xFFFF),
+				(s16)((it->first >> 32) & 0xFFFF));
+			if (cell.X < minp.X || cell.X > maxp.X ||
+					cell.Y < minp.Y || cell.Y > maxp.Y ||
+					cell.Z < minp.Z || cell.Z > maxp.Z)
+				continue;
+			ids.insert(ids.end(), it->second.begin(), it->second.end());
+		}
+		return;
+	}
+
+	v3s16 p;
+	for (p.X = minp.X; p.X <= maxp.X; p.X++)
+	for (p.Y = minp.Y; p.Y <= maxp.Y; p.Y++)
+	for (p.Z = minp.Z; p.Z <= maxp.Z; p.Z++) {
+		CellMap::const_iterator it = m_cells.find(getCellKey(p));
+		if (it == m_cells.end())
+			continue;
+		ids.insert(ids.end(), it->second.begin(), it->second.end());
+	}
+}
@@ -0,0 +1,69 @@
+/*
+Minetest
+Copyright (C) 2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef ACTIVE_OBJECT_GRID_HEADER
+#define ACTIVE_OBJECT_GRID_HEADER
+
+#include "irrlichttypes_bloated.h"
+#include "util/cpp11_container.h"
+#include <vector>
+
+/*
+	Uniform grid of active object ids, used by the environments to
+	answer spatial queries without walking every active object.
+
+	Each cell is one MapBlock large. ServerEnvironment moves objects
+	between cells when their base position changes (see
+	updateActiveObjectPos()), ClientEnvironment once per step.
+*/
+
+class ActiveObjectGrid
+{
+public:
+	void insert(u16 id, v3f pos);
+	void remove(u16 id);
+	// Moves an object to the cell containing pos; ignores unknown ids
+	void update(u16 id, v3f pos);
+
+	// Appends the ids of all objects in the cells touching box.
+	// This is a broad phase only, callers have to check exact positions.
+	void getObjectsInArea(const aabb3f &box, std::vector<u16> &ids) const;
+
+	void clear()
+	{
+		m_cells.clear();
+		m_object_cells.clear();
+	}
+
+	size_t size() const { return m_object_cells.size(); }
+
+private:
+	static u64 getCellKey(v3s16 cell);
+	static v3s16 getCell(v3f pos);
+
+	void removeFromCell(u64 key, u16 id);
+
+	typedef UNORDERED_MAP<u64, std::vector<u16> > CellMap;
+	// Objects stored by the key of the cell they are in
+	CellMap m_cells;
+	// Cell key of every object in the grid
+	UNORDERED_MAP<u16, u64> m_object_cells;
+};
+
+#endif
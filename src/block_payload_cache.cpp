@@ -0,0 +1,114 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "block_payload_cache.h"
+#include <sstream>
+#include "mapblock.h"
+#include "profiler.h"
+
+static std::string serialize_block(MapBlock *block, u8 ver, u8 codec)
+{
+	std::ostringstream os(std::ios_base::binary);
+	block->serialize(os, ver, false, codec);
+	block->serializeNetworkSpecific(os);
+	return os.str();
+}
+
+bool BlockPayloadCache::Key::operator<(const Key &other) const
+{
+	if (p.X != other.p.X)
+		return p.X < other.p.X;
+	if (p.Y != other.p.Y)
+		return p.Y < other.p.Y;
+	if (p.Z != other.p.Z)
+		return p.Z < other.p.Z;
+	if (ver != other.ver)
+		return ver < other.ver;
+	if (codec != other.codec)
+		return codec < other.codec;
+	return net_proto_version < other.net_proto_version;
+}
+
+BlockPayloadCache::BlockPayloadCache(size_t max_size):
+	m_size(0),
+	m_max_size(max_size)
+{
+}
+
+const std::string &BlockPayloadCache::get(MapBlock *block, u8 ver, u8 codec,
+	u16 net_proto_version)
+{
+	if (m_max_size == 0) {
+		m_uncached = serialize_block(block, ver, codec);
+		return m_uncached;
+	}
+
+	Key key;
+	key.p = block->getPos();
+	key.ver = ver;
+	key.codec = codec;
+	key.net_proto_version = net_proto_version;
+
+	std::map<Key, Entry>::iterator it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		Entry &entry = it->second;
+		// Move to the front of the LRU list
+		m_lru.splice(m_lru.begin(), m_lru, entry.lru_it);
+		if (entry.block_id == block->getId() &&
+				entry.modified_counter == block->getModifiedCounter()) {
+			g_profiler->add("Server: block send cache hits", 1);
+			return entry.data;
+		}
+		// The block changed since, update the entry
+		m_size -= entry.data.size();
+	} else {
+		m_lru.push_front(key);
+		it = m_entries.insert(std::make_pair(key, Entry())).first;
+		it->second.lru_it = m_lru.begin();
+	}
+	g_profiler->add("Server: block send cache misses", 1);
+
+	Entry &entry = it->second;
+	entry.block_id = block->getId();
+	entry.modified_counter = block->getModifiedCounter();
+	entry.data = serialize_block(block, ver, codec);
+	m_size += entry.data.size();
+
+	evict();
+
+	return entry.data;
+}
+
+void BlockPayloadCache::evict()
+{
+	// Never drops the entry just used, it is at the front
+	while (m_size > m_max_size && m_lru.size() > 1) {
+		std::map<Key, Entry>::iterator it = m_entries.find(m_lru.back());
+		m_size -= it->second.data.size();
+		m_entries.erase(it);
+		m_lru.pop_back();
+	}
+}
+
+void BlockPayloadCache::clear()
+{
+	m_entries.clear();
+	m_lru.clear();
+	m_size = 0;
+}
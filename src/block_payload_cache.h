@@ -0,0 +1,89 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BLOCK_PAYLOAD_CACHE_HEADER
+#define BLOCK_PAYLOAD_CACHE_HEADER
+
+#include <list>
+#include <map>
+#include <string>
+#include "irr_v3d.h"
+
+class MapBlock;
+
+/*
+	Keeps the serialized and compressed data of recently sent MapBlocks,
+	so a block that is sent to many clients is serialized only once.
+
+	An entry is valid as long as the block's id and modification
+	counter are the same, so any raiseModified() invalidates it. When
+	the cache grows over its size limit, the least recently used
+	entries are dropped.
+
+	Only to be used with the environment locked.
+*/
+class BlockPayloadCache
+{
+public:
+	// max_size is in bytes; 0 disables caching
+	BlockPayloadCache(size_t max_size);
+
+	// Returns the TOCLIENT_BLOCKDATA payload of the block, without the
+	// position. The reference is valid until the next call.
+	const std::string &get(MapBlock *block, u8 ver, u8 codec,
+		u16 net_proto_version);
+
+	void clear();
+
+	size_t getSize() const { return m_size; }
+	size_t getEntryCount() const { return m_entries.size(); }
+
+private:
+	struct Key
+	{
+		v3s16 p;
+		u8 ver;
+		u8 codec;
+		u16 net_proto_version;
+
+		bool operator<(const Key &other) const;
+	};
+
+	struct Entry
+	{
+		u32 block_id;
+		u32 modified_counter;
+		std::string data;
+		// Position in m_lru
+		std::list<Key>::iterator lru_it;
+	};
+
+	void evict();
+
+	std::map<Key, Entry> m_entries;
+	// Most recently used first
+	std::list<Key> m_lru;
+	// Size of all cached data
+	size_t m_size;
+	size_t m_max_size;
+	// Returned when caching is disabled
+	std::string m_uncached;
+};
+
+#endif
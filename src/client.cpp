@@ -82,7 +82,7 @@ Client::Client(
 	m_nodedef(nodedef),
 	m_sound(sound),
 	m_event(event),
-	m_mesh_update_thread(this),
+	m_mesh_update_manager(this),
 	m_env(
 		new ClientMap(this, control,
 			device->getSceneManager()->getRootSceneNode(),
@@ -221,7 +221,7 @@ void Client::Stop()
 	m_script->on_shutdown();
 #endif
 	//request all client managed threads to stop
-	m_mesh_update_thread.stop();
+	m_mesh_update_manager.stop();
 	// Save local server map
 	if (m_localdb) {
 		infostream << "Local map saving ended." << std::endl;
@@ -233,7 +233,7 @@ void Client::Stop()
 
 bool Client::isShutdown()
 {
-	return m_shutdown || !m_mesh_update_thread.isRunning();
+	return m_shutdown || !m_mesh_update_manager.isRunning();
 }
 
 Client::~Client()
@@ -243,10 +243,10 @@ Client::~Client()
 
 	deleteAuthData();
 
-	m_mesh_update_thread.stop();
-	m_mesh_update_thread.wait();
-	while (!m_mesh_update_thread.m_queue_out.empty()) {
-		MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+	m_mesh_update_manager.stop();
+	m_mesh_update_manager.wait();
+	while (!m_mesh_update_manager.m_queue_out.empty()) {
+		MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 		delete r.mesh;
 	}
 
@@ -485,14 +485,14 @@ void Client::step(float dtime)
 	*/
 	{
 		int num_processed_meshes = 0;
-		while (!m_mesh_update_thread.m_queue_out.empty())
+		while (!m_mesh_update_manager.m_queue_out.empty())
 		{
 			num_processed_meshes++;
 
 			MinimapMapblock *minimap_mapblock = NULL;
 			bool do_mapper_update = true;
 
-			MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+			MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 			MapBlock *block = m_env.getMap().getBlockNoCreateNoEx(r.p);
 			if (block) {
 				// Delete the old mesh
@@ -536,6 +536,10 @@ void Client::step(float dtime)
 
 		if (num_processed_meshes > 0)
 			g_profiler->graphAdd("num_processed_meshes", num_processed_meshes);
+		g_profiler->avg("Client: mesh update threads",
+				m_mesh_update_manager.getWorkerCount());
+		g_profiler->avg("Client: mesh update queue",
+				m_mesh_update_manager.getQueueSize());
 	}
 
 	/*
@@ -1017,8 +1021,12 @@ void Client::sendInit(const std::string &playerName)
 {
 	NetworkPacket pkt(TOSERVER_INIT, 1 + 2 + 2 + (1 + playerName.size()));
 
-	// we don't support network compression yet
+	// Only the block codecs are used for network compression
 	u16 supp_comp_modes = NETPROTO_COMPRESSION_NONE;
+	for (u8 codec = 0; codec < BLOCK_CODEC_COUNT; codec++) {
+		if (block_codec_supported(codec))
+			supp_comp_modes |= netproto_block_codec_mode(codec);
+	}
 
 	u16 proto_version_min = g_settings->getFlag("send_pre_v25_init") ?
 		CLIENT_PROTOCOL_VERSION_MIN_LEGACY : CLIENT_PROTOCOL_VERSION_MIN;
@@ -1589,7 +1597,7 @@ void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server, bool urgent)
 	if (b == NULL)
 		return;
 
-	m_mesh_update_thread.updateBlock(&m_env.getMap(), p, ack_to_server, urgent);
+	m_mesh_update_manager.updateBlock(&m_env.getMap(), p, ack_to_server, urgent);
 }
 
 void Client::addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server, bool urgent)
@@ -1755,9 +1763,9 @@ void Client::afterContentReceived(IrrlichtDevice *device)
 	m_nodedef->updateTextures(this, texture_update_progress, &tu_args);
 	delete[] tu_args.text_base;
 
-	// Start mesh update thread after setting up content definitions
-	infostream<<"- Starting mesh update thread"<<std::endl;
-	m_mesh_update_thread.start();
+	// Start mesh update threads after setting up content definitions
+	infostream<<"- Starting mesh update threads"<<std::endl;
+	m_mesh_update_manager.start();
 
 	m_state = LC_Ready;
 	sendReady();
@@ -331,6 +331,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void handleCommand_PlaySound(NetworkPacket* pkt);
 	void handleCommand_StopSound(NetworkPacket* pkt);
 	void handleCommand_FadeSound(NetworkPacket *pkt);
+	void handleCommand_NodesChanged(NetworkPacket *pkt);
 	void handleCommand_Privileges(NetworkPacket* pkt);
 	void handleCommand_InventoryFormSpec(NetworkPacket* pkt);
 	void handleCommand_DetachedInventory(NetworkPacket* pkt);
@@ -427,7 +428,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void addUpdateMeshTaskForNode(v3s16 nodepos, bool ack_to_server=false, bool urgent=false);
 
 	void updateCameraOffset(v3s16 camera_offset)
-	{ m_mesh_update_thread.m_camera_offset = camera_offset; }
+	{ m_mesh_update_manager.m_camera_offset = camera_offset; }
 
 	bool hasClientEvents() const { return !m_client_event_queue.empty(); }
 	// Get event from queue. If queue is empty, it triggers an assertion failure.
@@ -584,7 +585,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	MtEventManager *m_event;
 
 
-	MeshUpdateThread m_mesh_update_thread;
+	MeshUpdateManager m_mesh_update_manager;
 	ClientEnvironment m_env;
 	ParticleManager m_particle_manager;
 	con::Connection m_con;
@@ -423,6 +423,8 @@ class TextureSource : public IWritableTextureSource
 
 	// Queued texture fetches (to be processed by the main thread)
 	RequestQueue<std::string, u32, u8, u8> m_get_texture_queue;
+	// Where the waiting threads get their textures from the main thread
+	ResultQueuePool<std::string, u32, u8, u8> m_texture_result_queues;
 
 	// Textures that have been overwritten with other ones
 	// but can't be deleted because the ITexture* might still be used
@@ -519,31 +521,35 @@ u32 TextureSource::getTextureId(const std::string &name)
 		infostream<<"getTextureId(): Queued: name=\""<<name<<"\""<<std::endl;
 
 		// We're gonna ask the result to be put into here
-		static ResultQueue<std::string, u32, u8, u8> result_queue;
+		ResultQueue<std::string, u32, u8, u8> *result_queue =
+				m_texture_result_queues.get();
 
 		// Throw a request in
-		m_get_texture_queue.add(name, 0, 0, &result_queue);
+		m_get_texture_queue.add(name, 0, 0, result_queue);
 
 		/*infostream<<"Waiting for texture from main thread, name=\""
 				<<name<<"\""<<std::endl;*/
 
+		u32 id = 0;
 		try
 		{
 			while(true) {
 				// Wait result for a second
 				GetResult<std::string, u32, u8, u8>
-					result = result_queue.pop_front(1000);
+					result = result_queue->pop_front(1000);
 
 				if (result.key == name) {
-					return result.item;
+					id = result.item;
+					break;
 				}
 			}
 		}
 		catch(ItemNotFoundException &e)
 		{
 			errorstream<<"Waiting for texture " << name << " timed out."<<std::endl;
-			return 0;
 		}
+		m_texture_result_queues.put(result_queue);
+		return id;
 	}
 
 	infostream<<"getTextureId(): Failed"<<std::endl;
@@ -355,6 +355,7 @@ void ClientEnvironment::step(float dtime)
 		ClientActiveObject* obj = i->second;
 		// Step object
 		obj->step(dtime, this);
+		m_active_object_grid.update(obj->getId(), obj->getPosition());
 
 		if(update_lighting)
 		{
@@ -465,6 +466,7 @@ u16 ClientEnvironment::addActiveObject(ClientActiveObject *object)
 		<<"added (id="<<object->getId()<<")"<<std::endl;
 	m_active_objects[object->getId()] = object;
 	object->addToScene(m_smgr, m_texturesource, m_irr);
+	m_active_object_grid.insert(object->getId(), object->getPosition());
 	{ // Update lighting immediately
 		u8 light = 0;
 		bool pos_ok;
@@ -527,6 +529,7 @@ void ClientEnvironment::removeActiveObject(u16 id)
 	obj->removeFromScene(true);
 	delete obj;
 	m_active_objects.erase(id);
+	m_active_object_grid.remove(id);
 }
 
 void ClientEnvironment::processActiveObjectMessage(u16 id, const std::string &data)
@@ -547,6 +550,8 @@ void ClientEnvironment::processActiveObjectMessage(u16 id, const std::string &da
 			<< " SerializationError in processMessage(): " << e.what()
 			<< std::endl;
 	}
+	// The message may have moved the object
+	m_active_object_grid.update(id, obj->getPosition());
 }
 
 /*
@@ -587,9 +592,14 @@ void ClientEnvironment::updateLocalPlayerBreath(u16 breath)
 void ClientEnvironment::getActiveObjects(v3f origin, f32 max_d,
 	std::vector<DistanceSortedActiveObject> &dest)
 {
-	for (UNORDERED_MAP<u16, ClientActiveObject*>::iterator i = m_active_objects.begin();
-		i != m_active_objects.end(); ++i) {
-		ClientActiveObject* obj = i->second;
+	std::vector<u16> ids;
+	m_active_object_grid.getObjectsInArea(
+		aabb3f(origin - v3f(max_d), origin + v3f(max_d)), ids);
+
+	for (std::vector<u16>::iterator i = ids.begin(); i != ids.end(); ++i) {
+		ClientActiveObject* obj = getActiveObject(*i);
+		if (obj == NULL)
+			continue;
 
 		f32 d = (obj->getPosition() - origin).getLength();
 
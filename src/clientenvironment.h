@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <IrrlichtDevice.h>
 #include <ISceneManager.h>
 #include "environment.h"
+#include "activeobjectgrid.h"
 #include "clientobject.h"
 
 class ClientSimpleObject;
@@ -182,6 +183,8 @@ class ClientEnvironment : public Environment
 	ClientScripting *m_script;
 	IrrlichtDevice *m_irr;
 	UNORDERED_MAP<u16, ClientActiveObject*> m_active_objects;
+	// Positions of m_active_objects, updated after every object step
+	ActiveObjectGrid m_active_object_grid;
 	std::vector<ClientSimpleObject*> m_simple_objects;
 	std::queue<ClientEnvEvent> m_client_event_queue;
 	IntervalLimiter m_active_object_light_update_interval;
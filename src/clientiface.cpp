@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "emerge.h"
 #include "content_sao.h"              // TODO this is used for cleanup of only
 #include "log.h"
+#include "profiler.h"
 #include "network/serveropcodes.h"
 #include "util/srp.h"
 #include "face_position_cache.h"
@@ -340,6 +341,9 @@ void RemoteClient::GetNextBlocks (
 			if(nearest_sent_d == -1)
 				nearest_sent_d = d;
 
+			if (m_blocks_prefetched.erase(p))
+				g_profiler->add("Server: prefetched blocks used", 1);
+
 			/*
 				Add block to send queue
 			*/
@@ -374,6 +378,98 @@ void RemoteClient::GetNextBlocks (
 		m_nearest_unsent_d = new_nearest_unsent_d;
 }
 
+void RemoteClient::PrefetchBlocks(ServerEnvironment *env,
+		EmergeManager *emerge, float dtime)
+{
+	DSTACK(FUNCTION_NAME);
+
+	const float prefetch_time = g_settings->getFloat("block_prefetch_time");
+
+	// Forget blocks the player did not get to in time
+	for (std::map<v3s16, float>::iterator it = m_blocks_prefetched.begin();
+			it != m_blocks_prefetched.end();) {
+		it->second += dtime;
+		if (it->second > prefetch_time + 5.0f) {
+			g_profiler->add("Server: prefetched blocks wasted", 1);
+			m_blocks_prefetched.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	m_prefetch_timer += dtime;
+	if (m_prefetch_timer < 0.5f || prefetch_time <= 0)
+		return;
+	m_prefetch_timer = 0;
+
+	RemotePlayer *player = env->getPlayer(peer_id);
+	if (player == NULL)
+		return;
+
+	PlayerSAO *sao = player->getPlayerSAO();
+	if (sao == NULL)
+		return;
+
+	v3f playerspeed = player->getSpeed();
+	f32 speed = playerspeed.getLength();
+	if (speed < BLOCK_PREFETCH_MIN_SPEED * BS)
+		return;
+
+	v3f camera_dir = v3f(0,0,1);
+	camera_dir.rotateYZBy(sao->getPitch());
+	camera_dir.rotateXZBy(sao->getYaw());
+
+	// Don't load what would not be sent anyway
+	s16 wanted_range = sao->getWantedRange();
+	if (wanted_range <= 0)
+		wanted_range = 1000;
+	f32 max_distance = MYMIN(g_settings->getS16("max_block_send_distance"),
+		wanted_range) * MAP_BLOCKSIZE * BS;
+	f32 distance = MYMIN(speed * prefetch_time, max_distance);
+
+	v3f playerpos = sao->getBasePosition();
+	v3f playerspeeddir = playerspeed / speed;
+	Map &map = env->getMap();
+
+	// Walk along the path one block at a time
+	v3s16 last_center(S16_MAX, S16_MAX, S16_MAX);
+	for (f32 d = MAP_BLOCKSIZE * BS; d <= distance; d += MAP_BLOCKSIZE * BS) {
+		v3s16 center = getNodeBlockPos(floatToInt(
+			playerpos + playerspeeddir * d, BS));
+		if (center == last_center)
+			continue;
+		last_center = center;
+
+		// The block on the path and the neighbors the player looks at
+		v3s16 off;
+		for (off.Z = -1; off.Z <= 1; off.Z++)
+		for (off.Y = -1; off.Y <= 1; off.Y++)
+		for (off.X = -1; off.X <= 1; off.X++) {
+			if (camera_dir.dotProduct(intToFloat(off, 1)) < 0)
+				continue;
+
+			v3s16 p = center + off;
+			if (m_blocks_prefetched.size() >= BLOCK_PREFETCH_MAX)
+				return;
+
+			if (blockpos_over_max_limit(p) ||
+					m_blocks_prefetched.find(p) != m_blocks_prefetched.end() ||
+					m_blocks_sent.find(p) != m_blocks_sent.end() ||
+					map.getBlockNoCreateNoEx(p) != NULL)
+				continue;
+
+			// Existing blocks only, after all others; stop when this
+			// client has enough of them queued
+			if (!emerge->enqueueBlockEmergeEx(p, peer_id,
+					BLOCK_EMERGE_PREFETCH, NULL, NULL))
+				return;
+
+			m_blocks_prefetched[p] = 0;
+			g_profiler->add("Server: prefetched blocks", 1);
+		}
+	}
+}
+
 void RemoteClient::GotBlock(v3s16 p)
 {
 	if (m_blocks_modified.find(p) == m_blocks_modified.end()) {
@@ -590,6 +686,15 @@ void RemoteClient::notifyEvent(ClientStateEvent event)
 	}
 }
 
+u8 RemoteClient::getBlockCodec() const
+{
+	for (u8 codec = 1; codec < BLOCK_CODEC_COUNT; codec++) {
+		if (m_deployed_compression & netproto_block_codec_mode(codec))
+			return codec;
+	}
+	return BLOCK_CODEC_ZLIB;
+}
+
 u64 RemoteClient::uptime() const
 {
 	return porting::getTimeS() - m_connection_time;
@@ -772,7 +877,7 @@ void ClientInterface::DeleteClient(u16 peer_id)
 	//TODO this should be done by client destructor!!!
 	RemoteClient *client = n->second;
 	// Handle objects
-	for(std::set<u16>::iterator
+	for(ActiveObjectIdSet::const_iterator
 			i = client->m_known_objects.begin();
 			i != client->m_known_objects.end(); ++i)
 	{
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"                   // for irrlicht datatypes
 
 #include "constants.h"
+#include "activeobject.h"              // for ActiveObjectIdSet
 #include "serialization.h"             // for SER_FMT_VER_INVALID
 #include "threading/mutex.h"
 #include "network/networkpacket.h"
@@ -258,6 +259,7 @@ class RemoteClient
 		m_state(CS_Created),
 		m_nearest_unsent_d(0),
 		m_nearest_unsent_reset_timer(0.0),
+		m_prefetch_timer(0.0),
 		m_excess_gotblocks(0),
 		m_nothing_to_send_pause_timer(0.0),
 		m_name(""),
@@ -281,6 +283,14 @@ class RemoteClient
 	void GetNextBlocks(ServerEnvironment *env, EmergeManager* emerge,
 			float dtime, std::vector<PrioritySortedBlockTransfer> &dest);
 
+	/*
+		Queues loading of the blocks a fast moving player is heading
+		to, so they are in memory when GetNextBlocks() gets to them.
+		Environment should be locked when this is called.
+	*/
+	void PrefetchBlocks(ServerEnvironment *env, EmergeManager* emerge,
+			float dtime);
+
 	void GotBlock(v3s16 p);
 
 	void SentBlock(v3s16 p);
@@ -323,7 +333,7 @@ class RemoteClient
 	/*
 		List of active objects that the client knows of.
 	*/
-	std::set<u16> m_known_objects;
+	ActiveObjectIdSet m_known_objects;
 
 	ClientState getState() const { return m_state; }
 
@@ -341,6 +351,9 @@ class RemoteClient
 	void setDeployedCompressionMode(u16 byteFlag)
 		{ m_deployed_compression = byteFlag; }
 
+	// The BlockCodec of the blocks sent to the client
+	u8 getBlockCodec() const;
+
 	void confirmSerializationVersion()
 		{ serialization_version = m_pending_serialization_version; }
 
@@ -381,6 +394,14 @@ class RemoteClient
 	v3s16 m_last_center;
 	float m_nearest_unsent_reset_timer;
 
+	/*
+		Blocks queued by PrefetchBlocks() that were not sent yet.
+		Value is time since queuing. A block is removed when it is
+		selected for sending (a hit) or when it expires (wasted).
+	*/
+	std::map<v3s16, float> m_blocks_prefetched;
+	float m_prefetch_timer;
+
 	/*
 		Blocks that are currently on the line.
 		This is used for throttling the sending of blocks.
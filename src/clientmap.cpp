@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "camera.h"               // CameraModes
 #include "util/basic_macros.h"
+#include "util/directiontables.h"
 #include <algorithm>
 
 ClientMap::ClientMap(
@@ -136,14 +137,101 @@ void ClientMap::getBlocksInViewRange(v3s16 cam_pos_nodes,
 			p_nodes_max.Z / MAP_BLOCKSIZE + 1);
 }
 
+struct VisibilityStep
+{
+	v3s16 blockpos;
+	// Face of the block that the view came in through, 6 for none
+	u8 entry_face;
+	// Directions (g_6dirs) taken to get here
+	u8 directions;
+
+	VisibilityStep(v3s16 blockpos_, u8 entry_face_, u8 directions_):
+		blockpos(blockpos_),
+		entry_face(entry_face_),
+		directions(directions_)
+	{}
+};
+
+struct DrawListEntry
+{
+	float d;
+	MapBlock *block;
+
+	DrawListEntry(float d_, MapBlock *block_):
+		d(d_),
+		block(block_)
+	{}
+
+	bool operator<(const DrawListEntry &other) const
+	{
+		return d < other.d;
+	}
+};
+
+/*
+	Instead of casting rays to the corners of every block in range,
+	the view is flood filled from the block of the camera. It leaves
+	a block only through the faces that are connected with the face it
+	came in through, as computed by the mesh of the block, and never
+	turns back towards the camera. Blocks without a mesh are open.
+*/
+void ClientMap::updateVisibleBlocks(v3s16 cam_pos_nodes, v3s16 p_blocks_min,
+		v3s16 p_blocks_max, f32 camera_fov, float range)
+{
+	ScopeProfiler sp(g_profiler, "CM::updateDrawList() visibility", SPT_AVG);
+
+	m_visibility_area = VoxelArea(p_blocks_min, p_blocks_max);
+	m_block_visibility.assign(m_visibility_area.getVolume(),
+		BLOCK_NOT_REACHED);
+
+	v3s16 cam_block = getContainerPos(cam_pos_nodes, MAP_BLOCKSIZE);
+	if (!m_visibility_area.contains(cam_block))
+		return;
+
+	std::vector<VisibilityStep> queue;
+	queue.push_back(VisibilityStep(cam_block, 6, 0));
+	m_block_visibility[m_visibility_area.index(cam_block)] = BLOCK_VISIBLE;
+
+	for (size_t head = 0; head < queue.size(); head++) {
+		VisibilityStep step = queue[head];
+		MapBlock *block = getBlockNoCreateNoEx(step.blockpos);
+		MapBlockMesh *mesh = block ? block->mesh : NULL;
+
+		for (u8 d = 0; d < 6; d++) {
+			// Opposite directions are 3 apart in g_6dirs
+			u8 opposite = (d + 3) % 6;
+			if (step.directions & (1 << opposite))
+				continue;
+			if (mesh && step.entry_face != 6 &&
+					!mesh->isFaceConnected(step.entry_face, d))
+				continue;
+
+			v3s16 p = step.blockpos + g_6dirs[d];
+			if (!m_visibility_area.contains(p))
+				continue;
+			u8 &visibility = m_block_visibility[m_visibility_area.index(p)];
+			if (visibility != BLOCK_NOT_REACHED)
+				continue;
+			if (!isBlockInSight(p, m_camera_position, m_camera_direction,
+					camera_fov, range)) {
+				visibility = BLOCK_OUT_OF_SIGHT;
+				continue;
+			}
+			visibility = BLOCK_VISIBLE;
+			queue.push_back(VisibilityStep(p, opposite,
+				step.directions | (1 << d)));
+		}
+	}
+}
+
 void ClientMap::updateDrawList(video::IVideoDriver* driver)
 {
 	ScopeProfiler sp(g_profiler, "CM::updateDrawList()", SPT_AVG);
 	g_profiler->add("CM::updateDrawList() count", 1);
 
-	for (std::map<v3s16, MapBlock*>::iterator i = m_drawlist.begin();
+	for (std::vector<MapBlock*>::iterator i = m_drawlist.begin();
 			i != m_drawlist.end(); ++i) {
-		MapBlock *block = i->second;
+		MapBlock *block = *i;
 		block->refDrop();
 	}
 	m_drawlist.clear();
@@ -162,6 +250,14 @@ void ClientMap::updateDrawList(video::IVideoDriver* driver)
 	v3s16 p_blocks_max;
 	getBlocksInViewRange(cam_pos_nodes, &p_blocks_min, &p_blocks_max);
 
+	float range = 100000 * BS;
+	#if defined(__ANDROID__) || defined(__IOS__)
+		range = m_control.wanted_range * 4 * BS;
+	#endif
+
+	if (m_control.range_all == false)
+		range = m_control.wanted_range * BS;
+
 	// Number of blocks in rendering range
 	u32 blocks_in_range = 0;
 	// Number of blocks occlusion culled
@@ -190,92 +286,87 @@ void ClientMap::updateDrawList(video::IVideoDriver* driver)
 			occlusion_culling_enabled = false;
 	}
 
-	for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-			si != m_sectors.end(); ++si) {
-		MapSector *sector = si->second;
-		v2s16 sp = sector->getPos();
+	if (occlusion_culling_enabled) {
+		updateVisibleBlocks(cam_pos_nodes, p_blocks_min, p_blocks_max,
+			camera_fov, range);
+	} else {
+		m_visibility_area = VoxelArea();
+		m_block_visibility.clear();
+	}
 
-		if (m_control.range_all == false) {
-			if (sp.X < p_blocks_min.X || sp.X > p_blocks_max.X ||
-					sp.Y < p_blocks_min.Z || sp.Y > p_blocks_max.Z)
-				continue;
-		}
+	MapBlockVect blocks;
+	if (m_control.range_all)
+		getBlocks(blocks);
+	else
+		getBlocksInArea(p_blocks_min, p_blocks_max, blocks);
 
-		MapBlockVect sectorblocks;
-		sector->getBlocks(sectorblocks);
+	std::vector<DrawListEntry> drawlist;
+	for (MapBlockVect::iterator i = blocks.begin(); i != blocks.end(); ++i) {
+		MapBlock *block = *i;
 
 		/*
-			Loop through blocks in sector
+			Compare block position to camera position, skip
+			if not seen on display
 		*/
 
-		u32 sector_blocks_drawn = 0;
-
-		for (MapBlockVect::iterator i = sectorblocks.begin();
-				i != sectorblocks.end(); ++i) {
-			MapBlock *block = *i;
-
-			/*
-				Compare block position to camera position, skip
-				if not seen on display
-			*/
+		if (block->mesh != NULL)
+			block->mesh->updateCameraOffset(m_camera_offset);
 
-			if (block->mesh != NULL)
-				block->mesh->updateCameraOffset(m_camera_offset);
-
-			float range = 100000 * BS;
-			#if defined(__ANDROID__) || defined(__IOS__)
-				range = m_control.wanted_range * 4 * BS;	
-			#endif
-			
-			if (m_control.range_all == false)
-				range = m_control.wanted_range * BS;
-
-			float d = 0.0;
-			if (!isBlockInSight(block->getPos(), camera_position,
-					camera_direction, camera_fov, range, &d))
-				continue;
-
-			blocks_in_range++;
+		float d = 0.0;
+		if (!isBlockInSight(block->getPos(), camera_position,
+				camera_direction, camera_fov, range, &d))
+			continue;
 
-			/*
-				Ignore if mesh doesn't exist
-			*/
-			if (block->mesh == NULL) {
-				blocks_in_range_without_mesh++;
-				continue;
-			}
+		blocks_in_range++;
 
-			/*
-				Occlusion culling
-			*/
-			if (occlusion_culling_enabled && isBlockOccluded(block, cam_pos_nodes)) {
-				blocks_occlusion_culled++;
-				continue;
-			}
+		/*
+			Ignore if mesh doesn't exist
+		*/
+		if (block->mesh == NULL) {
+			blocks_in_range_without_mesh++;
+			continue;
+		}
 
-			// This block is in range. Reset usage timer.
-			block->resetUsageTimer();
+		/*
+			Occlusion culling
+		*/
+		if (!isBlockVisible(block->getPos())) {
+			blocks_occlusion_culled++;
+			continue;
+		}
 
-			// Limit block count in case of a sudden increase
-			blocks_would_have_drawn++;
-			if (blocks_drawn >= m_control.wanted_max_blocks &&
-					!m_control.range_all &&
-					d > m_control.wanted_range * BS)
-				continue;
+		// This block is in range. Reset usage timer.
+		block->resetUsageTimer();
 
-			// Add to set
-			block->refGrab();
-			m_drawlist[block->getPos()] = block;
+		drawlist.push_back(DrawListEntry(d, block));
+	}
 
-			sector_blocks_drawn++;
-			blocks_drawn++;
-			if (d / BS > farthest_drawn)
-				farthest_drawn = d / BS;
+	// Nearer blocks first, which also leaves out the farthest ones
+	// when the block count is limited
+	std::sort(drawlist.begin(), drawlist.end());
+	m_drawlist.reserve(drawlist.size());
+
+	for (std::vector<DrawListEntry>::iterator i = drawlist.begin();
+			i != drawlist.end(); ++i) {
+		MapBlock *block = i->block;
+		float d = i->d;
+
+		// Limit block count in case of a sudden increase
+		blocks_would_have_drawn++;
+		if (blocks_drawn >= m_control.wanted_max_blocks &&
+				!m_control.range_all &&
+				d > m_control.wanted_range * BS)
+			continue;
 
-		} // foreach sectorblocks
+		// Add to list
+		block->refGrab();
+		m_drawlist.push_back(block);
 
-		if (sector_blocks_drawn != 0)
-			m_last_drawn_sectors.insert(sp);
+		v3s16 bp = block->getPos();
+		m_last_drawn_sectors.insert(v2s16(bp.X, bp.Z));
+		blocks_drawn++;
+		if (d / BS > farthest_drawn)
+			farthest_drawn = d / BS;
 	}
 
 	m_control.blocks_would_have_drawn = blocks_would_have_drawn;
@@ -401,9 +492,9 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 
 	MeshBufListList drawbufs;
 
-	for (std::map<v3s16, MapBlock*>::iterator i = m_drawlist.begin();
+	for (std::vector<MapBlock*>::iterator i = m_drawlist.begin();
 			i != m_drawlist.end(); ++i) {
-		MapBlock *block = i->second;
+		MapBlock *block = *i;
 
 		// If the mesh of the block happened to get deleted, ignore it
 		if (block->mesh == NULL)
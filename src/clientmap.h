@@ -23,8 +23,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_extrabloated.h"
 #include "map.h"
 #include "camera.h"
+#include "voxel.h"
 #include <set>
 #include <map>
+#include <vector>
 
 struct MapDrawControl
 {
@@ -146,7 +148,29 @@ class ClientMap : public Map, public scene::ISceneNode
 	f32 m_camera_fov;
 	v3s16 m_camera_offset;
 
-	std::map<v3s16, MapBlock*> m_drawlist;
+	// Flood fills the blocks seen from the camera block, through the
+	// faces that the meshes of the blocks connect
+	void updateVisibleBlocks(v3s16 cam_pos_nodes, v3s16 p_blocks_min,
+			v3s16 p_blocks_max, f32 camera_fov, float range);
+	// Blocks outside of the last flood filled area count as visible
+	bool isBlockVisible(v3s16 blockpos) const
+	{
+		return !m_visibility_area.contains(blockpos) ||
+			m_block_visibility[m_visibility_area.index(blockpos)] ==
+				BLOCK_VISIBLE;
+	}
+
+	enum BlockVisibility {
+		BLOCK_NOT_REACHED,
+		BLOCK_VISIBLE,
+		BLOCK_OUT_OF_SIGHT
+	};
+
+	VoxelArea m_visibility_area;
+	std::vector<u8> m_block_visibility;
+
+	// Sorted from the nearest to the farthest block
+	std::vector<MapBlock*> m_drawlist;
 
 	std::set<v2s16> m_last_drawn_sectors;
 
@@ -35,26 +35,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define COLL_ZERO 0
 
 
-struct NearbyCollisionInfo {
-	NearbyCollisionInfo(bool is_ul, bool is_obj, int bouncy,
-			const v3s16 &pos, const aabb3f &box) :
-		is_unloaded(is_ul),
-		is_step_up(false),
-		is_object(is_obj),
-		bouncy(bouncy),
-		position(pos),
-		box(box)
-	{}
-
-	bool is_unloaded;
-	bool is_step_up;
-	bool is_object;
-	int bouncy;
-	v3s16 position;
-	aabb3f box;
-};
-
-
 // Helper function:
 // Checks for collision of a moving aabbox with a static aabbox
 // Returns -1 if no collision, 0 if X collision, 1 if Y collision, 2 if Z collision
@@ -253,7 +233,9 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 	/*
 		Collect node boxes in movement range
 	*/
-	std::vector<NearbyCollisionInfo> cinfo;
+	CollisionMoveCache &cache = env->getCollisionMoveCache();
+	std::vector<NearbyCollisionInfo> &cinfo = cache.cinfo;
+	cinfo.clear();
 	{
 	//TimeTaker tt2("collisionMoveSimple collect boxes");
 	ScopeProfiler sp(g_profiler, "collisionMoveSimple collect boxes avg", SPT_AVG);
@@ -320,7 +302,8 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				p2.X++;
 				getNeighborConnectingFace(p2, nodedef, map, n, 32, &neighbors);
 			}
-			std::vector<aabb3f> nodeboxes;
+			std::vector<aabb3f> &nodeboxes = cache.nodeboxes;
+			nodeboxes.clear();
 			n.getCollisionBoxes(gamedef->ndef(), &nodeboxes, neighbors);
 			for(std::vector<aabb3f>::iterator
 					i = nodeboxes.begin();
@@ -358,11 +341,13 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 
 		/* add object boxes to cinfo */
 
-		std::vector<ActiveObject*> objects;
+		// Objects in reach of the whole movement
+		f32 distance = speed_f->getLength();
+		std::vector<ActiveObject*> &objects = cache.objects;
+		objects.clear();
 #ifndef SERVER
 		ClientEnvironment *c_env = dynamic_cast<ClientEnvironment*>(env);
 		if (c_env != 0) {
-			f32 distance = speed_f->getLength();
 			std::vector<DistanceSortedActiveObject> clientobjects;
 			c_env->getActiveObjects(*pos_f, distance * 1.5, clientobjects);
 			for (size_t i=0; i < clientobjects.size(); i++) {
@@ -376,8 +361,8 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		{
 			ServerEnvironment *s_env = dynamic_cast<ServerEnvironment*>(env);
 			if (s_env != NULL) {
-				f32 distance = speed_f->getLength();
-				std::vector<u16> s_objects;
+				std::vector<u16> &s_objects = cache.object_ids;
+				s_objects.clear();
 				s_env->getObjectsInsideRadius(s_objects, *pos_f, distance * 1.5);
 				for (std::vector<u16>::iterator iter = s_objects.begin(); iter != s_objects.end(); ++iter) {
 					ServerActiveObject *current = s_env->getActiveObject(*iter);
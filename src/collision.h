@@ -51,6 +51,38 @@ struct CollisionInfo
 	{}
 };
 
+struct NearbyCollisionInfo {
+	NearbyCollisionInfo(bool is_ul, bool is_obj, int bouncy,
+			const v3s16 &pos, const aabb3f &box) :
+		is_unloaded(is_ul),
+		is_step_up(false),
+		is_object(is_obj),
+		bouncy(bouncy),
+		position(pos),
+		box(box)
+	{}
+
+	bool is_unloaded;
+	bool is_step_up;
+	bool is_object;
+	int bouncy;
+	v3s16 position;
+	aabb3f box;
+};
+
+/*
+	Buffers of collisionMoveSimple(), kept by every Environment so that
+	they are not reallocated for each moving object. An environment is
+	only stepped by one thread, so one set of them is enough.
+*/
+struct CollisionMoveCache
+{
+	std::vector<NearbyCollisionInfo> cinfo;
+	std::vector<aabb3f> nodeboxes;
+	std::vector<ActiveObject *> objects;
+	std::vector<u16> object_ids;
+};
+
 struct collisionMoveResult
 {
 	bool touching_ground;
@@ -56,6 +56,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define LIMITED_MAX_SIMULTANEOUS_BLOCK_SENDS 0
 // Override for the previous one when distance of block is very low
 #define BLOCK_SEND_DISABLE_LIMITS_MAX_D 1
+// Players faster than this (in nodes per second) get blocks prefetched
+#define BLOCK_PREFETCH_MIN_SPEED 8
+// Maximum number of prefetched blocks waiting to be sent, per client
+#define BLOCK_PREFETCH_MAX 256
+// Blocks with this many node changes in one step are sent again as a whole
+#define NODE_CHANGES_BLOCK_RESEND_MIN 128
+// Node change packets are split when they grow over this size (in bytes)
+#define NODE_CHANGES_PACKET_MAX_SIZE 32768
 
 /*
     Map-related things
@@ -38,7 +38,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	}
 
 
-Database_LevelDB::Database_LevelDB(const std::string &savedir)
+Database_LevelDB::Database_LevelDB(const std::string &savedir):
+	m_in_batch(false)
 {
 	leveldb::Options options;
 	options.create_if_missing = true;
@@ -52,8 +53,33 @@ Database_LevelDB::~Database_LevelDB()
 	delete m_database;
 }
 
+void Database_LevelDB::beginSave()
+{
+	m_batch.Clear();
+	m_in_batch = true;
+}
+
+void Database_LevelDB::endSave()
+{
+	m_in_batch = false;
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &m_batch);
+	m_batch.Clear();
+	ENSURE_STATUS_OK(status);
+}
+
+void Database_LevelDB::rollbackSave()
+{
+	m_in_batch = false;
+	m_batch.Clear();
+}
+
 bool Database_LevelDB::saveBlock(const v3s16 &pos, const std::string &data)
 {
+	if (m_in_batch) {
+		m_batch.Put(i64tos(getBlockAsInteger(pos)), data);
+		return true;
+	}
+
 	leveldb::Status status = m_database->Put(leveldb::WriteOptions(),
 			i64tos(getBlockAsInteger(pos)), data);
 	if (!status.ok()) {
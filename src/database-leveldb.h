@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include "database.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 class Database_LevelDB : public MapDatabase
 {
@@ -39,10 +40,14 @@ class Database_LevelDB : public MapDatabase
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
-	void beginSave() {}
-	void endSave() {}
+	// Writes between these are committed as one batch
+	void beginSave();
+	void endSave();
+	void rollbackSave();
 private:
 	leveldb::DB *m_database;
+	leveldb::WriteBatch m_batch;
+	bool m_in_batch;
 };
 
 #endif // USE_LEVELDB
@@ -165,6 +165,15 @@ void Database_PostgreSQL::endSave()
 	checkResults(PQexec(m_conn, "COMMIT;"));
 }
 
+void Database_PostgreSQL::rollbackSave()
+{
+	PGresult *result = PQexec(m_conn, "ROLLBACK;");
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+		errorstream << "Failed to roll back PostgreSQL transaction: "
+			<< PQresultErrorMessage(result) << std::endl;
+	PQclear(result);
+}
+
 MapDatabasePostgreSQL::MapDatabasePostgreSQL(const std::string &connect_string):
 	Database_PostgreSQL(connect_string),
 	MapDatabase()
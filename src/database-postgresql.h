@@ -35,6 +35,7 @@ class Database_PostgreSQL: public Database
 
 	void beginSave();
 	void endSave();
+	void rollbackSave();
 
 	bool initialized() const;
 
@@ -121,6 +122,7 @@ class MapDatabasePostgreSQL : private Database_PostgreSQL, public MapDatabase
 
 	void beginSave() { Database_PostgreSQL::beginSave(); }
 	void endSave() { Database_PostgreSQL::endSave(); }
+	void rollbackSave() { Database_PostgreSQL::rollbackSave(); }
 
 protected:
 	virtual void createDatabase();
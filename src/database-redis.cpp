@@ -90,6 +90,17 @@ void Database_Redis::endSave() {
 	freeReplyObject(reply);
 }
 
+void Database_Redis::rollbackSave()
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "DISCARD"));
+	if (!reply) {
+		errorstream << "Redis command 'DISCARD' failed: " << ctx->errstr
+			<< std::endl;
+		return;
+	}
+	freeReplyObject(reply);
+}
+
 bool Database_Redis::saveBlock(const v3s16 &pos, const std::string &data)
 {
 	std::string tmp = i64tos(getBlockAsInteger(pos));
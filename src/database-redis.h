@@ -38,6 +38,7 @@ class Database_Redis : public MapDatabase
 
 	void beginSave();
 	void endSave();
+	void rollbackSave();
 
 	bool saveBlock(const v3s16 &pos, const std::string &data);
 	void loadBlock(const v3s16 &pos, std::string *block);
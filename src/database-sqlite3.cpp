@@ -139,6 +139,14 @@ void Database_SQLite3::endSave()
 	sqlite3_reset(m_stmt_end);
 }
 
+void Database_SQLite3::rollbackSave()
+{
+	if (!m_database)
+		return;
+	SQLOK_ERRSTREAM(sqlite3_exec(m_database, "ROLLBACK;", NULL, NULL, NULL),
+		"Failed to roll back SQLite3 transaction");
+}
+
 void Database_SQLite3::openDatabase()
 {
 	if (m_database) return;
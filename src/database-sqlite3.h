@@ -36,6 +36,7 @@ class Database_SQLite3 : public Database
 
 	void beginSave();
 	void endSave();
+	void rollbackSave();
 
 	bool initialized() const { return m_initialized; }
 protected:
@@ -144,6 +145,7 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 
 	void beginSave() { Database_SQLite3::beginSave(); }
 	void endSave() { Database_SQLite3::endSave(); }
+	void rollbackSave() { Database_SQLite3::rollbackSave(); }
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
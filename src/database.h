@@ -31,6 +31,8 @@ class Database
 public:
 	virtual void beginSave() = 0;
 	virtual void endSave() = 0;
+	// Discards what was saved since beginSave(), doesn't throw
+	virtual void rollbackSave() {}
 	virtual bool initialized() const { return true; }
 };
 
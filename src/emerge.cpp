@@ -21,7 +21,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "emerge.h"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <list>
 #include <queue>
 
 #include "util/container.h"
@@ -38,7 +41,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_ore.h"
 #include "mg_decoration.h"
 #include "mg_schematic.h"
+#include "nameidmapping.h"
 #include "nodedef.h"
+#include "porting.h"
 #include "profiler.h"
 #include "scripting_server.h"
 #include "server.h"
@@ -51,14 +56,17 @@ class EmergeThread : public Thread {
 	bool enable_mapgen_debug_info;
 	int id;
 
-	EmergeThread(Server *server, int ethreadid);
+	EmergeThread(Server *server, int ethreadid, bool loader = false);
 	~EmergeThread();
 
 	void *run();
 	void signal();
 
 	// Requires queue mutex held
-	bool pushBlock(v3s16 pos);
+	bool pushBlock(v3s16 pos, bool prefetch = false);
+	// Moves a prefetched block to the front queue, requires queue mutex held
+	bool promoteBlock(v3s16 pos);
+	size_t getQueueSize() const;
 
 	void cancelPendingItems();
 
@@ -74,11 +82,25 @@ class EmergeThread : public Thread {
 
 	Event m_queue_event;
 	std::queue<v3s16> m_block_queue;
+	// Taken when m_block_queue is empty
+	std::list<v3s16> m_prefetch_queue;
+
+	// Only loads blocks, see EmergeManager::m_load_threads
+	bool m_loader;
 
 	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
+	bool popBlockPos(v3s16 *pos);
+	// Requires queue mutex held
+	bool takeBlockPos(v3s16 *pos);
+
+	void runLoader(v3s16 &pos);
+	void runMapgen(v3s16 &pos);
 
 	EmergeAction getBlockOrStartGen(
 		v3s16 pos, bool allow_gen, MapBlock **block, BlockMakeData *data);
+	// Like getBlockOrStartGen() without generation, but takes the
+	// environment lock only to look up and insert the block
+	EmergeAction loadBlock(v3s16 pos, MapBlock **block);
 	MapBlock *finishGen(v3s16 pos, BlockMakeData *bmdata,
 		std::map<v3s16, MapBlock *> *modified_blocks);
 
@@ -98,11 +120,28 @@ EmergeManager::EmergeManager(Server *server)
 	this->schemmgr  = new SchematicManager(server);
 	this->gen_notify_on = 0;
 
+	m_pregen_active     = false;
+	m_pregen_radius     = 0;
+	m_pregen_max_chunks = 0;
+	m_pregen_ring       = 0;
+	m_pregen_center     = 0;
+	m_pregen_index      = 0;
+	m_pregen_layer      = 0;
+	m_pregen_retry      = false;
+	m_pregen_queued     = 0;
+	m_pregen_total      = 0;
+	m_pregen_done       = 0;
+	m_pregen_generated  = 0;
+	m_pregen_start_time = 0;
+	m_pregen_end_time   = 0;
+
 	// Note that accesses to this variable are not synchronized.
 	// This is because the *only* thread ever starting or stopping
 	// EmergeThreads should be the ServerThread.
 	this->m_threads_active = false;
 
+	this->m_prefetch_queued = 0;
+
 	enable_mapgen_debug_info = g_settings->getBool("enable_mapgen_debug_info");
 
 	// If unspecified, leave a proc for the main thread and one for
@@ -130,7 +169,12 @@ EmergeManager::EmergeManager(Server *server)
 	for (s16 i = 0; i < nthreads; i++)
 		m_threads.push_back(new EmergeThread(server, i));
 
-	infostream << "EmergeManager: using " << nthreads << " threads" << std::endl;
+	s16 nloadthreads = g_settings->getS16("num_emerge_load_threads");
+	for (s16 i = 0; i < nloadthreads; i++)
+		m_load_threads.push_back(new EmergeThread(server, i, true));
+
+	infostream << "EmergeManager: using " << nthreads << " threads and "
+		<< m_load_threads.size() << " loader threads" << std::endl;
 }
 
 
@@ -152,6 +196,18 @@ EmergeManager::~EmergeManager()
 			delete m_mapgens[i];
 	}
 
+	for (u32 i = 0; i != m_load_threads.size(); i++) {
+		EmergeThread *thread = m_load_threads[i];
+
+		if (m_threads_active) {
+			thread->stop();
+			thread->signal();
+			thread->wait();
+		}
+
+		delete thread;
+	}
+
 	delete biomemgr;
 	delete oremgr;
 	delete decomgr;
@@ -196,6 +252,8 @@ void EmergeManager::startThreads()
 
 	for (u32 i = 0; i != m_threads.size(); i++)
 		m_threads[i]->start();
+	for (u32 i = 0; i != m_load_threads.size(); i++)
+		m_load_threads[i]->start();
 
 	m_threads_active = true;
 }
@@ -211,10 +269,16 @@ void EmergeManager::stopThreads()
 		m_threads[i]->stop();
 		m_threads[i]->signal();
 	}
+	for (u32 i = 0; i != m_load_threads.size(); i++) {
+		m_load_threads[i]->stop();
+		m_load_threads[i]->signal();
+	}
 
 	// Then do the waiting for each
 	for (u32 i = 0; i != m_threads.size(); i++)
 		m_threads[i]->wait();
+	for (u32 i = 0; i != m_load_threads.size(); i++)
+		m_load_threads[i]->wait();
 
 	m_threads_active = false;
 }
@@ -251,19 +315,32 @@ bool EmergeManager::enqueueBlockEmergeEx(
 {
 	EmergeThread *thread = NULL;
 	bool entry_already_exists = false;
+	bool entry_promoted = false;
 
 	{
 		MutexAutoLock queuelock(m_queue_mutex);
 
 		if (!pushBlockEmergeData(blockpos, peer_id, flags,
-				callback, callback_param, &entry_already_exists))
+				callback, callback_param, &entry_already_exists,
+				&entry_promoted))
 			return false;
 
+		// Every block goes to the loaders first, if there are any
+		const std::vector<EmergeThread *> &threads =
+			m_load_threads.empty() ? m_threads : m_load_threads;
+
+		if (entry_promoted) {
+			for (size_t i = 0; i != threads.size(); i++) {
+				if (threads[i]->promoteBlock(blockpos))
+					break;
+			}
+		}
+
 		if (entry_already_exists)
 			return true;
 
-		thread = getOptimalThread();
-		thread->pushBlock(blockpos);
+		thread = getOptimalThread(threads);
+		thread->pushBlock(blockpos, flags & BLOCK_EMERGE_PREFETCH);
 	}
 
 	thread->signal();
@@ -272,6 +349,267 @@ bool EmergeManager::enqueueBlockEmergeEx(
 }
 
 
+//
+// Map pregeneration
+//
+
+// Keeps the visit counts of this many chunks at most
+#define PREGEN_MAX_VISITED_CHUNKS 1024
+
+// Offset of the index'th of the 8 * ring positions on a square ring
+static v2s16 spiral_offset(s16 ring, u32 index)
+{
+	if (ring == 0)
+		return v2s16(0, 0);
+
+	s16 side = index / (2 * ring);
+	s16 t = index % (2 * ring);
+	switch (side) {
+	case 0:  return v2s16(-ring + t, -ring);
+	case 1:  return v2s16(ring, -ring + t);
+	case 2:  return v2s16(ring - t, ring);
+	default: return v2s16(-ring, ring - t);
+	}
+}
+
+// Whether a run around centers with radius includes the chunk
+static bool in_pregen_range(v3s16 chunkpos, const std::vector<v3s16> &centers,
+	s16 radius, s16 chunksize)
+{
+	for (size_t i = 0; i != centers.size(); i++) {
+		v3s16 d = (chunkpos - centers[i]) / chunksize;
+		if (abs(d.X) <= radius && abs(d.Z) <= radius &&
+				abs(d.Y) <= PREGEN_VERTICAL_CHUNKS)
+			return true;
+	}
+	return false;
+}
+
+
+void EmergeManager::startPregen(const std::vector<v3s16> &centers,
+	s16 radius, u32 max_chunks)
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	m_pregen_centers.clear();
+	for (size_t i = 0; i != centers.size(); i++)
+		m_pregen_centers.push_back(getContainingChunk(centers[i]));
+
+	m_pregen_active     = !centers.empty() && radius >= 0;
+	m_pregen_radius     = radius;
+	m_pregen_max_chunks = max_chunks;
+	m_pregen_ring       = 0;
+	m_pregen_center     = 0;
+	m_pregen_index      = 0;
+	m_pregen_layer      = 0;
+	m_pregen_retry      = false;
+	m_pregen_total      = centers.size() * (2 * radius + 1) * (2 * radius + 1) *
+		(2 * PREGEN_VERTICAL_CHUNKS + 1);
+	m_pregen_done       = 0;
+	m_pregen_generated  = 0;
+	m_pregen_start_time = porting::getTimeMs();
+	m_pregen_end_time   = m_pregen_start_time;
+
+	// Forget the chunks of earlier runs that this one does not cover, or
+	// they would pile up as the centers move around with the players
+	std::set<v3s16>::iterator it = m_pregen_existing.begin();
+	while (it != m_pregen_existing.end()) {
+		if (in_pregen_range(*it, m_pregen_centers, radius, mgparams->chunksize))
+			++it;
+		else
+			m_pregen_existing.erase(it++);
+	}
+
+	infostream << "EmergeManager: pregenerating " << m_pregen_total
+		<< " chunks around " << centers.size() << " places" << std::endl;
+}
+
+
+void EmergeManager::stopPregen()
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	if (m_pregen_active)
+		m_pregen_end_time = porting::getTimeMs();
+	m_pregen_active = false;
+}
+
+
+bool EmergeManager::isPregenActive()
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	return m_pregen_active || m_pregen_queued > 0;
+}
+
+
+PregenStatus EmergeManager::getPregenStatus()
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	PregenStatus status;
+	status.active           = m_pregen_active || m_pregen_queued > 0;
+	status.chunks_total     = m_pregen_total;
+	status.chunks_done      = m_pregen_done;
+	status.chunks_generated = m_pregen_generated;
+
+	u64 end_time = status.active ? porting::getTimeMs() : m_pregen_end_time;
+	float seconds = (end_time - m_pregen_start_time) / 1000.0f;
+	s32 chunksize = mgparams->chunksize;
+	status.blocks_per_second = seconds > 0 ? m_pregen_generated *
+		chunksize * chunksize * chunksize / seconds : 0;
+
+	return status;
+}
+
+
+void EmergeManager::stepPregen()
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	if (!m_pregen_active)
+		return;
+
+	// Nothing but one chunk at a time for each mapgen thread is queued, so
+	// blocks requested by players or mods wait for a chunk at most
+	while (m_pregen_queued < m_threads.size()) {
+		{
+			MutexAutoLock queuelock(m_queue_mutex);
+			if (m_blocks_enqueued.size() > m_pregen_queued)
+				return;
+		}
+
+		if (m_pregen_max_chunks != 0 &&
+				m_pregen_generated + m_pregen_queued >= m_pregen_max_chunks) {
+			m_pregen_active = false;
+			break;
+		}
+
+		v3s16 chunkpos = m_pregen_retry_pos;
+		if (!m_pregen_retry && !nextPregenChunk(&chunkpos)) {
+			m_pregen_active = false;
+			break;
+		}
+
+		// Keep the chunk for the next step if the queue is full
+		m_pregen_retry = !enqueueBlockEmergeEx(chunkpos, PEER_ID_INEXISTENT,
+			BLOCK_EMERGE_ALLOW_GEN, pregenCallback, this);
+		if (m_pregen_retry) {
+			m_pregen_retry_pos = chunkpos;
+			return;
+		}
+		m_pregen_queued++;
+	}
+
+	if (!m_pregen_active && m_pregen_queued == 0) {
+		m_pregen_end_time = porting::getTimeMs();
+		infostream << "EmergeManager: pregeneration done, generated "
+			<< m_pregen_generated << " chunks" << std::endl;
+	}
+}
+
+
+bool EmergeManager::nextPregenChunk(v3s16 *chunkpos)
+{
+	s16 chunksize = mgparams->chunksize;
+
+	while (m_pregen_ring <= m_pregen_radius) {
+		v2s16 offset = spiral_offset(m_pregen_ring, m_pregen_index);
+		// Layers 0, 1, 2, 3, 4... are 0, -1, 1, -2, 2... chunks up
+		s16 layer_y = (m_pregen_layer + 1) / 2;
+		if (m_pregen_layer % 2 == 1)
+			layer_y = -layer_y;
+		*chunkpos = m_pregen_centers[m_pregen_center] +
+			v3s16(offset.X, layer_y, offset.Y) * chunksize;
+
+		// Every ring around every center, so the nearest chunks come first
+		u32 ring_size = m_pregen_ring == 0 ? 1 : 8 * m_pregen_ring;
+		if (++m_pregen_layer == 2 * PREGEN_VERTICAL_CHUNKS + 1) {
+			m_pregen_layer = 0;
+			if (++m_pregen_index == ring_size) {
+				m_pregen_index = 0;
+				if (++m_pregen_center == m_pregen_centers.size()) {
+					m_pregen_center = 0;
+					m_pregen_ring++;
+				}
+			}
+		}
+
+		// Chunks beyond the map limits are never generated
+		if (!blockpos_over_max_limit(*chunkpos) &&
+				m_pregen_existing.find(*chunkpos) == m_pregen_existing.end())
+			return true;
+		m_pregen_done++;
+	}
+
+	return false;
+}
+
+
+void EmergeManager::pregenCallback(v3s16 blockpos, EmergeAction action,
+	void *param)
+{
+	EmergeManager *emerge = (EmergeManager *)param;
+	MutexAutoLock pregenlock(emerge->m_pregen_mutex);
+
+	emerge->m_pregen_queued--;
+	emerge->m_pregen_done++;
+
+	switch (action) {
+	case EMERGE_GENERATED:
+		emerge->m_pregen_generated++;
+		// Fall through
+	case EMERGE_FROM_MEMORY:
+	case EMERGE_FROM_DISK:
+	case EMERGE_CANCELLED:
+		// Cancelled means beyond the map generation limits
+		emerge->m_pregen_existing.insert(blockpos);
+		break;
+	default:
+		break;
+	}
+}
+
+
+void EmergeManager::addPregenVisit(v3s16 blockpos)
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	m_pregen_visits[getContainingChunk(blockpos)]++;
+	if (m_pregen_visits.size() <= PREGEN_MAX_VISITED_CHUNKS)
+		return;
+
+	// Halve all counts, forgetting the chunks visited least
+	std::map<v3s16, u32>::iterator it = m_pregen_visits.begin();
+	while (it != m_pregen_visits.end()) {
+		it->second /= 2;
+		if (it->second == 0)
+			m_pregen_visits.erase(it++);
+		else
+			++it;
+	}
+}
+
+
+void EmergeManager::getMostVisitedChunks(u32 count,
+	std::vector<v3s16> *chunks)
+{
+	MutexAutoLock pregenlock(m_pregen_mutex);
+
+	std::vector<std::pair<u32, v3s16> > visits;
+	for (std::map<v3s16, u32>::iterator it = m_pregen_visits.begin();
+			it != m_pregen_visits.end(); ++it)
+		visits.push_back(std::make_pair(it->second, it->first));
+
+	count = MYMIN(count, visits.size());
+	std::partial_sort(visits.begin(), visits.begin() + count, visits.end(),
+		std::greater<std::pair<u32, v3s16> >());
+
+	for (u32 i = 0; i != count; i++)
+		chunks->push_back(visits[i].second);
+}
+
+
 //
 // Mapgen-related helper functions
 //
@@ -337,16 +675,26 @@ bool EmergeManager::pushBlockEmergeData(
 	u16 flags,
 	EmergeCompletionCallback callback,
 	void *callback_param,
-	bool *entry_already_exists)
+	bool *entry_already_exists,
+	bool *entry_promoted)
 {
-	u16 &count_peer = m_peer_queue_count[peer_requested];
+	bool prefetch = flags & BLOCK_EMERGE_PREFETCH;
+	u16 &count_peer = prefetch ? m_peer_prefetch_count[peer_requested] :
+		m_peer_queue_count[peer_requested];
 
-	if ((flags & BLOCK_EMERGE_FORCE_QUEUE) == 0) {
-		if (m_blocks_enqueued.size() >= m_qlimit_total)
+	if (prefetch) {
+		if (m_blocks_enqueued.size() >= m_qlimit_total ||
+				count_peer >= EMERGE_PREFETCH_LIMIT)
+			return false;
+	} else if ((flags & BLOCK_EMERGE_FORCE_QUEUE) == 0) {
+		if (m_blocks_enqueued.size() - m_prefetch_queued >= m_qlimit_total)
 			return false;
 
 		if (peer_requested != PEER_ID_INEXISTENT) {
-			u16 qlimit_peer = (flags & BLOCK_EMERGE_ALLOW_GEN) ?
+			// With loader threads, the generate limit is applied when
+			// a block turns out to be missing, see finishBlockLoad()
+			u16 qlimit_peer = ((flags & BLOCK_EMERGE_ALLOW_GEN) &&
+					m_load_threads.empty()) ?
 				m_qlimit_generate : m_qlimit_diskonly;
 			if (count_peer >= qlimit_peer)
 				return false;
@@ -358,17 +706,31 @@ bool EmergeManager::pushBlockEmergeData(
 
 	BlockEmergeData &bedata = findres.first->second;
 	*entry_already_exists   = !findres.second;
+	*entry_promoted         = false;
 
 	if (callback)
 		bedata.callbacks.push_back(std::make_pair(callback, callback_param));
 
 	if (*entry_already_exists) {
-		bedata.flags |= flags;
+		if ((bedata.flags & BLOCK_EMERGE_PREFETCH) && !prefetch) {
+			// Somebody needs the prefetched block now, it counts to the
+			// queue of the peer that asked for it from here on
+			bedata.flags &= ~BLOCK_EMERGE_PREFETCH;
+			m_peer_prefetch_count[bedata.peer_requested]--;
+			m_prefetch_queued--;
+			bedata.peer_requested = peer_requested;
+			count_peer++;
+			*entry_promoted = true;
+		}
+		bedata.flags |= flags & ~BLOCK_EMERGE_PREFETCH;
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.generating = false;
 
 		count_peer++;
+		if (prefetch)
+			m_prefetch_queued++;
 	}
 
 	return true;
@@ -386,13 +748,21 @@ bool EmergeManager::popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata)
 
 	*bedata = it->second;
 
-	it2 = m_peer_queue_count.find(bedata->peer_requested);
-	if (it2 == m_peer_queue_count.end())
+	// Blocks passed on to the mapgen threads and prefetched blocks are
+	// counted separately
+	bool prefetch = bedata->flags & BLOCK_EMERGE_PREFETCH;
+	UNORDERED_MAP<u16, u16> &peer_counts = bedata->generating ?
+		m_peer_generate_count : prefetch ?
+		m_peer_prefetch_count : m_peer_queue_count;
+	it2 = peer_counts.find(bedata->peer_requested);
+	if (it2 == peer_counts.end())
 		return false;
 
 	u16 &count_peer = it2->second;
 	assert(count_peer != 0);
 	count_peer--;
+	if (prefetch)
+		m_prefetch_queued--;
 
 	m_blocks_enqueued.erase(it);
 
@@ -400,24 +770,71 @@ bool EmergeManager::popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata)
 }
 
 
-EmergeThread *EmergeManager::getOptimalThread()
+bool EmergeManager::finishBlockLoad(v3s16 pos, EmergeAction action,
+	BlockEmergeData *bedata)
+{
+	EmergeThread *thread = NULL;
+
+	{
+		MutexAutoLock queuelock(m_queue_mutex);
+
+		std::map<v3s16, BlockEmergeData>::iterator it =
+			m_blocks_enqueued.find(pos);
+		if (it == m_blocks_enqueued.end())
+			return true;
+
+		BlockEmergeData &data = it->second;
+		if (action != EMERGE_CANCELLED ||
+				(data.flags & BLOCK_EMERGE_ALLOW_GEN) == 0 ||
+				blockpos_over_max_limit(pos)) {
+			popBlockEmergeData(pos, bedata);
+			return true;
+		}
+
+		u16 &count_generate = m_peer_generate_count[data.peer_requested];
+		if ((data.flags & BLOCK_EMERGE_FORCE_QUEUE) == 0 &&
+				data.peer_requested != PEER_ID_INEXISTENT &&
+				count_generate >= m_qlimit_generate) {
+			// Too much to generate for this peer, it will ask again
+			popBlockEmergeData(pos, bedata);
+			return true;
+		}
+
+		// Move the block from the load to the generate limits, so
+		// generating can't hold up loading for the peer
+		data.generating = true;
+		m_peer_queue_count[data.peer_requested]--;
+		count_generate++;
+
+		thread = getOptimalThread(m_threads);
+		thread->pushBlock(pos);
+	}
+
+	thread->signal();
+
+	return false;
+}
+
+
+EmergeThread *EmergeManager::getOptimalThread(
+	const std::vector<EmergeThread *> &threads)
 {
-	size_t nthreads = m_threads.size();
+	size_t nthreads = threads.size();
 
 	FATAL_ERROR_IF(nthreads == 0, "No emerge threads!");
 
 	size_t index = 0;
-	size_t nitems_lowest = m_threads[0]->m_block_queue.size();
+	size_t nitems_lowest = threads[0]->getQueueSize();
 
 	for (size_t i = 1; i < nthreads; i++) {
-		size_t nitems = m_threads[i]->m_block_queue.size();
+		size_t nitems = threads[i]->getQueueSize();
 		if (nitems < nitems_lowest) {
 			index = i;
 			nitems_lowest = nitems;
 		}
 	}
 
-	return m_threads[index];
+	return threads[index];
 }
 
 
@@ -425,15 +842,16 @@ EmergeThread *EmergeManager::getOptimalThread()
 //// EmergeThread
 ////
 
-EmergeThread::EmergeThread(Server *server, int ethreadid) :
+EmergeThread::EmergeThread(Server *server, int ethreadid, bool loader) :
 	enable_mapgen_debug_info(false),
 	id(ethreadid),
 	m_server(server),
 	m_map(NULL),
 	m_emerge(NULL),
-	m_mapgen(NULL)
+	m_mapgen(NULL),
+	m_loader(loader)
 {
-	m_name = "Emerge-" + itos(ethreadid);
+	m_name = (loader ? "EmergeLoad-" : "Emerge-") + itos(ethreadid);
 }
 
 
@@ -449,28 +867,55 @@ void EmergeThread::signal()
 }
 
 
-bool EmergeThread::pushBlock(v3s16 pos)
+bool EmergeThread::pushBlock(v3s16 pos, bool prefetch)
+{
+	if (prefetch)
+		m_prefetch_queue.push_back(pos);
+	else
+		m_block_queue.push(pos);
+	return true;
+}
+
+
+bool EmergeThread::promoteBlock(v3s16 pos)
 {
+	std::list<v3s16>::iterator it = std::find(m_prefetch_queue.begin(),
+		m_prefetch_queue.end(), pos);
+	if (it == m_prefetch_queue.end())
+		return false;
+
+	m_prefetch_queue.erase(it);
 	m_block_queue.push(pos);
 	return true;
 }
 
 
+size_t EmergeThread::getQueueSize() const
+{
+	return m_block_queue.size() + m_prefetch_queue.size();
+}
+
+
 void EmergeThread::cancelPendingItems()
 {
-	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
+	std::vector<std::pair<v3s16, EmergeCallbackList> > cancelled;
+
+	{
+		MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	while (!m_block_queue.empty()) {
 		BlockEmergeData bedata;
 		v3s16 pos;
 
-		pos = m_block_queue.front();
-		m_block_queue.pop();
-
-		m_emerge->popBlockEmergeData(pos, &bedata);
-
-		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
+		while (takeBlockPos(&pos)) {
+			m_emerge->popBlockEmergeData(pos, &bedata);
+			cancelled.push_back(std::make_pair(pos, bedata.callbacks));
+		}
 	}
+
+	// Callbacks may take other locks, see m_pregen_mutex
+	for (size_t i = 0; i != cancelled.size(); i++)
+		runCompletionCallbacks(cancelled[i].first, EMERGE_CANCELLED,
+			cancelled[i].second);
 }
 
 
@@ -495,18 +940,41 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	if (m_block_queue.empty())
+	if (!takeBlockPos(pos))
 		return false;
 
-	*pos = m_block_queue.front();
-	m_block_queue.pop();
-
 	m_emerge->popBlockEmergeData(*pos, bedata);
 
 	return true;
 }
 
 
+bool EmergeThread::popBlockPos(v3s16 *pos)
+{
+	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
+
+	return takeBlockPos(pos);
+}
+
+
+bool EmergeThread::takeBlockPos(v3s16 *pos)
+{
+	if (!m_block_queue.empty()) {
+		*pos = m_block_queue.front();
+		m_block_queue.pop();
+		return true;
+	}
+
+	if (!m_prefetch_queue.empty()) {
+		*pos = m_prefetch_queue.front();
+		m_prefetch_queue.pop_front();
+		return true;
+	}
+
+	return false;
+}
+
+
 EmergeAction EmergeThread::getBlockOrStartGen(
 	v3s16 pos, bool allow_gen, MapBlock **block, BlockMakeData *bmdata)
 {
@@ -533,6 +1001,52 @@ EmergeAction EmergeThread::getBlockOrStartGen(
 }
 
 
+EmergeAction EmergeThread::loadBlock(v3s16 pos, MapBlock **block)
+{
+	std::string data;
+	{
+		MutexAutoLock envlock(m_server->m_env_mutex);
+
+		*block = m_map->getBlockNoCreateNoEx(pos);
+		if (*block && !(*block)->isDummy())
+			return (*block)->isGenerated() ?
+				EMERGE_FROM_MEMORY : EMERGE_CANCELLED;
+
+		if (!m_map->isReadThreadSafe())
+			m_map->readBlock(pos, &data);
+	}
+
+	// Read and deserialize without holding up the server thread. The node
+	// ids are corrected under the lock, the node definitions may change.
+	if (m_map->isReadThreadSafe())
+		m_map->readBlock(pos, &data);
+
+	MapBlock *loaded = NULL;
+	NameIdMapping nimap;
+	if (!data.empty() &&
+			!m_map->deSerializeBlock(pos, data, &loaded, &nimap)) {
+		*block = NULL;
+		return EMERGE_CANCELLED;
+	}
+
+	MutexAutoLock envlock(m_server->m_env_mutex);
+
+	// The block may have been loaded or generated in the meantime
+	*block = m_map->getBlockNoCreateNoEx(pos);
+	if (*block && !(*block)->isDummy()) {
+		delete loaded;
+		return (*block)->isGenerated() ?
+			EMERGE_FROM_MEMORY : EMERGE_CANCELLED;
+	}
+
+	*block = m_map->insertLoadedBlock(pos, &data, loaded, &nimap);
+	if (*block && (*block)->isGenerated())
+		return EMERGE_FROM_DISK;
+
+	return EMERGE_CANCELLED;
+}
+
+
 MapBlock *EmergeThread::finishGen(v3s16 pos, BlockMakeData *bmdata,
 	std::map<v3s16, MapBlock *> *modified_blocks)
 {
@@ -599,10 +1113,76 @@ void *EmergeThread::run()
 
 	m_map    = (ServerMap *)&(m_server->m_env->getMap());
 	m_emerge = m_server->m_emerge;
-	m_mapgen = m_emerge->m_mapgens[id];
+	if (!m_loader)
+		m_mapgen = m_emerge->m_mapgens[id];
 	enable_mapgen_debug_info = m_emerge->enable_mapgen_debug_info;
 
 	try {
+		if (m_loader)
+			runLoader(pos);
+		else
+			runMapgen(pos);
+	} catch (VersionMismatchException &e) {
+		std::ostringstream err;
+		err << "World data version mismatch in MapBlock " << PP(pos) << std::endl
+			<< "----" << std::endl
+			<< "\"" << e.what() << "\"" << std::endl
+			<< "See debug.txt." << std::endl
+			<< "World probably saved by a newer version of " PROJECT_NAME_C "."
+			<< std::endl;
+		m_server->setAsyncFatalError(err.str());
+	} catch (SerializationError &e) {
+		std::ostringstream err;
+		err << "Invalid data in MapBlock " << PP(pos) << std::endl
+			<< "----" << std::endl
+			<< "\"" << e.what() << "\"" << std::endl
+			<< "See debug.txt." << std::endl
+			<< "You can ignore this using [ignore_world_load_errors = true]."
+			<< std::endl;
+		m_server->setAsyncFatalError(err.str());
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+	return NULL;
+}
+
+
+void EmergeThread::runLoader(v3s16 &pos)
+{
+	while (!stopRequested()) {
+		BlockEmergeData bedata;
+		EmergeAction action;
+		MapBlock *block = NULL;
+
+		if (!popBlockPos(&pos)) {
+			m_queue_event.wait();
+			continue;
+		}
+
+		EMERGE_DBG_OUT("load pos=" PP(pos));
+
+		if (blockpos_over_max_limit(pos))
+			action = EMERGE_CANCELLED;
+		else
+			action = loadBlock(pos, &block);
+
+		// Missing blocks may be passed on to a mapgen thread
+		if (!m_emerge->finishBlockLoad(pos, action, &bedata))
+			continue;
+
+		runCompletionCallbacks(pos, action, bedata.callbacks);
+
+		if (block) {
+			std::map<v3s16, MapBlock *> modified_blocks;
+			modified_blocks[pos] = block;
+			m_server->SetBlocksNotSent(modified_blocks);
+		}
+	}
+}
+
+
+void EmergeThread::runMapgen(v3s16 &pos)
+{
 	while (!stopRequested()) {
 		std::map<v3s16, MapBlock *> modified_blocks;
 		BlockEmergeData bedata;
@@ -615,9 +1195,13 @@ void *EmergeThread::run()
 			continue;
 		}
 
-		if (blockpos_over_max_limit(pos))
+		// Whoever asked for the block still waits for an answer
+		if (blockpos_over_max_limit(pos)) {
+			runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
 			continue;
+		}
 
+		PROFILER_ZONE("EmergeThread: emerge block");
 		bool allow_gen = bedata.flags & BLOCK_EMERGE_ALLOW_GEN;
 		EMERGE_DBG_OUT("pos=" PP(pos) " allow_gen=" << allow_gen);
 
@@ -628,7 +1212,12 @@ void *EmergeThread::run()
 					"EmergeThread: Mapgen::makeChunk", SPT_AVG);
 				TimeTaker t("mapgen::make_block()");
 
+				m_mapgen->noise_cache.clear();
 				m_mapgen->makeChunk(&bmdata);
+				g_profiler->avg("EmergeThread: mapgen noise cache hits",
+					m_mapgen->noise_cache.hits);
+				g_profiler->avg("EmergeThread: mapgen noise cache misses",
+					m_mapgen->noise_cache.misses);
 
 				if (enable_mapgen_debug_info == false)
 					t.stop(true); // Hide output
@@ -645,26 +1234,4 @@ void *EmergeThread::run()
 		if (modified_blocks.size() > 0)
 			m_server->SetBlocksNotSent(modified_blocks);
 	}
-	} catch (VersionMismatchException &e) {
-		std::ostringstream err;
-		err << "World data version mismatch in MapBlock " << PP(pos) << std::endl
-			<< "----" << std::endl
-			<< "\"" << e.what() << "\"" << std::endl
-			<< "See debug.txt." << std::endl
-			<< "World probably saved by a newer version of " PROJECT_NAME_C "."
-			<< std::endl;
-		m_server->setAsyncFatalError(err.str());
-	} catch (SerializationError &e) {
-		std::ostringstream err;
-		err << "Invalid data in MapBlock " << PP(pos) << std::endl
-			<< "----" << std::endl
-			<< "\"" << e.what() << "\"" << std::endl
-			<< "See debug.txt." << std::endl
-			<< "You can ignore this using [ignore_world_load_errors = true]."
-			<< std::endl;
-		m_server->setAsyncFatalError(err.str());
-	}
-
-	END_DEBUG_EXCEPTION_HANDLER
-	return NULL;
 }
@@ -28,6 +28,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define BLOCK_EMERGE_ALLOW_GEN   (1 << 0)
 #define BLOCK_EMERGE_FORCE_QUEUE (1 << 1)
+// Loaded after all other blocks, with a separate queue limit
+#define BLOCK_EMERGE_PREFETCH    (1 << 2)
+
+// Prefetched blocks each peer may have in the emerge queue
+#define EMERGE_PREFETCH_LIMIT 4
+
+// Most visited chunks pregenerated around besides the spawn
+#define PREGEN_VISITED_CENTERS 4
+// Layers of chunks pregenerated below and above the one of each center
+#define PREGEN_VERTICAL_CHUNKS 1
 
 #define EMERGE_DBG_OUT(x) do {                         \
 	if (enable_mapgen_debug_info)                      \
@@ -83,9 +93,22 @@ typedef std::vector<
 	>
 > EmergeCallbackList;
 
+// Progress of a map pregeneration run, see EmergeManager::startPregen()
+struct PregenStatus {
+	bool active;
+	// Chunks in the run, chunks near several centers counted for each
+	u32 chunks_total;
+	u32 chunks_done;
+	// Chunks the run generated, the others existed already
+	u32 chunks_generated;
+	float blocks_per_second;
+};
+
 struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
+	// Passed on from a loader thread to a mapgen thread
+	bool generating;
 	EmergeCallbackList callbacks;
 };
 
@@ -140,6 +163,27 @@ class EmergeManager {
 
 	v3s16 getContainingChunk(v3s16 blockpos);
 
+	/*
+		Map pregeneration, using the emerge threads while no blocks are
+		requested. A run generates the chunks at most radius chunks away
+		from the chunks of the centers, in a spiral around each center and
+		nearest first, until max_chunks are generated (0 for no limit).
+		Vertically, only the chunks up to PREGEN_VERTICAL_CHUNKS away from
+		the chunk of each center are generated.
+	*/
+	void startPregen(const std::vector<v3s16> &centers, s16 radius,
+		u32 max_chunks);
+	void stopPregen();
+	bool isPregenActive();
+	PregenStatus getPregenStatus();
+	// Passes the next chunks of the run to idle emerge threads
+	void stepPregen();
+
+	// Counts a visit of a player to the chunk containing blockpos
+	void addPregenVisit(v3s16 blockpos);
+	// Block positions of up to count most visited chunks, most visited first
+	void getMostVisitedChunks(u32 count, std::vector<v3s16> *chunks);
+
 	Mapgen *getCurrentMapgen();
 
 	// Mapgen helpers methods
@@ -152,19 +196,56 @@ class EmergeManager {
 
 private:
 	std::vector<Mapgen *> m_mapgens;
+	// Mapgen threads, one per Mapgen
 	std::vector<EmergeThread *> m_threads;
+	// Threads that only load blocks, passing missing ones on to m_threads.
+	// If empty, m_threads load blocks themselves.
+	std::vector<EmergeThread *> m_load_threads;
 	bool m_threads_active;
 
 	Mutex m_queue_mutex;
 	std::map<v3s16, BlockEmergeData> m_blocks_enqueued;
 	UNORDERED_MAP<u16, u16> m_peer_queue_count;
+	// Blocks of each peer passed on to the mapgen threads
+	UNORDERED_MAP<u16, u16> m_peer_generate_count;
+	// Prefetched blocks of each peer and of all peers, counted separately
+	// so they never take the place of other blocks
+	UNORDERED_MAP<u16, u16> m_peer_prefetch_count;
+	u32 m_prefetch_queued;
 
 	u16 m_qlimit_total;
 	u16 m_qlimit_diskonly;
 	u16 m_qlimit_generate;
 
+	// Pregeneration, the chunks are given by their minimum block position.
+	// Taken before m_queue_mutex, emerge callbacks never run under the latter.
+	Mutex m_pregen_mutex;
+	bool m_pregen_active;
+	std::vector<v3s16> m_pregen_centers;
+	s16 m_pregen_radius;
+	u32 m_pregen_max_chunks;
+	// Position in the spiral: ring, center, index within the ring and layer
+	s16 m_pregen_ring;
+	u32 m_pregen_center;
+	u32 m_pregen_index;
+	u32 m_pregen_layer;
+	// A chunk taken from the spiral that could not be queued yet
+	bool m_pregen_retry;
+	v3s16 m_pregen_retry_pos;
+	u32 m_pregen_queued;
+	u32 m_pregen_total;
+	u32 m_pregen_done;
+	u32 m_pregen_generated;
+	u64 m_pregen_start_time;
+	u64 m_pregen_end_time;
+	// Chunks known to exist, kept over runs for the chunks the next run
+	// covers as well
+	std::set<v3s16> m_pregen_existing;
+	std::map<v3s16, u32> m_pregen_visits;
+
 	// Requires m_queue_mutex held
-	EmergeThread *getOptimalThread();
+	static EmergeThread *getOptimalThread(
+		const std::vector<EmergeThread *> &threads);
 
 	bool pushBlockEmergeData(
 		v3s16 pos,
@@ -172,10 +253,23 @@ class EmergeManager {
 		u16 flags,
 		EmergeCompletionCallback callback,
 		void *callback_param,
-		bool *entry_already_exists);
+		bool *entry_already_exists,
+		bool *entry_promoted);
 
 	bool popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata);
 
+	// Called by loader threads when they are done with a block.
+	// Returns false if the block was passed on to be generated,
+	// otherwise its emerge data is removed and stored in bedata.
+	bool finishBlockLoad(v3s16 pos, EmergeAction action,
+		BlockEmergeData *bedata);
+
+	// Requires m_pregen_mutex held
+	bool nextPregenChunk(v3s16 *chunkpos);
+	// Completion callback of the blocks queued by stepPregen()
+	static void pregenCallback(v3s16 blockpos, EmergeAction action,
+		void *param);
+
 	friend class EmergeThread;
 
 	DISABLE_CLASS_COPY(EmergeManager);
@@ -35,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include "irr_v3d.h"
 #include "activeobject.h"
+#include "collision.h"
 #include "util/numeric.h"
 #include "threading/mutex.h"
 #include "threading/atomic.h"
@@ -79,6 +80,8 @@ class Environment
 	u32 m_added_objects;
 
 	IGameDef *getGameDef() { return m_gamedef; }
+
+	CollisionMoveCache &getCollisionMoveCache() { return m_collision_move_cache; }
 protected:
 	GenericAtomic<float> m_time_of_day_speed;
 
@@ -121,6 +124,8 @@ class Environment
 private:
 	Mutex m_time_lock;
 
+	CollisionMoveCache m_collision_move_cache;
+
 	DISABLE_CLASS_COPY(Environment);
 };
 
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "debug.h"
 #include "unittest/test.h"
 #include "server.h"
+#include "emerge.h"
 #include "filesys.h"
 #include "version.h"
 #include "guiMainMenu.h"
@@ -104,6 +105,9 @@ static bool determine_subgame(GameParams *game_params);
 
 static bool run_dedicated_server(const GameParams &game_params, const Settings &cmd_args);
 static bool migrate_map_database(const GameParams &game_params, const Settings &cmd_args);
+static bool pregenerate_map(const GameParams &game_params, const Settings &cmd_args,
+		const Address &bind_addr);
+static bool recompress_map(const GameParams &game_params, const Address &bind_addr);
 
 /**********************************************************************/
 
@@ -189,8 +193,9 @@ int main(int argc, char *argv[])
 	// Disable unit tests
 #else
 	// Run unit tests
-	if (cmd_args.getFlag("run-unittests")) {
-		return run_tests();
+	if (cmd_args.getFlag("run-unittests") ||
+			cmd_args.getFlag("run-benchmarks")) {
+		return run_tests(cmd_args.getFlag("run-benchmarks"));
 	}
 #endif
 
@@ -264,6 +269,8 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Set network port (UDP)"))));
 	allowed_options->insert(std::make_pair("run-unittests", ValueSpec(VALUETYPE_FLAG,
 			_("Run the unit tests and exit"))));
+	allowed_options->insert(std::make_pair("run-benchmarks", ValueSpec(VALUETYPE_FLAG,
+			_("Run the unit tests and the benchmarks, then exit"))));
 	allowed_options->insert(std::make_pair("map-dir", ValueSpec(VALUETYPE_STRING,
 			_("Same as --world (deprecated)"))));
 	allowed_options->insert(std::make_pair("world", ValueSpec(VALUETYPE_STRING,
@@ -286,6 +293,10 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Migrate from current map backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("migrate-players", ValueSpec(VALUETYPE_STRING,
 		_("Migrate from current players backend to another (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("pregen", ValueSpec(VALUETYPE_STRING,
+		_("Generate the map within this radius in mapchunks around spawn, then exit (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("recompress-map", ValueSpec(VALUETYPE_FLAG,
+		_("Rewrite the map with the current block format and map_block_codec, then exit (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("terminal", ValueSpec(VALUETYPE_FLAG,
 			_("Feature an interactive terminal (Only works when using minetestserver or with --server)"))));
 #ifndef SERVER
@@ -817,6 +828,13 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	else if (cmd_args.exists("migrate-players"))
 		return ServerEnvironment::migratePlayersDatabase(game_params, cmd_args);
 
+	// Map pregeneration
+	if (cmd_args.exists("pregen"))
+		return pregenerate_map(game_params, cmd_args, bind_addr);
+
+	if (cmd_args.getFlag("recompress-map"))
+		return recompress_map(game_params, bind_addr);
+
 	if (cmd_args.exists("terminal")) {
 #if USE_CURSES
 		bool name_ok = true;
@@ -899,6 +917,78 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	return true;
 }
 
+static bool pregenerate_map(const GameParams &game_params, const Settings &cmd_args,
+		const Address &bind_addr)
+{
+	s16 radius = stoi(cmd_args.get("pregen"));
+	if (radius <= 0) {
+		errorstream << "Cannot pregenerate: invalid radius \""
+			<< cmd_args.get("pregen") << "\"" << std::endl;
+		return false;
+	}
+
+	try {
+		Server server(game_params.world_path, game_params.game_spec, false,
+			bind_addr.isIPv6(), true);
+		server.start(bind_addr);
+		server.startPregen(radius);
+
+		EmergeManager *emerge = server.getEmergeManager();
+		bool &kill = *porting::signal_handler_killstatus();
+		float steplen = g_settings->getFloat("dedicated_server_step");
+		IntervalLimiter report_interval;
+
+		while (!kill && emerge->isPregenActive()) {
+			sleep_ms((int)(steplen * 1000.0));
+			server.step(steplen);
+
+			if (report_interval.step(steplen, 5.0)) {
+				PregenStatus status = emerge->getPregenStatus();
+				actionstream << "Pregenerating: " << status.chunks_done << "/"
+					<< status.chunks_total << " mapchunks, "
+					<< status.blocks_per_second << " blocks/s" << std::endl;
+			}
+		}
+
+		PregenStatus status = emerge->getPregenStatus();
+		actionstream << "Pregenerated " << status.chunks_generated
+			<< " mapchunks of " << status.chunks_total << ", "
+			<< status.blocks_per_second << " blocks/s" << std::endl;
+	} catch (const ModError &e) {
+		errorstream << "ModError: " << e.what() << std::endl;
+		return false;
+	} catch (const ServerError &e) {
+		errorstream << "ServerError: " << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static bool recompress_map(const GameParams &game_params, const Address &bind_addr)
+{
+	try {
+		Server server(game_params.world_path, game_params.game_spec, false,
+			bind_addr.isIPv6(), true);
+		ServerMap &map = server.getEnv().getServerMap();
+		bool &kill = *porting::signal_handler_killstatus();
+
+		u32 count = map.recompressBlocks(&kill);
+		actionstream << "Recompressed " << count << " blocks with "
+			<< block_codec_name(map.getBlockCodec()) << std::endl;
+		if (kill)
+			return false;
+	} catch (const ModError &e) {
+		errorstream << "ModError: " << e.what() << std::endl;
+		return false;
+	} catch (const ServerError &e) {
+		errorstream << "ServerError: " << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
 static bool migrate_map_database(const GameParams &game_params, const Settings &cmd_args)
 {
 	std::string migrate_to = cmd_args.get("migrate");
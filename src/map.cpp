@@ -33,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "util/directiontables.h"
 #include "util/basic_macros.h"
+#include "util/thread.h"
 #include "rollback_interface.h"
 #include "environment.h"
 #include "reflowscan.h"
@@ -43,6 +44,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "database.h"
 #include "database-dummy.h"
+#include "map_save_thread.h"
 #ifdef _WIN32
 #include "database-sqlite3.h"
 #endif
@@ -68,6 +70,7 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 	m_dout(dout),
 	m_gamedef(gamedef),
 	m_sector_cache(NULL),
+	m_block_cache(NULL),
 	m_nodedef(gamedef->ndef()),
 	m_transforming_liquid_loop_count_multiplier(1.0f),
 	m_unprocessed_count(0),
@@ -145,14 +148,31 @@ MapSector * Map::getSectorNoGenerate(v2s16 p)
 
 MapBlock * Map::getBlockNoCreateNoEx(v3s16 p3d)
 {
-	v2s16 p2d(p3d.X, p3d.Z);
-	MapSector * sector = getSectorNoGenerateNoEx(p2d);
-	if(sector == NULL)
-		return NULL;
-	MapBlock *block = sector->getBlockNoCreateNoEx(p3d.Y);
+	if (m_block_cache != NULL && p3d == m_block_cache_p)
+		return m_block_cache;
+
+	MapBlock *block = m_blocks.get(p3d);
+
+	// Cache the last found block
+	if (block != NULL) {
+		m_block_cache_p = p3d;
+		m_block_cache = block;
+	}
 	return block;
 }
 
+void Map::onBlockInserted(MapBlock *block)
+{
+	m_blocks.insert(block);
+}
+
+void Map::onBlockDeleted(MapBlock *block)
+{
+	if (m_block_cache == block)
+		m_block_cache = NULL;
+	m_blocks.erase(block->getPos());
+}
+
 MapBlock * Map::getBlockNoCreate(v3s16 p3d)
 {
 	MapBlock *block = getBlockNoCreateNoEx(p3d);
@@ -200,6 +220,47 @@ MapNode Map::getNodeNoEx(v3s16 p, bool *is_valid_position)
 	return node;
 }
 
+void Map::findNodes(v3s16 minp, v3s16 maxp, const ContentFilter &filter,
+		std::vector<v3s16> &result)
+{
+	size_t first = result.size();
+	v3s16 bpmin = getNodeBlockPos(minp);
+	v3s16 bpmax = getNodeBlockPos(maxp);
+	for (s16 bz = bpmin.Z; bz <= bpmax.Z; bz++)
+	for (s16 by = bpmin.Y; by <= bpmax.Y; by++)
+	for (s16 bx = bpmin.X; bx <= bpmax.X; bx++) {
+		v3s16 blockpos(bx, by, bz);
+		v3s16 block_min = blockpos * MAP_BLOCKSIZE;
+		VoxelArea block_area(block_min,
+			block_min + v3s16(1, 1, 1) * (MAP_BLOCKSIZE - 1));
+		// The part of the block in the area
+		VoxelArea area(
+			v3s16(MYMAX(minp.X, block_min.X), MYMAX(minp.Y, block_min.Y),
+				MYMAX(minp.Z, block_min.Z)),
+			v3s16(MYMIN(maxp.X, block_area.MaxEdge.X),
+				MYMIN(maxp.Y, block_area.MaxEdge.Y),
+				MYMIN(maxp.Z, block_area.MaxEdge.Z)));
+
+		MapBlock *block = getBlockNoCreateNoEx(blockpos);
+		if (block == NULL || block->isDummy()) {
+			if (!filter.contains(CONTENT_IGNORE))
+				continue;
+			for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+			for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+			for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++)
+				result.push_back(v3s16(x, y, z));
+			continue;
+		}
+
+		if (!filter.containsAny(block->getContents()))
+			continue;
+		find_nodes_in_data(block->getData(), block_area, area, filter,
+			result);
+	}
+
+	sort_positions_xyz(result, first);
+}
+
 #if 0
 // Deprecated
 // throws InvalidPositionException if not found
@@ -427,11 +488,9 @@ bool Map::getDayNightDiff(v3s16 blockpos)
 }
 
 struct TimeOrderedMapBlock {
-	MapSector *sect;
 	MapBlock *block;
 
-	TimeOrderedMapBlock(MapSector *sect, MapBlock *block) :
-		sect(sect),
+	TimeOrderedMapBlock(MapBlock *block) :
 		block(block)
 	{}
 
@@ -459,69 +518,51 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 
 	beginSave();
 
+	MapBlockVect blocks;
+	m_blocks.getBlocks(blocks);
+
 	// If there is no practical limit, we spare creation of mapblock_queue
 	if (max_loaded_blocks == U32_MAX) {
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			bool all_blocks_deleted = true;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for (MapBlockVect::iterator i = blocks.begin();
-					i != blocks.end(); ++i) {
-				MapBlock *block = (*i);
+		for (MapBlockVect::iterator i = blocks.begin();
+				i != blocks.end(); ++i) {
+			MapBlock *block = (*i);
 
-				block->incrementUsageTimer(dtime);
+			block->incrementUsageTimer(dtime);
 
-				if (block->refGet() == 0
-						&& block->getUsageTimer() > unload_timeout) {
-					v3s16 p = block->getPos();
+			if (block->refGet() == 0
+					&& block->getUsageTimer() > unload_timeout) {
+				v3s16 p = block->getPos();
 
-					// Save if modified
-					if (block->getModified() != MOD_STATE_CLEAN
-							&& save_before_unloading) {
-						modprofiler.add(block->getModifiedReasonString(), 1);
-						if (!saveBlock(block))
-							continue;
-						saved_blocks_count++;
+				// Save if modified
+				if (block->getModified() != MOD_STATE_CLEAN
+						&& save_before_unloading) {
+					modprofiler.add(block->getModifiedReasonString(), 1);
+					if (!saveBlock(block)) {
+						block_count_all++;
+						continue;
 					}
+					saved_blocks_count++;
+				}
 
-					// Delete from memory
-					sector->deleteBlock(block);
+				// Delete from memory
+				getSectorNoGenerate(v2s16(p.X, p.Z))->deleteBlock(block);
 
-					if (unloaded_blocks)
-						unloaded_blocks->push_back(p);
+				if (unloaded_blocks)
+					unloaded_blocks->push_back(p);
 
-					deleted_blocks_count++;
-				} else {
-					all_blocks_deleted = false;
-					block_count_all++;
-				}
-			}
-
-			if (all_blocks_deleted) {
-				sector_deletion_queue.push_back(si->first);
+				deleted_blocks_count++;
+			} else {
+				block_count_all++;
 			}
 		}
 	} else {
 		std::priority_queue<TimeOrderedMapBlock> mapblock_queue;
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for(MapBlockVect::iterator i = blocks.begin();
-					i != blocks.end(); ++i) {
-				MapBlock *block = (*i);
+		for (MapBlockVect::iterator i = blocks.begin();
+				i != blocks.end(); ++i) {
+			MapBlock *block = (*i);
 
-				block->incrementUsageTimer(dtime);
-				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
-			}
+			block->incrementUsageTimer(dtime);
+			mapblock_queue.push(TimeOrderedMapBlock(block));
 		}
 		block_count_all = mapblock_queue.size();
 		// Delete old blocks, and blocks over the limit from the memory
@@ -546,7 +587,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 			}
 
 			// Delete from memory
-			b.sect->deleteBlock(block);
+			getSectorNoGenerate(v2s16(p.X, p.Z))->deleteBlock(block);
 
 			if (unloaded_blocks)
 				unloaded_blocks->push_back(p);
@@ -554,12 +595,13 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 			deleted_blocks_count++;
 			block_count_all--;
 		}
-		// Delete empty sectors
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-			si != m_sectors.end(); ++si) {
-			if (si->second->empty()) {
-				sector_deletion_queue.push_back(si->first);
-			}
+	}
+
+	// Delete empty sectors
+	for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
+		si != m_sectors.end(); ++si) {
+		if (si->second->empty()) {
+			sector_deletion_queue.push_back(si->first);
 		}
 	}
 	endSave();
@@ -640,335 +682,591 @@ s32 Map::transforming_liquid_size() {
         return m_transforming_liquid.size();
 }
 
-void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
-		ServerEnvironment *env)
+/*
+	How a queued liquid node changes, see decide_liquid_node()
+*/
+struct LiquidNodeUpdate
 {
-	DSTACK(FUNCTION_NAME);
-	//TimeTaker timer("transformLiquids()");
+	v3s16 p;
+	// Whether the node changes to n_new
+	bool changed;
+	MapNode n_old;
+	MapNode n_new;
+	// on_flood() has to be called before the node changes
+	bool flooded;
+	// The node did not reach its level because of viscosity
+	bool reflow;
+	// Nodes to transform next, whether or not the node changes
+	v3s16 queued[6];
+	u8 num_queued;
+	// Nodes to transform next if the node changes
+	v3s16 changed_queued[6];
+	u8 num_changed_queued;
+};
 
-	u32 loopcount = 0;
-	u32 initial_size = m_transforming_liquid.size();
+/*
+	Decides how the liquid node at p0 changes. get_node(p) returns the
+	node at p; nothing is written, so this can run on any thread that
+	can read the nodes.
+*/
+template <typename NodeGetter>
+static void decide_liquid_node(v3s16 p0, const NodeGetter &get_node,
+		INodeDefManager *nodedef, LiquidNodeUpdate &update)
+{
+	update.p = p0;
+	update.changed = false;
+	update.flooded = false;
+	update.reflow = false;
+	update.num_queued = 0;
+	update.num_changed_queued = 0;
 
-	/*if(initial_size != 0)
-		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
+	MapNode n0 = get_node(p0);
 
-	// list of nodes that due to viscosity have not reached their max level height
-	std::deque<v3s16> must_reflow;
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = nodedef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = nodedef->getId(cf.liquid_alternative_flowing);
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+	}
 
-	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+	/*
+		Collect information about the environment
+	 */
+	const v3s16 *dirs = g_6dirs;
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 1:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 4:
+				nt = NEIGHBOR_LOWER;
+				break;
+		}
+		v3s16 npos = p0 + dirs[i];
+		NodeNeighbor nb(get_node(npos), nt, npos);
+		const ContentFeatures &cfnb = nodedef->get(nb.n);
+		switch (nodedef->get(nb.n.getContent()).liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						update.queued[update.num_queued++] = npos;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
+						if (nb.t == NEIGHBOR_LOWER)
+							flowing_down = true;
+						else
+							ignored_sources = true;
+					}
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = nodedef->getId(cfnb.liquid_alternative_flowing);
+				if (nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(dirs[i].Y != -1)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = nodedef->getId(cfnb.liquid_alternative_flowing);
+				if (nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+		}
+	}
 
-	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
-	u32 loop_max = liquid_loop_max;
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = nodedef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = nodedef->getId(nodedef->get(liquid_kind).liquid_alternative_source);
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighbouring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
+			switch (flows[i].t) {
+				case NEIGHBOR_UPPER:
+					if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
+						max_node_level = LIQUID_LEVEL_MAX;
+						if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+							max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+					} else if (nb_liquid_level > max_node_level) {
+						max_node_level = nb_liquid_level;
+					}
+					break;
+				case NEIGHBOR_LOWER:
+					break;
+				case NEIGHBOR_SAME_LEVEL:
+					if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+							nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+						max_node_level = nb_liquid_level - 1;
+					break;
+			}
+		}
 
-#if 0
+		u8 viscosity = nodedef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				update.reflow = true;
+		} else {
+			new_node_level = max_node_level;
+		}
 
-	/* If liquid_loop_max is not keeping up with the queue size increase
-	 * loop_max up to a maximum of liquid_loop_max * dedicated_server_step.
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, just continue with the next node.
 	 */
-	if (m_transforming_liquid.size() > loop_max * 2) {
-		// "Burst" mode
-		float server_step = g_settings->getFloat("dedicated_server_step");
-		if (m_transforming_liquid_loop_count_multiplier - 1.0 < server_step)
-			m_transforming_liquid_loop_count_multiplier *= 1.0 + server_step / 10;
+	if (new_node_content == n0.getContent() &&
+			(nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
+
+
+	/*
+		update the current node
+	 */
+	MapNode n00 = n0;
+	//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
+	if (nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
 	} else {
-		m_transforming_liquid_loop_count_multiplier = 1.0;
+		// set the liquid level and flow bit to 0
+		n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
 	}
 
-	loop_max *= m_transforming_liquid_loop_count_multiplier;
-#endif
+	// change the node.
+	n0.setContent(new_node_content);
 
-	while (m_transforming_liquid.size() != 0)
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= initial_size || loopcount >= loop_max)
+	// Ignore light (because calling voxalgo::update_lighting_nodes)
+	n0.setLight(LIGHTBANK_DAY, 0, nodedef);
+	n0.setLight(LIGHTBANK_NIGHT, 0, nodedef);
+
+	update.changed = true;
+	update.n_old = n00;
+	update.n_new = n0;
+	update.flooded = floodable_node != CONTENT_AIR;
+
+	/*
+		enqueue neighbors for update if neccessary
+	 */
+	switch (nodedef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					update.changed_queued[update.num_changed_queued++] = flows[i].p;
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					update.changed_queued[update.num_changed_queued++] = airs[i].p;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				update.changed_queued[update.num_changed_queued++] = flows[i].p;
 			break;
-		loopcount++;
+	}
+}
+
+// Reads nodes for decide_liquid_node() from the map
+class MapNodeGetter
+{
+public:
+	MapNodeGetter(Map *map): m_map(map) {}
+	MapNode operator()(v3s16 p) const { return m_map->getNodeNoEx(p); }
+
+private:
+	Map *m_map;
+};
+
+void Map::applyLiquidUpdate(const LiquidNodeUpdate &update,
+		std::map<v3s16, MapBlock*> &modified_blocks,
+		std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+		ServerEnvironment *env)
+{
+	v3s16 p0 = update.p;
+	MapNode n0 = update.n_new;
+
+	// on_flood() the node
+	if (update.flooded) {
+		if (env->getScriptIface()->node_on_flood(p0, update.n_old, n0))
+			return;
+	}
+
+	// Find out whether there is a suspect for this action
+	std::string suspect;
+	if (m_gamedef->rollback())
+		suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
+
+	if (m_gamedef->rollback() && !suspect.empty()) {
+		// Blame suspect
+		RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+		// Get old node for rollback
+		RollbackNode rollback_oldnode(this, p0, m_gamedef);
+		// Set node
+		setNode(p0, n0);
+		// Report
+		RollbackNode rollback_newnode(this, p0, m_gamedef);
+		RollbackAction action;
+		action.setSetNode(p0, rollback_oldnode, rollback_newnode);
+		m_gamedef->rollback()->reportAction(action);
+	} else {
+		// Set node
+		setNode(p0, n0);
+	}
+
+	v3s16 blockpos = getNodeBlockPos(p0);
+	MapBlock *block = getBlockNoCreateNoEx(blockpos);
+	if (block != NULL) {
+		modified_blocks[blockpos] =  block;
+		changed_nodes.push_back(std::pair<v3s16, MapNode>(p0, update.n_old));
+	}
 
+	for (u8 i = 0; i < update.num_changed_queued; i++)
+		m_transforming_liquid.push_back(update.changed_queued[i]);
+}
+
+void Map::transformLiquidsSerial(u32 count,
+		std::map<v3s16, MapBlock*> &modified_blocks,
+		std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+		ServerEnvironment *env)
+{
+	// list of nodes that due to viscosity have not reached their max level height
+	std::deque<v3s16> must_reflow;
+
+	MapNodeGetter get_node(this);
+	LiquidNodeUpdate update;
+	for (u32 i = 0; i < count && m_transforming_liquid.size() != 0; i++) {
 		/*
 			Get a queued transforming liquid node
 		*/
 		v3s16 p0 = m_transforming_liquid.front();
 		m_transforming_liquid.pop_front();
 
-		MapNode n0 = getNodeNoEx(p0);
+		decide_liquid_node(p0, get_node, m_nodedef, update);
 
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		// The liquid node which will be placed there if
-		// the liquid flows into this node.
-		content_t liquid_kind = CONTENT_IGNORE;
-		// The node which will be placed there if liquid
-		// can't flow into this node.
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = m_nodedef->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = m_nodedef->getId(cf.liquid_alternative_flowing);
-				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
-				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
-				break;
-		}
-
-		/*
-			Collect information about the environment
-		 */
-		const v3s16 *dirs = g_6dirs;
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		bool ignored_sources = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 1:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 4:
-					nt = NEIGHBOR_LOWER;
-					break;
-			}
-			v3s16 npos = p0 + dirs[i];
-			NodeNeighbor nb(getNodeNoEx(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			switch (m_nodedef->get(nb.n.getContent()).liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueded for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							m_transforming_liquid.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						if (nb.n.getContent() == CONTENT_IGNORE) {
-							// If node below is ignore prevent water from
-							// spreading outwards and otherwise prevent from
-							// flowing away as ignore node might be the source
-							if (nb.t == NEIGHBOR_LOWER)
-								flowing_down = true;
-							else
-								ignored_sources = true;
-						}
-					}
-					break;
-				case LIQUID_SOURCE:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(dirs[i].Y != -1)
-							sources[num_sources++] = nb;
-					}
-					break;
-				case LIQUID_FLOWING:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
-					break;
-			}
-		}
+		for (u8 j = 0; j < update.num_queued; j++)
+			m_transforming_liquid.push_back(update.queued[j]);
+		if (update.reflow)
+			must_reflow.push_back(p0);
 
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = m_nodedef->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = m_nodedef->getId(m_nodedef->get(liquid_kind).liquid_alternative_source);
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else if (ignored_sources && liquid_level >= 0) {
-			// Maybe there are neighbouring sources that aren't loaded yet
-			// so prevent flowing away.
-			new_node_level = liquid_level;
-			new_node_content = liquid_kind;
-		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
-				switch (flows[i].t) {
-					case NEIGHBOR_UPPER:
-						if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
-							max_node_level = LIQUID_LEVEL_MAX;
-							if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-								max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-						} else if (nb_liquid_level > max_node_level) {
-							max_node_level = nb_liquid_level;
-						}
-						break;
-					case NEIGHBOR_LOWER:
-						break;
-					case NEIGHBOR_SAME_LEVEL:
-						if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-								nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-							max_node_level = nb_liquid_level - 1;
-						break;
-				}
-			}
+		if (update.changed)
+			applyLiquidUpdate(update, modified_blocks, changed_nodes, env);
+	}
 
-			u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
-			} else {
-				new_node_level = max_node_level;
-			}
+	for (std::deque<v3s16>::iterator iter = must_reflow.begin(); iter != must_reflow.end(); ++iter)
+		m_transforming_liquid.push_back(*iter);
+}
 
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
+/*
+	The queued liquid nodes of one MapBlock, and what transforming
+	them produced
+*/
+struct LiquidBlockPart
+{
+	v3s16 blockpos;
+	// In queue order
+	std::vector<v3s16> nodes;
 
-		}
+	std::vector<v3s16> queued;
+	std::vector<v3s16> reflow;
+	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+	// Changes that need on_flood(), done after all parts
+	std::vector<LiquidNodeUpdate> flooded;
+};
 
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
-			continue;
+// Reads nodes for decide_liquid_node() from the block table
+class TableNodeGetter
+{
+public:
+	TableNodeGetter(const MapBlockTable *blocks, MapBlock *block):
+		m_blocks(blocks),
+		m_block(block),
+		m_p0(block->getPosRelative())
+	{}
 
+	MapNode operator()(v3s16 p) const
+	{
+		v3s16 rel = p - m_p0;
+		if (rel.X >= 0 && rel.X < MAP_BLOCKSIZE &&
+				rel.Y >= 0 && rel.Y < MAP_BLOCKSIZE &&
+				rel.Z >= 0 && rel.Z < MAP_BLOCKSIZE)
+			return m_block->getNodeUnsafe(rel);
+
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = m_blocks->get(blockpos);
+		if (block == NULL || block->isDummy())
+			return MapNode(CONTENT_IGNORE);
+		rel = p - blockpos * MAP_BLOCKSIZE;
+		return block->getNodeUnsafe(rel);
+	}
+
+private:
+	const MapBlockTable *m_blocks;
+	MapBlock *m_block;
+	v3s16 m_p0;
+};
 
-		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bit to 0
-			n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
-		}
+/*
+	Transforms the liquid nodes of a set of MapBlocks that do not
+	touch each other, one part per block. A part only writes its own
+	block and reads its neighbors, which no other part writes.
+*/
+class LiquidTransformJob : public ParallelJob
+{
+public:
+	LiquidTransformJob(const MapBlockTable *blocks, INodeDefManager *nodedef,
+			std::vector<LiquidBlockPart> &parts):
+		m_blocks(blocks),
+		m_nodedef(nodedef),
+		m_parts(parts)
+	{}
 
-		// change the node.
-		n0.setContent(new_node_content);
+	std::vector<u32> wave;
 
-		// on_flood() the node
-		if (floodable_node != CONTENT_AIR) {
-			if (env->getScriptIface()->node_on_flood(p0, n00, n0))
+	void runPart(u32 part_i)
+	{
+		LiquidBlockPart &part = m_parts[wave[part_i]];
+		MapBlock *block = m_blocks->get(part.blockpos);
+		// The nodes of unloaded blocks are dropped, like ignore nodes
+		if (block == NULL || block->isDummy())
+			return;
+
+		TableNodeGetter get_node(m_blocks, block);
+		v3s16 p0 = block->getPosRelative();
+		LiquidNodeUpdate update;
+		for (size_t i = 0; i < part.nodes.size(); i++) {
+			decide_liquid_node(part.nodes[i], get_node, m_nodedef, update);
+
+			part.queued.insert(part.queued.end(),
+					update.queued, update.queued + update.num_queued);
+			if (update.reflow)
+				part.reflow.push_back(update.p);
+
+			if (!update.changed)
+				continue;
+			// Scripts can only be called from the server thread
+			if (update.flooded) {
+				part.flooded.push_back(update);
 				continue;
+			}
+
+			MapNode n = update.n_new;
+			block->setNodeNoCheck(update.p - p0, n);
+			part.changed_nodes.push_back(
+					std::pair<v3s16, MapNode>(update.p, update.n_old));
+			part.queued.insert(part.queued.end(), update.changed_queued,
+					update.changed_queued + update.num_changed_queued);
 		}
+	}
 
-		// Ignore light (because calling voxalgo::update_lighting_nodes)
-		n0.setLight(LIGHTBANK_DAY, 0, m_nodedef);
-		n0.setLight(LIGHTBANK_NIGHT, 0, m_nodedef);
-
-		// Find out whether there is a suspect for this action
-		std::string suspect;
-		if (m_gamedef->rollback())
-			suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
-
-		if (m_gamedef->rollback() && !suspect.empty()) {
-			// Blame suspect
-			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
-			// Get old node for rollback
-			RollbackNode rollback_oldnode(this, p0, m_gamedef);
-			// Set node
-			setNode(p0, n0);
-			// Report
-			RollbackNode rollback_newnode(this, p0, m_gamedef);
-			RollbackAction action;
-			action.setSetNode(p0, rollback_oldnode, rollback_newnode);
-			m_gamedef->rollback()->reportAction(action);
-		} else {
-			// Set node
-			setNode(p0, n0);
+private:
+	const MapBlockTable *m_blocks;
+	INodeDefManager *m_nodedef;
+	std::vector<LiquidBlockPart> &m_parts;
+};
+
+void Map::transformLiquidsParallel(u32 count,
+		std::map<v3s16, MapBlock*> &modified_blocks,
+		std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+		ServerEnvironment *env, WorkerPool *pool)
+{
+	// Split the queued nodes by block, keeping their order
+	std::vector<LiquidBlockPart> parts;
+	std::map<v3s16, u32> part_of_block;
+	for (u32 i = 0; i < count && m_transforming_liquid.size() != 0; i++) {
+		v3s16 p = m_transforming_liquid.front();
+		m_transforming_liquid.pop_front();
+
+		v3s16 blockpos = getNodeBlockPos(p);
+		std::map<v3s16, u32>::iterator it = part_of_block.find(blockpos);
+		if (it == part_of_block.end()) {
+			it = part_of_block.insert(
+					std::make_pair(blockpos, (u32)parts.size())).first;
+			parts.push_back(LiquidBlockPart());
+			parts.back().blockpos = blockpos;
 		}
+		parts[it->second].nodes.push_back(p);
+	}
 
-		v3s16 blockpos = getNodeBlockPos(p0);
-		MapBlock *block = getBlockNoCreateNoEx(blockpos);
-		if (block != NULL) {
-			modified_blocks[blockpos] =  block;
-			changed_nodes.push_back(std::pair<v3s16, MapNode>(p0, n00));
+	/*
+		Blocks with the same parity of their coordinates never touch,
+		so they are processed together. This makes 8 waves, in a fixed
+		order, so the result does not depend on the number of threads.
+	*/
+	LiquidTransformJob job(&m_blocks, m_nodedef, parts);
+	for (u32 parity = 0; parity < 8; parity++) {
+		job.wave.clear();
+		for (std::map<v3s16, u32>::iterator it = part_of_block.begin();
+				it != part_of_block.end(); ++it) {
+			v3s16 bp = it->first;
+			if (((bp.X & 1) | (bp.Y & 1) << 1 | (bp.Z & 1) << 2) == (s32)parity)
+				job.wave.push_back(it->second);
 		}
+		if (!job.wave.empty())
+			pool->run(&job, job.wave.size());
+	}
 
-		/*
-			enqueue neighbors for update if neccessary
-		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					m_transforming_liquid.push_back(flows[i].p);
-				break;
+	// Collect the results in block order
+	std::vector<v3s16> reflow;
+	for (std::map<v3s16, u32>::iterator it = part_of_block.begin();
+			it != part_of_block.end(); ++it) {
+		LiquidBlockPart &part = parts[it->second];
+
+		if (!part.changed_nodes.empty()) {
+			modified_blocks[part.blockpos] = getBlockNoCreateNoEx(part.blockpos);
+			changed_nodes.insert(changed_nodes.end(),
+					part.changed_nodes.begin(), part.changed_nodes.end());
 		}
+		for (size_t i = 0; i < part.queued.size(); i++)
+			m_transforming_liquid.push_back(part.queued[i]);
+		for (size_t i = 0; i < part.flooded.size(); i++)
+			applyLiquidUpdate(part.flooded[i], modified_blocks, changed_nodes, env);
+		reflow.insert(reflow.end(), part.reflow.begin(), part.reflow.end());
 	}
-	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
 
-	for (std::deque<v3s16>::iterator iter = must_reflow.begin(); iter != must_reflow.end(); ++iter)
-		m_transforming_liquid.push_back(*iter);
+	for (size_t i = 0; i < reflow.size(); i++)
+		m_transforming_liquid.push_back(reflow[i]);
+}
+
+void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
+		ServerEnvironment *env, WorkerPool *pool)
+{
+	DSTACK(FUNCTION_NAME);
+	//TimeTaker timer("transformLiquids()");
+
+	u32 initial_size = m_transforming_liquid.size();
+
+	/*if(initial_size != 0)
+		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
+
+	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+
+	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
+	u32 loop_max = liquid_loop_max;
+
+#if 0
+
+	/* If liquid_loop_max is not keeping up with the queue size increase
+	 * loop_max up to a maximum of liquid_loop_max * dedicated_server_step.
+	 */
+	if (m_transforming_liquid.size() > loop_max * 2) {
+		// "Burst" mode
+		float server_step = g_settings->getFloat("dedicated_server_step");
+		if (m_transforming_liquid_loop_count_multiplier - 1.0 < server_step)
+			m_transforming_liquid_loop_count_multiplier *= 1.0 + server_step / 10;
+	} else {
+		m_transforming_liquid_loop_count_multiplier = 1.0;
+	}
+
+	loop_max *= m_transforming_liquid_loop_count_multiplier;
+#endif
+
+	u32 count = MYMIN(initial_size, loop_max);
+	// Rollback needs the map for every change, so it keeps to one thread
+	if (pool && !m_gamedef->rollback())
+		transformLiquidsParallel(count, modified_blocks, changed_nodes, env, pool);
+	else
+		transformLiquidsSerial(count, modified_blocks, changed_nodes, env);
+	//infostream<<"Map::transformLiquids(): loopcount="<<count<<std::endl;
 
 	voxalgo::update_lighting_nodes(this, changed_nodes, modified_blocks);
 
@@ -1265,6 +1563,21 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	std::string backend = conf.get("backend");
 	dbase = createDatabase(backend, savedir, conf);
 
+	m_save_thread = NULL;
+	s32 save_queue_size = g_settings->getS32("map_save_queue_size");
+	if (save_queue_size > 0) {
+		m_save_thread = new MapSaveThread(dbase, save_queue_size);
+		m_save_thread->start();
+	}
+
+	std::string codec_name = g_settings->get("map_block_codec");
+	m_block_codec = block_codec_from_name(codec_name);
+	if (!block_codec_supported(m_block_codec)) {
+		warningstream << "ServerMap: map_block_codec \"" << codec_name
+			<< "\" is not supported, using zlib" << std::endl;
+		m_block_codec = BLOCK_CODEC_ZLIB;
+	}
+
 	if (!conf.updateConfigFile(conf_path.c_str()))
 		errorstream << "ServerMap::ServerMap(): Failed to update world.mt!" << std::endl;
 
@@ -1345,6 +1658,9 @@ ServerMap::~ServerMap()
 				<<", exception: "<<e.what()<<std::endl;
 	}
 
+	// Finish pending writes
+	delete m_save_thread;
+
 	/*
 		Close database if it was opened
 	*/
@@ -2089,24 +2405,21 @@ void ServerMap::listAllLoadableBlocks(std::vector<v3s16> &dst)
 		errorstream << "Map::listAllLoadableBlocks(): Result will be missing "
 				<< "all blocks that are stored in flat files." << std::endl;
 	}
-	dbase->listAllLoadableBlocks(dst);
+	if (m_save_thread)
+		m_save_thread->listAllLoadableBlocks(dst);
+	else
+		dbase->listAllLoadableBlocks(dst);
 }
 
 void ServerMap::listAllLoadedBlocks(std::vector<v3s16> &dst)
 {
-	for(std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-		si != m_sectors.end(); ++si)
-	{
-		MapSector *sector = si->second;
-
-		MapBlockVect blocks;
-		sector->getBlocks(blocks);
+	MapBlockVect blocks;
+	m_blocks.getBlocks(blocks);
 
-		for(MapBlockVect::iterator i = blocks.begin();
-				i != blocks.end(); ++i) {
-			v3s16 p = (*i)->getPos();
-			dst.push_back(p);
-		}
+	for(MapBlockVect::iterator i = blocks.begin();
+			i != blocks.end(); ++i) {
+		v3s16 p = (*i)->getPos();
+		dst.push_back(p);
 	}
 }
 
@@ -2317,30 +2630,37 @@ MapDatabase *ServerMap::createDatabase(
 
 void ServerMap::beginSave()
 {
-	dbase->beginSave();
+	// The save thread groups its writes itself
+	if (!m_save_thread)
+		dbase->beginSave();
 }
 
 void ServerMap::endSave()
 {
-	dbase->endSave();
+	if (!m_save_thread)
+		dbase->endSave();
 }
 
 bool ServerMap::saveBlock(MapBlock *block)
 {
-	return saveBlock(block, dbase);
-}
-
-bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db)
-{
-	v3s16 p3d = block->getPos();
+	if (!m_save_thread)
+		return saveBlock(block, dbase, m_block_codec);
 
 	// Dummy blocks are not written
 	if (block->isDummy()) {
 		warningstream << "saveBlock: Not writing dummy block "
-			<< PP(p3d) << std::endl;
+			<< PP(block->getPos()) << std::endl;
 		return true;
 	}
 
+	m_save_thread->saveBlock(block->getPos(),
+			serializeBlock(block, m_block_codec));
+	block->resetModified();
+	return true;
+}
+
+std::string ServerMap::serializeBlock(MapBlock *block, u8 codec)
+{
 	// Format used for writing
 	u8 version = SER_FMT_VER_HIGHEST_WRITE;
 
@@ -2350,10 +2670,23 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db)
 	*/
 	std::ostringstream o(std::ios_base::binary);
 	o.write((char*) &version, 1);
-	block->serialize(o, version, true);
+	block->serialize(o, version, true, codec);
+
+	return o.str();
+}
+
+bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, u8 codec)
+{
+	v3s16 p3d = block->getPos();
 
-	std::string data = o.str();
-	bool ret = db->saveBlock(p3d, data);
+	// Dummy blocks are not written
+	if (block->isDummy()) {
+		warningstream << "saveBlock: Not writing dummy block "
+			<< PP(p3d) << std::endl;
+		return true;
+	}
+
+	bool ret = db->saveBlock(p3d, serializeBlock(block, codec));
 	if (ret) {
 		// We just wrote it to the disk so clear modified flag
 		block->resetModified();
@@ -2361,6 +2694,48 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db)
 	return ret;
 }
 
+u32 ServerMap::recompressBlocks(bool *kill)
+{
+	std::vector<v3s16> blocks;
+	dbase->listAllLoadableBlocks(blocks);
+
+	u32 count = 0;
+	dbase->beginSave();
+	for (size_t i = 0; i < blocks.size() && !*kill; i++) {
+		v3s16 p = blocks[i];
+		std::string data;
+		dbase->loadBlock(p, &data);
+		// [0] version, [1] flags, [2] lighting, [4] codec
+		if (data.empty() || (data.size() > 4 &&
+				(u8)data[0] == SER_FMT_VER_HIGHEST_WRITE &&
+				(u8)data[4] == m_block_codec))
+			continue;
+
+		MapBlock block(this, p, m_gamedef);
+		try {
+			std::istringstream is(data, std::ios_base::binary);
+			u8 version = SER_FMT_VER_INVALID;
+			is.read((char *)&version, 1);
+			block.deSerialize(is, version, true);
+		} catch (BaseException &e) {
+			errorstream << "Cannot recompress block " << PP(p) << ": "
+				<< e.what() << std::endl;
+			continue;
+		}
+		dbase->saveBlock(p, serializeBlock(&block, m_block_codec));
+
+		if (++count % 1024 == 0) {
+			dbase->endSave();
+			dbase->beginSave();
+			actionstream << "Recompressed " << count << " blocks, "
+				<< i + 1 << "/" << blocks.size() << " done" << std::endl;
+		}
+	}
+	dbase->endSave();
+
+	return count;
+}
+
 void ServerMap::loadBlock(const std::string &sectordir, const std::string &blockfile,
 		MapSector *sector, bool save_after_load)
 {
@@ -2504,6 +2879,66 @@ void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool
 }
 
 MapBlock* ServerMap::loadBlock(v3s16 blockpos)
+{
+	std::string data;
+	readBlock(blockpos, &data);
+	return insertLoadedBlock(blockpos, &data, NULL, NULL);
+}
+
+void ServerMap::readBlock(v3s16 blockpos, std::string *data)
+{
+	if (m_save_thread)
+		m_save_thread->loadBlock(blockpos, data);
+	else
+		dbase->loadBlock(blockpos, data);
+}
+
+bool ServerMap::deSerializeBlock(v3s16 blockpos, const std::string &data,
+		MapBlock **block, NameIdMapping *nimap)
+{
+	DSTACK(FUNCTION_NAME);
+
+	*block = NULL;
+	try {
+		std::istringstream is(data, std::ios_base::binary);
+
+		u8 version = SER_FMT_VER_INVALID;
+		is.read((char*)&version, 1);
+
+		if(is.fail())
+			throw SerializationError("ServerMap::deSerializeBlock(): Failed"
+					" to read MapBlock version");
+
+		// Converting these uses the node definitions
+		if (version <= 21)
+			return true;
+
+		*block = new MapBlock(this, blockpos, m_gamedef);
+		(*block)->deSerialize(is, version, true, nimap);
+		(*block)->resetModified();
+	} catch (SerializationError &e) {
+		delete *block;
+		*block = NULL;
+		errorstream<<"Invalid block data in database"
+				<<" ("<<blockpos.X<<","<<blockpos.Y<<","<<blockpos.Z<<")"
+				<<" (SerializationError): "<<e.what()<<std::endl;
+
+		if(g_settings->getBool("ignore_world_load_errors")){
+			errorstream<<"Ignoring block load error. Duck and cover! "
+					<<"(ignore_world_load_errors)"<<std::endl;
+			return false;
+		}
+		throw SerializationError("Invalid block data in database");
+	} catch (...) {
+		delete *block;
+		*block = NULL;
+		throw;
+	}
+	return true;
+}
+
+MapBlock *ServerMap::insertLoadedBlock(v3s16 blockpos, std::string *data,
+		MapBlock *loaded, const NameIdMapping *nimap)
 {
 	DSTACK(FUNCTION_NAME);
 
@@ -2511,10 +2946,15 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 
 	v2s16 p2d(blockpos.X, blockpos.Z);
 
-	std::string ret;
-	dbase->loadBlock(blockpos, &ret);
-	if (ret != "") {
-		loadBlock(&ret, blockpos, createSector(p2d), false);
+	if (loaded && created_new) {
+		loaded->correctNodeIds(*nimap);
+		createSector(p2d)->insertBlock(loaded);
+		ReflowScan scanner(this, m_emerge->ndef);
+		scanner.scan(loaded, &m_transforming_liquid);
+	} else if (*data != "") {
+		// A dummy block is in the way, deserialize into it
+		delete loaded;
+		loadBlock(data, blockpos, createSector(p2d), false);
 	} else {
 		// Not found in database, try the files
 
@@ -2585,7 +3025,9 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 
 bool ServerMap::deleteBlock(v3s16 blockpos)
 {
-	if (!dbase->deleteBlock(blockpos))
+	bool deleted = m_save_thread ?
+		m_save_thread->deleteBlock(blockpos) : dbase->deleteBlock(blockpos);
+	if (!deleted)
 		return false;
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
@@ -35,18 +35,23 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/cpp11_container.h"
 #include "nodetimer.h"
 #include "map_settings_manager.h"
+#include "mapblock_table.h"
 
 class Settings;
 class MapDatabase;
 class ClientMap;
 class MapSector;
 class ServerMapSector;
+class MapSaveThread;
+class NameIdMapping;
 class MapBlock;
 class NodeMetadata;
 class IGameDef;
 class IRollbackManager;
 class EmergeManager;
 class ServerEnvironment;
+class WorkerPool;
+struct LiquidNodeUpdate;
 struct BlockMakeData;
 
 /*
@@ -189,6 +194,19 @@ class Map /*: public NodeContainer*/
 	// Returns NULL if not found
 	MapBlock * getBlockNoCreateNoEx(v3s16 p);
 
+	// Appends all loaded blocks, in no particular order
+	void getBlocks(std::vector<MapBlock *> &dest) const
+	{ m_blocks.getBlocks(dest); }
+	// Appends the loaded blocks between minp and maxp (inclusive)
+	void getBlocksInArea(v3s16 minp, v3s16 maxp,
+			std::vector<MapBlock *> &dest) const
+	{ m_blocks.getBlocksInArea(minp, maxp, dest); }
+	size_t getBlockCount() const { return m_blocks.size(); }
+
+	// Called by MapSector to keep the block table up to date
+	void onBlockInserted(MapBlock *block);
+	void onBlockDeleted(MapBlock *block);
+
 	/* Server overrides */
 	virtual MapBlock * emergeBlock(v3s16 p, bool create_blank=true)
 	{ return getBlockNoCreateNoEx(p); }
@@ -208,6 +226,16 @@ class Map /*: public NodeContainer*/
 	// position is valid, otherwise false
 	MapNode getNodeNoEx(v3s16 p, bool *is_valid_position = NULL);
 
+	/*
+		Appends the positions between minp and maxp (inclusive) of the
+		nodes whose content is in filter, in the order of x, then y,
+		then z. Like getNodeNoEx(), nodes of blocks that are not loaded
+		are CONTENT_IGNORE. Blocks are looked up once and skipped when
+		none of their contents is in the filter.
+	*/
+	void findNodes(v3s16 minp, v3s16 maxp, const ContentFilter &filter,
+			std::vector<v3s16> &result);
+
 	/*
 		These handle lighting but not faces.
 	*/
@@ -266,8 +294,12 @@ class Map /*: public NodeContainer*/
 	// For debug printing. Prints "Map: ", "ServerMap: " or "ClientMap: "
 	virtual void PrintInfo(std::ostream &out);
 
+	/*
+		Transforms the queued liquid nodes. With a pool, the nodes are
+		split by MapBlock and transformed on its threads.
+	*/
 	void transformLiquids(std::map<v3s16, MapBlock*> & modified_blocks,
-			ServerEnvironment *env);
+			ServerEnvironment *env, WorkerPool *pool = NULL);
 
 	/*
 		Node metadata
@@ -331,6 +363,13 @@ class Map /*: public NodeContainer*/
 	MapSector *m_sector_cache;
 	v2s16 m_sector_cache_p;
 
+	// All blocks of m_sectors, by position
+	MapBlockTable m_blocks;
+	// Last found block. Map access is serialized by the environment
+	// lock, so one cache serves every thread.
+	MapBlock *m_block_cache;
+	v3s16 m_block_cache_p;
+
 	// Queued transforming water nodes
 	UniqueQueue<v3s16> m_transforming_liquid;
 
@@ -341,6 +380,21 @@ class Map /*: public NodeContainer*/
 			float start_off, float end_off, u32 needed_count);
 
 private:
+	// Parts of transformLiquids()
+	void transformLiquidsSerial(u32 count,
+			std::map<v3s16, MapBlock*> &modified_blocks,
+			std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+			ServerEnvironment *env);
+	void transformLiquidsParallel(u32 count,
+			std::map<v3s16, MapBlock*> &modified_blocks,
+			std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+			ServerEnvironment *env, WorkerPool *pool);
+	// Sets a decided liquid node, calling on_flood() and reporting to rollback
+	void applyLiquidUpdate(const LiquidNodeUpdate &update,
+			std::map<v3s16, MapBlock*> &modified_blocks,
+			std::vector<std::pair<v3s16, MapNode> > &changed_nodes,
+			ServerEnvironment *env);
+
 	f32 m_transforming_liquid_loop_count_multiplier;
 	u32 m_unprocessed_count;
 	u64 m_inc_trending_up_start_time; // milliseconds
@@ -455,7 +509,17 @@ class ServerMap : public Map
 	bool loadSectorMeta(v2s16 p2d);
 
 	bool saveBlock(MapBlock *block);
-	static bool saveBlock(MapBlock *block, MapDatabase *db);
+	static bool saveBlock(MapBlock *block, MapDatabase *db,
+			u8 codec = BLOCK_CODEC_ZLIB);
+	// Serialization used for the database
+	static std::string serializeBlock(MapBlock *block,
+			u8 codec = BLOCK_CODEC_ZLIB);
+	// Codec of the blocks written to the database, see map_block_codec
+	u8 getBlockCodec() const { return m_block_codec; }
+	// Rewrites the blocks in the database that don't have the current
+	// serialization version and codec, returns how many. Only while the
+	// server isn't running, stops early when *kill is set.
+	u32 recompressBlocks(bool *kill);
 	// This will generate a sector with getSector if not found.
 	void loadBlock(const std::string &sectordir, const std::string &blockfile,
 			MapSector *sector, bool save_after_load=false);
@@ -463,6 +527,24 @@ class ServerMap : public Map
 	// Database version
 	void loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load=false);
 
+	/*
+		Loading in steps, so that only the last one needs the environment
+		lock. readBlock() needs it too unless isReadThreadSafe().
+	*/
+	bool isReadThreadSafe() const { return m_save_thread != NULL; }
+	// Reads the database data of a block, empty if it is not stored
+	void readBlock(v3s16 blockpos, std::string *data);
+	// Deserializes a block without inserting it or using the node
+	// definitions, false on ignored errors. *block is NULL for old
+	// formats that need the node definitions to be read.
+	bool deSerializeBlock(v3s16 blockpos, const std::string &data,
+			MapBlock **block, NameIdMapping *nimap);
+	// Inserts a block from deSerializeBlock(), correcting its node ids with
+	// nimap, or loads it from data or the old sector files if it is NULL
+	// or a dummy block is in the way
+	MapBlock *insertLoadedBlock(v3s16 blockpos, std::string *data,
+			MapBlock *loaded, const NameIdMapping *nimap);
+
 	bool deleteBlock(v3s16 blockpos);
 
 	void updateVManip(v3s16 pos);
@@ -508,6 +590,9 @@ class ServerMap : public Map
 	*/
 	bool m_map_metadata_changed;
 	MapDatabase *dbase;
+	// Writes blocks to dbase, NULL if saving synchronously
+	MapSaveThread *m_save_thread;
+	u8 m_block_codec;
 };
 
 
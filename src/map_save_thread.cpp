@@ -0,0 +1,172 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "map_save_thread.h"
+#include "database.h"
+#include "exceptions.h"
+#include "log.h"
+#include "profiler.h"
+#include "util/timetaker.h"
+
+MapSaveThread::MapSaveThread(MapDatabase *db, u32 max_queued):
+	UpdateThread("MapSave"),
+	m_db(db),
+	m_max_queued(max_queued)
+{
+}
+
+MapSaveThread::~MapSaveThread()
+{
+	stop();
+	wait();
+
+	// Nothing is left to retry later, don't let the error out of here
+	try {
+		flush();
+	} catch (DatabaseException &e) {
+		errorstream << "MapSaveThread: Failed to write the queued blocks: "
+			<< e.what() << std::endl;
+	}
+}
+
+void MapSaveThread::saveBlock(const v3s16 &pos, const std::string &data)
+{
+	size_t queue_size;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_queue[pos] = data;
+		queue_size = m_queue.size();
+	}
+
+	g_profiler->avg("MapSave: queued blocks", queue_size);
+
+	if (queue_size >= m_max_queued) {
+		// The thread does not keep up, wait for a pass to finish
+		g_profiler->add("MapSave: queue full", 1);
+		writeQueue();
+	} else {
+		deferUpdate();
+	}
+}
+
+void MapSaveThread::loadBlock(const v3s16 &pos, std::string *data)
+{
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		std::map<v3s16, std::string>::const_iterator it = m_queue.find(pos);
+		if (it != m_queue.end()) {
+			*data = it->second;
+			return;
+		}
+		it = m_writing.find(pos);
+		if (it != m_writing.end()) {
+			*data = it->second;
+			return;
+		}
+	}
+
+	MutexAutoLock lock(m_db_mutex);
+	m_db->loadBlock(pos, data);
+}
+
+bool MapSaveThread::deleteBlock(const v3s16 &pos)
+{
+	MutexAutoLock lock(m_db_mutex);
+	{
+		MutexAutoLock queue_lock(m_queue_mutex);
+		m_queue.erase(pos);
+		// Or a retry of a failed pass would write it back
+		m_writing.erase(pos);
+	}
+	return m_db->deleteBlock(pos);
+}
+
+void MapSaveThread::listAllLoadableBlocks(std::vector<v3s16> &dst)
+{
+	flush();
+
+	MutexAutoLock lock(m_db_mutex);
+	m_db->listAllLoadableBlocks(dst);
+}
+
+void MapSaveThread::flush()
+{
+	writeQueue();
+}
+
+void MapSaveThread::doUpdate()
+{
+	try {
+		writeQueue();
+	} catch (DatabaseException &e) {
+		errorstream << "MapSaveThread: " << e.what() << std::endl;
+	}
+}
+
+void MapSaveThread::writeQueue()
+{
+	MutexAutoLock lock(m_db_mutex);
+	{
+		MutexAutoLock queue_lock(m_queue_mutex);
+		if (m_queue.empty() && m_writing.empty())
+			return;
+		if (m_writing.empty()) {
+			m_writing.swap(m_queue);
+		} else {
+			// The last pass failed, retry its blocks too
+			for (std::map<v3s16, std::string>::const_iterator
+					it = m_queue.begin(); it != m_queue.end(); ++it)
+				m_writing[it->first] = it->second;
+			m_queue.clear();
+		}
+	}
+
+	TimeTaker timer("MapSave: commit", NULL, PRECISION_MICRO);
+
+	std::vector<v3s16> failed;
+	m_db->beginSave();
+	try {
+		for (std::map<v3s16, std::string>::const_iterator
+				it = m_writing.begin(); it != m_writing.end(); ++it) {
+			if (!m_db->saveBlock(it->first, it->second)) {
+				errorstream << "MapSaveThread: Failed to save block "
+					<< PP(it->first) << std::endl;
+				failed.push_back(it->first);
+			}
+		}
+		m_db->endSave();
+	} catch (DatabaseException &e) {
+		// Leave no transaction open, the next pass writes m_writing again
+		m_db->rollbackSave();
+		throw;
+	}
+
+	g_profiler->avg("MapSave: blocks per commit", m_writing.size());
+	g_profiler->avg("MapSave: commit time [ms]",
+		timer.stop(true) / 1000.0f);
+
+	MutexAutoLock queue_lock(m_queue_mutex);
+	// Failed blocks are written with the next pass, unless newer data of
+	// them has been queued meanwhile
+	for (size_t i = 0; i < failed.size(); i++) {
+		if (m_queue.find(failed[i]) == m_queue.end())
+			m_queue[failed[i]] = m_writing[failed[i]];
+	}
+	m_writing.clear();
+}
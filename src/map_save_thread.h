@@ -0,0 +1,76 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAP_SAVE_THREAD_HEADER
+#define MAP_SAVE_THREAD_HEADER
+
+#include <map>
+#include <string>
+#include <vector>
+#include "irr_v3d.h"
+#include "util/thread.h"
+
+class MapDatabase;
+
+/*
+	Writes serialized MapBlocks to a MapDatabase on its own thread.
+
+	Each pass writes everything queued so far inside one
+	beginSave()/endSave() pair. Queuing a block that is still waiting
+	replaces the older data. When the queue is full, the caller writes
+	it itself, so a producer can't run away from the database.
+
+	While the thread exists, all access to the database has to go
+	through this class.
+*/
+class MapSaveThread : public UpdateThread
+{
+public:
+	MapSaveThread(MapDatabase *db, u32 max_queued);
+	// Writes what is still queued
+	~MapSaveThread();
+
+	void saveBlock(const v3s16 &pos, const std::string &data);
+	// Sees blocks that are queued but not written yet
+	void loadBlock(const v3s16 &pos, std::string *data);
+	bool deleteBlock(const v3s16 &pos);
+	void listAllLoadableBlocks(std::vector<v3s16> &dst);
+
+	// Writes everything queued so far before returning
+	void flush();
+
+protected:
+	virtual void doUpdate();
+
+private:
+	void writeQueue();
+
+	MapDatabase *m_db;
+	u32 m_max_queued;
+
+	// Locked while the database is used; taken before m_queue_mutex
+	Mutex m_db_mutex;
+
+	Mutex m_queue_mutex;
+	std::map<v3s16, std::string> m_queue;
+	// Blocks of the pass currently being written
+	std::map<v3s16, std::string> m_writing;
+};
+
+#endif
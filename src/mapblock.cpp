@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <algorithm>
 #include <sstream>
 #include "map.h"
 #include "light.h"
@@ -27,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "log.h"
 #include "nameidmapping.h"
+#include "threading/atomic.h"
 #include "content_mapnode.h" // For legacy name-id mapping
 #include "content_nodemeta.h" // For legacy deserialization
 #include "serialization.h"
@@ -65,6 +67,9 @@ static const char *modified_reason_strings[] = {
 	MapBlock
 */
 
+// Blocks are created by the emerge threads too
+static Atomic<u32> s_next_block_id(0);
+
 MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_parent(parent),
 		m_pos(pos),
@@ -72,10 +77,13 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_gamedef(gamedef),
 		m_modified(MOD_STATE_WRITE_NEEDED),
 		m_modified_reason(MOD_REASON_INITIAL),
+		m_id(s_next_block_id++),
+		m_modified_counter(0),
 		is_underground(false),
 		m_lighting_complete(0xFFFF),
 		m_day_night_differs(false),
 		m_day_night_differs_expired(true),
+		m_contents_expired(true),
 		m_generated(false),
 		m_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
 		m_disk_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
@@ -369,6 +377,9 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+
+	m_contents_expired = true;
+	m_modified_counter++;
 }
 
 void MapBlock::actuallyUpdateDayNightDiff()
@@ -417,6 +428,27 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	m_day_night_differs = differs;
 }
 
+void MapBlock::actuallyUpdateContents()
+{
+	m_contents_expired = false;
+	m_contents.clear();
+
+	if (data == NULL)
+		return;
+
+	// Nodes mostly come in runs, so only look up changes of content
+	content_t previous = CONTENT_IGNORE;
+	for (u32 i = 0; i < nodecount; i++) {
+		content_t c = data[i].getContent();
+		if (c == previous && !m_contents.empty())
+			continue;
+		previous = c;
+		if (std::find(m_contents.begin(), m_contents.end(), c) ==
+				m_contents.end())
+			m_contents.push_back(c);
+	}
+}
+
 void MapBlock::expireDayNightDiff()
 {
 	//INodeDefManager *nodemgr = m_gamedef->ndef();
@@ -553,7 +585,7 @@ static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
 	}
 }
 
-void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
+void MapBlock::serialize(std::ostream &os, u8 version, bool disk, u8 codec)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
@@ -577,6 +609,10 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	if (version >= 27) {
 		writeU16(os, m_lighting_complete);
 	}
+	if (version >= 29)
+		writeU8(os, codec);
+	else
+		codec = BLOCK_CODEC_ZLIB;
 
 	/*
 		Bulk node data
@@ -594,7 +630,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 		writeU8(os, content_width);
 		writeU8(os, params_width);
 		MapNode::serializeBulk(os, version, tmp_nodes, nodecount,
-				content_width, params_width, true);
+				content_width, params_width, true, codec);
 		delete[] tmp_nodes;
 	}
 	else
@@ -604,7 +640,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 		writeU8(os, content_width);
 		writeU8(os, params_width);
 		MapNode::serializeBulk(os, version, data, nodecount,
-				content_width, params_width, true);
+				content_width, params_width, true, codec);
 	}
 
 	/*
@@ -612,7 +648,8 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	*/
 	std::ostringstream oss(std::ios_base::binary);
 	m_node_metadata.serialize(oss, version, disk);
-	compressZlib(oss.str(), os);
+	std::string metadata = oss.str();
+	compressBlockData((const u8 *)metadata.c_str(), metadata.size(), os, codec);
 
 	/*
 		Data that goes to disk, but not the network
@@ -651,7 +688,8 @@ void MapBlock::serializeNetworkSpecific(std::ostream &os)
 	writeF1000(os, 0); // deprecated humidity
 }
 
-void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
+void MapBlock::deSerialize(std::istream &is, u8 version, bool disk,
+		NameIdMapping *nimap)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
@@ -659,9 +697,12 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())<<std::endl);
 
 	m_day_night_differs_expired = false;
+	m_contents_expired = true;
+	m_modified_counter++;
 
 	if(version <= 21)
 	{
+		FATAL_ERROR_IF(nimap != NULL, "Old MapBlock format needs the node ids");
 		deSerialize_pre22(is, version, disk);
 		return;
 	}
@@ -674,6 +715,13 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	else
 		m_lighting_complete = readU16(is);
 	m_generated = (flags & 0x08) ? false : true;
+	u8 codec = BLOCK_CODEC_ZLIB;
+	if (version >= 29) {
+		codec = readU8(is);
+		if (!block_codec_supported(codec))
+			throw SerializationError(std::string("MapBlock::deSerialize(): "
+					"codec not supported: ") + block_codec_name(codec));
+	}
 
 	/*
 		Bulk node data
@@ -687,7 +735,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	if(params_width != 2)
 		throw SerializationError("MapBlock::deSerialize(): invalid params_width");
 	MapNode::deSerializeBulk(is, version, data, nodecount,
-			content_width, params_width, true);
+			content_width, params_width, true, codec);
 
 	/*
 		NodeMetadata
@@ -697,7 +745,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	// Ignore errors
 	try {
 		std::ostringstream oss(std::ios_base::binary);
-		decompressZlib(is, oss);
+		decompressBlockData(is, oss, codec);
 		std::istringstream iss(oss.str(), std::ios_base::binary);
 		if (version >= 23)
 			m_node_metadata.deSerialize(iss, m_gamedef->idef());
@@ -741,9 +789,13 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 		// Dynamically re-set ids based on node names
 		TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 				<<": NameIdMapping"<<std::endl);
-		NameIdMapping nimap;
-		nimap.deSerialize(is);
-		correctBlockNodeIds(&nimap, data, m_gamedef);
+		if (nimap) {
+			nimap->deSerialize(is);
+		} else {
+			NameIdMapping block_nimap;
+			block_nimap.deSerialize(is);
+			correctBlockNodeIds(&block_nimap, data, m_gamedef);
+		}
 
 		if(version >= 25){
 			TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
@@ -756,6 +808,12 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 			<<": Done."<<std::endl);
 }
 
+void MapBlock::correctNodeIds(const NameIdMapping &nimap)
+{
+	m_contents_expired = true;
+	correctBlockNodeIds(&nimap, data, m_gamedef);
+}
+
 void MapBlock::deSerializeNetworkSpecific(std::istream &is)
 {
 	try {
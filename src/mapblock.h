@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MAPBLOCK_HEADER
 
 #include <set>
+#include <vector>
 #include "debug.h"
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -38,6 +39,7 @@ class Map;
 class NodeMetadataList;
 class IGameDef;
 class MapBlockMesh;
+class NameIdMapping;
 class VoxelManipulator;
 
 #define BLOCK_TIMESTAMP_UNDEFINED 0xffffffff
@@ -151,6 +153,7 @@ class MapBlock /*: public NodeContainer*/
 		data = new MapNode[nodecount];
 		for (u32 i = 0; i < nodecount; i++)
 			data[i] = MapNode(CONTENT_IGNORE);
+		m_contents_expired = true;
 
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
@@ -165,6 +168,7 @@ class MapBlock /*: public NodeContainer*/
 	////
 	void raiseModified(u32 mod, u32 reason=MOD_REASON_UNKNOWN)
 	{
+		m_modified_counter++;
 		if (mod > m_modified) {
 			m_modified = mod;
 			m_modified_reason = reason;
@@ -187,6 +191,21 @@ class MapBlock /*: public NodeContainer*/
 
 	std::string getModifiedReasonString();
 
+	/*
+		Changes whenever raiseModified() is called. Together with the id,
+		which is unique for every MapBlock object, it tells whether the
+		block is still the same as when it was last looked at.
+	*/
+	inline u32 getModifiedCounter()
+	{
+		return m_modified_counter;
+	}
+
+	inline u32 getId()
+	{
+		return m_id;
+	}
+
 	inline void resetModified()
 	{
 		m_modified = MOD_STATE_CLEAN;
@@ -337,6 +356,7 @@ class MapBlock /*: public NodeContainer*/
 			throw InvalidPositionException();
 
 		data[z * zstride + y * ystride + x] = n;
+		addContent(n.getContent());
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -385,6 +405,7 @@ class MapBlock /*: public NodeContainer*/
 			throw InvalidPositionException();
 
 		data[z * zstride + y * ystride + x] = n;
+		addContent(n.getContent());
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
 
@@ -433,6 +454,23 @@ class MapBlock /*: public NodeContainer*/
 		return m_day_night_differs;
 	}
 
+	////
+	//// Contents
+	////
+
+	// Rebuilds the list of content IDs present in the block.
+	void actuallyUpdateContents();
+
+	// Content IDs present in the block, each listed once.
+	// Nodes set after the list was built are added to it but never
+	// removed, so it may contain IDs that are no longer present.
+	inline const std::vector<content_t> &getContents()
+	{
+		if (m_contents_expired)
+			actuallyUpdateContents();
+		return m_contents;
+	}
+
 	////
 	//// Miscellaneous stuff
 	////
@@ -543,10 +581,19 @@ class MapBlock /*: public NodeContainer*/
 	// These don't write or read version by itself
 	// Set disk to true for on-disk format, false for over-the-network format
 	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
-	void serialize(std::ostream &os, u8 version, bool disk);
+	// The codec is only used from version 29 on, older ones use zlib.
+	void serialize(std::ostream &os, u8 version, bool disk,
+			u8 codec = BLOCK_CODEC_ZLIB);
 	// If disk == true: In addition to doing other things, will add
-	// unknown blocks from id-name mapping to wndef
-	void deSerialize(std::istream &is, u8 version, bool disk);
+	// unknown blocks from id-name mapping to wndef.
+	// If nimap is given, the node ids are left as stored and the mapping
+	// is returned for correctNodeIds(), which uses the node definitions.
+	// Only for version >= 22.
+	void deSerialize(std::istream &is, u8 version, bool disk,
+			NameIdMapping *nimap = NULL);
+	// Sets the ids of a block deserialized with a mapping to those of the
+	// node definitions, adding unknown names to them
+	void correctNodeIds(const NameIdMapping &nimap);
 
 	void serializeNetworkSpecific(std::ostream &os);
 	void deSerializeNetworkSpecific(std::istream &is);
@@ -574,6 +621,16 @@ class MapBlock /*: public NodeContainer*/
 		return getNodeRef(p.X, p.Y, p.Z);
 	}
 
+	inline void addContent(content_t c)
+	{
+		if (m_contents_expired)
+			return;
+		for (size_t i = 0; i < m_contents.size(); i++)
+			if (m_contents[i] == c)
+				return;
+		m_contents.push_back(c);
+	}
+
 public:
 	/*
 		Public member variables
@@ -626,6 +683,10 @@ class MapBlock /*: public NodeContainer*/
 	u32 m_modified;
 	u32 m_modified_reason;
 
+	// See getModifiedCounter()
+	u32 m_id;
+	u32 m_modified_counter;
+
 	/*
 		When propagating sunlight and the above block doesn't exist,
 		sunlight is assumed if this is false.
@@ -650,6 +711,10 @@ class MapBlock /*: public NodeContainer*/
 	bool m_day_night_differs;
 	bool m_day_night_differs_expired;
 
+	// See getContents()
+	std::vector<content_t> m_contents;
+	bool m_contents_expired;
+
 	bool m_generated;
 
 	/*
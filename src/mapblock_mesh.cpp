@@ -38,12 +38,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 MeshMakeData::MeshMakeData(Client *client, bool use_shaders,
 		bool use_tangent_vertices):
-	m_vmanip(),
+	m_origin(-1337,-1337,-1337),
 	m_blockpos(-1337,-1337,-1337),
 	m_crack_pos_relative(-1337, -1337, -1337),
 	m_smooth_lighting(false),
 	m_show_hud(false),
 	m_client(client),
+	m_ndef(client ? client->ndef() : NULL),
 	m_use_shaders(use_shaders),
 	m_use_tangent_vertices(use_tangent_vertices)
 {}
@@ -51,23 +52,36 @@ MeshMakeData::MeshMakeData(Client *client, bool use_shaders,
 void MeshMakeData::fillBlockDataBegin(const v3s16 &blockpos)
 {
 	m_blockpos = blockpos;
+	m_origin = m_blockpos * MAP_BLOCKSIZE - v3s16(1,1,1);
+	m_crack_pos_relative = v3s16(-1337, -1337, -1337);
 
-	v3s16 blockpos_nodes = m_blockpos*MAP_BLOCKSIZE;
-
-	m_vmanip.clear();
-	VoxelArea voxel_area(blockpos_nodes - v3s16(1,1,1) * MAP_BLOCKSIZE,
-			blockpos_nodes + v3s16(1,1,1) * MAP_BLOCKSIZE*2-v3s16(1,1,1));
-	m_vmanip.addArea(voxel_area);
+	MapNode ignore(CONTENT_IGNORE);
+	for (u32 i = 0; i < ARRLEN(m_nodes); i++)
+		m_nodes[i] = ignore;
 }
 
 void MeshMakeData::fillBlockData(const v3s16 &block_offset, MapNode *data)
 {
-	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
-	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
-
-	v3s16 bp = m_blockpos + block_offset;
-	v3s16 blockpos_nodes = bp * MAP_BLOCKSIZE;
-	m_vmanip.copyFrom(data, data_area, v3s16(0,0,0), blockpos_nodes, data_size);
+	// The part of the block that is in the snapshot, relative to the
+	// block. The neighbors only give their nodes next to the block.
+	v3s16 min(0,0,0), max(MAP_BLOCKSIZE-1, MAP_BLOCKSIZE-1, MAP_BLOCKSIZE-1);
+	if (block_offset.X < 0) min.X = max.X;
+	if (block_offset.X > 0) max.X = min.X;
+	if (block_offset.Y < 0) min.Y = max.Y;
+	if (block_offset.Y > 0) max.Y = min.Y;
+	if (block_offset.Z < 0) min.Z = max.Z;
+	if (block_offset.Z > 0) max.Z = min.Z;
+
+	// Position of the block's first node in the snapshot
+	v3s16 off = block_offset * MAP_BLOCKSIZE + v3s16(1,1,1);
+	size_t row_size = (max.X - min.X + 1) * sizeof(MapNode);
+	for (s16 z = min.Z; z <= max.Z; z++)
+	for (s16 y = min.Y; y <= max.Y; y++) {
+		memcpy(&m_nodes[((z + off.Z) * SNAPSHOT_SIZE + y + off.Y) *
+				SNAPSHOT_SIZE + min.X + off.X],
+			&data[(z * MAP_BLOCKSIZE + y) * MAP_BLOCKSIZE + min.X],
+			row_size);
+	}
 }
 
 void MeshMakeData::fill(MapBlock *block)
@@ -91,32 +105,13 @@ void MeshMakeData::fill(MapBlock *block)
 void MeshMakeData::fillSingleNode(MapNode *node)
 {
 	m_blockpos = v3s16(0,0,0);
+	m_origin = v3s16(-1,-1,-1);
 
-	v3s16 blockpos_nodes = v3s16(0,0,0);
-	VoxelArea area(blockpos_nodes-v3s16(1,1,1)*MAP_BLOCKSIZE,
-			blockpos_nodes+v3s16(1,1,1)*MAP_BLOCKSIZE*2-v3s16(1,1,1));
-	s32 volume = area.getVolume();
-	s32 our_node_index = area.index(1,1,1);
-
-	// Allocate this block + neighbors
-	m_vmanip.clear();
-	m_vmanip.addArea(area);
-
-	// Fill in data
-	MapNode *data = new MapNode[volume];
-	for(s32 i = 0; i < volume; i++)
-	{
-		if(i == our_node_index)
-		{
-			data[i] = *node;
-		}
-		else
-		{
-			data[i] = MapNode(CONTENT_AIR, LIGHT_MAX, 0);
-		}
-	}
-	m_vmanip.copyFrom(data, area, area.MinEdge, area.MinEdge, area.getExtent());
-	delete[] data;
+	// Put the node at (1,1,1) into air
+	MapNode air(CONTENT_AIR, LIGHT_MAX, 0);
+	for (u32 i = 0; i < ARRLEN(m_nodes); i++)
+		m_nodes[i] = air;
+	m_nodes[(2 * SNAPSHOT_SIZE + 2) * SNAPSHOT_SIZE + 2] = *node;
 }
 
 void MeshMakeData::setCrack(int crack_level, v3s16 crack_pos)
@@ -220,7 +215,7 @@ static u16 getSmoothLightCombined(v3s16 p, MeshMakeData *data)
 		v3s16(1,1,1),
 	};
 
-	INodeDefManager *ndef = data->m_client->ndef();
+	INodeDefManager *ndef = data->m_ndef;
 
 	u16 ambient_occlusion = 0;
 	u16 light_count = 0;
@@ -230,7 +225,7 @@ static u16 getSmoothLightCombined(v3s16 p, MeshMakeData *data)
 
 	for (u32 i = 0; i < 8; i++)
 	{
-		MapNode n = data->m_vmanip.getNodeNoExNoEmerge(p - dirs8[i]);
+		MapNode n = data->getNodeNoEx(p - dirs8[i]);
 
 		// if it's CONTENT_IGNORE we can't do any light calculations
 		if (n.getContent() == CONTENT_IGNORE) {
@@ -420,19 +415,6 @@ static void getNodeVertexDirs(v3s16 dir, v3s16 *vertex_dirs)
 	}
 }
 
-struct FastFace
-{
-	TileLayer layer;
-	video::S3DVertex vertices[4]; // Precalculated vertices
-	/*!
-	 * The face is divided into two triangles. If this is true,
-	 * vertices 0 and 2 are connected, othervise vertices 1 and 3
-	 * are connected.
-	 */
-	bool vertex_0_2_connected;
-	u8 layernum;
-};
-
 static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li3,
 	v3f p, v3s16 dir, v3f scale, std::vector<FastFace> &dest)
 {
@@ -577,10 +559,12 @@ static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li
 		vertex_pos[i] += pos;
 	}
 
-	f32 abs_scale = 1.0;
-	if     (scale.X < 0.999 || scale.X > 1.001) abs_scale = scale.X;
-	else if(scale.Y < 0.999 || scale.Y > 1.001) abs_scale = scale.Y;
-	else if(scale.Z < 0.999 || scale.Z > 1.001) abs_scale = scale.Z;
+	// Merged faces repeat the texture along the U (vertex 1 to 0)
+	// and V (vertex 2 to 1) axes of the face
+	v3s16 u_dir = vertex_dirs[0] - vertex_dirs[1];
+	v3s16 v_dir = vertex_dirs[1] - vertex_dirs[2];
+	f32 u_scale = u_dir.X != 0 ? scale.X : u_dir.Y != 0 ? scale.Y : scale.Z;
+	f32 v_scale = v_dir.X != 0 ? scale.X : v_dir.Y != 0 ? scale.Y : scale.Z;
 
 	v3f normal(dir.X, dir.Y, dir.Z);
 
@@ -597,10 +581,10 @@ static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li
 			< abs(day[1] - day[3]) + abs(night[1] - night[3]);
 
 	v2f32 f[4] = {
-		core::vector2d<f32>(x0 + w * abs_scale, y0 + h),
-		core::vector2d<f32>(x0, y0 + h),
+		core::vector2d<f32>(x0 + w * u_scale, y0 + h * v_scale),
+		core::vector2d<f32>(x0, y0 + h * v_scale),
 		core::vector2d<f32>(x0, y0),
-		core::vector2d<f32>(x0 + w * abs_scale, y0) };
+		core::vector2d<f32>(x0 + w * u_scale, y0) };
 
 	for (int layernum = 0; layernum < MAX_TILE_LAYERS; layernum++) {
 		const TileLayer *layer = &tile.layers[layernum];
@@ -691,7 +675,7 @@ static u8 face_contents(content_t m1, content_t m2, bool *equivalent,
 */
 void getNodeTileN(MapNode mn, v3s16 p, u8 tileindex, MeshMakeData *data, TileSpec &tile)
 {
-	INodeDefManager *ndef = data->m_client->ndef();
+	INodeDefManager *ndef = data->m_ndef;
 	const ContentFeatures &f = ndef->get(mn);
 	tile = f.tiles[tileindex];
 	TileLayer *top_layer = NULL;
@@ -713,7 +697,7 @@ void getNodeTileN(MapNode mn, v3s16 p, u8 tileindex, MeshMakeData *data, TileSpe
 */
 void getNodeTile(MapNode mn, v3s16 p, v3s16 dir, MeshMakeData *data, TileSpec &tile)
 {
-	INodeDefManager *ndef = data->m_client->ndef();
+	INodeDefManager *ndef = data->m_ndef;
 
 	// Direction must be (1,0,0), (-1,0,0), (0,1,0), (0,-1,0),
 	// (0,0,1), (0,0,-1) or (0,0,0)
@@ -785,11 +769,10 @@ static void getTileInfo(
 		TileSpec &tile
 	)
 {
-	VoxelManipulator &vmanip = data->m_vmanip;
-	INodeDefManager *ndef = data->m_client->ndef();
+	INodeDefManager *ndef = data->m_ndef;
 	v3s16 blockpos_nodes = data->m_blockpos * MAP_BLOCKSIZE;
 
-	const MapNode &n0 = vmanip.getNodeRefUnsafe(blockpos_nodes + p);
+	const MapNode &n0 = data->getNodeRefUnsafe(blockpos_nodes + p);
 
 	// Don't even try to get n1 if n0 is already CONTENT_IGNORE
 	if (n0.getContent() == CONTENT_IGNORE) {
@@ -797,7 +780,7 @@ static void getTileInfo(
 		return;
 	}
 
-	const MapNode &n1 = vmanip.getNodeRefUnsafeCheckFlags(blockpos_nodes + p + face_dir);
+	const MapNode &n1 = data->getNodeRefUnsafe(blockpos_nodes + p + face_dir);
 
 	if (n1.getContent() == CONTENT_IGNORE) {
 		makes_face = false;
@@ -853,6 +836,22 @@ static void getTileInfo(
 	}
 }
 
+/*
+	Faces of neighboring nodes that are drawn as one face: a run of
+	faces in a row, or a rectangle of them when rows are merged too.
+*/
+struct FaceStrip
+{
+	TileSpec tile;
+	u16 lights[4];
+	// Corrected position and face direction of the first node
+	v3s16 p;
+	v3s16 face_dir;
+	// Faces along the row and rows
+	u16 length;
+	u16 rows;
+};
+
 /*
 	startpos:
 	translate_dir: unit vector with only one of x, y or z
@@ -862,10 +861,8 @@ static void updateFastFaceRow(
 		MeshMakeData *data,
 		v3s16 startpos,
 		v3s16 translate_dir,
-		v3f translate_dir_f,
 		v3s16 face_dir,
-		v3f face_dir_f,
-		std::vector<FastFace> &dest)
+		std::vector<FaceStrip> &strips)
 {
 	v3s16 p = startpos;
 
@@ -916,33 +913,18 @@ static void updateFastFaceRow(
 
 		if (next_is_different) {
 			/*
-				Create a face if there should be one
+				Add a strip if there should be a face
 			*/
 			if (makes_face) {
-				// Floating point conversion of the position vector
-				v3f pf(p_corrected.X, p_corrected.Y, p_corrected.Z);
-				// Center point of face (kind of)
-				v3f sp = pf -
-					((f32)continuous_tiles_count / 2.0f - 0.5f) * translate_dir_f;
-				v3f scale(1,1,1);
-
-				if(translate_dir.X != 0) {
-					scale.X = continuous_tiles_count;
-				}
-				if(translate_dir.Y != 0) {
-					scale.Y = continuous_tiles_count;
-				}
-				if(translate_dir.Z != 0) {
-					scale.Z = continuous_tiles_count;
-				}
-
-				makeFastFace(tile, lights[0], lights[1], lights[2], lights[3],
-						sp, face_dir_corrected, scale, dest);
-
-				g_profiler->avg("Meshgen: faces drawn by tiling", 0);
-				for(int i = 1; i < continuous_tiles_count; i++){
-					g_profiler->avg("Meshgen: faces drawn by tiling", 1);
-				}
+				strips.push_back(FaceStrip());
+				FaceStrip &strip = strips.back();
+				strip.tile = tile;
+				std::memcpy(strip.lights, lights, ARRLEN(lights) * sizeof(u16));
+				strip.p = p_corrected -
+					translate_dir * (continuous_tiles_count - 1);
+				strip.face_dir = face_dir_corrected;
+				strip.length = continuous_tiles_count;
+				strip.rows = 1;
 			}
 
 			continuous_tiles_count = 1;
@@ -958,52 +940,135 @@ static void updateFastFaceRow(
 	}
 }
 
-static void updateAllFastFaceRows(MeshMakeData *data,
+static void makeFaceStrip(const FaceStrip &strip, v3s16 translate_dir,
+		v3s16 row_dir, std::vector<FastFace> &dest)
+{
+	v3f translate_dir_f(translate_dir.X, translate_dir.Y, translate_dir.Z);
+	v3f row_dir_f(row_dir.X, row_dir.Y, row_dir.Z);
+	// Floating point conversion of the position vector
+	v3f pf(strip.p.X, strip.p.Y, strip.p.Z);
+	// Center point of face (kind of)
+	v3f sp = pf + translate_dir_f * ((strip.length - 1) / 2.0f) +
+		row_dir_f * ((strip.rows - 1) / 2.0f);
+	// The directions are positive and along different axes
+	v3f scale = v3f(1, 1, 1) + translate_dir_f * (f32)(strip.length - 1) +
+		row_dir_f * (f32)(strip.rows - 1);
+
+	makeFastFace(strip.tile, strip.lights[0], strip.lights[1],
+			strip.lights[2], strip.lights[3],
+			sp, strip.face_dir, scale, dest);
+
+	g_profiler->avg("Meshgen: faces drawn by tiling", 0);
+	for (int i = 1; i < strip.length * strip.rows; i++)
+		g_profiler->avg("Meshgen: faces drawn by tiling", 1);
+}
+
+// Whether next continues strip in the next row with the same extent
+static bool can_merge_rows(const FaceStrip &strip, const FaceStrip &next,
+		v3s16 row_dir)
+{
+	return next.length == strip.length
+		&& next.p == strip.p + row_dir * strip.rows
+		&& next.face_dir == strip.face_dir
+		&& memcmp(next.lights, strip.lights, ARRLEN(strip.lights) * sizeof(u16)) == 0
+		&& next.tile.isTileable(strip.tile);
+}
+
+/*
+	Makes the faces of the rows startpos + row_dir * i along translate_dir.
+	With merge_rows, a strip that continues one of the previous row
+	extends it, so flat areas become single faces (greedy meshing).
+*/
+static void updateFastFaceSlice(
+		MeshMakeData *data,
+		v3s16 startpos,
+		v3s16 translate_dir,
+		v3s16 row_dir,
+		v3s16 face_dir,
+		bool merge_rows,
+		std::vector<FastFace> &dest)
+{
+	std::vector<FaceStrip> open_strips;
+	std::vector<FaceStrip> next_open_strips;
+	std::vector<FaceStrip> row;
+	std::vector<bool> merged;
+
+	for (s16 i = 0; i < MAP_BLOCKSIZE; i++) {
+		row.clear();
+		updateFastFaceRow(data, startpos + row_dir * i, translate_dir,
+				face_dir, row);
+
+		if (!merge_rows) {
+			for (size_t j = 0; j < row.size(); j++)
+				makeFaceStrip(row[j], translate_dir, row_dir, dest);
+			continue;
+		}
+
+		merged.assign(row.size(), false);
+		next_open_strips.clear();
+		for (size_t k = 0; k < open_strips.size(); k++) {
+			FaceStrip &strip = open_strips[k];
+			bool extended = false;
+			for (size_t j = 0; j < row.size(); j++) {
+				if (merged[j] || !can_merge_rows(strip, row[j], row_dir))
+					continue;
+				merged[j] = true;
+				strip.rows++;
+				next_open_strips.push_back(strip);
+				extended = true;
+				break;
+			}
+			if (!extended)
+				makeFaceStrip(strip, translate_dir, row_dir, dest);
+		}
+		for (size_t j = 0; j < row.size(); j++) {
+			if (!merged[j])
+				next_open_strips.push_back(row[j]);
+		}
+		open_strips.swap(next_open_strips);
+	}
+
+	for (size_t k = 0; k < open_strips.size(); k++)
+		makeFaceStrip(open_strips[k], translate_dir, row_dir, dest);
+}
+
+void updateAllFastFaceRows(MeshMakeData *data, bool merge_rows,
 		std::vector<FastFace> &dest)
 {
 	/*
 		Go through every y,z and get top(y+) faces in rows of x+
 	*/
 	for(s16 y = 0; y < MAP_BLOCKSIZE; y++) {
-		for(s16 z = 0; z < MAP_BLOCKSIZE; z++) {
-			updateFastFaceRow(data,
-					v3s16(0,y,z),
-					v3s16(1,0,0), //dir
-					v3f  (1,0,0),
-					v3s16(0,1,0), //face dir
-					v3f  (0,1,0),
-					dest);
-		}
+		updateFastFaceSlice(data,
+				v3s16(0,y,0),
+				v3s16(1,0,0), //dir
+				v3s16(0,0,1), //row dir
+				v3s16(0,1,0), //face dir
+				merge_rows, dest);
 	}
 
 	/*
 		Go through every x,y and get right(x+) faces in rows of z+
 	*/
 	for(s16 x = 0; x < MAP_BLOCKSIZE; x++) {
-		for(s16 y = 0; y < MAP_BLOCKSIZE; y++) {
-			updateFastFaceRow(data,
-					v3s16(x,y,0),
-					v3s16(0,0,1), //dir
-					v3f  (0,0,1),
-					v3s16(1,0,0), //face dir
-					v3f  (1,0,0),
-					dest);
-		}
+		updateFastFaceSlice(data,
+				v3s16(x,0,0),
+				v3s16(0,0,1), //dir
+				v3s16(0,1,0), //row dir
+				v3s16(1,0,0), //face dir
+				merge_rows, dest);
 	}
 
 	/*
 		Go through every y,z and get back(z+) faces in rows of x+
 	*/
 	for(s16 z = 0; z < MAP_BLOCKSIZE; z++) {
-		for(s16 y = 0; y < MAP_BLOCKSIZE; y++) {
-			updateFastFaceRow(data,
-					v3s16(0,y,z),
-					v3s16(1,0,0), //dir
-					v3f  (1,0,0),
-					v3s16(0,0,1), //face dir
-					v3f  (0,0,1),
-					dest);
-		}
+		updateFastFaceSlice(data,
+				v3s16(0,0,z),
+				v3s16(1,0,0), //dir
+				v3s16(0,1,0), //row dir
+				v3s16(0,0,1), //face dir
+				merge_rows, dest);
 	}
 }
 
@@ -1031,10 +1096,15 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 
 	if (g_settings->getBool("enable_minimap")) {
 		m_minimap_mapblock = new MinimapMapblock;
-		m_minimap_mapblock->getMinimapNodes(
-			&data->m_vmanip, data->m_blockpos * MAP_BLOCKSIZE);
+		m_minimap_mapblock->getMinimapNodes(data);
 	}
 
+	m_face_connectivity = voxalgo::get_face_connectivity(
+		&data->getNodeRefUnsafe(data->m_blockpos * MAP_BLOCKSIZE),
+		MeshMakeData::SNAPSHOT_SIZE,
+		MeshMakeData::SNAPSHOT_SIZE * MeshMakeData::SNAPSHOT_SIZE,
+		m_client->ndef());
+
 	// 4-21ms for MAP_BLOCKSIZE=16  (NOTE: probably outdated)
 	// 24-155ms for MAP_BLOCKSIZE=32  (NOTE: probably outdated)
 	//TimeTaker timer1("MapBlockMesh()");
@@ -1052,8 +1122,10 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 	{
 		// 4-23ms for MAP_BLOCKSIZE=16  (NOTE: probably outdated)
 		//TimeTaker timer2("updateAllFastFaceRows()");
-		updateAllFastFaceRows(data, fastfaces_new);
+		updateAllFastFaceRows(data, g_settings->getBool("greedy_meshing"),
+				fastfaces_new);
 	}
+	g_profiler->avg("Meshgen: fast faces", fastfaces_new.size());
 	// End of slow part
 
 	/*
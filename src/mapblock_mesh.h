@@ -22,12 +22,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "irrlichttypes_extrabloated.h"
 #include "client/tile.h"
+#include "constants.h"
 #include "voxel.h"
+#include "voxelalgorithms.h"
 #include "util/cpp11_container.h"
 #include <map>
 
 class Client;
 class IShaderSource;
+class INodeDefManager;
 
 /*
 	Mesh making stuff
@@ -39,13 +42,21 @@ struct MinimapMapblock;
 
 struct MeshMakeData
 {
-	VoxelManipulator m_vmanip;
+	// Edge length of the node snapshot: the block and a one node border
+	static const s16 SNAPSHOT_SIZE = MAP_BLOCKSIZE + 2;
+
+	// Nodes around the block, indexed by position relative to m_origin.
+	// Missing neighbors are CONTENT_IGNORE.
+	MapNode m_nodes[SNAPSHOT_SIZE * SNAPSHOT_SIZE * SNAPSHOT_SIZE];
+	v3s16 m_origin;
 	v3s16 m_blockpos;
 	v3s16 m_crack_pos_relative;
 	bool m_smooth_lighting;
 	bool m_show_hud;
 
 	Client *m_client;
+	// Node definitions of m_client, set by the tests that have no client
+	INodeDefManager *m_ndef;
 	bool m_use_shaders;
 	bool m_use_tangent_vertices;
 
@@ -54,10 +65,34 @@ struct MeshMakeData
 
 	/*
 		Copy block data manually (to allow optimizations by the caller)
+		This can be called again to reuse the MeshMakeData.
 	*/
 	void fillBlockDataBegin(const v3s16 &blockpos);
 	void fillBlockData(const v3s16 &block_offset, MapNode *data);
 
+	/*
+		Get a node by map position. p must be in the block or in the
+		one node thick border around it.
+	*/
+	inline const MapNode &getNodeRefUnsafe(const v3s16 &p) const
+	{
+		v3s16 rp = p - m_origin;
+		return m_nodes[(rp.Z * SNAPSHOT_SIZE + rp.Y) * SNAPSHOT_SIZE + rp.X];
+	}
+
+	/*
+		Get a node by map position, CONTENT_IGNORE if p is too far
+		from the block.
+	*/
+	inline MapNode getNodeNoEx(const v3s16 &p) const
+	{
+		v3s16 rp = p - m_origin;
+		if ((u16)rp.X >= SNAPSHOT_SIZE || (u16)rp.Y >= SNAPSHOT_SIZE ||
+				(u16)rp.Z >= SNAPSHOT_SIZE)
+			return MapNode(CONTENT_IGNORE);
+		return m_nodes[(rp.Z * SNAPSHOT_SIZE + rp.Y) * SNAPSHOT_SIZE + rp.X];
+	}
+
 	/*
 		Copy central data directly from block, and other data from
 		parent of block.
@@ -136,9 +171,18 @@ class MapBlockMesh
 
 	void updateCameraOffset(v3s16 camera_offset);
 
+	// Whether the view can pass through the block from face a to face b,
+	// faces are indices of g_6dirs
+	bool isFaceConnected(u8 a, u8 b) const
+	{
+		return m_face_connectivity & voxalgo::face_connection_bit(a, b);
+	}
+
 private:
 	scene::IMesh *m_mesh[MAX_TILE_LAYERS];
 	MinimapMapblock *m_minimap_mapblock;
+	// Faces connected through the block, see voxalgo::get_face_connectivity()
+	u16 m_face_connectivity;
 	Client *m_client;
 	video::IVideoDriver *m_driver;
 	ITextureSource *m_tsrc;
@@ -272,5 +316,23 @@ void final_color_blend(video::SColor *result,
 void getNodeTileN(MapNode mn, v3s16 p, u8 tileindex, MeshMakeData *data, TileSpec &tile);
 void getNodeTile(MapNode mn, v3s16 p, v3s16 dir, MeshMakeData *data, TileSpec &tile);
 
+struct FastFace
+{
+	TileLayer layer;
+	video::S3DVertex vertices[4]; // Precalculated vertices
+	/*!
+	 * The face is divided into two triangles. If this is true,
+	 * vertices 0 and 2 are connected, othervise vertices 1 and 3
+	 * are connected.
+	 */
+	bool vertex_0_2_connected;
+	u8 layernum;
+};
+
+// Makes the faces between the cube-like nodes of the block and
+// its neighbors. With merge_rows, flat areas become single faces.
+void updateAllFastFaceRows(MeshMakeData *data, bool merge_rows,
+		std::vector<FastFace> &dest);
+
 #endif
 
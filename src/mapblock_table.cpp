@@ -0,0 +1,154 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapblock_table.h"
+#include "mapblock.h"
+
+// Capacity of the first allocation, must be a power of two
+#define MAPBLOCK_TABLE_MIN_CAPACITY 64
+
+MapBlockTable::MapBlockTable():
+	m_mask(0),
+	m_shift(64),
+	m_count(0)
+{
+}
+
+void MapBlockTable::insert(MapBlock *block)
+{
+	assert(block);
+
+	// Keep at least half of the slots free
+	if ((m_count + 1) * 2 > m_slots.size())
+		resize(MYMAX(m_slots.size() * 2, MAPBLOCK_TABLE_MIN_CAPACITY));
+
+	u64 key = packPos(block->getPos());
+	u32 i = home(key);
+	while (m_slots[i].block) {
+		assert(m_slots[i].key != key);
+		i = (i + 1) & m_mask;
+	}
+	m_slots[i].key = key;
+	m_slots[i].block = block;
+	m_count++;
+}
+
+bool MapBlockTable::erase(v3s16 p)
+{
+	if (m_count == 0)
+		return false;
+
+	u64 key = packPos(p);
+	u32 i = home(key);
+	while (m_slots[i].key != key || !m_slots[i].block) {
+		if (!m_slots[i].block)
+			return false;
+		i = (i + 1) & m_mask;
+	}
+
+	// Move back the following entries that would no longer be found
+	// behind the free slot
+	for (u32 j = (i + 1) & m_mask; m_slots[j].block; j = (j + 1) & m_mask) {
+		u32 k = home(m_slots[j].key);
+		// Stays if its home is cyclically in (i, j]
+		bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+		if (stays)
+			continue;
+		m_slots[i] = m_slots[j];
+		i = j;
+	}
+	m_slots[i].key = 0;
+	m_slots[i].block = NULL;
+	m_count--;
+	return true;
+}
+
+void MapBlockTable::clear()
+{
+	m_slots.clear();
+	m_mask = 0;
+	m_shift = 64;
+	m_count = 0;
+}
+
+void MapBlockTable::getBlocks(std::vector<MapBlock *> &dest) const
+{
+	dest.reserve(dest.size() + m_count);
+	for (size_t i = 0; i < m_slots.size(); i++) {
+		if (m_slots[i].block)
+			dest.push_back(m_slots[i].block);
+	}
+}
+
+void MapBlockTable::getBlocksInArea(v3s16 minp, v3s16 maxp,
+		std::vector<MapBlock *> &dest) const
+{
+	if (m_count == 0 || minp.X > maxp.X || minp.Y > maxp.Y || minp.Z > maxp.Z)
+		return;
+
+	u64 volume = (u64)(maxp.X - minp.X + 1) * (maxp.Y - minp.Y + 1) *
+			(maxp.Z - minp.Z + 1);
+
+	// Scanning all slots is cheaper than looking up a large area
+	if (volume * 4 > m_slots.size()) {
+		for (size_t i = 0; i < m_slots.size(); i++) {
+			MapBlock *block = m_slots[i].block;
+			if (!block)
+				continue;
+			v3s16 p = block->getPos();
+			if (p.X >= minp.X && p.X <= maxp.X &&
+					p.Y >= minp.Y && p.Y <= maxp.Y &&
+					p.Z >= minp.Z && p.Z <= maxp.Z)
+				dest.push_back(block);
+		}
+		return;
+	}
+
+	for (s32 z = minp.Z; z <= maxp.Z; z++)
+	for (s32 y = minp.Y; y <= maxp.Y; y++)
+	for (s32 x = minp.X; x <= maxp.X; x++) {
+		if (MapBlock *block = get(v3s16(x, y, z)))
+			dest.push_back(block);
+	}
+}
+
+void MapBlockTable::resize(u32 capacity)
+{
+	std::vector<Slot> old_slots;
+	old_slots.swap(m_slots);
+
+	Slot empty;
+	empty.key = 0;
+	empty.block = NULL;
+	m_slots.resize(capacity, empty);
+	m_mask = capacity - 1;
+	m_shift = 64;
+	for (u32 c = capacity; c > 1; c >>= 1)
+		m_shift--;
+
+	for (size_t i = 0; i < old_slots.size(); i++) {
+		const Slot &slot = old_slots[i];
+		if (!slot.block)
+			continue;
+		u32 j = home(slot.key);
+		while (m_slots[j].block)
+			j = (j + 1) & m_mask;
+		m_slots[j] = slot;
+	}
+}
@@ -0,0 +1,94 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPBLOCK_TABLE_HEADER
+#define MAPBLOCK_TABLE_HEADER
+
+#include <vector>
+#include "irr_v3d.h"
+
+class MapBlock;
+
+/*
+	Hash table of MapBlocks by block position, with open addressing
+	and linear probing. Positions are packed into one 64-bit key, which
+	is stored next to the block so probing never touches the blocks.
+*/
+class MapBlockTable
+{
+public:
+	MapBlockTable();
+
+	MapBlock *get(v3s16 p) const
+	{
+		if (m_count == 0)
+			return NULL;
+		u64 key = packPos(p);
+		for (u32 i = home(key);; i = (i + 1) & m_mask) {
+			const Slot &slot = m_slots[i];
+			if (!slot.block)
+				return NULL;
+			if (slot.key == key)
+				return slot.block;
+		}
+	}
+
+	// There must not be a block at the same position yet
+	void insert(MapBlock *block);
+	// Returns false if there was no block at p
+	bool erase(v3s16 p);
+	void clear();
+
+	size_t size() const { return m_count; }
+
+	// Appends all blocks, in no particular order
+	void getBlocks(std::vector<MapBlock *> &dest) const;
+	// Appends the blocks between minp and maxp (inclusive),
+	// in no particular order
+	void getBlocksInArea(v3s16 minp, v3s16 maxp,
+			std::vector<MapBlock *> &dest) const;
+
+private:
+	struct Slot
+	{
+		u64 key;
+		// NULL if the slot is free
+		MapBlock *block;
+	};
+
+	static u64 packPos(v3s16 p)
+	{
+		return (u64)(u16)p.X | (u64)(u16)p.Y << 16 | (u64)(u16)p.Z << 32;
+	}
+
+	u32 home(u64 key) const
+	{
+		// Fibonacci hashing, the top bits are the best mixed
+		return (u32)((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+	}
+
+	void resize(u32 capacity);
+
+	std::vector<Slot> m_slots;
+	u32 m_mask;
+	u32 m_shift;
+	size_t m_count;
+};
+
+#endif
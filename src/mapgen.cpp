@@ -605,6 +605,7 @@ MapgenBasic::MapgenBasic(int mapgenid, MapgenParams *params, EmergeManager *emer
 	// TODO(hmmmm): should we have a way to disable biomemanager biomes?
 	biomegen = m_bmgr->createBiomeGen(BIOMEGEN_ORIGINAL, params->bparams, csize);
 	biomemap = biomegen->biomemap;
+	biomegen->noise_cache = &noise_cache;
 
 	//// Look up some commonly used content
 	c_stone              = ndef->getId("mapgen_stone");
@@ -653,6 +654,8 @@ MapgenBasic::~MapgenBasic()
 
 MgStoneType MapgenBasic::generateBiomes()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen biomes", SPT_AVG);
+
 	// can't generate biomes without a biome generator!
 	assert(biomegen);
 	assert(biomemap);
@@ -847,6 +850,8 @@ void MapgenBasic::dustTopNodes()
 
 void MapgenBasic::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen caves", SPT_AVG);
+
 	if (max_stone_y < node_min.Y)
 		return;
 
@@ -883,6 +888,8 @@ bool MapgenBasic::generateCaverns(s16 max_stone_y)
 
 void MapgenBasic::generateDungeons(s16 max_stone_y, MgStoneType stone_type)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen dungeons", SPT_AVG);
+
 	if (max_stone_y < node_min.Y)
 		return;
 
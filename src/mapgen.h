@@ -192,6 +192,8 @@ class Mapgen {
 
 	BiomeGen *biomegen;
 	GenerateNotifier gennotify;
+	// Noise maps of the chunk being generated
+	NoiseMapCache noise_cache;
 
 	Mapgen();
 	Mapgen(int mapgenid, MapgenParams *params, EmergeManager *emerge);
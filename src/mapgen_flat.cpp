@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_flat.h"
 
 
@@ -254,6 +255,8 @@ void MapgenFlat::generateBedrock()
 
 s16 MapgenFlat::generateTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	MapNode n_air(CONTENT_AIR);
 	MapNode n_stone(c_stone);
 	MapNode n_bedrock(c_bedrock);
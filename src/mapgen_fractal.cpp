@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_fractal.h"
 
 
@@ -360,6 +361,8 @@ bool MapgenFractal::getFractalAtPoint(s16 x, s16 y, s16 z)
 
 s16 MapgenFractal::generateTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	MapNode n_air(CONTENT_AIR);
 	MapNode n_stone(c_stone);
 	MapNode n_water(c_water_source);
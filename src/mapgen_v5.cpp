@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_v5.h"
 
 
@@ -249,6 +250,8 @@ void MapgenV5::makeChunk(BlockMakeData *data)
 
 int MapgenV5::generateBaseTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	u32 index = 0;
 	u32 index2d = 0;
 	int stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
@@ -38,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "treegen.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_v6.h"
 
 
@@ -666,6 +667,8 @@ void MapgenV6::calculateNoise()
 
 int MapgenV6::generateGround()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	//TimeTaker timer1("Generating ground level");
 	MapNode n_air(CONTENT_AIR), n_water_source(c_water_source);
 	MapNode n_stone(c_stone), n_desert_stone(c_desert_stone);
@@ -1084,6 +1087,8 @@ void MapgenV6::growGrass() // Add surface nodes
 
 void MapgenV6::generateCaves(int max_stone_y)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen caves", SPT_AVG);
+
 	float cave_amount = NoisePerlin2D(np_cave, node_min.X, node_min.Y, seed);
 	int volume_nodes = (node_max.X - node_min.X + 1) *
 					   (node_max.Y - node_min.Y + 1) * MAP_BLOCKSIZE;
@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_v7.h"
 
 
@@ -445,6 +446,8 @@ void MapgenV7::floatBaseExtentFromMap(s16 *float_base_min, s16 *float_base_max,
 
 int MapgenV7::generateTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	MapNode n_air(CONTENT_AIR);
 	MapNode n_stone(c_stone);
 	MapNode n_water(c_water_source);
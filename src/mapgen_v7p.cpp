@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_v7p.h"
 
 
@@ -318,6 +319,8 @@ void MapgenV7P::generateBedrock()
 
 int MapgenV7P::generateTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	MapNode n_stone(c_stone);
 	MapNode n_bedrock(c_bedrock);
 	MapNode n_water(c_water_source);
@@ -413,6 +416,8 @@ void MapgenV7P::generateRidgeTerrain()
 
 void MapgenV7P::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen caves", SPT_AVG);
+
 	if (max_stone_y < node_min.Y)
 		return;
 
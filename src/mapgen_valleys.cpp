@@ -39,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_biome.h"
 #include "mg_ore.h"
 #include "mg_decoration.h"
+#include "profiler.h"
 #include "mapgen_valleys.h"
 #include "cavegen.h"
 
@@ -469,6 +470,8 @@ float MapgenValleys::terrainLevelAtPoint(s16 x, s16 z)
 
 int MapgenValleys::generateTerrain()
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen terrain", SPT_AVG);
+
 	// Raising this reduces the rate of evaporation.
 	static const float evaporation = 300.f;
 	// from the lua
@@ -593,6 +596,8 @@ int MapgenValleys::generateTerrain()
 
 void MapgenValleys::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen caves", SPT_AVG);
+
 	if (max_stone_y < node_min.Y)
 		return;
 
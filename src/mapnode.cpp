@@ -653,7 +653,7 @@ void MapNode::deSerialize(u8 *source, u8 version)
 }
 void MapNode::serializeBulk(std::ostream &os, int version,
 		const MapNode *nodes, u32 nodecount,
-		u8 content_width, u8 params_width, bool compressed)
+		u8 content_width, u8 params_width, bool compressed, u8 codec)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapNode format not supported");
@@ -689,7 +689,7 @@ void MapNode::serializeBulk(std::ostream &os, int version,
 
 	if(compressed)
 	{
-		compressZlib(databuf, os);
+		compressBlockData(&databuf[0], databuf.getSize(), os, codec);
 	}
 	else
 	{
@@ -700,7 +700,7 @@ void MapNode::serializeBulk(std::ostream &os, int version,
 // Deserialize bulk node data
 void MapNode::deSerializeBulk(std::istream &is, int version,
 		MapNode *nodes, u32 nodecount,
-		u8 content_width, u8 params_width, bool compressed)
+		u8 content_width, u8 params_width, bool compressed, u8 codec)
 {
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapNode format not supported");
@@ -715,13 +715,7 @@ void MapNode::deSerializeBulk(std::istream &is, int version,
 	SharedBuffer<u8> databuf(len);
 	if(compressed)
 	{
-		std::ostringstream os(std::ios_base::binary);
-		decompressZlib(is, os);
-		std::string s = os.str();
-		if(s.size() != len)
-			throw SerializationError("deSerializeBulkNodes: "
-					"decompress resulted in invalid size");
-		memcpy(&databuf[0], s.c_str(), len);
+		decompressBlockData(is, &databuf[0], len, codec);
 	}
 	else
 	{
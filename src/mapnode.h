@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "irrlichttypes_bloated.h"
 #include "light.h"
+#include "serialization.h"
 #include <string>
 #include <vector>
 
@@ -71,6 +72,44 @@ typedef u16 content_t;
 */
 #define CONTENT_IGNORE 127
 
+/*
+	A set of content IDs with a bit for every ID, for testing the
+	contents of many nodes.
+*/
+class ContentFilter
+{
+public:
+	void add(content_t c)
+	{
+		if (c >= m_bits.size())
+			m_bits.resize(c + 1, false);
+		m_bits[c] = true;
+	}
+
+	void remove(content_t c)
+	{
+		if (c < m_bits.size())
+			m_bits[c] = false;
+	}
+
+	inline bool contains(content_t c) const
+	{
+		return c < m_bits.size() && m_bits[c];
+	}
+
+	// Whether any of contents is in the set
+	bool containsAny(const std::vector<content_t> &contents) const
+	{
+		for (size_t i = 0; i < contents.size(); i++)
+			if (contains(contents[i]))
+				return true;
+		return false;
+	}
+
+private:
+	std::vector<bool> m_bits;
+};
+
 enum LightBank
 {
 	LIGHTBANK_DAY,
@@ -292,13 +331,15 @@ struct MapNode
 	//   version = serialization version. Must be >= 22
 	//   content_width = the number of bytes of content per node
 	//   params_width = the number of bytes of params per node
-	//   compressed = true to zlib-compress output
+	//   compressed = true to compress output with the BlockCodec codec
 	static void serializeBulk(std::ostream &os, int version,
 			const MapNode *nodes, u32 nodecount,
-			u8 content_width, u8 params_width, bool compressed);
+			u8 content_width, u8 params_width, bool compressed,
+			u8 codec = BLOCK_CODEC_ZLIB);
 	static void deSerializeBulk(std::istream &is, int version,
 			MapNode *nodes, u32 nodecount,
-			u8 content_width, u8 params_width, bool compressed);
+			u8 content_width, u8 params_width, bool compressed,
+			u8 codec = BLOCK_CODEC_ZLIB);
 
 private:
 	// Deprecated serialization methods
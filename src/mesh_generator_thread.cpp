@@ -23,6 +23,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "client.h"
 #include "mapblock.h"
 #include "map.h"
+#include "log.h"
+#include "util/string.h"
+
+// Number of MeshMakeDatas kept for reuse, enough for all workers
+#define MESHGEN_DATA_POOL_SIZE 8
 
 /*
 	CachedMapBlockData
@@ -93,6 +98,9 @@ MeshUpdateQueue::~MeshUpdateQueue()
 		QueuedMeshUpdate *q = *i;
 		delete q;
 	}
+
+	for (size_t i = 0; i < m_data_pool.size(); i++)
+		delete m_data_pool[i];
 }
 
 void MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent)
@@ -178,14 +186,32 @@ QueuedMeshUpdate *MeshUpdateQueue::pop()
 		QueuedMeshUpdate *q = *i;
 		if(must_be_urgent && m_urgents.count(q->p) == 0)
 			continue;
+		// Another worker has an older version of the block, leave
+		// this one to it
+		if (m_inflight_blocks.count(q->p) != 0)
+			continue;
 		m_queue.erase(i);
 		m_urgents.erase(q->p);
+		m_inflight_blocks.insert(q->p);
 		fillDataFromMapBlockCache(q);
 		return q;
 	}
 	return NULL;
 }
 
+void MeshUpdateQueue::done(QueuedMeshUpdate *q)
+{
+	MutexAutoLock lock(m_mutex);
+	m_inflight_blocks.erase(q->p);
+
+	// Keep the node snapshot for the next update
+	if (q->data && m_data_pool.size() < MESHGEN_DATA_POOL_SIZE) {
+		m_data_pool.push_back(q->data);
+		q->data = NULL;
+	}
+	delete q;
+}
+
 CachedMapBlockData* MeshUpdateQueue::cacheBlock(Map *map, v3s16 p, UpdateMode mode,
 			size_t *cache_hit_counter)
 {
@@ -237,8 +263,14 @@ CachedMapBlockData* MeshUpdateQueue::getCachedBlock(const v3s16 &p)
 
 void MeshUpdateQueue::fillDataFromMapBlockCache(QueuedMeshUpdate *q)
 {
-	MeshMakeData *data = new MeshMakeData(m_client, m_cache_enable_shaders,
-			m_cache_use_tangent_vertices);
+	MeshMakeData *data;
+	if (m_data_pool.empty()) {
+		data = new MeshMakeData(m_client, m_cache_enable_shaders,
+				m_cache_use_tangent_vertices);
+	} else {
+		data = m_data_pool.back();
+		m_data_pool.pop_back();
+	}
 	q->data = data;
 
 	data->fillBlockDataBegin(q->p);
@@ -294,42 +326,97 @@ void MeshUpdateQueue::cleanupCache()
 }
 
 /*
-	MeshUpdateThread
+	MeshUpdateWorkerThread
 */
 
-MeshUpdateThread::MeshUpdateThread(Client *client):
-	UpdateThread("Mesh"),
-	m_queue_in(client)
+MeshUpdateWorkerThread::MeshUpdateWorkerThread(MeshUpdateQueue *queue_in,
+		MeshUpdateManager *manager, u32 id):
+	UpdateThread("Mesh" + itos(id)),
+	m_queue_in(queue_in),
+	m_manager(manager)
 {
 	m_generation_interval = g_settings->getU16("mesh_generation_interval");
 	m_generation_interval = rangelim(m_generation_interval, 0, 50);
 }
 
-void MeshUpdateThread::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
-		bool urgent)
-{
-	// Allow the MeshUpdateQueue to do whatever it wants
-	m_queue_in.addBlock(map, p, ack_block_to_server, urgent);
-	deferUpdate();
-}
-
-void MeshUpdateThread::doUpdate()
+void MeshUpdateWorkerThread::doUpdate()
 {
 	QueuedMeshUpdate *q;
-	while ((q = m_queue_in.pop())) {
+	while ((q = m_queue_in->pop())) {
 		if (m_generation_interval)
 			sleep_ms(m_generation_interval);
 		ScopeProfiler sp(g_profiler, "Client: Mesh making");
 
-		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, m_camera_offset);
+		MapBlockMesh *mesh_new = new MapBlockMesh(q->data,
+				m_manager->m_camera_offset);
 
 		MeshUpdateResult r;
 		r.p = q->p;
 		r.mesh = mesh_new;
 		r.ack_block_to_server = q->ack_block_to_server;
 
-		m_queue_out.push_back(r);
-
-		delete q;
+		// Push the result before another worker can take the block
+		m_manager->m_queue_out.push_back(r);
+		m_queue_in->done(q);
 	}
 }
+
+/*
+	MeshUpdateManager
+*/
+
+MeshUpdateManager::MeshUpdateManager(Client *client):
+	m_queue_in(client)
+{
+	// 0 = half of the processors, for the main thread and the rest
+	s32 num_threads = g_settings->getS32("mesh_generation_threads");
+	if (num_threads <= 0)
+		num_threads = Thread::getNumberOfProcessors() / 2;
+	num_threads = rangelim(num_threads, 1, 8);
+
+	for (s32 i = 0; i < num_threads; i++)
+		m_workers.push_back(new MeshUpdateWorkerThread(&m_queue_in, this, i));
+	infostream << "MeshUpdateManager: using " << num_threads
+			<< " mesh update threads" << std::endl;
+}
+
+MeshUpdateManager::~MeshUpdateManager()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
+}
+
+void MeshUpdateManager::updateBlock(Map *map, v3s16 p,
+		bool ack_block_to_server, bool urgent)
+{
+	// Allow the MeshUpdateQueue to do whatever it wants
+	m_queue_in.addBlock(map, p, ack_block_to_server, urgent);
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->deferUpdate();
+}
+
+void MeshUpdateManager::start()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->start();
+}
+
+void MeshUpdateManager::stop()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->stop();
+}
+
+void MeshUpdateManager::wait()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->wait();
+}
+
+bool MeshUpdateManager::isRunning()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		if (!m_workers[i]->isRunning())
+			return false;
+	return true;
+}
@@ -69,9 +69,14 @@ class MeshUpdateQueue
 	void addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
 
 	// Returned pointer must be deleted
-	// Returns NULL if queue is empty
+	// Returns NULL if queue is empty, or if all queued blocks are being
+	// meshed already
 	QueuedMeshUpdate *pop();
 
+	// Must be called when the mesh of a popped update is done, so the
+	// block can be popped again. Deletes q.
+	void done(QueuedMeshUpdate *q);
+
 	u32 size()
 	{
 		MutexAutoLock lock(m_mutex);
@@ -82,6 +87,10 @@ class MeshUpdateQueue
 	Client *m_client;
 	std::vector<QueuedMeshUpdate *> m_queue;
 	std::set<v3s16> m_urgents;
+	// Blocks that are being meshed by a worker
+	std::set<v3s16> m_inflight_blocks;
+	// MeshMakeDatas of finished updates, for reuse
+	std::vector<MeshMakeData *> m_data_pool;
 	std::map<v3s16, CachedMapBlockData *> m_cache;
 	Mutex m_mutex;
 
@@ -110,26 +119,55 @@ struct MeshUpdateResult
 	}
 };
 
-class MeshUpdateThread : public UpdateThread
+class MeshUpdateManager;
+
+class MeshUpdateWorkerThread : public UpdateThread
+{
+public:
+	MeshUpdateWorkerThread(MeshUpdateQueue *queue_in,
+			MeshUpdateManager *manager, u32 id);
+
+private:
+	MeshUpdateQueue *m_queue_in;
+	MeshUpdateManager *m_manager;
+
+	// TODO: Add callback to update these when g_settings changes
+	int m_generation_interval;
+
+protected:
+	virtual void doUpdate();
+};
+
+/*
+	Makes meshes on a number of worker threads.
+	A block is meshed by one worker at a time, so a newer mesh of
+	a block never gets replaced by an older one.
+*/
+class MeshUpdateManager
 {
 public:
-	MeshUpdateThread(Client *client);
+	MeshUpdateManager(Client *client);
+	~MeshUpdateManager();
 
 	// Caches the block at p and its neighbors (if needed) and queues a mesh
 	// update for the block at p
 	void updateBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
 
+	void start();
+	void stop();
+	void wait();
+	// False if any of the workers stopped
+	bool isRunning();
+
+	u32 getWorkerCount() const { return m_workers.size(); }
+	u32 getQueueSize() { return m_queue_in.size(); }
+
 	v3s16 m_camera_offset;
 	MutexedQueue<MeshUpdateResult> m_queue_out;
 
 private:
 	MeshUpdateQueue m_queue_in;
-
-	// TODO: Add callback to update these when g_settings changes
-	int m_generation_interval;
-
-protected:
-	virtual void doUpdate();
+	std::vector<MeshUpdateWorkerThread *> m_workers;
 };
 
 #endif
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "porting.h"
 #include "settings.h"
+#include "profiler.h"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -158,16 +159,38 @@ Biome *BiomeGenOriginal::calcBiomeAtPoint(v3s16 pos) const
 
 void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen biome noise", SPT_AVG);
+
 	m_pmin = pmin;
 
-	noise_heat->perlinMap2D(pmin.X, pmin.Z);
-	noise_humidity->perlinMap2D(pmin.X, pmin.Z);
-	noise_heat_blend->perlinMap2D(pmin.X, pmin.Z);
-	noise_humidity_blend->perlinMap2D(pmin.X, pmin.Z);
+	if (!noise_cache) {
+		noise_heat->perlinMap2D(pmin.X, pmin.Z);
+		noise_humidity->perlinMap2D(pmin.X, pmin.Z);
+		noise_heat_blend->perlinMap2D(pmin.X, pmin.Z);
+		noise_humidity_blend->perlinMap2D(pmin.X, pmin.Z);
+
+		for (s32 i = 0; i < m_csize.X * m_csize.Z; i++) {
+			noise_heat->result[i]     += noise_heat_blend->result[i];
+			noise_humidity->result[i] += noise_humidity_blend->result[i];
+		}
+		return;
+	}
+
+	// Mapgens modify heatmap and humidmap, so the shared maps are copied
+	const float *heat = noise_cache->perlinMap2D(m_params->np_heat,
+		m_params->seed, pmin.X, pmin.Z, m_csize.X, m_csize.Z);
+	const float *humidity = noise_cache->perlinMap2D(m_params->np_humidity,
+		m_params->seed, pmin.X, pmin.Z, m_csize.X, m_csize.Z);
+	const float *heat_blend = noise_cache->perlinMap2D(
+		m_params->np_heat_blend, m_params->seed,
+		pmin.X, pmin.Z, m_csize.X, m_csize.Z);
+	const float *humidity_blend = noise_cache->perlinMap2D(
+		m_params->np_humidity_blend, m_params->seed,
+		pmin.X, pmin.Z, m_csize.X, m_csize.Z);
 
 	for (s32 i = 0; i < m_csize.X * m_csize.Z; i++) {
-		noise_heat->result[i]     += noise_heat_blend->result[i];
-		noise_humidity->result[i] += noise_humidity_blend->result[i];
+		heatmap[i]  = heat[i] + heat_blend[i];
+		humidmap[i] = humidity[i] + humidity_blend[i];
 	}
 }
 
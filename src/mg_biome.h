@@ -91,6 +91,7 @@ struct BiomeParams {
 
 class BiomeGen {
 public:
+	BiomeGen() : noise_cache(NULL) {}
 	virtual ~BiomeGen() {}
 	virtual BiomeGenType getType() const = 0;
 
@@ -119,6 +120,9 @@ class BiomeGen {
 	// Result of calcBiomes bulk computation.
 	biome_t *biomemap;
 
+	// Noise maps shared with the mapgen, NULL to compute them separately
+	NoiseMapCache *noise_cache;
+
 protected:
 	BiomeManager *m_bmgr;
 	v3s16 m_pmin;
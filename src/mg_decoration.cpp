@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "noise.h"
 #include "map.h"
 #include "log.h"
+#include "profiler.h"
 #include "util/numeric.h"
 #include <algorithm>
 
@@ -50,6 +51,8 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 size_t DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 	v3s16 nmin, v3s16 nmax)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen decorations", SPT_AVG);
+
 	size_t nplaced = 0;
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
@@ -151,12 +154,16 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 	s16 divlen = carea_size / sidelen;
 	int area = sidelen * sidelen;
 
+	// Noise at the center of each part of the division. Decorations with
+	// the same noise and sidelen share it
+	const float *noisegrid = (flags & DECO_USE_NOISE) ?
+		mg->noise_cache.perlinGrid2D(np, mapseed,
+			nmin.X + sidelen / 2, nmin.Z + sidelen / 2, sidelen,
+			divlen, divlen) :
+		NULL;
+
 	for (s16 z0 = 0; z0 < divlen; z0++)
 	for (s16 x0 = 0; x0 < divlen; x0++) {
-		v2s16 p2d_center( // Center position of part of division
-			nmin.X + sidelen / 2 + sidelen * x0,
-			nmin.Z + sidelen / 2 + sidelen * z0
-		);
 		v2s16 p2d_min( // Minimum edge of part of division
 			nmin.X + sidelen * x0,
 			nmin.Z + sidelen * z0
@@ -167,9 +174,7 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 		);
 
 		// Amount of decorations
-		float nval = (flags & DECO_USE_NOISE) ?
-			NoisePerlin2D(&np, p2d_center.X, p2d_center.Y, mapseed) :
-			fill_ratio;
+		float nval = noisegrid ? noisegrid[divlen * z0 + x0] : fill_ratio;
 		u32 deco_count = 0;
 		float deco_count_f = (float)area * nval;
 		if (deco_count_f >= 1.f) {
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "noise.h"
 #include "map.h"
 #include "log.h"
+#include "profiler.h"
 #include <algorithm>
 
 
@@ -45,6 +46,8 @@ OreManager::OreManager(IGameDef *gamedef) :
 
 size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 {
+	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen ores", SPT_AVG);
+
 	size_t nplaced = 0;
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
@@ -116,7 +119,8 @@ size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 	nmin.Y = actual_ymin;
 	nmax.Y = actual_ymax;
-	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
+	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap,
+		&mg->noise_cache);
 
 	return 1;
 }
@@ -126,7 +130,7 @@ size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 
 void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache)
 {
 	PcgRandom pr(blockseed);
 	MapNode n_ore(c_ore, 0, ore_param2);
@@ -175,7 +179,7 @@ void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 
 void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache)
 {
 	PcgRandom pr(blockseed + 4234);
 	MapNode n_ore(c_ore, 0, ore_param2);
@@ -188,18 +192,15 @@ void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
 		pr.range(y_start_min, y_start_max) :
 		(y_start_min + y_start_max) / 2;
 
-	if (!noise) {
-		int sx = nmax.X - nmin.X + 1;
-		int sz = nmax.Z - nmin.Z + 1;
-		noise = new Noise(&np, 0, sx, sz);
-	}
-	noise->seed = mapseed + y_start;
-	noise->perlinMap2D(nmin.X, nmin.Z);
+	u32 sx = nmax.X - nmin.X + 1;
+	u32 sz = nmax.Z - nmin.Z + 1;
+	const float *noisemap = noise_cache->perlinMap2D(np, mapseed + y_start,
+		nmin.X, nmin.Z, sx, sz);
 
 	size_t index = 0;
 	for (int z = nmin.Z; z <= nmax.Z; z++)
 	for (int x = nmin.X; x <= nmax.X; x++, index++) {
-		float noiseval = noise->result[index];
+		float noiseval = noisemap[index];
 		if (noiseval < nthresh)
 			continue;
 
@@ -229,45 +230,25 @@ void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 ///////////////////////////////////////////////////////////////////////////////
 
-OrePuff::OrePuff() :
-	Ore()
-{
-	noise_puff_top    = NULL;
-	noise_puff_bottom = NULL;
-}
-
-
-OrePuff::~OrePuff()
-{
-	delete noise_puff_top;
-	delete noise_puff_bottom;
-}
-
-
 void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache)
 {
 	PcgRandom pr(blockseed + 4234);
 	MapNode n_ore(c_ore, 0, ore_param2);
 
 	int y_start = pr.range(nmin.Y, nmax.Y);
 
-	if (!noise) {
-		int sx = nmax.X - nmin.X + 1;
-		int sz = nmax.Z - nmin.Z + 1;
-		noise = new Noise(&np, 0, sx, sz);
-		noise_puff_top = new Noise(&np_puff_top, 0, sx, sz);
-		noise_puff_bottom = new Noise(&np_puff_bottom, 0, sx, sz);
-	}
-
-	noise->seed = mapseed + y_start;
-	noise->perlinMap2D(nmin.X, nmin.Z);
-	bool noise_generated = false;
+	u32 sx = nmax.X - nmin.X + 1;
+	u32 sz = nmax.Z - nmin.Z + 1;
+	const float *noisemap = noise_cache->perlinMap2D(np, mapseed + y_start,
+		nmin.X, nmin.Z, sx, sz);
+	const float *puff_top = NULL;
+	const float *puff_bottom = NULL;
 
 	size_t index = 0;
 	for (int z = nmin.Z; z <= nmax.Z; z++)
 	for (int x = nmin.X; x <= nmax.X; x++, index++) {
-		float noiseval = noise->result[index];
+		float noiseval = noisemap[index];
 		if (noiseval < nthresh)
 			continue;
 
@@ -277,14 +258,15 @@ void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
 				continue;
 		}
 
-		if (!noise_generated) {
-			noise_generated = true;
-			noise_puff_top->perlinMap2D(nmin.X, nmin.Z);
-			noise_puff_bottom->perlinMap2D(nmin.X, nmin.Z);
+		if (!puff_top) {
+			puff_top = noise_cache->perlinMap2D(np_puff_top, 0,
+				nmin.X, nmin.Z, sx, sz);
+			puff_bottom = noise_cache->perlinMap2D(np_puff_bottom, 0,
+				nmin.X, nmin.Z, sx, sz);
 		}
 
-		float ntop    = noise_puff_top->result[index];
-		float nbottom = noise_puff_bottom->result[index];
+		float ntop    = puff_top[index];
+		float nbottom = puff_bottom[index];
 
 		if (!(flags & OREFLAG_PUFF_CLIFFS)) {
 			float ndiff = noiseval - nthresh;
@@ -318,7 +300,7 @@ void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 
 void OreBlob::generate(MMVManip *vm, int mapseed, u32 blockseed,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache)
 {
 	PcgRandom pr(blockseed + 2404);
 	MapNode n_ore(c_ore, 0, ore_param2);
@@ -382,35 +364,18 @@ void OreBlob::generate(MMVManip *vm, int mapseed, u32 blockseed,
 
 ///////////////////////////////////////////////////////////////////////////////
 
-OreVein::OreVein() :
-	Ore()
-{
-	noise2 = NULL;
-}
-
-
-OreVein::~OreVein()
-{
-	delete noise2;
-}
-
-
 void OreVein::generate(MMVManip *vm, int mapseed, u32 blockseed,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache)
 {
 	PcgRandom pr(blockseed + 520);
 	MapNode n_ore(c_ore, 0, ore_param2);
 
 	u32 sizex = (nmax.X - nmin.X + 1);
 
-	if (!noise) {
-		int sx = nmax.X - nmin.X + 1;
-		int sy = nmax.Y - nmin.Y + 1;
-		int sz = nmax.Z - nmin.Z + 1;
-		noise  = new Noise(&np, mapseed, sx, sy, sz);
-		noise2 = new Noise(&np, mapseed + 436, sx, sy, sz);
-	}
-	bool noise_generated = false;
+	u32 sy = nmax.Y - nmin.Y + 1;
+	u32 sz = nmax.Z - nmin.Z + 1;
+	const float *noisemap = NULL;
+	const float *noisemap2 = NULL;
 
 	size_t index = 0;
 	for (int z = nmin.Z; z <= nmax.Z; z++)
@@ -430,16 +395,17 @@ void OreVein::generate(MMVManip *vm, int mapseed, u32 blockseed,
 		}
 
 		// Same lazy generation optimization as in OreBlob
-		if (!noise_generated) {
-			noise_generated = true;
-			noise->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
-			noise2->perlinMap3D(nmin.X, nmin.Y, nmin.Z);
+		if (!noisemap) {
+			noisemap = noise_cache->perlinMap3D(np, mapseed,
+				nmin.X, nmin.Y, nmin.Z, sizex, sy, sz);
+			noisemap2 = noise_cache->perlinMap3D(np, mapseed + 436,
+				nmin.X, nmin.Y, nmin.Z, sizex, sy, sz);
 		}
 
 		// randval ranges from -1..1
 		float randval   = (float)pr.next() / (pr.RANDOM_RANGE / 2) - 1.f;
-		float noiseval  = contour(noise->result[index]);
-		float noiseval2 = contour(noise2->result[index]);
+		float noiseval  = contour(noisemap[index]);
+		float noiseval2 = contour(noisemap2[index]);
 		if (noiseval * noiseval2 + randval * random_factor < nthresh)
 			continue;
 
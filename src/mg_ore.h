@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodedef.h"
 
 class Noise;
+class NoiseMapCache;
 class Mapgen;
 class MMVManip;
 
@@ -75,7 +76,7 @@ class Ore : public ObjDef, public NodeResolver {
 
 	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap) = 0;
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache) = 0;
 };
 
 class OreScatter : public Ore {
@@ -83,7 +84,7 @@ class OreScatter : public Ore {
 	static const bool NEEDS_NOISE = false;
 
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap);
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache);
 };
 
 class OreSheet : public Ore {
@@ -95,7 +96,7 @@ class OreSheet : public Ore {
 	float column_midpoint_factor;
 
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap);
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache);
 };
 
 class OrePuff : public Ore {
@@ -104,14 +105,9 @@ class OrePuff : public Ore {
 
 	NoiseParams np_puff_top;
 	NoiseParams np_puff_bottom;
-	Noise *noise_puff_top;
-	Noise *noise_puff_bottom;
-
-	OrePuff();
-	virtual ~OrePuff();
 
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap);
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache);
 };
 
 class OreBlob : public Ore {
@@ -119,7 +115,7 @@ class OreBlob : public Ore {
 	static const bool NEEDS_NOISE = true;
 
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap);
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache);
 };
 
 class OreVein : public Ore {
@@ -127,13 +123,9 @@ class OreVein : public Ore {
 	static const bool NEEDS_NOISE = true;
 
 	float random_factor;
-	Noise *noise2;
-
-	OreVein();
-	virtual ~OreVein();
 
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
-		v3s16 nmin, v3s16 nmax, u8 *biomemap);
+		v3s16 nmin, v3s16 nmax, u8 *biomemap, NoiseMapCache *noise_cache);
 };
 
 class OreManager : public ObjDefManager {
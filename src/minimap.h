@@ -60,7 +60,7 @@ struct MinimapPixel {
 };
 
 struct MinimapMapblock {
-	void getMinimapNodes(VoxelManipulator *vmanip, v3s16 pos);
+	void getMinimapNodes(const MeshMakeData *mesh_data);
 
 	MinimapPixel data[MAP_BLOCKSIZE * MAP_BLOCKSIZE];
 };
@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "util/strfnd.h"
 #include "network/clientopcodes.h"
+#include "network/nodechanges.h"
 #include "script/scripting_client.h"
 #include "util/serialize.h"
 #include "util/srp.h"
@@ -279,6 +280,41 @@ void Client::handleCommand_AddNode(NetworkPacket* pkt)
 
 	addNode(p, n, remove_metadata);
 }
+
+void Client::handleCommand_NodesChanged(NetworkPacket* pkt)
+{
+	std::map<v3s16, MapBlock*> modified_blocks;
+
+	u16 block_count;
+	*pkt >> block_count;
+	for (u16 i = 0; i < block_count; i++) {
+		v3s16 blockpos;
+		NodeChangeMap changes;
+		deserialize_node_changes(pkt, &blockpos, &changes);
+
+		v3s16 p0 = blockpos * MAP_BLOCKSIZE;
+		for (NodeChangeMap::iterator it = changes.begin();
+				it != changes.end(); ++it) {
+			u16 index = it->first;
+			v3s16 p = p0 + v3s16(index % MAP_BLOCKSIZE,
+					index / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+					index / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+
+			try {
+				m_env.getMap().addNodeAndUpdate(p, it->second.n,
+						modified_blocks, it->second.remove_metadata);
+			} catch (InvalidPositionException &e) {
+			}
+		}
+	}
+
+	// Update each mesh only once for all changes
+	for (std::map<v3s16, MapBlock *>::iterator
+			i = modified_blocks.begin();
+			i != modified_blocks.end(); ++i) {
+		addUpdateMeshTaskWithEdge(i->first, false, true);
+	}
+}
 void Client::handleCommand_BlockData(NetworkPacket* pkt)
 {
 	// Ignore too small packet
@@ -622,7 +658,7 @@ void Client::handleCommand_AnnounceMedia(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u16 i = 0; i < num_files; i++) {
 		std::string name, sha1_base64;
@@ -694,7 +730,7 @@ void Client::handleCommand_Media(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u32 i=0; i < num_files; i++) {
 		std::string name;
@@ -715,7 +751,7 @@ void Client::handleCommand_NodeDef(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	// Decompress node definitions
 	std::istringstream tmp_is(pkt->readLongString(), std::ios::binary);
@@ -735,7 +771,7 @@ void Client::handleCommand_ItemDef(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	// Decompress item definitions
 	std::istringstream tmp_is(pkt->readLongString(), std::ios::binary);
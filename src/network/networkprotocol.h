@@ -155,9 +155,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 		Stop sending TOSERVER_CLIENT_READY
 	PROTOCOL VERSION 32:
 		Add fading sounds
+	PROTOCOL VERSION 33:
+		Add TOCLIENT_NODES_CHANGED
+	PROTOCOL VERSION 34:
+		Map block serialization version 29, with a codec byte
+		Block codecs in the network compression modes of TOSERVER_INIT
+			and TOCLIENT_HELLO
 */
 
-#define LATEST_PROTOCOL_VERSION 32
+#define LATEST_PROTOCOL_VERSION 34
 
 // Server's supported network protocol range
 #define SERVER_PROTOCOL_VERSION_MIN 24
@@ -630,6 +636,21 @@ enum ToClientCommand
 		float gain
 	*/
 
+	TOCLIENT_NODES_CHANGED = 0x56,
+	/*
+		u16 block count
+		for each block:
+			v3s16 block position
+			u16 node count
+			for each node, ordered by index in the block:
+				u16 index in the block (z*256 + y*16 + x) minus the index
+				    of the previous node of the block
+				u16 param0
+				u8 param1
+				u8 param2
+				u8 keep_metadata
+	*/
+
 	TOCLIENT_SRP_BYTES_S_B = 0x60,
 	/*
 		Belonging to AUTH_MECHANISM_LEGACY_PASSWORD and AUTH_MECHANISM_SRP.
@@ -947,8 +968,18 @@ enum AccessDeniedCode {
 
 enum NetProtoCompressionMode {
 	NETPROTO_COMPRESSION_NONE = 0,
+	// Map blocks are compressed with another BlockCodec than zlib. The
+	// client sends all that it supports, the server deploys one of them.
+	NETPROTO_COMPRESSION_BLOCK_ZSTD = 0x01,
+	NETPROTO_COMPRESSION_BLOCK_LZ4 = 0x02,
 };
 
+// The compression mode of a BlockCodec, NETPROTO_COMPRESSION_NONE for zlib
+inline u16 netproto_block_codec_mode(u8 codec)
+{
+	return codec == 0 ? NETPROTO_COMPRESSION_NONE : 1 << (codec - 1);
+}
+
 const static std::string accessDeniedStrings[SERVER_ACCESSDENIED_MAX] = {
 	"Invalid password",
 	"Your client sent something the server didn't expect.  Try reconnecting or updating your client",
@@ -0,0 +1,75 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nodechanges.h"
+#include "constants.h"
+#include "exceptions.h"
+#include "networkpacket.h"
+#include "util/serialize.h"
+
+void add_node_change(NodeChangeMap &changes, u16 index, const MapNode &n,
+		bool remove_metadata)
+{
+	NodeChange &change = changes[index];
+	change.n = n;
+	change.remove_metadata = change.remove_metadata || remove_metadata;
+}
+
+void serialize_node_changes(std::ostream &os, v3s16 blockpos,
+		const NodeChangeMap &changes)
+{
+	writeV3S16(os, blockpos);
+	writeU16(os, changes.size());
+	u16 last_index = 0;
+	for (NodeChangeMap::const_iterator it = changes.begin();
+			it != changes.end(); ++it) {
+		const MapNode &n = it->second.n;
+		writeU16(os, it->first - last_index);
+		writeU16(os, n.param0);
+		writeU8(os, n.param1);
+		writeU8(os, n.param2);
+		writeU8(os, it->second.remove_metadata ? 0 : 1);
+		last_index = it->first;
+	}
+}
+
+void deserialize_node_changes(NetworkPacket *pkt, v3s16 *blockpos,
+		NodeChangeMap *changes)
+{
+	const u32 volume = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+	u16 node_count;
+	*pkt >> *blockpos >> node_count;
+
+	u32 index = 0;
+	for (u16 i = 0; i < node_count; i++) {
+		u16 index_delta;
+		u8 keep_metadata;
+		NodeChange change;
+		*pkt >> index_delta >> change.n.param0 >> change.n.param1
+				>> change.n.param2 >> keep_metadata;
+		change.remove_metadata = !keep_metadata;
+
+		index += index_delta;
+		if (index >= volume)
+			throw SerializationError("deserialize_node_changes: "
+					"node index out of the block");
+		(*changes)[index] = change;
+	}
+}
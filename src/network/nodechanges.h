@@ -0,0 +1,58 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef NODECHANGES_HEADER
+#define NODECHANGES_HEADER
+
+#include <map>
+#include <ostream>
+#include "irr_v3d.h"
+#include "mapnode.h"
+
+class NetworkPacket;
+
+// A changed node, as sent in TOCLIENT_NODES_CHANGED
+struct NodeChange
+{
+	NodeChange(): remove_metadata(false) {}
+
+	MapNode n;
+	bool remove_metadata;
+};
+
+// Node changes of one MapBlock, by index in the block
+typedef std::map<u16, NodeChange> NodeChangeMap;
+
+/*
+	Adds a change of the node at index. A later change of the same node
+	replaces the node of the earlier one, but metadata stays removed if
+	any of them removed it.
+*/
+void add_node_change(NodeChangeMap &changes, u16 index, const MapNode &n,
+		bool remove_metadata);
+
+// Writes the changes of one block in the format of TOCLIENT_NODES_CHANGED
+void serialize_node_changes(std::ostream &os, v3s16 blockpos,
+		const NodeChangeMap &changes);
+
+// Reads the changes of one block from a TOCLIENT_NODES_CHANGED packet
+void deserialize_node_changes(NetworkPacket *pkt, v3s16 *blockpos,
+		NodeChangeMap *changes);
+
+#endif
@@ -116,8 +116,6 @@ void Server::handleCommand_Init(NetworkPacket* pkt)
 		return;
 	}
 
-	client->setPendingSerializationVersion(depl_serial_v);
-
 	/*
 		Read and check network protocol version
 	*/
@@ -141,6 +139,11 @@ void Server::handleCommand_Init(NetworkPacket* pkt)
 
 	client->net_proto_version = net_proto_version;
 
+	// The codec byte of blocks is known from protocol version 34 on
+	if (net_proto_version < 34)
+		depl_serial_v = std::min(depl_serial_v, (u8)28);
+	client->setPendingSerializationVersion(depl_serial_v);
+
 	// On this handler at least protocol version 25 is required
 	if (net_proto_version < 25 ||
 			net_proto_version < SERVER_PROTOCOL_VERSION_MIN ||
@@ -279,7 +282,12 @@ void Server::handleCommand_Init(NetworkPacket* pkt)
 	NetworkPacket resp_pkt(TOCLIENT_HELLO, 1 + 4
 		+ legacyPlayerNameCasing.size(), pkt->getPeerId());
 
+	// Blocks are sent with the codec of the map if the client supports it
 	u16 depl_compress_mode = NETPROTO_COMPRESSION_NONE;
+	u16 block_codec_mode = netproto_block_codec_mode(
+		m_env->getServerMap().getBlockCodec());
+	if (depl_serial_v >= 29 && (supp_compr_modes & block_codec_mode))
+		depl_compress_mode = block_codec_mode;
 	resp_pkt << depl_serial_v << depl_compress_mode << net_proto_version
 		<< auth_mechs << legacyPlayerNameCasing;
 
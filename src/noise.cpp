@@ -31,20 +31,7 @@
 #include "util/numeric.h"
 #include "util/string.h"
 #include "exceptions.h"
-
-#define NOISE_MAGIC_X    1619
-#define NOISE_MAGIC_Y    31337
-#define NOISE_MAGIC_Z    52591
-#define NOISE_MAGIC_SEED 1013
-
-typedef float (*Interp2dFxn)(
-		float v00, float v10, float v01, float v11,
-		float x, float y);
-
-typedef float (*Interp3dFxn)(
-		float v000, float v100, float v010, float v110,
-		float v001, float v101, float v011, float v111,
-		float x, float y, float z);
+#include "noise_simd.h"
 
 float cos_lookup[16] = {
 	1.0,  0.9238,  0.7071,  0.3826, 0, -0.3826, -0.7071, -0.9238,
@@ -438,6 +425,10 @@ Noise::Noise(NoiseParams *np_, s32 seed, u32 sx, u32 sy, u32 sz)
 	this->persist_buf  = NULL;
 	this->gradient_buf = NULL;
 	this->result       = NULL;
+	this->column_x_buf = NULL;
+	this->column_t_buf = NULL;
+	this->row_buf      = NULL;
+	this->kernels      = noise_kernels();
 
 	allocBuffers();
 }
@@ -449,6 +440,9 @@ Noise::~Noise()
 	delete[] persist_buf;
 	delete[] noise_buf;
 	delete[] result;
+	delete[] column_x_buf;
+	delete[] column_t_buf;
+	delete[] row_buf;
 }
 
 
@@ -467,12 +461,16 @@ void Noise::allocBuffers()
 	delete[] gradient_buf;
 	delete[] persist_buf;
 	delete[] result;
+	delete[] column_x_buf;
+	delete[] column_t_buf;
 
 	try {
 		size_t bufsize = sx * sy * sz;
 		this->persist_buf  = NULL;
 		this->gradient_buf = new float[bufsize];
 		this->result       = new float[bufsize];
+		this->column_x_buf = new u32[sx];
+		this->column_t_buf = new float[sx];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -531,8 +529,10 @@ void Noise::resizeNoiseBuf(bool is3d)
 	size_t nlz = is3d ? (size_t)ceil(num_noise_points_z) + 3 : 1;
 
 	delete[] noise_buf;
+	delete[] row_buf;
 	try {
 		noise_buf = new float[nlx * nly * nlz];
+		row_buf = new float[nly * nlz * sx];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -550,59 +550,60 @@ void Noise::resizeNoiseBuf(bool is3d)
  * values from the previous noise lattice as midpoints in the new lattice for the
  * next octave.
  */
+void Noise::fillColumns(float u, float step_x, bool eased)
+{
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		column_x_buf[i] = noisex;
+		column_t_buf[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
 #define idx(x, y) ((y) * nlx + (x))
 void Noise::gradientMap2D(
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	float u, v;
+	u32 index, j, noisey;
 	u32 nlx, nly;
 	s32 x0, y0;
 
 	bool eased = np.flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED);
-	Interp2dFxn interpolate = eased ?
-		biLinearInterpolation : biLinearInterpolationNoEase;
 
 	x0 = floor(x);
 	y0 = floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
 	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+		kernels->lattice2d(&noise_buf[idx(0, j)], nlx, x0, y0 + j, seed);
+
+	//interpolate the lattice rows in X, once for all map rows between them
+	fillColumns(u, step_x, eased);
+	for (j = 0; j != nly; j++)
+		kernels->interpolateX(&row_buf[j * sx], sx, &noise_buf[idx(0, j)],
+			column_x_buf, column_t_buf);
 
 	//calculate interpolations
 	index  = 0;
 	noisey = 0;
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			gradient_buf[index++] = interpolate(v00, v10, v01, v11, u, v);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+		kernels->interpolate2(&gradient_buf[index], sx,
+			&row_buf[noisey * sx], &row_buf[(noisey + 1) * sx],
+			eased ? easeCurve(v) : v);
+		index += sx;
 
 		v += step_y;
 		if (v >= 1.0) {
@@ -620,15 +621,12 @@ void Noise::gradientMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	float u, v, w, orig_v;
+	u32 index, j, k, noisey, noisez;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
-	Interp3dFxn interpolate = (np.flags & NOISE_FLAG_EASED) ?
-		triLinearInterpolation : triLinearInterpolationNoEase;
+	bool eased = np.flags & NOISE_FLAG_EASED;
 
 	x0 = floor(x);
 	y0 = floor(y);
@@ -636,58 +634,38 @@ void Noise::gradientMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+			kernels->lattice3d(&noise_buf[idx(0, j, k)], nlx,
+				x0, y0 + j, z0 + k, seed);
+
+	//interpolate the lattice rows in X, once for all map rows between them
+	fillColumns(u, step_x, eased);
+	for (k = 0; k != nlz; k++)
+		for (j = 0; j != nly; j++)
+			kernels->interpolateX(&row_buf[(k * nly + j) * sx], sx,
+				&noise_buf[idx(0, j, k)], column_x_buf, column_t_buf);
 
 	//calculate interpolations
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
 	for (k = 0; k != sz; k++) {
+		float tz = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				gradient_buf[index++] = interpolate(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			u32 row = noisez * nly + noisey;
+			kernels->interpolate4(&gradient_buf[index], sx,
+				&row_buf[row * sx], &row_buf[(row + 1) * sx],
+				&row_buf[(row + nly) * sx], &row_buf[(row + nly + 1) * sx],
+				eased ? easeCurve(v) : v, tz);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
@@ -784,27 +762,140 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 void Noise::updateResults(float g, float *gmap,
 	float *persistence_map, size_t bufsize)
 {
-	// This looks very ugly, but it is 50-70% faster than having
-	// conditional statements inside the loop
-	if (np.flags & NOISE_FLAG_ABSVALUE) {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * fabs(gradient_buf[i]);
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * fabs(gradient_buf[i]);
-		}
-	} else {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * gradient_buf[i];
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * gradient_buf[i];
+	bool absvalue = np.flags & NOISE_FLAG_ABSVALUE;
+	if (persistence_map)
+		kernels->accumulatePersist(result, gradient_buf, bufsize,
+			gmap, persistence_map, absvalue);
+	else
+		kernels->accumulate(result, gradient_buf, bufsize, g, absvalue);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
+static bool noise_params_equal(const NoiseParams &a, const NoiseParams &b)
+{
+	return a.offset == b.offset && a.scale == b.scale &&
+		a.spread == b.spread && a.seed == b.seed &&
+		a.octaves == b.octaves && a.persist == b.persist &&
+		a.lacunarity == b.lacunarity && a.flags == b.flags;
+}
+
+
+NoiseMapCache::NoiseMapCache() :
+	hits(0),
+	misses(0)
+{
+}
+
+
+NoiseMapCache::~NoiseMapCache()
+{
+	for (size_t i = 0; i != m_entries.size(); i++) {
+		delete m_entries[i]->noise;
+		delete m_entries[i];
+	}
+}
+
+
+void NoiseMapCache::clear()
+{
+	hits   = 0;
+	misses = 0;
+	for (size_t i = 0; i != m_entries.size(); i++)
+		m_entries[i]->valid = false;
+}
+
+
+NoiseMapCache::Entry *NoiseMapCache::find(EntryType type,
+	const NoiseParams &np, s32 seed, v3f origin, s32 step,
+	u32 sx, u32 sy, u32 sz, bool *found)
+{
+	Entry *unused = NULL;
+	for (size_t i = 0; i != m_entries.size(); i++) {
+		Entry *e = m_entries[i];
+		if (e->type != type || e->sx != sx || e->sy != sy || e->sz != sz ||
+				e->step != step || !noise_params_equal(e->np, np))
+			continue;
+
+		if (e->valid && e->seed == seed && e->origin == origin) {
+			hits++;
+			*found = true;
+			return e;
 		}
+		if (!e->valid && !unused)
+			unused = e;
 	}
+
+	misses++;
+	*found = false;
+
+	// An entry of the previous chunk has buffers of the right size
+	if (!unused) {
+		unused = new Entry;
+		unused->type  = type;
+		unused->np    = np;
+		unused->step  = step;
+		unused->sx    = sx;
+		unused->sy    = sy;
+		unused->sz    = sz;
+		unused->noise = NULL;
+		m_entries.push_back(unused);
+	}
+	unused->valid  = true;
+	unused->seed   = seed;
+	unused->origin = origin;
+	return unused;
+}
+
+
+const float *NoiseMapCache::perlinMap2D(const NoiseParams &np, s32 seed,
+	float x, float y, u32 sx, u32 sy)
+{
+	bool found;
+	Entry *e = find(ENTRY_MAP_2D, np, seed, v3f(x, y, 0), 0,
+		sx, sy, 1, &found);
+	if (found)
+		return e->noise->result;
+
+	if (!e->noise)
+		e->noise = new Noise(&e->np, seed, sx, sy);
+	e->noise->seed = seed;
+	return e->noise->perlinMap2D(x, y);
+}
+
+
+const float *NoiseMapCache::perlinMap3D(const NoiseParams &np, s32 seed,
+	float x, float y, float z, u32 sx, u32 sy, u32 sz)
+{
+	bool found;
+	Entry *e = find(ENTRY_MAP_3D, np, seed, v3f(x, y, z), 0,
+		sx, sy, sz, &found);
+	if (found)
+		return e->noise->result;
+
+	if (!e->noise)
+		e->noise = new Noise(&e->np, seed, sx, sy, sz);
+	e->noise->seed = seed;
+	return e->noise->perlinMap3D(x, y, z);
+}
+
+
+const float *NoiseMapCache::perlinGrid2D(const NoiseParams &np, s32 seed,
+	s32 x, s32 y, s32 step, u32 nx, u32 ny)
+{
+	bool found;
+	Entry *e = find(ENTRY_GRID_2D, np, seed, v3f(x, y, 0), step,
+		nx, ny, 1, &found);
+	if (found)
+		return &e->values[0];
+
+	e->values.resize(nx * ny);
+	size_t index = 0;
+	for (u32 j = 0; j != ny; j++)
+	for (u32 i = 0; i != nx; i++)
+		e->values[index++] = NoisePerlin2D(&e->np,
+			x + (s32)i * step, y + (s32)j * step, seed);
+	return &e->values[0];
 }
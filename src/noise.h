@@ -29,6 +29,7 @@
 #include "irr_v3d.h"
 #include "exceptions.h"
 #include "util/string.h"
+#include <vector>
 
 extern FlagDesc flagdesc_noiseparams[];
 
@@ -145,6 +146,8 @@ struct NoiseParams {
 //#define getNoiseParams(x, y) getStruct((x), NOISEPARAMS_FMT_STR, &(y), sizeof(y))
 //#define setNoiseParams(x, y) setStruct((x), NOISEPARAMS_FMT_STR, &(y))
 
+struct NoiseKernels;
+
 class Noise {
 public:
 	NoiseParams np;
@@ -156,6 +159,8 @@ class Noise {
 	float *gradient_buf;
 	float *persist_buf;
 	float *result;
+	// Inner loops, by default the fastest ones for the CPU
+	const NoiseKernels *kernels;
 
 	Noise(NoiseParams *np, s32 seed, u32 sx, u32 sy, u32 sz=1);
 	~Noise();
@@ -199,6 +204,13 @@ class Noise {
 	void allocBuffers();
 	void resizeNoiseBuf(bool is3d);
 	void updateResults(float g, float *gmap, float *persistence_map, size_t bufsize);
+	void fillColumns(float u, float step_x, bool eased);
+
+	// Lattice column and interpolation weight of each X of a map
+	u32 *column_x_buf;
+	float *column_t_buf;
+	// The lattice rows interpolated in X, sx values each
+	float *row_buf;
 
 };
 
@@ -224,6 +236,65 @@ inline float NoisePerlin3D_PO(NoiseParams *np, float x, float xoff,
 		seed);
 }
 
+/*
+	Noise of one mapchunk, shared by everything that generates it.
+	Maps with equal params, seed, origin and size are equal, so each
+	of them is computed once until clear() is called for the next chunk.
+	Returned pointers stay valid until then and must not be written to.
+*/
+class NoiseMapCache {
+public:
+	NoiseMapCache();
+	~NoiseMapCache();
+
+	// Forgets the maps of the previous chunk, keeping their buffers
+	void clear();
+
+	const float *perlinMap2D(const NoiseParams &np, s32 seed,
+		float x, float y, u32 sx, u32 sy);
+	const float *perlinMap3D(const NoiseParams &np, s32 seed,
+		float x, float y, float z, u32 sx, u32 sy, u32 sz);
+	// NoisePerlin2D at x + i * step, y + j * step for i < nx and j < ny
+	const float *perlinGrid2D(const NoiseParams &np, s32 seed,
+		s32 x, s32 y, s32 step, u32 nx, u32 ny);
+
+	// Lookups since the last clear()
+	u32 hits;
+	u32 misses;
+
+private:
+	enum EntryType {
+		ENTRY_MAP_2D,
+		ENTRY_MAP_3D,
+		ENTRY_GRID_2D,
+	};
+
+	struct Entry {
+		EntryType type;
+		bool valid;
+		NoiseParams np;
+		s32 seed;
+		v3f origin;
+		s32 step;
+		u32 sx;
+		u32 sy;
+		u32 sz;
+		// The map of ENTRY_MAP_*, values of ENTRY_GRID_2D
+		Noise *noise;
+		std::vector<float> values;
+	};
+
+	Entry *find(EntryType type, const NoiseParams &np, s32 seed,
+		v3f origin, s32 step, u32 sx, u32 sy, u32 sz, bool *found);
+
+	std::vector<Entry *> m_entries;
+};
+
+#define NOISE_MAGIC_X    1619
+#define NOISE_MAGIC_Y    31337
+#define NOISE_MAGIC_Z    52591
+#define NOISE_MAGIC_SEED 1013
+
 // Return value: -1 ... 1
 float noise2d(int x, int y, s32 seed);
 float noise3d(int x, int y, int z, s32 seed);
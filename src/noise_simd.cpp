@@ -0,0 +1,459 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "noise_simd.h"
+#include <math.h>
+#include "noise.h"
+
+/*
+	Vector kernels are only built where the scalar code computes floats
+	with SSE as well, so both round identically: x86-64, and 32-bit x86
+	built with -mfpmath=sse. The x87 FPU keeps excess precision and
+	AArch64 compilers fuse multiplies and adds, so vectors could not
+	reproduce their noise bit by bit.
+*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__SSE2_MATH__))
+	#define NOISE_SIMD_X86
+	#include <immintrin.h>
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+	Scalar
+*/
+
+static inline float lerp(float v0, float v1, float t)
+{
+	return v0 + (v1 - v0) * t;
+}
+
+static void lattice2d_scalar(float *dst, u32 count, s32 x0, s32 y, s32 seed)
+{
+	for (u32 i = 0; i != count; i++)
+		dst[i] = noise2d(x0 + i, y, seed);
+}
+
+static void lattice3d_scalar(float *dst, u32 count, s32 x0, s32 y, s32 z,
+		s32 seed)
+{
+	for (u32 i = 0; i != count; i++)
+		dst[i] = noise3d(x0 + i, y, z, seed);
+}
+
+static void interpolateX_scalar(float *dst, u32 count, const float *r,
+		const u32 *x, const float *tx)
+{
+	for (u32 i = 0; i != count; i++)
+		dst[i] = lerp(r[x[i]], r[x[i] + 1], tx[i]);
+}
+
+static void interpolate2_scalar(float *dst, u32 count,
+		const float *a, const float *b, float t)
+{
+	for (u32 i = 0; i != count; i++)
+		dst[i] = lerp(a[i], b[i], t);
+}
+
+static void interpolate4_scalar(float *dst, u32 count,
+		const float *a, const float *b, const float *c, const float *d,
+		float ty, float tz)
+{
+	for (u32 i = 0; i != count; i++)
+		dst[i] = lerp(lerp(a[i], b[i], ty), lerp(c[i], d[i], ty), tz);
+}
+
+// The loops are split by absvalue, a condition inside them is much slower
+static void accumulate_scalar(float *result, const float *gradient,
+		u32 count, float g, bool absvalue)
+{
+	if (absvalue) {
+		for (u32 i = 0; i != count; i++)
+			result[i] += g * fabs(gradient[i]);
+	} else {
+		for (u32 i = 0; i != count; i++)
+			result[i] += g * gradient[i];
+	}
+}
+
+static void accumulatePersist_scalar(float *result, const float *gradient,
+		u32 count, float *gmap, const float *persistence, bool absvalue)
+{
+	if (absvalue) {
+		for (u32 i = 0; i != count; i++) {
+			result[i] += gmap[i] * fabs(gradient[i]);
+			gmap[i] *= persistence[i];
+		}
+	} else {
+		for (u32 i = 0; i != count; i++) {
+			result[i] += gmap[i] * gradient[i];
+			gmap[i] *= persistence[i];
+		}
+	}
+}
+
+static const NoiseKernels kernels_scalar = {
+	NOISE_SIMD_NONE,
+	"scalar",
+	lattice2d_scalar,
+	lattice3d_scalar,
+	interpolateX_scalar,
+	interpolate2_scalar,
+	interpolate4_scalar,
+	accumulate_scalar,
+	accumulatePersist_scalar,
+};
+
+#ifdef NOISE_SIMD_X86
+
+// Base of the lattice hash without the X term, wrapping like noise3d()
+static inline u32 lattice_hash_base(s32 x0, s32 y, s32 z, s32 seed)
+{
+	return (u32)NOISE_MAGIC_X * (u32)x0 + (u32)NOISE_MAGIC_Y * (u32)y +
+		(u32)NOISE_MAGIC_Z * (u32)z + (u32)NOISE_MAGIC_SEED * (u32)seed;
+}
+
+/*
+	SSE2, which the scalar floats already require
+*/
+
+// SSE2 has no 32 bit multiply, build it from two 32x32->64 bit ones
+static inline __m128i mullo_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// The part of noise2d() and noise3d() after summing the coordinate terms
+static inline __m128 lattice_hash_sse2(__m128i n)
+{
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	n = _mm_and_si128(n, mask);
+	n = _mm_xor_si128(_mm_srli_epi32(n, 13), n);
+	__m128i m = mullo_sse2(mullo_sse2(n, n), _mm_set1_epi32(60493));
+	m = _mm_add_epi32(m, _mm_set1_epi32(19990303));
+	n = _mm_add_epi32(mullo_sse2(n, m), _mm_set1_epi32(1376312589));
+	n = _mm_and_si128(n, mask);
+	return _mm_sub_ps(_mm_set1_ps(1.f),
+		_mm_div_ps(_mm_cvtepi32_ps(n), _mm_set1_ps(0x40000000)));
+}
+
+static void lattice_sse2(float *dst, u32 count, u32 base)
+{
+	__m128i n = _mm_add_epi32(_mm_set1_epi32(base), _mm_setr_epi32(
+		0, NOISE_MAGIC_X, 2 * NOISE_MAGIC_X, 3 * NOISE_MAGIC_X));
+	const __m128i step = _mm_set1_epi32(4 * NOISE_MAGIC_X);
+	for (u32 i = 0; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(dst + i, lattice_hash_sse2(n));
+		n = _mm_add_epi32(n, step);
+	}
+}
+
+static void lattice2d_sse2(float *dst, u32 count, s32 x0, s32 y, s32 seed)
+{
+	lattice_sse2(dst, count, lattice_hash_base(x0, y, 0, seed));
+	u32 done = count & ~3;
+	lattice2d_scalar(dst + done, count - done, x0 + done, y, seed);
+}
+
+static void lattice3d_sse2(float *dst, u32 count, s32 x0, s32 y, s32 z,
+		s32 seed)
+{
+	lattice_sse2(dst, count, lattice_hash_base(x0, y, z, seed));
+	u32 done = count & ~3;
+	lattice3d_scalar(dst + done, count - done, x0 + done, y, z, seed);
+}
+
+static inline __m128 lerp_sse2(__m128 v0, __m128 v1, __m128 t)
+{
+	return _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), t));
+}
+
+static void interpolateX_sse2(float *dst, u32 count, const float *r,
+		const u32 *x, const float *tx)
+{
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const u32 *xi = x + i;
+		__m128 v0 = _mm_setr_ps(r[xi[0]], r[xi[1]], r[xi[2]], r[xi[3]]);
+		__m128 v1 = _mm_setr_ps(r[xi[0] + 1], r[xi[1] + 1],
+			r[xi[2] + 1], r[xi[3] + 1]);
+		_mm_storeu_ps(dst + i, lerp_sse2(v0, v1, _mm_loadu_ps(tx + i)));
+	}
+	interpolateX_scalar(dst + i, count - i, r, x + i, tx + i);
+}
+
+static void interpolate2_sse2(float *dst, u32 count,
+		const float *a, const float *b, float t)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, lerp_sse2(
+			_mm_loadu_ps(a + i), _mm_loadu_ps(b + i), vt));
+	interpolate2_scalar(dst + i, count - i, a + i, b + i, t);
+}
+
+static void interpolate4_sse2(float *dst, u32 count,
+		const float *a, const float *b, const float *c, const float *d,
+		float ty, float tz)
+{
+	const __m128 vty = _mm_set1_ps(ty);
+	const __m128 vtz = _mm_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 u = lerp_sse2(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i), vty);
+		__m128 v = lerp_sse2(_mm_loadu_ps(c + i), _mm_loadu_ps(d + i), vty);
+		_mm_storeu_ps(dst + i, lerp_sse2(u, v, vtz));
+	}
+	interpolate4_scalar(dst + i, count - i, a + i, b + i, c + i, d + i,
+		ty, tz);
+}
+
+static void accumulate_sse2(float *result, const float *gradient,
+		u32 count, float g, bool absvalue)
+{
+	const __m128 vg = _mm_set1_ps(g);
+	// Clearing the sign bit is what fabs() does
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(
+		absvalue ? 0x7fffffff : 0xffffffff));
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 grad = _mm_and_ps(_mm_loadu_ps(gradient + i), mask);
+		_mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i),
+			_mm_mul_ps(vg, grad)));
+	}
+	accumulate_scalar(result + i, gradient + i, count - i, g, absvalue);
+}
+
+static void accumulatePersist_sse2(float *result, const float *gradient,
+		u32 count, float *gmap, const float *persistence, bool absvalue)
+{
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(
+		absvalue ? 0x7fffffff : 0xffffffff));
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 grad = _mm_and_ps(_mm_loadu_ps(gradient + i), mask);
+		__m128 vg = _mm_loadu_ps(gmap + i);
+		_mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i),
+			_mm_mul_ps(vg, grad)));
+		_mm_storeu_ps(gmap + i,
+			_mm_mul_ps(vg, _mm_loadu_ps(persistence + i)));
+	}
+	accumulatePersist_scalar(result + i, gradient + i, count - i,
+		gmap + i, persistence + i, absvalue);
+}
+
+static const NoiseKernels kernels_sse2 = {
+	NOISE_SIMD_SSE2,
+	"SSE2",
+	lattice2d_sse2,
+	lattice3d_sse2,
+	interpolateX_sse2,
+	interpolate2_sse2,
+	interpolate4_sse2,
+	accumulate_sse2,
+	accumulatePersist_sse2,
+};
+
+/*
+	AVX2, when the CPU has it
+*/
+
+TARGET_AVX2
+static inline __m256 lattice_hash_avx2(__m256i n)
+{
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	n = _mm256_and_si256(n, mask);
+	n = _mm256_xor_si256(_mm256_srli_epi32(n, 13), n);
+	__m256i m = _mm256_mullo_epi32(_mm256_mullo_epi32(n, n),
+		_mm256_set1_epi32(60493));
+	m = _mm256_add_epi32(m, _mm256_set1_epi32(19990303));
+	n = _mm256_add_epi32(_mm256_mullo_epi32(n, m),
+		_mm256_set1_epi32(1376312589));
+	n = _mm256_and_si256(n, mask);
+	return _mm256_sub_ps(_mm256_set1_ps(1.f),
+		_mm256_div_ps(_mm256_cvtepi32_ps(n), _mm256_set1_ps(0x40000000)));
+}
+
+TARGET_AVX2
+static void lattice_avx2(float *dst, u32 count, u32 base)
+{
+	__m256i n = _mm256_add_epi32(_mm256_set1_epi32(base),
+		_mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(NOISE_MAGIC_X)));
+	const __m256i step = _mm256_set1_epi32(8 * NOISE_MAGIC_X);
+	for (u32 i = 0; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(dst + i, lattice_hash_avx2(n));
+		n = _mm256_add_epi32(n, step);
+	}
+}
+
+TARGET_AVX2
+static void lattice2d_avx2(float *dst, u32 count, s32 x0, s32 y, s32 seed)
+{
+	lattice_avx2(dst, count, lattice_hash_base(x0, y, 0, seed));
+	u32 done = count & ~7;
+	lattice2d_scalar(dst + done, count - done, x0 + done, y, seed);
+}
+
+TARGET_AVX2
+static void lattice3d_avx2(float *dst, u32 count, s32 x0, s32 y, s32 z,
+		s32 seed)
+{
+	lattice_avx2(dst, count, lattice_hash_base(x0, y, z, seed));
+	u32 done = count & ~7;
+	lattice3d_scalar(dst + done, count - done, x0 + done, y, z, seed);
+}
+
+TARGET_AVX2
+static inline __m256 lerp_avx2(__m256 v0, __m256 v1, __m256 t)
+{
+	return _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), t));
+}
+
+TARGET_AVX2
+static void interpolateX_avx2(float *dst, u32 count, const float *r,
+		const u32 *x, const float *tx)
+{
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i vx = _mm256_loadu_si256((const __m256i *)(x + i));
+		__m256 v0 = _mm256_i32gather_ps(r, vx, 4);
+		__m256 v1 = _mm256_i32gather_ps(r + 1, vx, 4);
+		_mm256_storeu_ps(dst + i, lerp_avx2(v0, v1, _mm256_loadu_ps(tx + i)));
+	}
+	interpolateX_scalar(dst + i, count - i, r, x + i, tx + i);
+}
+
+TARGET_AVX2
+static void interpolate2_avx2(float *dst, u32 count,
+		const float *a, const float *b, float t)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, lerp_avx2(
+			_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), vt));
+	interpolate2_scalar(dst + i, count - i, a + i, b + i, t);
+}
+
+TARGET_AVX2
+static void interpolate4_avx2(float *dst, u32 count,
+		const float *a, const float *b, const float *c, const float *d,
+		float ty, float tz)
+{
+	const __m256 vty = _mm256_set1_ps(ty);
+	const __m256 vtz = _mm256_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 u = lerp_avx2(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i),
+			vty);
+		__m256 v = lerp_avx2(_mm256_loadu_ps(c + i), _mm256_loadu_ps(d + i),
+			vty);
+		_mm256_storeu_ps(dst + i, lerp_avx2(u, v, vtz));
+	}
+	interpolate4_scalar(dst + i, count - i, a + i, b + i, c + i, d + i,
+		ty, tz);
+}
+
+TARGET_AVX2
+static void accumulate_avx2(float *result, const float *gradient,
+		u32 count, float g, bool absvalue)
+{
+	const __m256 vg = _mm256_set1_ps(g);
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(
+		absvalue ? 0x7fffffff : 0xffffffff));
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 grad = _mm256_and_ps(_mm256_loadu_ps(gradient + i), mask);
+		_mm256_storeu_ps(result + i, _mm256_add_ps(
+			_mm256_loadu_ps(result + i), _mm256_mul_ps(vg, grad)));
+	}
+	accumulate_scalar(result + i, gradient + i, count - i, g, absvalue);
+}
+
+TARGET_AVX2
+static void accumulatePersist_avx2(float *result, const float *gradient,
+		u32 count, float *gmap, const float *persistence, bool absvalue)
+{
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(
+		absvalue ? 0x7fffffff : 0xffffffff));
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 grad = _mm256_and_ps(_mm256_loadu_ps(gradient + i), mask);
+		__m256 vg = _mm256_loadu_ps(gmap + i);
+		_mm256_storeu_ps(result + i, _mm256_add_ps(
+			_mm256_loadu_ps(result + i), _mm256_mul_ps(vg, grad)));
+		_mm256_storeu_ps(gmap + i,
+			_mm256_mul_ps(vg, _mm256_loadu_ps(persistence + i)));
+	}
+	accumulatePersist_scalar(result + i, gradient + i, count - i,
+		gmap + i, persistence + i, absvalue);
+}
+
+static const NoiseKernels kernels_avx2 = {
+	NOISE_SIMD_AVX2,
+	"AVX2",
+	lattice2d_avx2,
+	lattice3d_avx2,
+	interpolateX_avx2,
+	interpolate2_avx2,
+	interpolate4_avx2,
+	accumulate_avx2,
+	accumulatePersist_avx2,
+};
+
+#endif // NOISE_SIMD_X86
+
+const NoiseKernels *noise_kernels(NoiseSimdLevel level)
+{
+	switch (level) {
+	case NOISE_SIMD_NONE:
+		return &kernels_scalar;
+#ifdef NOISE_SIMD_X86
+	case NOISE_SIMD_SSE2:
+		return &kernels_sse2;
+	case NOISE_SIMD_AVX2:
+		// Also checks that the OS saves the AVX registers
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? &kernels_avx2 : NULL;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const NoiseKernels *find_best_kernels()
+{
+	for (int level = NOISE_SIMD_LEVEL_COUNT - 1; level > 0; level--) {
+		const NoiseKernels *kernels = noise_kernels((NoiseSimdLevel)level);
+		if (kernels)
+			return kernels;
+	}
+	return &kernels_scalar;
+}
+
+const NoiseKernels *noise_kernels()
+{
+	static const NoiseKernels *best = find_best_kernels();
+	return best;
+}
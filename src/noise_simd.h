@@ -0,0 +1,79 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef NOISE_SIMD_HEADER
+#define NOISE_SIMD_HEADER
+
+#include "irrlichttypes.h"
+
+enum NoiseSimdLevel {
+	NOISE_SIMD_NONE,
+	NOISE_SIMD_SSE2,
+	NOISE_SIMD_AVX2,
+	NOISE_SIMD_LEVEL_COUNT
+};
+
+/*
+	The inner loops of Noise maps. Every level computes the same float
+	operations in the same order as the scalar one, so all of them give
+	bit-identical noise and terrain does not depend on the CPU.
+
+	lerp(v0, v1, t) below is v0 + (v1 - v0) * t.
+*/
+struct NoiseKernels
+{
+	NoiseSimdLevel level;
+	const char *name;
+
+	// dst[i] = noise2d(x0 + i, y, seed)
+	void (*lattice2d)(float *dst, u32 count, s32 x0, s32 y, s32 seed);
+	// dst[i] = noise3d(x0 + i, y, z, seed)
+	void (*lattice3d)(float *dst, u32 count, s32 x0, s32 y, s32 z,
+			s32 seed);
+
+	/*
+		Gradient maps are interpolated in X once per lattice row;
+		every row of the map then lies between such rows.
+	*/
+	// dst[i] = lerp(r[x[i]], r[x[i] + 1], tx[i])
+	void (*interpolateX)(float *dst, u32 count, const float *r,
+			const u32 *x, const float *tx);
+	// dst[i] = lerp(a[i], b[i], t)
+	void (*interpolate2)(float *dst, u32 count,
+			const float *a, const float *b, float t);
+	// dst[i] = lerp(lerp(a[i], b[i], ty), lerp(c[i], d[i], ty), tz)
+	void (*interpolate4)(float *dst, u32 count,
+			const float *a, const float *b, const float *c, const float *d,
+			float ty, float tz);
+
+	// result[i] += g * gradient[i], with fabs(gradient[i]) if absvalue
+	void (*accumulate)(float *result, const float *gradient, u32 count,
+			float g, bool absvalue);
+	// result[i] += gmap[i] * gradient[i], then gmap[i] *= persistence[i]
+	void (*accumulatePersist)(float *result, const float *gradient,
+			u32 count, float *gmap, const float *persistence,
+			bool absvalue);
+};
+
+// Kernels of the best level the CPU supports
+const NoiseKernels *noise_kernels();
+// Kernels of a level, NULL if the CPU or compiler does not support it
+const NoiseKernels *noise_kernels(NoiseSimdLevel level);
+
+#endif
@@ -26,6 +26,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serverenvironment.h"
 #include "server.h"
 #include "nodedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "threading/mutex_auto_lock.h"
+#include "util/cpp11_container.h"
+#include <algorithm>
+#include <queue>
 
 //#define PATHFINDER_DEBUG
 //#define PATHFINDER_CALC_TIME
@@ -44,8 +50,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /* Typedefs and macros                                                        */
 /******************************************************************************/
 
-#define LVL "(" << level << ")" <<
-
 #ifdef PATHFINDER_DEBUG
 #define DEBUG_OUT(a)     std::cout << a
 #define INFO_TARGET      std::cout
@@ -58,6 +62,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define ERROR_TARGET     warningstream << "Pathfinder: "
 #endif
 
+/** number of map grid containers kept for later searches */
+#define PATHFINDER_POOL_SIZE 4
+
 /******************************************************************************/
 /* Class definitions                                                          */
 /******************************************************************************/
@@ -126,6 +133,47 @@ class PathGridnode {
 	char      type;                /**< type of node                          */
 };
 
+/** entry of the open set, sorted so that the lowest estimate is on top */
+struct PathOpenEntry {
+	PathOpenEntry(v3s16 ipos, int cost, int estimate) :
+		ipos(ipos),
+		cost(cost),
+		estimate(estimate)
+	{}
+
+	bool operator< (const PathOpenEntry &b) const
+	{
+		if (estimate != b.estimate)
+			return estimate > b.estimate;
+		// prefer the entries closest to the target
+		return cost < b.cost;
+	}
+
+	v3s16 ipos;                    /**< index position of node                */
+	int   cost;                    /**< cost to move here from starting point */
+	int   estimate;                /**< cost plus estimated cost to target    */
+};
+
+/** what a node is to the pathfinder */
+typedef enum {
+	PN_IGNORE,                     /**< not loaded                            */
+	PN_OPEN,                       /**< not walkable                          */
+	PN_SOLID                       /**< walkable                              */
+} PathNodeKind;
+
+/** summary of the nodes of a mapblock */
+typedef enum {
+	PB_UNLOADED,                   /**< block isn't loaded, all nodes ignore  */
+	PB_OPEN,                       /**< no node of block is walkable          */
+	PB_SOLID,                      /**< all nodes of block are walkable       */
+	PB_MIXED                       /**< nodes have to be checked one by one   */
+} PathBlockKind;
+
+struct PathBlock {
+	MapBlock      *block;
+	PathBlockKind kind;
+};
+
 class Pathfinder;
 
 /** Abstract class to manage the map data */
@@ -155,10 +203,26 @@ class ArrayGridNodeContainer : public GridNodeContainer {
 class MapGridNodeContainer : public GridNodeContainer {
 public:
 	virtual ~MapGridNodeContainer() {}
-	MapGridNodeContainer(Pathfinder *pathf);
 	virtual PathGridnode &access(v3s16 p);
+
+	/**
+	 * get an empty container, reusing the memory of earlier searches
+	 * @param pathf pathfinder to initialize nodes for
+	 */
+	static MapGridNodeContainer *acquire(Pathfinder *pathf);
+
+	/**
+	 * give a container back for later searches
+	 * @param container container to give back
+	 */
+	static void release(MapGridNodeContainer *container);
 private:
-	std::map<v3s16, PathGridnode> m_nodes;
+	MapGridNodeContainer() {}
+
+	UNORDERED_MAP<u64, PathGridnode> m_nodes;
+
+	static std::vector<MapGridNodeContainer *> s_pool;
+	static Mutex s_pool_mutex;
 };
 
 /** class doing pathfinding */
@@ -174,7 +238,8 @@ class Pathfinder {
 
 	/**
 	 * path evaluation function
-	 * @param env environment to look for path
+	 * @param map map to look for path
+	 * @param ndef node definitions of map
 	 * @param source origin of path
 	 * @param destination end position of path
 	 * @param searchdistance maximum number of nodes to look in each direction
@@ -182,7 +247,8 @@ class Pathfinder {
 	 * @param max_drop maximum number of blocks a path may drop
 	 * @param algo Algorithm to use for finding a path
 	 */
-	std::vector<v3s16> getPath(ServerEnvironment *env,
+	std::vector<v3s16> getPath(Map *map,
+			INodeDefManager *ndef,
 			v3s16 source,
 			v3s16 destination,
 			unsigned int searchdistance,
@@ -241,6 +307,13 @@ class Pathfinder {
 	 */
 	v3f            tov3f(v3s16 pos);
 
+	/**
+	 * get what a node is to the pathfinder, looking up each mapblock once
+	 * @param pos real world position of node
+	 * @return kind of node
+	 */
+	PathNodeKind   getNodeKind(v3s16 pos);
+
 
 	/* algorithm functions */
 
@@ -251,20 +324,6 @@ class Pathfinder {
 	 */
 	int           getXZManhattanDist(v3s16 pos);
 
-	/**
-	 * get best direction based uppon heuristics
-	 * @param directions list of unchecked directions
-	 * @param g_pos mapnode to start from
-	 * @return direction to check
-	 */
-	v3s16         getDirHeuristic(std::vector<v3s16> &directions, PathGridnode &g_pos);
-
-	/**
-	 * build internal data representation of search area
-	 * @return true/false if costmap creation was successfull
-	 */
-	bool          buildCostmap();
-
 	/**
 	 * calculate cost of movement
 	 * @param pos real world position to start movement
@@ -274,32 +333,20 @@ class Pathfinder {
 	PathCost     calcCost(v3s16 pos, v3s16 dir);
 
 	/**
-	 * recursive update whole search areas total cost information
-	 * @param ipos position to check next
-	 * @param srcdir positionc checked last time
-	 * @param total_cost cost of moving to ipos
-	 * @param level current recursion depth
+	 * update total cost information until the destination is reached,
+	 * expanding the cheapest node first
+	 * @param start_index position to start at
+	 * @param use_heuristic estimate the remaining cost to the destination
 	 * @return true/false path to destination has been found
 	 */
-	bool          updateAllCosts(v3s16 ipos, v3s16 srcdir, int total_cost, int level);
+	bool          updateCosts(v3s16 start_index, bool use_heuristic);
 
 	/**
-	 * recursive try to find a patrh to destionation
-	 * @param ipos position to check next
-	 * @param srcdir positionc checked last time
-	 * @param total_cost cost of moving to ipos
-	 * @param level current recursion depth
-	 * @return true/false path to destination has been found
-	 */
-	bool          updateCostHeuristic(v3s16 ipos, v3s16 srcdir, int current_cost, int level);
-
-	/**
-	 * recursive build a vector containing all nodes from source to destination
+	 * build a vector containing all nodes from source to destination
 	 * @param path vector to add nodes to
-	 * @param pos pos to check next
-	 * @param level recursion depth
+	 * @param ipos index position of destination
 	 */
-	void          buildPath(std::vector<v3s16> &path, v3s16 pos, int level);
+	void          buildPath(std::vector<v3s16> &path, v3s16 ipos);
 
 	/* variables */
 	int m_max_index_x;            /**< max index of search area in x direction  */
@@ -310,7 +357,6 @@ class Pathfinder {
 	int m_searchdistance;         /**< max distance to search in each direction */
 	int m_maxdrop;                /**< maximum number of blocks a path may drop */
 	int m_maxjump;                /**< maximum number of blocks a path may jump */
-	int m_min_target_distance;    /**< current smalest path to target           */
 
 	bool m_prefetch;              /**< prefetch cost data                       */
 
@@ -323,8 +369,15 @@ class Pathfinder {
 		Access it via the getIndexElement/getIdxElem methods. */
 	friend class GridNodeContainer;
 	GridNodeContainer *m_nodes_container;
+	bool m_nodes_pooled;          /**< m_nodes_container is from the pool      */
+
+	/** mapblocks already looked up, by packed block position */
+	UNORDERED_MAP<u64, PathBlock> m_blocks;
+	v3s16 m_last_blockpos;        /**< position of m_last_block                 */
+	PathBlock *m_last_block;      /**< last mapblock looked up                  */
 
-	ServerEnvironment *m_env;     /**< minetest environment pointer             */
+	Map *m_map;                   /**< map to search                            */
+	INodeDefManager *m_ndef;      /**< node definitions of map                  */
 
 #ifdef PATHFINDER_DEBUG
 
@@ -386,14 +439,44 @@ std::vector<v3s16> get_path(ServerEnvironment* env,
 							unsigned int max_jump,
 							unsigned int max_drop,
 							PathAlgorithm algo)
+{
+	//check parameters
+	if (env == 0) {
+		ERROR_TARGET << "missing environment pointer" << std::endl;
+		return std::vector<v3s16>();
+	}
+
+	return get_path(&env->getMap(), env->getGameDef()->ndef(),
+				source, destination,
+				searchdistance, max_jump, max_drop, algo);
+}
+
+/******************************************************************************/
+std::vector<v3s16> get_path(Map *map,
+							INodeDefManager *ndef,
+							v3s16 source,
+							v3s16 destination,
+							unsigned int searchdistance,
+							unsigned int max_jump,
+							unsigned int max_drop,
+							PathAlgorithm algo)
 {
 	Pathfinder searchclass;
 
-	return searchclass.getPath(env,
+	return searchclass.getPath(map, ndef,
 				source, destination,
 				searchdistance, max_jump, max_drop, algo);
 }
 
+/******************************************************************************/
+/** key of a position in hash maps */
+static inline u64 pos_key(v3s16 p)
+{
+	return (u64)(u16)p.X |
+		((u64)(u16)p.Y << 16) |
+		((u64)(u16)p.Z << 32);
+}
+
 /******************************************************************************/
 PathCost::PathCost()
 :	valid(false),
@@ -514,20 +597,18 @@ void PathGridnode::setCost(v3s16 dir, const PathCost &cost)
 
 void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 {
-	INodeDefManager *ndef = m_pathf->m_env->getGameDef()->ndef();
 	PathGridnode &elem = *p_node;
 
 	v3s16 realpos = m_pathf->getRealPos(ipos);
 
-	MapNode current = m_pathf->m_env->getMap().getNodeNoEx(realpos);
-	MapNode below   = m_pathf->m_env->getMap().getNodeNoEx(realpos + v3s16(0, -1, 0));
+	PathNodeKind current = m_pathf->getNodeKind(realpos);
+	PathNodeKind below   = m_pathf->getNodeKind(realpos + v3s16(0, -1, 0));
 
 
-	if ((current.param0 == CONTENT_IGNORE) ||
-			(below.param0 == CONTENT_IGNORE)) {
+	if ((current == PN_IGNORE) || (below == PN_IGNORE)) {
 		DEBUG_OUT("Pathfinder: " << PP(realpos) <<
 			" current or below is invalid element" << std::endl);
-		if (current.param0 == CONTENT_IGNORE) {
+		if (current == PN_IGNORE) {
 			elem.type = 'i';
 			DEBUG_OUT(PP(ipos) << ": " << 'i' << std::endl);
 		}
@@ -535,10 +616,10 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 
 	//don't add anything if it isn't an air node
-	if (ndef->get(current).walkable || !ndef->get(below).walkable) {
+	if ((current == PN_SOLID) || (below != PN_SOLID)) {
 			DEBUG_OUT("Pathfinder: " << PP(realpos)
 				<< " not on surface" << std::endl);
-			if (ndef->get(current).walkable) {
+			if (current == PN_SOLID) {
 				elem.type = 's';
 				DEBUG_OUT(PP(ipos) << ": " << 's' << std::endl);
 			} else {
@@ -584,18 +665,48 @@ PathGridnode &ArrayGridNodeContainer::access(v3s16 p)
 	return m_nodes_array[p.X * m_x_stride + p.Y * m_y_stride + p.Z];
 }
 
-MapGridNodeContainer::MapGridNodeContainer(Pathfinder *pathf)
+std::vector<MapGridNodeContainer *> MapGridNodeContainer::s_pool;
+Mutex MapGridNodeContainer::s_pool_mutex;
+
+MapGridNodeContainer *MapGridNodeContainer::acquire(Pathfinder *pathf)
 {
-	m_pathf = pathf;
+	MapGridNodeContainer *container = NULL;
+	{
+		MutexAutoLock lock(s_pool_mutex);
+		if (!s_pool.empty()) {
+			container = s_pool.back();
+			s_pool.pop_back();
+		}
+	}
+	if (container == NULL)
+		container = new MapGridNodeContainer();
+	container->m_pathf = pathf;
+	return container;
+}
+
+void MapGridNodeContainer::release(MapGridNodeContainer *container)
+{
+	// clear() keeps the buckets for the next search
+	container->m_nodes.clear();
+	container->m_pathf = NULL;
+	{
+		MutexAutoLock lock(s_pool_mutex);
+		if (s_pool.size() < PATHFINDER_POOL_SIZE) {
+			s_pool.push_back(container);
+			return;
+		}
+	}
+	delete container;
 }
 
 PathGridnode &MapGridNodeContainer::access(v3s16 p)
 {
-	std::map<v3s16, PathGridnode>::iterator it = m_nodes.find(p);
+	u64 key = pos_key(p);
+	UNORDERED_MAP<u64, PathGridnode>::iterator it = m_nodes.find(key);
 	if (it != m_nodes.end()) {
 		return it->second;
 	}
-	PathGridnode &n = m_nodes[p];
+	PathGridnode &n = m_nodes[key];
 	initNode(p, &n);
 	return n;
 }
@@ -603,7 +714,8 @@ PathGridnode &MapGridNodeContainer::access(v3s16 p)
 
 
 /******************************************************************************/
-std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
+std::vector<v3s16> Pathfinder::getPath(Map *map,
+							INodeDefManager *ndef,
 							v3s16 source,
 							v3s16 destination,
 							unsigned int searchdistance,
@@ -617,19 +729,13 @@ std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
 #endif
 	std::vector<v3s16> retval;
 
-	//check parameters
-	if (env == 0) {
-		ERROR_TARGET << "missing environment pointer" << std::endl;
-		return retval;
-	}
-
 	m_searchdistance = searchdistance;
-	m_env = env;
+	m_map = map;
+	m_ndef = ndef;
 	m_maxjump = max_jump;
 	m_maxdrop = max_drop;
 	m_start       = source;
 	m_destination = destination;
-	m_min_target_distance = -1;
 	m_prefetch = true;
 
 	if (algo == PA_PLAIN_NP) {
@@ -659,11 +765,19 @@ std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
 	m_max_index_y = diff.Y;
 	m_max_index_z = diff.Z;
 
-	delete m_nodes_container;
+	if (m_nodes_pooled)
+		MapGridNodeContainer::release(
+			static_cast<MapGridNodeContainer *>(m_nodes_container));
+	else
+		delete m_nodes_container;
+	m_blocks.clear();
+	m_last_block = NULL;
 	if (diff.getLength() > 5) {
-		m_nodes_container = new MapGridNodeContainer(this);
+		m_nodes_container = MapGridNodeContainer::acquire(this);
+		m_nodes_pooled = true;
 	} else {
 		m_nodes_container = new ArrayGridNodeContainer(this, diff);
+		m_nodes_pooled = false;
 	}
 #ifdef PATHFINDER_DEBUG
 	printType();
@@ -699,11 +813,11 @@ std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
 
 	switch (algo) {
 		case PA_DIJKSTRA:
-			update_cost_retval = updateAllCosts(StartIndex, v3s16(0, 0, 0), 0, 0);
+			update_cost_retval = updateCosts(StartIndex, false);
 			break;
 		case PA_PLAIN_NP:
 		case PA_PLAIN:
-			update_cost_retval = updateCostHeuristic(StartIndex, v3s16(0, 0, 0), 0, 0);
+			update_cost_retval = updateCosts(StartIndex, true);
 			break;
 		default:
 			ERROR_TARGET << "missing PathAlgorithm"<< std::endl;
@@ -719,7 +833,7 @@ std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
 
 		//find path
 		std::vector<v3s16> path;
-		buildPath(path, EndIndex, 0);
+		buildPath(path, EndIndex);
 
 #ifdef PATHFINDER_DEBUG
 		std::cout << "Full index path:" << std::endl;
@@ -728,6 +842,7 @@ std::vector<v3s16> Pathfinder::getPath(ServerEnvironment *env,
 
 		//finalize path
 		std::vector<v3s16> full_path;
+		full_path.reserve(path.size());
 		for (std::vector<v3s16>::iterator i = path.begin();
 					i != path.end(); ++i) {
 			full_path.push_back(getIndexElement(*i).pos);
@@ -771,19 +886,25 @@ Pathfinder::Pathfinder() :
 	m_searchdistance(0),
 	m_maxdrop(0),
 	m_maxjump(0),
-	m_min_target_distance(0),
 	m_prefetch(true),
 	m_start(0, 0, 0),
 	m_destination(0, 0, 0),
 	m_nodes_container(NULL),
-	m_env(0)
+	m_nodes_pooled(false),
+	m_last_block(NULL),
+	m_map(NULL),
+	m_ndef(NULL)
 {
 	//intentionaly empty
 }
 
 Pathfinder::~Pathfinder()
 {
-	delete m_nodes_container;
+	if (m_nodes_pooled)
+		MapGridNodeContainer::release(
+			static_cast<MapGridNodeContainer *>(m_nodes_container));
+	else
+		delete m_nodes_container;
 }
 /******************************************************************************/
 v3s16 Pathfinder::getRealPos(v3s16 ipos)
@@ -791,10 +912,66 @@ v3s16 Pathfinder::getRealPos(v3s16 ipos)
 	return m_limits.MinEdge + ipos;
 }
 
+/******************************************************************************/
+PathNodeKind Pathfinder::getNodeKind(v3s16 pos)
+{
+	v3s16 blockpos = getNodeBlockPos(pos);
+
+	if (m_last_block == NULL || blockpos != m_last_blockpos) {
+		u64 key = pos_key(blockpos);
+		UNORDERED_MAP<u64, PathBlock>::iterator it = m_blocks.find(key);
+		if (it == m_blocks.end()) {
+			PathBlock b;
+			b.block = m_map->getBlockNoCreateNoEx(blockpos);
+			b.kind  = PB_UNLOADED;
+			if (b.block && !b.block->isDummy()) {
+				// the content list of the block contains at least
+				// every content in it, so it tells if it is uniform
+				const std::vector<content_t> &contents =
+						b.block->getContents();
+				u32 walkable = 0;
+				bool has_ignore = false;
+				for (std::vector<content_t>::const_iterator
+						c = contents.begin(); c != contents.end(); ++c) {
+					if (*c == CONTENT_IGNORE)
+						has_ignore = true;
+					else if (m_ndef->get(*c).walkable)
+						walkable++;
+				}
+				if (has_ignore || (walkable > 0 && walkable < contents.size()))
+					b.kind = PB_MIXED;
+				else if (walkable > 0)
+					b.kind = PB_SOLID;
+				else
+					b.kind = PB_OPEN;
+			}
+			it = m_blocks.insert(std::make_pair(key, b)).first;
+		}
+		m_last_blockpos = blockpos;
+		m_last_block    = &it->second;
+	}
+
+	switch (m_last_block->kind) {
+		case PB_UNLOADED:
+			return PN_IGNORE;
+		case PB_OPEN:
+			return PN_OPEN;
+		case PB_SOLID:
+			return PN_SOLID;
+		default:
+			break;
+	}
+
+	v3s16 relpos = pos - blockpos * MAP_BLOCKSIZE;
+	const MapNode &n = m_last_block->block->getNodeUnsafe(relpos);
+	if (n.getContent() == CONTENT_IGNORE)
+		return PN_IGNORE;
+	return m_ndef->get(n).walkable ? PN_SOLID : PN_OPEN;
+}
+
 /******************************************************************************/
 PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 {
-	INodeDefManager *ndef = m_env->getGameDef()->ndef();
 	PathCost retval;
 
 	retval.updated = true;
@@ -808,27 +985,26 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_env->getMap().getNodeNoEx(pos2);
+	PathNodeKind node_at_pos2 = getNodeKind(pos2);
 
 	//did we get information about node?
-	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
+	if (node_at_pos2 == PN_IGNORE) {
 			VERBOSE_TARGET << "Pathfinder: (1) area at pos: "
 					<< PP(pos2) << " not loaded";
 			return retval;
 	}
 
-	if (!ndef->get(node_at_pos2).walkable) {
-		MapNode node_below_pos2 =
-							m_env->getMap().getNodeNoEx(pos2 + v3s16(0, -1, 0));
+	if (node_at_pos2 != PN_SOLID) {
+		PathNodeKind node_below_pos2 = getNodeKind(pos2 + v3s16(0, -1, 0));
 
 		//did we get information about node?
-		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
+		if (node_below_pos2 == PN_IGNORE) {
 				VERBOSE_TARGET << "Pathfinder: (2) area at pos: "
 					<< PP((pos2 + v3s16(0, -1, 0))) << " not loaded";
 				return retval;
 		}
 
-		if (ndef->get(node_below_pos2).walkable) {
+		if (node_below_pos2 == PN_SOLID) {
 			retval.valid = true;
 			retval.value = 1;
 			retval.direction = 0;
@@ -836,20 +1012,18 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 					<< " cost same height found" << std::endl);
 		}
 		else {
-			v3s16 testpos = pos2 - v3s16(0, -1, 0);
-			MapNode node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+			v3s16 testpos = pos2 + v3s16(0, -1, 0);
+			PathNodeKind node_at_pos = node_below_pos2;
 
-			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-					(!ndef->get(node_at_pos).walkable) &&
+			while ((node_at_pos == PN_OPEN) &&
 					(testpos.Y > m_limits.MinEdge.Y)) {
 				testpos += v3s16(0, -1, 0);
-				node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+				node_at_pos = getNodeKind(testpos);
 			}
 
 			//did we find surface?
 			if ((testpos.Y >= m_limits.MinEdge.Y) &&
-					(node_at_pos.param0 != CONTENT_IGNORE) &&
-					(ndef->get(node_at_pos).walkable)) {
+					(node_at_pos == PN_SOLID)) {
 				if ((pos2.Y - testpos.Y - 1) <= m_maxdrop) {
 					retval.valid = true;
 					retval.value = 2;
@@ -871,18 +1045,17 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 	}
 	else {
 		v3s16 testpos = pos2;
-		MapNode node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+		PathNodeKind node_at_pos = node_at_pos2;
 
-		while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-				(ndef->get(node_at_pos).walkable) &&
+		while ((node_at_pos == PN_SOLID) &&
 				(testpos.Y < m_limits.MaxEdge.Y)) {
 			testpos += v3s16(0, 1, 0);
-			node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+			node_at_pos = getNodeKind(testpos);
 		}
 
 		//did we find surface?
 		if ((testpos.Y <= m_limits.MaxEdge.Y) &&
-				(!ndef->get(node_at_pos).walkable)) {
+				(node_at_pos != PN_SOLID)) {
 
 			if (testpos.Y - pos2.Y <= m_maxjump) {
 				retval.valid = true;
@@ -947,93 +1120,6 @@ v3s16 Pathfinder::invert(v3s16 pos)
 	return retval;
 }
 
-/******************************************************************************/
-bool Pathfinder::updateAllCosts(v3s16 ipos,
-								v3s16 srcdir,
-								int current_cost,
-								int level)
-{
-	PathGridnode &g_pos = getIndexElement(ipos);
-	g_pos.totalcost = current_cost;
-	g_pos.sourcedir = srcdir;
-
-	level ++;
-
-	//check if target has been found
-	if (g_pos.target) {
-		m_min_target_distance = current_cost;
-		DEBUG_OUT(LVL " Pathfinder: target found!" << std::endl);
-		return true;
-	}
-
-	bool retval = false;
-
-	std::vector<v3s16> directions;
-
-	directions.push_back(v3s16( 1,0, 0));
-	directions.push_back(v3s16(-1,0, 0));
-	directions.push_back(v3s16( 0,0, 1));
-	directions.push_back(v3s16( 0,0,-1));
-
-	for (unsigned int i=0; i < directions.size(); i++) {
-		if (directions[i] != srcdir) {
-			PathCost cost = g_pos.getCost(directions[i]);
-
-			if (cost.valid) {
-				directions[i].Y = cost.direction;
-
-				v3s16 ipos2 = ipos + directions[i];
-
-				if (!isValidIndex(ipos2)) {
-					DEBUG_OUT(LVL " Pathfinder: " << PP(ipos2) <<
-						" out of range, max=" << PP(m_limits.MaxEdge) << std::endl);
-					continue;
-				}
-
-				PathGridnode &g_pos2 = getIndexElement(ipos2);
-
-				if (!g_pos2.valid) {
-					VERBOSE_TARGET << LVL "Pathfinder: no data for new position: "
-												<< PP(ipos2) << std::endl;
-					continue;
-				}
-
-				assert(cost.value > 0);
-
-				int new_cost = current_cost + cost.value;
-
-				// check if there already is a smaller path
-				if ((m_min_target_distance > 0) &&
-						(m_min_target_distance < new_cost)) {
-					return false;
-				}
-
-				if ((g_pos2.totalcost < 0) ||
-						(g_pos2.totalcost > new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder: updating path at: "<<
-							PP(ipos2) << " from: " << g_pos2.totalcost << " to "<<
-							new_cost << std::endl);
-					if (updateAllCosts(ipos2, invert(directions[i]),
-											new_cost, level)) {
-						retval = true;
-						}
-					}
-				else {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already found shorter path to: "
-							<< PP(ipos2) << std::endl);
-				}
-			}
-			else {
-				DEBUG_OUT(LVL "Pathfinder:"
-						" not moving to invalid direction: "
-						<< PP(directions[i]) << std::endl);
-			}
-		}
-	}
-	return retval;
-}
-
 /******************************************************************************/
 int Pathfinder::getXZManhattanDist(v3s16 pos)
 {
@@ -1046,189 +1132,131 @@ int Pathfinder::getXZManhattanDist(v3s16 pos)
 }
 
 /******************************************************************************/
-v3s16 Pathfinder::getDirHeuristic(std::vector<v3s16> &directions, PathGridnode &g_pos)
+bool Pathfinder::updateCosts(v3s16 start_index, bool use_heuristic)
 {
-	int   minscore = -1;
-	v3s16 retdir   = v3s16(0, 0, 0);
-	v3s16 srcpos = g_pos.pos;
-	DEBUG_OUT("Pathfinder: remaining dirs at beginning:"
-				<< directions.size() << std::endl);
-
-	for (std::vector<v3s16>::iterator iter = directions.begin();
-			iter != directions.end();
-			++iter) {
-
-		v3s16 pos1 = v3s16(srcpos.X + iter->X, 0, srcpos.Z+iter->Z);
-
-		int cur_manhattan = getXZManhattanDist(pos1);
-		PathCost cost    = g_pos.getCost(*iter);
-
-		if (!cost.updated) {
-			cost = calcCost(g_pos.pos, *iter);
-			g_pos.setCost(*iter, cost);
+	static const v3s16 directions[4] = {
+		v3s16( 1, 0,  0),
+		v3s16(-1, 0,  0),
+		v3s16( 0, 0,  1),
+		v3s16( 0, 0, -1)
+	};
+
+	// Every move changes the xz position by one node and costs at least
+	// one, so the manhattan distance never overestimates the remaining
+	// cost and the first path to reach the target is a shortest one.
+	std::priority_queue<PathOpenEntry> open;
+	int estimate = use_heuristic ? getXZManhattanDist(m_start) : 0;
+	open.push(PathOpenEntry(start_index, 0, estimate));
+
+	while (!open.empty()) {
+		PathOpenEntry entry = open.top();
+		open.pop();
+
+		PathGridnode &g_pos = getIndexElement(entry.ipos);
+
+		// a cheaper way to this node has been queued since
+		if (entry.cost != g_pos.totalcost)
+			continue;
+
+		//check if target has been found
+		if (g_pos.target) {
+			DEBUG_OUT("Pathfinder: target found!" << std::endl);
+			return true;
 		}
 
-		if (cost.valid) {
-			int score = cost.value + cur_manhattan;
+		for (unsigned int i = 0; i < 4; i++) {
+			v3s16 direction = directions[i];
+			PathCost cost = g_pos.getCost(direction);
 
-			if ((minscore < 0)|| (score < minscore)) {
-				minscore = score;
-				retdir = *iter;
+			if (!cost.updated) {
+				cost = calcCost(g_pos.pos, direction);
+				g_pos.setCost(direction, cost);
 			}
-		}
-	}
 
-	if (retdir != v3s16(0, 0, 0)) {
-		for (std::vector<v3s16>::iterator iter = directions.begin();
-					iter != directions.end();
-					++iter) {
-			if(*iter == retdir) {
-				DEBUG_OUT("Pathfinder: removing return direction" << std::endl);
-				directions.erase(iter);
-				break;
+			if (!cost.valid) {
+				DEBUG_OUT("Pathfinder:"
+						" not moving to invalid direction: "
+						<< PP(direction) << std::endl);
+				continue;
 			}
-		}
-	}
-	else {
-		DEBUG_OUT("Pathfinder: didn't find any valid direction clearing"
-					<< std::endl);
-		directions.clear();
-	}
-	DEBUG_OUT("Pathfinder: remaining dirs at end:" << directions.size()
-				<< std::endl);
-	return retdir;
-}
-
-/******************************************************************************/
-bool Pathfinder::updateCostHeuristic(	v3s16 ipos,
-										v3s16 srcdir,
-										int current_cost,
-										int level)
-{
-
-	PathGridnode &g_pos = getIndexElement(ipos);
-	g_pos.totalcost = current_cost;
-	g_pos.sourcedir = srcdir;
-
-	level ++;
-
-	//check if target has been found
-	if (g_pos.target) {
-		m_min_target_distance = current_cost;
-		DEBUG_OUT(LVL " Pathfinder: target found!" << std::endl);
-		return true;
-	}
-
-	bool retval = false;
-
-	std::vector<v3s16> directions;
 
-	directions.push_back(v3s16( 1, 0,  0));
-	directions.push_back(v3s16(-1, 0,  0));
-	directions.push_back(v3s16( 0, 0,  1));
-	directions.push_back(v3s16( 0, 0, -1));
+			direction.Y = cost.direction;
 
-	v3s16 direction = getDirHeuristic(directions, g_pos);
+			v3s16 ipos2 = entry.ipos + direction;
 
-	while (direction != v3s16(0, 0, 0) && (!retval)) {
-
-		if (direction != srcdir) {
-			PathCost cost = g_pos.getCost(direction);
-
-			if (cost.valid) {
-				direction.Y = cost.direction;
-
-				v3s16 ipos2 = ipos + direction;
+			if (!isValidIndex(ipos2)) {
+				DEBUG_OUT("Pathfinder: " << PP(ipos2) <<
+					" out of range, max=" << PP(m_limits.MaxEdge) << std::endl);
+				continue;
+			}
 
-				if (!isValidIndex(ipos2)) {
-					DEBUG_OUT(LVL " Pathfinder: " << PP(ipos2) <<
-						" out of range, max=" << PP(m_limits.MaxEdge) << std::endl);
-					direction = getDirHeuristic(directions, g_pos);
-					continue;
-				}
+			PathGridnode &g_pos2 = getIndexElement(ipos2);
 
-				PathGridnode &g_pos2 = getIndexElement(ipos2);
+			if (!g_pos2.valid) {
+				VERBOSE_TARGET << "Pathfinder: no data for new position: "
+											<< PP(ipos2) << std::endl;
+				continue;
+			}
 
-				if (!g_pos2.valid) {
-					VERBOSE_TARGET << LVL "Pathfinder: no data for new position: "
-												<< PP(ipos2) << std::endl;
-					direction = getDirHeuristic(directions, g_pos);
-					continue;
-				}
+			assert(cost.value > 0);
 
-				assert(cost.value > 0);
+			int new_cost = entry.cost + cost.value;
 
-				int new_cost = current_cost + cost.value;
+			if ((g_pos2.totalcost >= 0) &&
+					(g_pos2.totalcost <= new_cost)) {
+				DEBUG_OUT("Pathfinder:"
+						" already found shorter path to: "
+						<< PP(ipos2) << std::endl);
+				continue;
+			}
 
-				// check if there already is a smaller path
-				if ((m_min_target_distance > 0) &&
-						(m_min_target_distance < new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already longer than best already found path "
-							<< PP(ipos2) << std::endl);
-					return false;
-				}
+			DEBUG_OUT("Pathfinder: updating path at: "<<
+					PP(ipos2) << " from: " << g_pos2.totalcost << " to "<<
+					new_cost << std::endl);
+			g_pos2.totalcost = new_cost;
+			g_pos2.sourcedir = invert(direction);
 
-				if ((g_pos2.totalcost < 0) ||
-						(g_pos2.totalcost > new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder: updating path at: "<<
-							PP(ipos2) << " from: " << g_pos2.totalcost << " to "<<
-							new_cost << " srcdir=" <<
-							PP(invert(direction))<< std::endl);
-					if (updateCostHeuristic(ipos2, invert(direction),
-											new_cost, level)) {
-						retval = true;
-						}
-					}
-				else {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already found shorter path to: "
-							<< PP(ipos2) << std::endl);
-				}
-			}
-			else {
-				DEBUG_OUT(LVL "Pathfinder:"
-						" not moving to invalid direction: "
-						<< PP(direction) << std::endl);
-			}
-		}
-		else {
-			DEBUG_OUT(LVL "Pathfinder:"
-							" skipping srcdir: "
-							<< PP(direction) << std::endl);
+			estimate = new_cost;
+			if (use_heuristic)
+				estimate += getXZManhattanDist(g_pos2.pos);
+			open.push(PathOpenEntry(ipos2, new_cost, estimate));
 		}
-		direction = getDirHeuristic(directions, g_pos);
 	}
-	return retval;
+	return false;
 }
 
 /******************************************************************************/
-void Pathfinder::buildPath(std::vector<v3s16> &path, v3s16 pos, int level)
+void Pathfinder::buildPath(std::vector<v3s16> &path, v3s16 ipos)
 {
-	level ++;
-	if (level > 700) {
-		ERROR_TARGET
-			<< LVL "Pathfinder: path is too long aborting" << std::endl;
-		return;
-	}
+	// every step costs at least one
+	int max_length = getIndexElement(ipos).totalcost + 1;
+
+	for (;;) {
+		PathGridnode &g_pos = getIndexElement(ipos);
+		if (!g_pos.valid) {
+			ERROR_TARGET
+				<< "Pathfinder: invalid next pos detected aborting" << std::endl;
+			path.clear();
+			return;
+		}
 
-	PathGridnode &g_pos = getIndexElement(pos);
-	if (!g_pos.valid) {
-		ERROR_TARGET
-			<< LVL "Pathfinder: invalid next pos detected aborting" << std::endl;
-		return;
-	}
+		g_pos.is_element = true;
+		path.push_back(ipos);
 
-	g_pos.is_element = true;
+		//check if source reached
+		if (g_pos.source)
+			break;
 
-	//check if source reached
-	if (g_pos.source) {
-		path.push_back(pos);
-		return;
+		if ((int)path.size() > max_length) {
+			ERROR_TARGET
+				<< "Pathfinder: path is too long aborting" << std::endl;
+			path.clear();
+			return;
+		}
+		ipos += g_pos.sourcedir;
 	}
 
-	buildPath(path, pos + g_pos.sourcedir, level);
-	path.push_back(pos);
+	std::reverse(path.begin(), path.end());
 }
 
 /******************************************************************************/
@@ -31,6 +31,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /******************************************************************************/
 
 class ServerEnvironment;
+class Map;
+class INodeDefManager;
 
 /******************************************************************************/
 /* Typedefs and macros                                                        */
@@ -63,4 +65,14 @@ std::vector<v3s16> get_path(ServerEnvironment *env,
 							unsigned int max_drop,
 							PathAlgorithm algo);
 
+/** search a path on a map, see get_path() above */
+std::vector<v3s16> get_path(Map *map,
+							INodeDefManager *ndef,
+							v3s16 source,
+							v3s16 destination,
+							unsigned int searchdistance,
+							unsigned int max_jump,
+							unsigned int max_drop,
+							PathAlgorithm algo);
+
 #endif /* PATHFINDER_H_ */
@@ -18,36 +18,396 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "profiler.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "filesys.h"
+#include "porting.h"
+#include "util/serialize.h"
+#include "util/cpp11_container.h"
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
 
 static Profiler main_profiler;
 Profiler *g_profiler = &main_profiler;
 ScopeProfiler::ScopeProfiler(
 		Profiler *profiler, const std::string &name, ScopeProfilerType type)
-    : m_profiler(profiler), m_name(name), m_timer(NULL), m_type(type)
+    : m_profiler(profiler), m_name(name), m_start_us(0), m_type(type)
 {
 	if (m_profiler)
-		m_timer = new TimeTaker(m_name);
+		m_start_us = porting::getTimeUs();
+	if (g_trace_profiler->isTracing())
+		m_zone_scope.begin(g_trace_profiler->getZoneId(name));
 }
 
 ScopeProfiler::~ScopeProfiler()
 {
-	if (!m_timer)
+	if (!m_profiler)
+		return;
+
+	float duration = (porting::getTimeUs() - m_start_us) / 1000000.0;
+	switch (m_type) {
+	case SPT_ADD:
+		m_profiler->add(m_name, duration);
+		break;
+	case SPT_AVG:
+		m_profiler->avg(m_name, duration);
+		break;
+	case SPT_GRAPH_ADD:
+		m_profiler->graphAdd(m_name, duration);
+		break;
+	}
+}
+
+/*
+	Trace profiler
+*/
+
+static TraceProfiler main_trace_profiler;
+TraceProfiler *g_trace_profiler = &main_trace_profiler;
+
+struct TraceEvent
+{
+	u64 start_us;
+	u32 duration_us;
+	u32 self_us;
+	u16 zone;
+};
+
+/*
+	Written by its thread only, read by aggregate(): the thread moves
+	write_index after an event is complete and aggregate() moves
+	read_index after it has read the events.
+*/
+struct TraceThreadBuffer
+{
+	TraceEvent events[TRACE_RING_SIZE];
+	Atomic<u32> write_index;
+	Atomic<u32> read_index;
+	Atomic<u32> dropped;
+	// Set when the thread ends, the buffer is deleted once drained
+	Atomic<bool> exited;
+	u32 thread_index;
+
+	// Open scopes, only used by the thread itself
+	u16 depth;
+	u32 child_us[TRACE_MAX_DEPTH];
+	// Zones of scope profilers, only used by the thread itself
+	UNORDERED_MAP<std::string, u16> zone_ids;
+
+	TraceThreadBuffer(u32 thread_index_):
+		write_index(0),
+		read_index(0),
+		dropped(0),
+		exited(false),
+		thread_index(thread_index_),
+		depth(0)
+	{}
+};
+
+/*
+	The buffer of every thread is kept in a thread-local slot. Threads
+	of Windows do not clean it up, their buffers stay allocated.
+*/
+#ifdef _WIN32
+static DWORD trace_buffer_key = TlsAlloc();
+
+static TraceThreadBuffer *get_trace_buffer()
+{
+	return (TraceThreadBuffer *)TlsGetValue(trace_buffer_key);
+}
+
+static void set_trace_buffer(TraceThreadBuffer *buffer)
+{
+	TlsSetValue(trace_buffer_key, buffer);
+}
+#else
+static void trace_buffer_thread_exit(void *buffer)
+{
+	((TraceThreadBuffer *)buffer)->exited = true;
+}
+
+static pthread_key_t create_trace_buffer_key()
+{
+	pthread_key_t key;
+	pthread_key_create(&key, trace_buffer_thread_exit);
+	return key;
+}
+
+static pthread_key_t trace_buffer_key = create_trace_buffer_key();
+
+static TraceThreadBuffer *get_trace_buffer()
+{
+	return (TraceThreadBuffer *)pthread_getspecific(trace_buffer_key);
+}
+
+static void set_trace_buffer(TraceThreadBuffer *buffer)
+{
+	pthread_setspecific(trace_buffer_key, buffer);
+}
+#endif
+
+ProfilerZone::ProfilerZone(const std::string &name):
+	m_id(g_trace_profiler->registerZone(name))
+{
+}
+
+void ZoneScope::begin(u16 zone)
+{
+	if (!g_trace_profiler->isEnabled())
 		return;
 
-	float duration_ms = m_timer->stop(true);
-	float duration = duration_ms / 1000.0;
-	if (m_profiler) {
-		switch (m_type) {
-		case SPT_ADD:
-			m_profiler->add(m_name, duration);
-			break;
-		case SPT_AVG:
-			m_profiler->avg(m_name, duration);
-			break;
-		case SPT_GRAPH_ADD:
-			m_profiler->graphAdd(m_name, duration);
-			break;
+	m_buffer = g_trace_profiler->getThreadBuffer();
+	m_zone = zone;
+	if (m_buffer->depth < TRACE_MAX_DEPTH)
+		m_buffer->child_us[m_buffer->depth] = 0;
+	m_buffer->depth++;
+	m_start_us = porting::getTimeUs();
+}
+
+void ZoneScope::end()
+{
+	TraceThreadBuffer *b = m_buffer;
+	u32 duration_us = porting::getTimeUs() - m_start_us;
+	u16 depth = --b->depth;
+
+	u32 self_us = duration_us;
+	if (depth < TRACE_MAX_DEPTH)
+		self_us -= MYMIN(b->child_us[depth], duration_us);
+	if (depth > 0 && depth <= TRACE_MAX_DEPTH)
+		b->child_us[depth - 1] += duration_us;
+
+	u32 w = b->write_index;
+	if (w - b->read_index >= TRACE_RING_SIZE) {
+		b->dropped++;
+		return;
+	}
+	TraceEvent &e = b->events[w & (TRACE_RING_SIZE - 1)];
+	e.start_us = m_start_us;
+	e.duration_us = duration_us;
+	e.self_us = self_us;
+	e.zone = m_zone;
+	b->write_index = w + 1;
+}
+
+TraceZoneStats::TraceZoneStats():
+	count(0),
+	total_us(0),
+	self_us(0),
+	max_us(0)
+{
+	memset(histogram, 0, sizeof(histogram));
+}
+
+void TraceZoneStats::add(u32 duration_us, u32 self_us_)
+{
+	count++;
+	total_us += duration_us;
+	self_us += self_us_;
+	max_us = MYMAX(max_us, duration_us);
+
+	u32 bucket = 0;
+	while (duration_us >= 2 && bucket < TRACE_HISTOGRAM_BUCKETS - 1) {
+		duration_us >>= 1;
+		bucket++;
+	}
+	histogram[bucket]++;
+}
+
+TraceProfiler::TraceProfiler():
+	m_enabled(false),
+	m_tracing(false),
+	m_next_thread_index(1),
+	m_dropped(0),
+	m_trace_file(NULL),
+	m_trace_count(0)
+{
+}
+
+TraceProfiler::~TraceProfiler()
+{
+	if (m_tracing)
+		stopTrace();
+	// Buffers of running threads are left alone
+}
+
+u16 TraceProfiler::registerZone(const std::string &name)
+{
+	MutexAutoLock lock(m_mutex);
+	std::map<std::string, u16>::iterator it = m_zone_ids.find(name);
+	if (it != m_zone_ids.end())
+		return it->second;
+
+	u16 id = m_zone_names.size();
+	m_zone_names.push_back(name);
+	m_zone_ids[name] = id;
+	m_stats.push_back(TraceZoneStats());
+	return id;
+}
+
+u16 TraceProfiler::getZoneId(const std::string &name)
+{
+	// Only registerZone() takes the mutex, once per name and thread
+	UNORDERED_MAP<std::string, u16> &zone_ids = getThreadBuffer()->zone_ids;
+	UNORDERED_MAP<std::string, u16>::const_iterator it = zone_ids.find(name);
+	if (it != zone_ids.end())
+		return it->second;
+
+	u16 id = registerZone(name);
+	zone_ids[name] = id;
+	return id;
+}
+
+TraceThreadBuffer *TraceProfiler::getThreadBuffer()
+{
+	TraceThreadBuffer *buffer = get_trace_buffer();
+	if (buffer)
+		return buffer;
+
+	MutexAutoLock lock(m_mutex);
+	buffer = new TraceThreadBuffer(m_next_thread_index++);
+	m_buffers.push_back(buffer);
+	set_trace_buffer(buffer);
+	return buffer;
+}
+
+void TraceProfiler::aggregate()
+{
+	MutexAutoLock lock(m_mutex);
+	drainBuffers();
+}
+
+void TraceProfiler::drainBuffers()
+{
+	for (size_t i = 0; i < m_buffers.size();) {
+		TraceThreadBuffer *b = m_buffers[i];
+		// Read first, an exited thread writes nothing after it
+		bool exited = b->exited;
+
+		u32 w = b->write_index;
+		for (u32 r = b->read_index; r != w; r++) {
+			const TraceEvent &e = b->events[r & (TRACE_RING_SIZE - 1)];
+			m_stats[e.zone].add(e.duration_us, e.self_us);
+			if (!m_trace_file)
+				continue;
+
+			*m_trace_file << (m_trace_count == 0 ? "\n" : ",\n")
+				<< "{\"name\":" << serializeJsonString(m_zone_names[e.zone])
+				<< ",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->thread_index
+				<< ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+				<< ",\"args\":{\"self_us\":" << e.self_us << "}}";
+			m_trace_count++;
+		}
+		b->read_index = w;
+		m_dropped += b->dropped.exchange(0);
+
+		if (exited) {
+			delete b;
+			m_buffers.erase(m_buffers.begin() + i);
+		} else {
+			i++;
 		}
 	}
-	delete m_timer;
+}
+
+bool TraceProfiler::startTrace(const std::string &path)
+{
+	MutexAutoLock lock(m_mutex);
+	if (m_trace_file)
+		return false;
+
+	// Scopes that ended before the start are not part of the trace
+	drainBuffers();
+
+	m_trace_file = new std::ofstream(path.c_str(),
+		std::ios_base::binary | std::ios_base::trunc);
+	if (!m_trace_file->good()) {
+		delete m_trace_file;
+		m_trace_file = NULL;
+		return false;
+	}
+	*m_trace_file << "[";
+	m_trace_count = 0;
+	m_tracing = true;
+	return true;
+}
+
+u32 TraceProfiler::stopTrace()
+{
+	MutexAutoLock lock(m_mutex);
+	if (!m_trace_file)
+		return 0;
+
+	drainBuffers();
+	*m_trace_file << "\n]\n";
+	delete m_trace_file;
+	m_trace_file = NULL;
+	m_tracing = false;
+	return m_trace_count;
+}
+
+bool TraceProfiler::getZoneStats(const std::string &name,
+		TraceZoneStats &stats)
+{
+	MutexAutoLock lock(m_mutex);
+	std::map<std::string, u16>::iterator it = m_zone_ids.find(name);
+	if (it == m_zone_ids.end())
+		return false;
+	stats = m_stats[it->second];
+	return true;
+}
+
+void TraceProfiler::printHistograms(std::ostream &o)
+{
+	MutexAutoLock lock(m_mutex);
+
+	o << "# zone: count, average, self average and maximum ms,"
+		" then the counts of durations from <2us, doubling up to >="
+		<< (1 << (TRACE_HISTOGRAM_BUCKETS - 1)) << "us" << std::endl;
+
+	std::map<std::string, u16>::const_iterator it;
+	for (it = m_zone_ids.begin(); it != m_zone_ids.end(); ++it) {
+		const TraceZoneStats &stats = m_stats[it->second];
+		if (stats.count == 0)
+			continue;
+
+		o << it->first << ": " << stats.count
+			<< " " << stats.total_us / 1000.0 / stats.count
+			<< " " << stats.self_us / 1000.0 / stats.count
+			<< " " << stats.max_us / 1000.0 << " |";
+		for (u32 i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++)
+			o << " " << stats.histogram[i];
+		o << std::endl;
+	}
+	if (m_dropped > 0)
+		o << "# dropped: " << m_dropped << std::endl;
+}
+
+bool TraceProfiler::saveHistograms(const std::string &path)
+{
+	std::ostringstream os(std::ios_base::binary);
+	printHistograms(os);
+	resetStats();
+	return fs::safeWriteToFile(path, os.str());
+}
+
+void TraceProfiler::resetStats()
+{
+	MutexAutoLock lock(m_mutex);
+	for (size_t i = 0; i < m_stats.size(); i++)
+		m_stats[i] = TraceZoneStats();
+	m_dropped = 0;
+}
+
+u32 TraceProfiler::getDroppedCount()
+{
+	MutexAutoLock lock(m_mutex);
+	return m_dropped;
 }
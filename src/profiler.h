@@ -23,7 +23,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes.h"
 #include <string>
 #include <map>
+#include <vector>
+#include <ostream>
 
+#include "threading/atomic.h"
 #include "threading/mutex.h"
 #include "threading/mutex_auto_lock.h"
 #include "util/timetaker.h"
@@ -189,6 +192,144 @@ enum ScopeProfilerType{
 	SPT_GRAPH_ADD
 };
 
+/*
+	Trace profiler
+
+	Zones are registered once per call site and then known by their id.
+	Every thread records the scopes it leaves into a ring buffer of its
+	own without locking, and aggregate() periodically drains the buffers
+	into statistics per zone and, while a trace is captured, into a
+	Chrome trace event file (chrome://tracing or ui.perfetto.dev).
+
+		void ServerEnvironment::step(float dtime)
+		{
+			PROFILER_ZONE("SEnv::step");
+			...
+
+	Nothing is recorded until the trace profiler is enabled, the server
+	enables it and aggregates it every step.
+*/
+
+// Events per thread that can wait for aggregate(), a power of two
+#define TRACE_RING_SIZE 4096
+// Nesting depth up to which the time of child scopes is tracked
+#define TRACE_MAX_DEPTH 32
+// Bucket i counts the scopes that took 2^i to 2^(i+1) microseconds
+#define TRACE_HISTOGRAM_BUCKETS 16
+
+class TraceProfiler;
+extern TraceProfiler *g_trace_profiler;
+
+struct TraceThreadBuffer;
+
+class ProfilerZone
+{
+public:
+	explicit ProfilerZone(const std::string &name);
+
+	u16 getId() const { return m_id; }
+private:
+	u16 m_id;
+};
+
+class ZoneScope
+{
+public:
+	// Does not record anything until begin()
+	ZoneScope():
+		m_buffer(NULL)
+	{}
+	ZoneScope(const ProfilerZone &zone):
+		m_buffer(NULL)
+	{
+		begin(zone.getId());
+	}
+	~ZoneScope()
+	{
+		if (m_buffer)
+			end();
+	}
+
+	void begin(u16 zone);
+private:
+	void end();
+
+	TraceThreadBuffer *m_buffer;
+	u16 m_zone;
+	u64 m_start_us;
+};
+
+#define PROFILER_ZONE(name) \
+	static ProfilerZone profiler_zone_(name); \
+	ZoneScope profiler_zone_scope_(profiler_zone_)
+
+struct TraceZoneStats
+{
+	u32 count;
+	u64 total_us;
+	// Time spent outside of child scopes
+	u64 self_us;
+	u32 max_us;
+	u32 histogram[TRACE_HISTOGRAM_BUCKETS];
+
+	TraceZoneStats();
+	void add(u32 duration_us, u32 self_us);
+};
+
+class TraceProfiler
+{
+public:
+	TraceProfiler();
+	~TraceProfiler();
+
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+	bool isEnabled() { return m_enabled; }
+	bool isTracing() { return m_tracing; }
+
+	// Returns the id of the zone with this name, registering it if needed
+	u16 registerZone(const std::string &name);
+	// Same, but looks the name up in a cache of the calling thread first
+	u16 getZoneId(const std::string &name);
+
+	// Drains the ring buffers of all threads
+	void aggregate();
+
+	// Writes the scopes aggregated from now on to a trace event file
+	bool startTrace(const std::string &path);
+	// Returns the number of scopes that were written
+	u32 stopTrace();
+
+	// Statistics aggregated since the last reset
+	bool getZoneStats(const std::string &name, TraceZoneStats &stats);
+	void printHistograms(std::ostream &o);
+	// Writes the histograms and resets them, so that every file shows the
+	// time since the previous one
+	bool saveHistograms(const std::string &path);
+	void resetStats();
+
+	// Scopes that were lost because a ring buffer was full
+	u32 getDroppedCount();
+
+	// Buffer of the calling thread, created on first use
+	TraceThreadBuffer *getThreadBuffer();
+private:
+	void drainBuffers();
+
+	Atomic<bool> m_enabled;
+	Atomic<bool> m_tracing;
+
+	Mutex m_mutex;
+	std::vector<std::string> m_zone_names;
+	std::map<std::string, u16> m_zone_ids;
+	std::vector<TraceZoneStats> m_stats;
+	std::vector<TraceThreadBuffer *> m_buffers;
+	u32 m_next_thread_index;
+	u32 m_dropped;
+
+	std::ofstream *m_trace_file;
+	u32 m_trace_count;
+};
+
 class ScopeProfiler
 {
 public:
@@ -198,8 +339,10 @@ class ScopeProfiler
 private:
 	Profiler *m_profiler;
 	std::string m_name;
-	TimeTaker *m_timer;
+	u64 m_start_us;
 	enum ScopeProfilerType m_type;
+	// Shows up in traces too while they are captured
+	ZoneScope m_zone_scope;
 };
 
 #endif
@@ -1431,6 +1431,27 @@ void push_flags_string(lua_State *L, FlagDesc *flagdesc, u32 flags, u32 flagmask
 /* Lua Stored data!                                                           */
 /******************************************************************************/
 
+/******************************************************************************/
+// Reads a node name or a list of them, eg. {"ignore", "group:tree"}
+void read_content_ids(lua_State *L, int index, INodeDefManager *ndef,
+		std::set<content_t> &result)
+{
+	if (lua_istable(L, index)) {
+		lua_pushnil(L);
+		if (index < 0)
+			index -= 1;
+		while (lua_next(L, index) != 0) {
+			// key at index -2 and value at index -1
+			luaL_checktype(L, -1, LUA_TSTRING);
+			ndef->getIds(lua_tostring(L, -1), result);
+			// removes value, keeps key for next iteration
+			lua_pop(L, 1);
+		}
+	} else if (lua_isstring(L, index)) {
+		ndef->getIds(lua_tostring(L, index), result);
+	}
+}
+
 /******************************************************************************/
 void read_groups(lua_State *L, int index, ItemGroupList &result)
 {
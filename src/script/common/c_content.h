@@ -33,17 +33,18 @@ extern "C" {
 }
 
 #include <iostream>
+#include <set>
 #include <vector>
 
 #include "irrlichttypes_bloated.h"
 #include "util/string.h"
 #include "itemgroup.h"
 #include "itemdef.h"
+#include "mapnode.h"
 #include "c_types.h"
 
 namespace Json { class Value; }
 
-struct MapNode;
 class INodeDefManager;
 struct PointedThing;
 struct ItemStack;
@@ -124,6 +125,10 @@ MapNode            readnode                  (lua_State *L, int index,
 void               pushnode                  (lua_State *L, const MapNode &n,
                                               INodeDefManager *ndef);
 
+void               read_content_ids          (lua_State *L, int index,
+                                              INodeDefManager *ndef,
+                                              std::set<content_t> &result);
+
 NodeBox            read_nodebox              (lua_State *L, int index);
 
 void               read_groups               (lua_State *L, int index,
@@ -35,7 +35,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "treegen.h"
 #include "emerge.h"
 #include "pathfinder.h"
+#include "settings.h"
 #include "face_position_cache.h"
+#include "mapblock.h"
+#include <algorithm>
 
 struct EnumString ModApiEnvMod::es_ClearObjectsMode[] =
 {
@@ -611,30 +614,46 @@ int ModApiEnvMod::l_find_node_near(lua_State *L)
 	}
 
 	INodeDefManager *ndef = getGameDef(L)->ndef();
+	Map &map = env->getMap();
 	v3s16 pos = read_v3s16(L, 1);
 	int radius = luaL_checkinteger(L, 2);
-	std::set<content_t> filter;
-	if (lua_istable(L, 3)) {
-		lua_pushnil(L);
-		while (lua_next(L, 3) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if (lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
-
+	std::set<content_t> ids;
+	read_content_ids(L, 3, ndef, ids);
+	ContentFilter filter;
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		filter.add(*it);
+
+	// The shells visit neighboring positions, so remember the last block
+	MapBlock *block = NULL;
+	v3s16 blockpos;
+	bool block_valid = false;
+	bool skip_block = false;
 	int start_radius = (lua_toboolean(L, 4)) ? 0 : 1;
 	for (int d = start_radius; d <= radius; d++) {
 		std::vector<v3s16> list = FacePositionCache::getFacePositions(d);
 		for (std::vector<v3s16>::iterator i = list.begin();
 				i != list.end(); ++i) {
 			v3s16 p = pos + (*i);
-			content_t c = env->getMap().getNodeNoEx(p).getContent();
-			if (filter.count(c) != 0) {
+			v3s16 bp = getNodeBlockPos(p);
+			if (!block_valid || bp != blockpos) {
+				blockpos = bp;
+				block_valid = true;
+				block = map.getBlockNoCreateNoEx(blockpos);
+				if (block && block->isDummy())
+					block = NULL;
+				skip_block = block ?
+					!filter.containsAny(block->getContents()) :
+					!filter.contains(CONTENT_IGNORE);
+			}
+			if (skip_block)
+				continue;
+			content_t c = CONTENT_IGNORE;
+			if (block) {
+				v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+				c = block->getNodeUnsafe(relpos).getContent();
+			}
+			if (filter.contains(c)) {
 				push_v3s16(L, p);
 				return 1;
 			}
@@ -650,6 +669,7 @@ int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
 	GET_ENV_PTR;
 
 	INodeDefManager *ndef = getServer(L)->ndef();
+	Map &map = env->getMap();
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
 	sortBoxVerticies(minp, maxp);
@@ -662,44 +682,63 @@ int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
 		return 0;
 	}
 
-	std::set<content_t> filter;
-	if (lua_istable(L, 3)) {
-		lua_pushnil(L);
-		while (lua_next(L, 3) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if (lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
+	std::set<content_t> ids;
+	read_content_ids(L, 3, ndef, ids);
+	ContentFilter filter;
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		filter.add(*it);
 
-	UNORDERED_MAP<content_t, u32> individual_count;
+	std::vector<v3s16> found;
+	map.findNodes(minp, maxp, filter, found);
 
-	lua_newtable(L);
-	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-	for (s16 y = minp.Y; y <= maxp.Y; y++)
-	for (s16 z = minp.Z; z <= maxp.Z; z++) {
-		v3s16 p(x, y, z);
-		content_t c = env->getMap().getNodeNoEx(p).getContent();
-		if (filter.count(c) != 0) {
-			push_v3s16(L, p);
-			lua_rawseti(L, -2, ++i);
+	UNORDERED_MAP<content_t, u32> individual_count;
+	if (ids.size() == 1) {
+		individual_count[*ids.begin()] = found.size();
+	} else {
+		MapBlock *block = NULL;
+		v3s16 blockpos;
+		for (size_t i = 0; i < found.size(); i++) {
+			v3s16 bp = getNodeBlockPos(found[i]);
+			if (i == 0 || bp != blockpos) {
+				blockpos = bp;
+				block = map.getBlockNoCreateNoEx(blockpos);
+			}
+			content_t c = CONTENT_IGNORE;
+			if (block && !block->isDummy()) {
+				v3s16 relpos = found[i] - blockpos * MAP_BLOCKSIZE;
+				c = block->getNodeUnsafe(relpos).getContent();
+			}
 			individual_count[c]++;
 		}
 	}
+
+	lua_newtable(L);
+	for (size_t i = 0; i < found.size(); i++) {
+		push_v3s16(L, found[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
 	lua_newtable(L);
-	for (std::set<content_t>::const_iterator it = filter.begin();
-			it != filter.end(); ++it) {
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it) {
 		lua_pushnumber(L, individual_count[*it]);
 		lua_setfield(L, -2, ndef->get(*it).name.c_str());
 	}
 	return 2;
 }
 
+struct SurfacePosLess
+{
+	bool operator()(const v3s16 &a, const v3s16 &b) const
+	{
+		if (a.X != b.X)
+			return a.X < b.X;
+		if (a.Z != b.Z)
+			return a.Z < b.Z;
+		return a.Y < b.Y;
+	}
+};
+
 // find_nodes_in_area_under_air(minp, maxp, nodenames) -> list of positions
 // nodenames: e.g. {"ignore", "group:tree"} or "default:dirt"
 int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
@@ -714,6 +753,7 @@ int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 	GET_ENV_PTR;
 
 	INodeDefManager *ndef = getServer(L)->ndef();
+	Map &map = env->getMap();
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
 	sortBoxVerticies(minp, maxp);
@@ -726,37 +766,27 @@ int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 		return 0;
 	}
 
-	std::set<content_t> filter;
+	std::set<content_t> ids;
+	read_content_ids(L, 3, ndef, ids);
+	ContentFilter filter;
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		filter.add(*it);
+	// Air is never under air
+	filter.remove(CONTENT_AIR);
 
-	if (lua_istable(L, 3)) {
-		lua_pushnil(L);
-		while (lua_next(L, 3) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if (lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
+	std::vector<v3s16> found;
+	map.findNodes(minp, maxp, filter, found);
+	std::sort(found.begin(), found.end(), SurfacePosLess());
 
 	lua_newtable(L);
 	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-	for (s16 z = minp.Z; z <= maxp.Z; z++) {
-		s16 y = minp.Y;
-		v3s16 p(x, y, z);
-		content_t c = env->getMap().getNodeNoEx(p).getContent();
-		for (; y <= maxp.Y; y++) {
-			v3s16 psurf(x, y + 1, z);
-			content_t csurf = env->getMap().getNodeNoEx(psurf).getContent();
-			if (c != CONTENT_AIR && csurf == CONTENT_AIR &&
-					filter.count(c) != 0) {
-				push_v3s16(L, v3s16(x, y, z));
-				lua_rawseti(L, -2, ++i);
-			}
-			c = csurf;
+	for (std::vector<v3s16>::const_iterator it = found.begin();
+			it != found.end(); ++it) {
+		v3s16 psurf = *it + v3s16(0, 1, 0);
+		if (map.getNodeNoEx(psurf).getContent() == CONTENT_AIR) {
+			push_v3s16(L, *it);
+			lua_rawseti(L, -2, ++i);
 		}
 	}
 	return 1;
@@ -942,6 +972,49 @@ int ModApiEnvMod::l_emerge_area(lua_State *L)
 	return 0;
 }
 
+// start_pregen([radius])
+// pregenerate the map around spawn and the places visited most
+int ModApiEnvMod::l_start_pregen(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	s16 radius = lua_isnumber(L, 1) ? lua_tonumber(L, 1) :
+		g_settings->getS16("pregen_radius");
+	if (radius <= 0) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	getServer(L)->startPregen(radius);
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+// stop_pregen()
+int ModApiEnvMod::l_stop_pregen(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	getServer(L)->getEmergeManager()->stopPregen();
+	return 0;
+}
+
+// get_pregen_status()
+int ModApiEnvMod::l_get_pregen_status(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	PregenStatus status = getServer(L)->getEmergeManager()->getPregenStatus();
+
+	lua_newtable(L);
+	setboolfield(L, -1, "active", status.active);
+	setintfield(L, -1, "chunks_total", status.chunks_total);
+	setintfield(L, -1, "chunks_done", status.chunks_done);
+	setintfield(L, -1, "chunks_generated", status.chunks_generated);
+	setfloatfield(L, -1, "blocks_per_second", status.blocks_per_second);
+	return 1;
+}
+
 // delete_area(p1, p2)
 // delete mapblocks in area p1..p2
 int ModApiEnvMod::l_delete_area(lua_State *L)
@@ -1141,6 +1214,9 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(fix_light);
 	API_FCT(emerge_area);
 	API_FCT(delete_area);
+	API_FCT(start_pregen);
+	API_FCT(stop_pregen);
+	API_FCT(get_pregen_status);
 	API_FCT(get_perlin);
 	API_FCT(get_perlin_map);
 	API_FCT(get_voxel_manip);
@@ -137,6 +137,15 @@ class ModApiEnvMod : public ModApiBase {
 	// delete_area(p1, p2) -> true/false
 	static int l_delete_area(lua_State *L);
 
+	// start_pregen([radius]) -> true/false
+	static int l_start_pregen(lua_State *L);
+
+	// stop_pregen()
+	static int l_stop_pregen(lua_State *L);
+
+	// get_pregen_status() -> table
+	static int l_get_pregen_status(lua_State *L);
+
 	// get_perlin(seeddiff, octaves, persistence, scale)
 	// returns world-specific PerlinNoise
 	static int l_get_perlin(lua_State *L);
@@ -22,10 +22,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/c_converter.h"
 #include "common/c_content.h"
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_security.h"
 #include "server.h"
 #include "environment.h"
 #include "player.h"
 #include "log.h"
+#include "profiler.h"
 #include <algorithm>
 
 // request_shutdown()
@@ -510,6 +512,35 @@ int ModApiServer::l_set_last_run_mod(lua_State *L)
 	return 0;
 }
 
+// start_profiler_trace(path)
+int ModApiServer::l_start_profiler_trace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	const char *path = luaL_checkstring(L, 1);
+	CHECK_SECURE_PATH(L, path, true);
+	lua_pushboolean(L, g_trace_profiler->startTrace(path));
+	return 1;
+}
+
+// stop_profiler_trace()
+int ModApiServer::l_stop_profiler_trace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	lua_pushinteger(L, g_trace_profiler->stopTrace());
+	return 1;
+}
+
+// save_profiler_histograms(path)
+int ModApiServer::l_save_profiler_histograms(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	const char *path = luaL_checkstring(L, 1);
+	CHECK_SECURE_PATH(L, path, true);
+	g_trace_profiler->aggregate();
+	lua_pushboolean(L, g_trace_profiler->saveHistograms(path));
+	return 1;
+}
+
 void ModApiServer::Initialize(lua_State *L, int top)
 {
 	API_FCT(request_shutdown);
@@ -544,4 +575,8 @@ void ModApiServer::Initialize(lua_State *L, int top)
 
 	API_FCT(get_last_run_mod);
 	API_FCT(set_last_run_mod);
+
+	API_FCT(start_profiler_trace);
+	API_FCT(stop_profiler_trace);
+	API_FCT(save_profiler_histograms);
 }
@@ -107,6 +107,15 @@ class ModApiServer : public ModApiBase
 	// set_last_run_mod(modname)
 	static int l_set_last_run_mod(lua_State *L);
 
+	// start_profiler_trace(path) -> success
+	static int l_start_profiler_trace(lua_State *L);
+
+	// stop_profiler_trace() -> number of scopes written
+	static int l_stop_profiler_trace(lua_State *L);
+
+	// save_profiler_histograms(path) -> success
+	static int l_save_profiler_histograms(lua_State *L);
+
 public:
 	static void Initialize(lua_State *L, int top);
 };
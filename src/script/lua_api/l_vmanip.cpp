@@ -160,6 +160,51 @@ int LuaVoxelManip::l_set_node_at(lua_State *L)
 	return 0;
 }
 
+// find_nodes_in_area(self, minp, maxp, nodenames) -> list of positions
+int LuaVoxelManip::l_find_nodes_in_area(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	INodeDefManager *ndef = getServer(L)->getNodeDefManager();
+
+	LuaVoxelManip *o = checkobject(L, 1);
+	MMVManip *vm = o->vm;
+	v3s16 minp = check_v3s16(L, 2);
+	v3s16 maxp = check_v3s16(L, 3);
+	sortBoxVerticies(minp, maxp);
+
+	std::set<content_t> ids;
+	read_content_ids(L, 4, ndef, ids);
+	ContentFilter filter;
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		filter.add(*it);
+
+	// Only the part of the area that is in the VoxelManip
+	VoxelArea area(
+		v3s16(MYMAX(minp.X, vm->m_area.MinEdge.X),
+			MYMAX(minp.Y, vm->m_area.MinEdge.Y),
+			MYMAX(minp.Z, vm->m_area.MinEdge.Z)),
+		v3s16(MYMIN(maxp.X, vm->m_area.MaxEdge.X),
+			MYMIN(maxp.Y, vm->m_area.MaxEdge.Y),
+			MYMIN(maxp.Z, vm->m_area.MaxEdge.Z)));
+
+	std::vector<v3s16> found;
+	if (vm->m_data && area.MinEdge.X <= area.MaxEdge.X &&
+			area.MinEdge.Y <= area.MaxEdge.Y &&
+			area.MinEdge.Z <= area.MaxEdge.Z) {
+		find_nodes_in_data(vm->m_data, vm->m_area, area, filter, found);
+		sort_positions_xyz(found);
+	}
+
+	lua_newtable(L);
+	for (size_t i = 0; i < found.size(); i++) {
+		push_v3s16(L, found[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
 int LuaVoxelManip::l_update_liquids(lua_State *L)
 {
 	GET_ENV_PTR;
@@ -459,6 +504,7 @@ const luaL_Reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, set_data),
 	luamethod(LuaVoxelManip, get_node_at),
 	luamethod(LuaVoxelManip, set_node_at),
+	luamethod(LuaVoxelManip, find_nodes_in_area),
 	luamethod(LuaVoxelManip, write_to_map),
 	luamethod(LuaVoxelManip, update_map),
 	luamethod(LuaVoxelManip, update_liquids),
@@ -49,6 +49,7 @@ class LuaVoxelManip : public ModApiBase
 
 	static int l_get_node_at(lua_State *L);
 	static int l_set_node_at(lua_State *L);
+	static int l_find_nodes_in_area(lua_State *L);
 
 	static int l_update_map(lua_State *L);
 	static int l_update_liquids(lua_State *L);
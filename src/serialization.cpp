@@ -19,11 +19,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "serialization.h"
 
+#include "config.h"
 #include "util/serialize.h"
 #if defined(_WIN32) && !defined(WIN32_NO_ZLIB_WINAPI)
 	#define ZLIB_WINAPI
 #endif
 #include "zlib.h"
+#if USE_ZSTD
+	#include <zstd.h>
+#endif
+#if USE_LZ4
+	#include <lz4.h>
+#endif
 
 /* report a zlib or i/o error */
 void zerr(int ret)
@@ -53,7 +60,8 @@ void zerr(int ret)
     }
 }
 
-void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level)
+static void compressZlib(const u8 *data, size_t data_size, std::ostream &os,
+		int level)
 {
 	z_stream z;
 	const s32 bufsize = 16384;
@@ -70,8 +78,8 @@ void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level)
 		throw SerializationError("compressZlib: deflateInit failed");
 	
 	// Point zlib to our input buffer
-	z.next_in = (Bytef*)&data[0];
-	z.avail_in = data.getSize();
+	z.next_in = (Bytef*)data;
+	z.avail_in = data_size;
 	// And get all output
 	for(;;)
 	{
@@ -96,10 +104,39 @@ void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level)
 	deflateEnd(&z);
 }
 
+void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level)
+{
+	compressZlib(&data[0], data.getSize(), os, level);
+}
+
 void compressZlib(const std::string &data, std::ostream &os, int level)
 {
-	SharedBuffer<u8> databuf((u8*)data.c_str(), data.size());
-	compressZlib(databuf, os, level);
+	compressZlib((const u8*)data.c_str(), data.size(), os, level);
+}
+
+// Gives back input that was read past the end of a zlib stream
+static void rewindInput(std::istream &is, u32 count)
+{
+	is.clear(); // Just in case EOF is set
+	if (count == 0)
+		return;
+
+	// Seekable streams can skip back at once
+	is.seekg(-(std::streamoff)count, std::ios_base::cur);
+	if (!is.fail())
+		return;
+
+	is.clear();
+	for(u32 i=0; i < count; i++)
+	{
+		is.unget();
+		if(is.fail() || is.bad())
+		{
+			dstream<<"unget #"<<i<<" failed"<<std::endl;
+			dstream<<"fail="<<is.fail()<<" bad="<<is.bad()<<std::endl;
+			throw SerializationError("decompressZlib: unget failed");
+		}
+	}
 }
 
 void decompressZlib(std::istream &is, std::ostream &os)
@@ -167,17 +204,7 @@ void decompressZlib(std::istream &is, std::ostream &os)
 			//dstream<<"z.avail_in="<<z.avail_in<<std::endl;
 			//dstream<<"fail="<<is.fail()<<" bad="<<is.bad()<<std::endl;
 			// Unget all the data that inflate didn't take
-			is.clear(); // Just in case EOF is set
-			for(u32 i=0; i < z.avail_in; i++)
-			{
-				is.unget();
-				if(is.fail() || is.bad())
-				{
-					dstream<<"unget #"<<i<<" failed"<<std::endl;
-					dstream<<"fail="<<is.fail()<<" bad="<<is.bad()<<std::endl;
-					throw SerializationError("decompressZlib: unget failed");
-				}
-			}
+			rewindInput(is, z.avail_in);
 			
 			break;
 		}
@@ -186,6 +213,226 @@ void decompressZlib(std::istream &is, std::ostream &os)
 	inflateEnd(&z);
 }
 
+void decompressZlib(std::istream &is, u8 *dst, u32 dst_size)
+{
+	z_stream z;
+	const s32 bufsize = 16384;
+	char input_buffer[bufsize];
+	// Catches output past dst_size
+	u8 overflow_buffer[1];
+	int status = 0;
+	int ret;
+
+	z.zalloc = Z_NULL;
+	z.zfree = Z_NULL;
+	z.opaque = Z_NULL;
+
+	ret = inflateInit(&z);
+	if(ret != Z_OK)
+		throw SerializationError("decompressZlib: inflateInit failed");
+
+	z.avail_in = 0;
+	z.next_out = (Bytef*)dst;
+	z.avail_out = dst_size;
+
+	for(;;)
+	{
+		if(z.avail_in == 0)
+		{
+			z.next_in = (Bytef*)input_buffer;
+			is.read(input_buffer, bufsize);
+			z.avail_in = is.gcount();
+		}
+		if(z.avail_in == 0)
+			break;
+
+		if(z.avail_out == 0)
+		{
+			if(z.next_out != (Bytef*)dst + dst_size)
+				break; // Already wrote to overflow_buffer
+			z.next_out = (Bytef*)overflow_buffer;
+			z.avail_out = sizeof(overflow_buffer);
+		}
+
+		status = inflate(&z, Z_NO_FLUSH);
+
+		if(status == Z_NEED_DICT || status == Z_DATA_ERROR
+				|| status == Z_MEM_ERROR)
+		{
+			zerr(status);
+			inflateEnd(&z);
+			throw SerializationError("decompressZlib: inflate failed");
+		}
+		if(status == Z_STREAM_END)
+		{
+			rewindInput(is, z.avail_in);
+			break;
+		}
+	}
+
+	uLong total_out = z.total_out;
+	inflateEnd(&z);
+
+	if(status != Z_STREAM_END || total_out != dst_size)
+		throw SerializationError("decompressZlib: "
+				"decompressed size does not match");
+}
+
+bool block_codec_supported(u8 codec)
+{
+	switch (codec) {
+	case BLOCK_CODEC_ZLIB:
+#if USE_ZSTD
+	case BLOCK_CODEC_ZSTD:
+#endif
+#if USE_LZ4
+	case BLOCK_CODEC_LZ4:
+#endif
+		return true;
+	default:
+		return false;
+	}
+}
+
+static const char *block_codec_names[BLOCK_CODEC_COUNT] = {
+	"zlib",
+	"zstd",
+	"lz4",
+};
+
+u8 block_codec_from_name(const std::string &name)
+{
+	for (u8 i = 0; i < BLOCK_CODEC_COUNT; i++) {
+		if (name == block_codec_names[i])
+			return i;
+	}
+	return BLOCK_CODEC_COUNT;
+}
+
+const char *block_codec_name(u8 codec)
+{
+	return codec < BLOCK_CODEC_COUNT ? block_codec_names[codec] : "unknown";
+}
+
+// Limits what a corrupted size can make us allocate
+#define BLOCK_DATA_MAX_SIZE (64 * 1024 * 1024)
+
+void compressBlockData(const u8 *data, u32 data_size, std::ostream &os,
+		u8 codec)
+{
+	if (codec == BLOCK_CODEC_ZLIB) {
+		compressZlib(data, data_size, os, -1);
+		return;
+	}
+
+	std::string buf;
+	size_t size = 0;
+	switch (codec) {
+#if USE_ZSTD
+	case BLOCK_CODEC_ZSTD:
+		buf.resize(ZSTD_compressBound(data_size));
+		// The default level of zstd
+		size = ZSTD_compress(&buf[0], buf.size(), data, data_size, 3);
+		if (ZSTD_isError(size))
+			throw SerializationError(std::string("compressBlockData: ") +
+					ZSTD_getErrorName(size));
+		break;
+#endif
+#if USE_LZ4
+	case BLOCK_CODEC_LZ4: {
+		buf.resize(LZ4_compressBound(data_size));
+		int ret = LZ4_compress_default((const char *)data, &buf[0],
+				data_size, buf.size());
+		if (ret <= 0)
+			throw SerializationError("compressBlockData: LZ4 failed");
+		size = ret;
+		break;
+	}
+#endif
+	default:
+		throw SerializationError(std::string("compressBlockData: "
+				"codec not supported: ") + block_codec_name(codec));
+	}
+
+	writeU32(os, size);
+	writeU32(os, data_size);
+	os.write(buf.c_str(), size);
+}
+
+// Reads the data of the codecs other than zlib
+static void readBlockData(std::istream &is, std::string *data,
+		u32 *decompressed_size)
+{
+	u32 size = readU32(is);
+	*decompressed_size = readU32(is);
+	if (is.fail() || size > BLOCK_DATA_MAX_SIZE ||
+			*decompressed_size > BLOCK_DATA_MAX_SIZE)
+		throw SerializationError("decompressBlockData: invalid size");
+
+	data->resize(size);
+	is.read(&(*data)[0], size);
+	if (is.gcount() != (std::streamsize)size)
+		throw SerializationError("decompressBlockData: data too short");
+}
+
+static void decompressBlockData(const std::string &data, u8 *dst,
+		u32 dst_size, u8 codec)
+{
+	switch (codec) {
+#if USE_ZSTD
+	case BLOCK_CODEC_ZSTD: {
+		size_t ret = ZSTD_decompress(dst, dst_size, data.c_str(), data.size());
+		if (ZSTD_isError(ret) || ret != dst_size)
+			throw SerializationError("decompressBlockData: zstd failed");
+		return;
+	}
+#endif
+#if USE_LZ4
+	case BLOCK_CODEC_LZ4: {
+		int ret = LZ4_decompress_safe(data.c_str(), (char *)dst,
+				data.size(), dst_size);
+		if (ret < 0 || (u32)ret != dst_size)
+			throw SerializationError("decompressBlockData: LZ4 failed");
+		return;
+	}
+#endif
+	default:
+		throw SerializationError(std::string("decompressBlockData: "
+				"codec not supported: ") + block_codec_name(codec));
+	}
+}
+
+void decompressBlockData(std::istream &is, std::ostream &os, u8 codec)
+{
+	if (codec == BLOCK_CODEC_ZLIB) {
+		decompressZlib(is, os);
+		return;
+	}
+
+	std::string data;
+	u32 decompressed_size;
+	readBlockData(is, &data, &decompressed_size);
+	std::string decompressed(decompressed_size, '\0');
+	decompressBlockData(data, (u8 *)&decompressed[0], decompressed_size, codec);
+	os.write(decompressed.c_str(), decompressed_size);
+}
+
+void decompressBlockData(std::istream &is, u8 *dst, u32 dst_size, u8 codec)
+{
+	if (codec == BLOCK_CODEC_ZLIB) {
+		decompressZlib(is, dst, dst_size);
+		return;
+	}
+
+	std::string data;
+	u32 decompressed_size;
+	readBlockData(is, &data, &decompressed_size);
+	if (decompressed_size != dst_size)
+		throw SerializationError("decompressBlockData: "
+				"decompressed size does not match");
+	decompressBlockData(data, dst, dst_size, codec);
+}
+
 void compress(SharedBuffer<u8> data, std::ostream &os, u8 version)
 {
 	if(version >= 11)
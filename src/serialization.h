@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes.h"
 #include "exceptions.h"
 #include <iostream>
+#include <string>
 #include "util/pointer.h"
 
 /*
@@ -64,13 +65,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	26: Never written; read the same as 25
 	27: Added light spreading flags to blocks
 	28: Added "private" flag to NodeMetadata
+	29: Added the codec byte to blocks, see BlockCodec
 */
 // This represents an uninitialized or invalid format
 #define SER_FMT_VER_INVALID 255
 // Highest supported serialization version
-#define SER_FMT_VER_HIGHEST_READ 28
+#define SER_FMT_VER_HIGHEST_READ 29
 // Saved on disk version
-#define SER_FMT_VER_HIGHEST_WRITE 28
+#define SER_FMT_VER_HIGHEST_WRITE 29
 // Lowest supported serialization version
 #define SER_FMT_VER_LOWEST_READ 0
 // Lowest serialization version for writing
@@ -82,6 +84,28 @@ inline bool ser_ver_supported(s32 v) {
 	return v >= SER_FMT_VER_LOWEST_READ && v <= SER_FMT_VER_HIGHEST_READ;
 }
 
+/*
+	Map block codecs
+	----------------
+
+	How the node data and node metadata of a block are compressed. Blocks
+	of version >= 29 store the codec in a byte, older ones use zlib.
+	zlib is always supported, zstd and LZ4 only when built with
+	ENABLE_ZSTD or ENABLE_LZ4.
+*/
+enum BlockCodec {
+	BLOCK_CODEC_ZLIB = 0,
+	BLOCK_CODEC_ZSTD = 1,
+	BLOCK_CODEC_LZ4 = 2,
+	BLOCK_CODEC_COUNT
+};
+
+// Whether this build can read and write blocks with the codec
+bool block_codec_supported(u8 codec);
+// Returns BLOCK_CODEC_COUNT for unknown names
+u8 block_codec_from_name(const std::string &name);
+const char *block_codec_name(u8 codec);
+
 /*
 	Misc. serialization functions
 */
@@ -89,6 +113,17 @@ inline bool ser_ver_supported(s32 v) {
 void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level = -1);
 void compressZlib(const std::string &data, std::ostream &os, int level = -1);
 void decompressZlib(std::istream &is, std::ostream &os);
+// Decompresses to dst, which the data has to fill exactly
+void decompressZlib(std::istream &is, u8 *dst, u32 dst_size);
+
+// Compress with a block codec. Other codecs than zlib don't end their
+// data by themselves, so their data is preceded by its compressed and
+// decompressed size.
+void compressBlockData(const u8 *data, u32 data_size, std::ostream &os,
+		u8 codec);
+void decompressBlockData(std::istream &is, std::ostream &os, u8 codec);
+// Decompresses to dst, which the data has to fill exactly
+void decompressBlockData(std::istream &is, u8 *dst, u32 dst_size, u8 codec);
 
 // These choose between zlib and a self-made one according to version
 void compress(SharedBuffer<u8> data, std::ostream &os, u8 version);
@@ -43,6 +43,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "itemdef.h"
 #include "craftdef.h"
 #include "emerge.h"
+#include "block_payload_cache.h"
 #include "mapgen.h"
 #include "mg_biome.h"
 #include "content_mapnode.h"
@@ -167,6 +168,7 @@ Server::Server(
 	m_rollback(NULL),
 	m_enable_rollback_recording(false),
 	m_emerge(NULL),
+	m_block_payload_cache(NULL),
 	m_script(NULL),
 	m_itemdef(createItemDefManager()),
 	m_nodedef(createNodeDefManager()),
@@ -189,11 +191,16 @@ Server::Server(
 	m_liquid_transform_every = 1.0;
 	m_masterserver_timer = 0.0;
 	m_emergethread_trigger_timer = 0.0;
+	m_pregen_timer = 0.0;
+	m_profiler_histogram_timer = 0.0;
 	m_savemap_timer = 0.0;
 
 	m_step_dtime = 0.0;
 	m_lag = g_settings->getFloat("dedicated_server_step");
 
+	m_block_payload_cache = new BlockPayloadCache(
+		(size_t)g_settings->getU16("block_send_cache_size") * 1024 * 1024);
+
 	if(path_world == "")
 		throw ServerError("Supplied empty world path");
 
@@ -372,8 +379,13 @@ Server::~Server()
 	stop();
 	delete m_thread;
 
+	g_trace_profiler->setEnabled(false);
+	if (g_trace_profiler->isTracing())
+		g_trace_profiler->stopTrace();
+
 	// Delete things in the reverse order of creation
 	delete m_emerge;
+	delete m_block_payload_cache;
 	delete m_env;
 	delete m_rollback;
 	delete m_banmanager;
@@ -410,6 +422,9 @@ void Server::start(Address bind_addr)
 	m_con.SetTimeoutMs(30);
 	m_con.Serve(bind_addr);
 
+	// Record the profiler zones of all threads from now on
+	g_trace_profiler->setEnabled(true);
+
 	// Start thread
 	m_thread->start();
 
@@ -460,6 +475,7 @@ void Server::step(float dtime)
 void Server::AsyncRunStep(bool initial_step)
 {
 	DSTACK(FUNCTION_NAME);
+	PROFILER_ZONE("Server::AsyncRunStep");
 
 	g_profiler->add("Server::AsyncRunStep (num)", 1);
 
@@ -573,7 +589,8 @@ void Server::AsyncRunStep(bool initial_step)
 		ScopeProfiler sp(g_profiler, "Server: liquid transform");
 
 		std::map<v3s16, MapBlock*> modified_blocks;
-		m_env->getMap().transformLiquids(modified_blocks, m_env);
+		m_env->getMap().transformLiquids(modified_blocks, m_env,
+				m_env->getLiquidPool());
 #if 0
 		/*
 			Update lighting
@@ -776,9 +793,14 @@ void Server::AsyncRunStep(bool initial_step)
 		MutexAutoLock envlock(m_env_mutex);
 		ScopeProfiler sp(g_profiler, "Server: sending object messages");
 
+		// Messages of each object, serialized once for all clients
+		struct ObjectMessages
+		{
+			std::string reliable_data;
+			std::string unreliable_data;
+		};
 		// Key = object id
-		// Value = data sent by object
-		UNORDERED_MAP<u16, std::vector<ActiveObjectMessage>* > buffered_messages;
+		std::map<u16, ObjectMessages> buffered_messages;
 
 		// Get active object messages from environment
 		for(;;) {
@@ -786,76 +808,53 @@ void Server::AsyncRunStep(bool initial_step)
 			if (aom.id == 0)
 				break;
 
-			std::vector<ActiveObjectMessage>* message_list = NULL;
-			UNORDERED_MAP<u16, std::vector<ActiveObjectMessage>* >::iterator n;
-			n = buffered_messages.find(aom.id);
-			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			}
-			else {
-				message_list = n->second;
-			}
-			message_list->push_back(aom);
+			ObjectMessages &messages = buffered_messages[aom.id];
+			std::string &data = aom.reliable ?
+					messages.reliable_data : messages.unreliable_data;
+			// Add object id
+			char buf[2];
+			writeU16((u8*)&buf[0], aom.id);
+			data.append(buf, 2);
+			// Add data
+			data += serializeString(aom.datastring);
 		}
 
-		m_clients.lock();
-		UNORDERED_MAP<u16, RemoteClient*> clients = m_clients.getClientList();
-		// Route data to every client
-		for (UNORDERED_MAP<u16, RemoteClient*>::iterator i = clients.begin();
-			i != clients.end(); ++i) {
-			RemoteClient *client = i->second;
-			std::string reliable_data;
-			std::string unreliable_data;
-			// Go through all objects in message buffer
-			for (UNORDERED_MAP<u16, std::vector<ActiveObjectMessage>* >::iterator
-					j = buffered_messages.begin();
-					j != buffered_messages.end(); ++j) {
-				// If object is not known by client, skip it
-				u16 id = j->first;
-				if (client->m_known_objects.find(id) == client->m_known_objects.end())
+		if (!buffered_messages.empty()) {
+			m_clients.lock();
+			UNORDERED_MAP<u16, RemoteClient*> clients = m_clients.getClientList();
+			// Route data to every client
+			for (UNORDERED_MAP<u16, RemoteClient*>::iterator i = clients.begin();
+				i != clients.end(); ++i) {
+				RemoteClient *client = i->second;
+				if (client->m_known_objects.empty())
 					continue;
 
-				// Get message list of object
-				std::vector<ActiveObjectMessage>* list = j->second;
-				// Go through every message
-				for (std::vector<ActiveObjectMessage>::iterator
-						k = list->begin(); k != list->end(); ++k) {
-					// Compose the full new data with header
-					ActiveObjectMessage aom = *k;
-					std::string new_data;
-					// Add object id
-					char buf[2];
-					writeU16((u8*)&buf[0], aom.id);
-					new_data.append(buf, 2);
-					// Add data
-					new_data += serializeString(aom.datastring);
-					// Add data to buffer
-					if(aom.reliable)
-						reliable_data += new_data;
-					else
-						unreliable_data += new_data;
+				std::string reliable_data;
+				std::string unreliable_data;
+				// Go through all objects in message buffer
+				for (std::map<u16, ObjectMessages>::iterator
+						j = buffered_messages.begin();
+						j != buffered_messages.end(); ++j) {
+					// If object is not known by client, skip it
+					if (!client->m_known_objects.contains(j->first))
+						continue;
+
+					reliable_data += j->second.reliable_data;
+					unreliable_data += j->second.unreliable_data;
+				}
+				/*
+					reliable_data and unreliable_data are now ready.
+					Send them.
+				*/
+				if(reliable_data.size() > 0) {
+					SendActiveObjectMessages(client->peer_id, reliable_data);
 				}
-			}
-			/*
-				reliable_data and unreliable_data are now ready.
-				Send them.
-			*/
-			if(reliable_data.size() > 0) {
-				SendActiveObjectMessages(client->peer_id, reliable_data);
-			}
 
-			if(unreliable_data.size() > 0) {
-				SendActiveObjectMessages(client->peer_id, unreliable_data, false);
+				if(unreliable_data.size() > 0) {
+					SendActiveObjectMessages(client->peer_id, unreliable_data, false);
+				}
 			}
-		}
-		m_clients.unlock();
-
-		// Clear buffered_messages
-		for (UNORDERED_MAP<u16, std::vector<ActiveObjectMessage>* >::iterator
-				i = buffered_messages.begin();
-				i != buffered_messages.end(); ++i) {
-			delete i->second;
+			m_clients.unlock();
 		}
 	}
 
@@ -879,29 +878,35 @@ void Server::AsyncRunStep(bool initial_step)
 		// We'll log the amount of each
 		Profiler prof;
 
+		// Node changes are sent together after all events are handled
+		std::map<v3s16, BlockNodeChanges> node_changes;
+
 		while(m_unsent_map_edit_queue.size() != 0)
 		{
 			MapEditEvent* event = m_unsent_map_edit_queue.front();
 			m_unsent_map_edit_queue.pop();
 
-			// Players far away from the change are stored here.
-			// Instead of sending the changes, MapBlocks are set not sent
-			// for them.
-			std::vector<u16> far_players;
-
 			switch (event->type) {
 			case MEET_ADDNODE:
 			case MEET_SWAPNODE:
-				prof.add("MEET_ADDNODE", 1);
-				sendAddNode(event->p, event->n, event->already_known_by_peer,
-						&far_players, disable_single_change_sending ? 5 : 30,
-						event->type == MEET_ADDNODE);
-				break;
-			case MEET_REMOVENODE:
-				prof.add("MEET_REMOVENODE", 1);
-				sendRemoveNode(event->p, event->already_known_by_peer,
-						&far_players, disable_single_change_sending ? 5 : 30);
+			case MEET_REMOVENODE: {
+				if (event->type == MEET_REMOVENODE)
+					prof.add("MEET_REMOVENODE", 1);
+				else
+					prof.add("MEET_ADDNODE", 1);
+				v3s16 blockpos = getNodeBlockPos(event->p);
+				v3s16 p_rel = event->p - blockpos * MAP_BLOCKSIZE;
+				u16 index = p_rel.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+						p_rel.Y * MAP_BLOCKSIZE + p_rel.X;
+				BlockNodeChanges &changes = node_changes[blockpos];
+				add_node_change(changes.nodes, index,
+						event->type == MEET_REMOVENODE ?
+						MapNode(CONTENT_AIR) : event->n,
+						event->type != MEET_SWAPNODE);
+				changes.modified_blocks.insert(event->modified_blocks.begin(),
+						event->modified_blocks.end());
 				break;
+			}
 			case MEET_BLOCK_NODE_METADATA_CHANGED:
 				infostream << "Server: MEET_BLOCK_NODE_METADATA_CHANGED" << std::endl;
 						prof.add("MEET_BLOCK_NODE_METADATA_CHANGED", 1);
@@ -923,36 +928,11 @@ void Server::AsyncRunStep(bool initial_step)
 				break;
 			}
 
-			/*
-				Set blocks not sent to far players
-			*/
-			if(!far_players.empty()) {
-				// Convert list format to that wanted by SetBlocksNotSent
-				std::map<v3s16, MapBlock*> modified_blocks2;
-				for(std::set<v3s16>::iterator
-						i = event->modified_blocks.begin();
-						i != event->modified_blocks.end(); ++i) {
-					modified_blocks2[*i] =
-							m_env->getMap().getBlockNoCreateNoEx(*i);
-				}
-
-				// Set blocks not sent
-				for(std::vector<u16>::iterator
-						i = far_players.begin();
-						i != far_players.end(); ++i) {
-					if(RemoteClient *client = getClient(*i))
-						client->SetBlocksNotSent(modified_blocks2);
-				}
-			}
-
 			delete event;
-
-			/*// Don't send too many at a time
-			count++;
-			if(count >= 1 && m_unsent_map_edit_queue.size() < 100)
-				break;*/
 		}
 
+		sendNodeChanges(node_changes, disable_single_change_sending ? 5 : 30);
+
 		if(event_count >= 5){
 			infostream<<"Server: MapEditEvents:"<<std::endl;
 			prof.print(infostream);
@@ -977,6 +957,63 @@ void Server::AsyncRunStep(bool initial_step)
 		}
 	}
 
+	/*
+		Pregenerate the map while the emerge threads are idle
+	*/
+	{
+		float &counter = m_pregen_timer;
+		counter += dtime;
+		if (counter >= 10.0) {
+			counter = 0.0;
+
+			// Remember where players are, the places they visit most
+			// are pregenerated as well
+			MutexAutoLock envlock(m_env_mutex);
+			std::vector<u16> clients = m_clients.getClientIDs();
+			for (std::vector<u16>::iterator i = clients.begin();
+					i != clients.end(); ++i) {
+				RemotePlayer *player = m_env->getPlayer(*i);
+				PlayerSAO *sao = player ? player->getPlayerSAO() : NULL;
+				if (!sao)
+					continue;
+				v3s16 nodepos = floatToInt(sao->getBasePosition(), BS);
+				m_emerge->addPregenVisit(getNodeBlockPos(nodepos));
+			}
+
+			// Runs again once players visit other places most
+			static const s16 pregen_radius = g_settings->getS16("pregen_radius");
+			if (pregen_radius > 0 && !m_emerge->isPregenActive()) {
+				std::vector<v3s16> centers = getPregenCenters();
+				if (centers != m_pregen_auto_centers) {
+					m_pregen_auto_centers = centers;
+					m_emerge->startPregen(centers, pregen_radius,
+						MYMAX(g_settings->getS32("pregen_max_chunks"), 0));
+				}
+			}
+		}
+
+		m_emerge->stepPregen();
+	}
+
+	/*
+		Aggregate the trace profiler, it records scopes since the server
+		started
+	*/
+	{
+		g_trace_profiler->aggregate();
+
+		static const float histogram_interval =
+				g_settings->getFloat("profiler_histogram_interval");
+		float &counter = m_profiler_histogram_timer;
+		counter += dtime;
+		if (histogram_interval > 0 && counter >= histogram_interval) {
+			counter = 0.0;
+
+			g_trace_profiler->saveHistograms(
+				m_path_world + DIR_DELIM + "profiler_histograms.txt");
+		}
+	}
+
 	// Save map, players and auth stuff
 	{
 		float &counter = m_savemap_timer;
@@ -2178,76 +2215,122 @@ void Server::fadeSound(s32 handle, float step, float gain)
 	}
 }
 
-void Server::sendRemoveNode(v3s16 p, u16 ignore_id,
-	std::vector<u16> *far_players, float far_d_nodes)
+static float distance_to_block(v3f pos, v3s16 blockpos)
 {
-	float maxd = far_d_nodes*BS;
-	v3f p_f = intToFloat(p, BS);
+	v3f p0 = intToFloat(blockpos * MAP_BLOCKSIZE, BS);
+	v3f p1 = p0 + v3f(1, 1, 1) * (MAP_BLOCKSIZE - 1) * BS;
+	v3f closest(rangelim(pos.X, p0.X, p1.X), rangelim(pos.Y, p0.Y, p1.Y),
+			rangelim(pos.Z, p0.Z, p1.Z));
+	return pos.getDistanceFrom(closest);
+}
 
-	NetworkPacket pkt(TOCLIENT_REMOVENODE, 6);
-	pkt << p;
+static void send_nodes_changed(ClientInterface &clients, u16 peer_id,
+		u16 block_count, const std::string &data)
+{
+	NetworkPacket pkt(TOCLIENT_NODES_CHANGED, 2 + data.size());
+	pkt << block_count;
+	pkt.putRawString(data);
+	// Send as reliable
+	clients.send(peer_id, 0, &pkt, true);
+}
 
-	std::vector<u16> clients = m_clients.getClientIDs();
-	for (std::vector<u16>::iterator i = clients.begin(); i != clients.end(); ++i) {
-		if (far_players) {
-			// Get player
-			if (RemotePlayer *player = m_env->getPlayer(*i)) {
-				PlayerSAO *sao = player->getPlayerSAO();
-				if (!sao)
-					continue;
+void Server::sendNodeChanges(const std::map<v3s16, BlockNodeChanges> &changes,
+		float far_d_nodes)
+{
+	if (changes.empty())
+		return;
 
-				// If player is far away, only set modified blocks not sent
-				v3f player_pos = sao->getBasePosition();
-				if (player_pos.getDistanceFrom(p_f) > maxd) {
-					far_players->push_back(*i);
-					continue;
-				}
-			}
-		}
+	float maxd = far_d_nodes * BS;
 
-		// Send as reliable
-		m_clients.send(*i, 0, &pkt, true);
+	// Encode the changes of each block once for all clients
+	std::map<v3s16, std::string> encoded;
+	for (std::map<v3s16, BlockNodeChanges>::const_iterator
+			i = changes.begin(); i != changes.end(); ++i) {
+		if (i->second.nodes.size() >= NODE_CHANGES_BLOCK_RESEND_MIN)
+			continue;
+
+		std::ostringstream os(std::ios_base::binary);
+		serialize_node_changes(os, i->first, i->second.nodes);
+		encoded[i->first] = os.str();
 	}
-}
 
-void Server::sendAddNode(v3s16 p, MapNode n, u16 ignore_id,
-		std::vector<u16> *far_players, float far_d_nodes,
-		bool remove_metadata)
-{
-	float maxd = far_d_nodes*BS;
-	v3f p_f = intToFloat(p, BS);
+	u32 sent_blocks = 0;
+	u32 resent_blocks = 0;
 
 	std::vector<u16> clients = m_clients.getClientIDs();
-	for(std::vector<u16>::iterator i = clients.begin();	i != clients.end(); ++i) {
-		if (far_players) {
-			// Get player
-			if (RemotePlayer *player = m_env->getPlayer(*i)) {
-				PlayerSAO *sao = player->getPlayerSAO();
-				if (!sao)
-					continue;
+	for (std::vector<u16>::iterator i = clients.begin(); i != clients.end(); ++i) {
+		RemoteClient *client = getClientNoEx(*i);
+		if (!client)
+			continue;
 
-				// If player is far away, only set modified blocks not sent
-				v3f player_pos = sao->getBasePosition();
-				if(player_pos.getDistanceFrom(p_f) > maxd) {
-					far_players->push_back(*i);
-					continue;
+		bool check_distance = false;
+		v3f player_pos;
+		if (RemotePlayer *player = m_env->getPlayer(*i)) {
+			PlayerSAO *sao = player->getPlayerSAO();
+			if (!sao)
+				continue;
+			player_pos = sao->getBasePosition();
+			check_distance = true;
+		}
+
+		std::string data;
+		u16 block_count = 0;
+		for (std::map<v3s16, BlockNodeChanges>::const_iterator
+				j = changes.begin(); j != changes.end(); ++j) {
+			std::map<v3s16, std::string>::iterator e = encoded.find(j->first);
+
+			// Far players and changes of many nodes get the blocks instead
+			if (e == encoded.end() || (check_distance &&
+					distance_to_block(player_pos, j->first) > maxd)) {
+				const std::set<v3s16> &blocks = j->second.modified_blocks;
+				for (std::set<v3s16>::const_iterator
+						b = blocks.begin(); b != blocks.end(); ++b)
+					client->SetBlockNotSent(*b);
+				resent_blocks++;
+				continue;
+			}
+			sent_blocks++;
+
+			if (client->net_proto_version >= 33) {
+				data += e->second;
+				block_count++;
+				if (block_count == U16_MAX ||
+						data.size() >= NODE_CHANGES_PACKET_MAX_SIZE) {
+					send_nodes_changed(m_clients, *i, block_count, data);
+					data.clear();
+					block_count = 0;
 				}
+				continue;
 			}
-		}
 
-		NetworkPacket pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
-		m_clients.lock();
-		RemoteClient* client = m_clients.lockedGetClientNoEx(*i);
-		if (client != 0) {
-			pkt << p << n.param0 << n.param1 << n.param2
-					<< (u8) (remove_metadata ? 0 : 1);
+			// Older clients get one packet per node
+			v3s16 p0 = j->first * MAP_BLOCKSIZE;
+			const NodeChangeMap &nodes = j->second.nodes;
+			for (NodeChangeMap::const_iterator
+					k = nodes.begin(); k != nodes.end(); ++k) {
+				v3s16 p = p0 + v3s16(k->first % MAP_BLOCKSIZE,
+						k->first / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+						k->first / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+				const MapNode &n = k->second.n;
+				if (n.getContent() == CONTENT_AIR && k->second.remove_metadata) {
+					NetworkPacket pkt(TOCLIENT_REMOVENODE, 6);
+					pkt << p;
+					m_clients.send(*i, 0, &pkt, true);
+				} else {
+					NetworkPacket pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
+					pkt << p << n.param0 << n.param1 << n.param2
+							<< (u8) (k->second.remove_metadata ? 0 : 1);
+					m_clients.send(*i, 0, &pkt, true);
+				}
+			}
 		}
-		m_clients.unlock();
 
-		// Send as reliable
-		if (pkt.getSize() > 0)
-			m_clients.send(*i, 0, &pkt, true);
+		if (block_count > 0)
+			send_nodes_changed(m_clients, *i, block_count, data);
 	}
+
+	g_profiler->add("Server: node change blocks sent", sent_blocks);
+	g_profiler->add("Server: node change blocks resent", resent_blocks);
 }
 
 void Server::setBlockNotSent(v3s16 p)
@@ -2262,7 +2345,8 @@ void Server::setBlockNotSent(v3s16 p)
 	m_clients.unlock();
 }
 
-void Server::SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version)
+void Server::SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u8 codec,
+		u16 net_proto_version)
 {
 	DSTACK(FUNCTION_NAME);
 
@@ -2272,10 +2356,8 @@ void Server::SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto
 		Create a packet with the block in the right format
 	*/
 
-	std::ostringstream os(std::ios_base::binary);
-	block->serialize(os, ver, false);
-	block->serializeNetworkSpecific(os);
-	std::string s = os.str();
+	const std::string &s = m_block_payload_cache->get(block, ver, codec,
+		net_proto_version);
 
 	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + 2 + s.size(), peer_id);
 
@@ -2312,6 +2394,7 @@ void Server::SendBlocks(float dtime)
 
 			total_sending += client->SendingCount();
 			client->GetNextBlocks(m_env,m_emerge, dtime, queue);
+			client->PrefetchBlocks(m_env, m_emerge, dtime);
 		}
 		m_clients.unlock();
 	}
@@ -2346,12 +2429,16 @@ void Server::SendBlocks(float dtime)
 		if(!client)
 			continue;
 
-		SendBlockNoLock(q.peer_id, block, client->serialization_version, client->net_proto_version);
+		SendBlockNoLock(q.peer_id, block, client->serialization_version,
+			client->getBlockCodec(), client->net_proto_version);
 
 		client->SentBlock(q.pos);
 		total_sending++;
 	}
 	m_clients.unlock();
+
+	g_profiler->avg("Server: block send cache size [KB]",
+		m_block_payload_cache->getSize() / 1024);
 }
 
 void Server::fillMediaCache()
@@ -3507,6 +3594,25 @@ std::string Server::getModStoragePath() const
 	return m_path_world + DIR_DELIM + "mod_storage";
 }
 
+void Server::startPregen(s16 radius)
+{
+	m_emerge->startPregen(getPregenCenters(), radius,
+		MYMAX(g_settings->getS32("pregen_max_chunks"), 0));
+}
+
+std::vector<v3s16> Server::getPregenCenters()
+{
+	std::vector<v3s16> centers;
+
+	v3f spawnpos;
+	if (!g_settings->getV3FNoEx("static_spawnpoint", spawnpos))
+		spawnpos = v3f(0, m_emerge->mgparams->water_level, 0);
+	centers.push_back(getNodeBlockPos(floatToInt(spawnpos, 1.0f)));
+
+	m_emerge->getMostVisitedChunks(PREGEN_VISITED_CENTERS, &centers);
+	return centers;
+}
+
 v3f Server::findSpawnPos()
 {
 	ServerMap &map = m_env->getServerMap();
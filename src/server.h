@@ -38,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientiface.h"
 #include "remoteplayer.h"
 #include "network/networkpacket.h"
+#include "network/nodechanges.h"
 #include <string>
 #include <list>
 #include <map>
@@ -53,6 +54,7 @@ class PlayerSAO;
 class IRollbackManager;
 struct RollbackAction;
 class EmergeManager;
+class BlockPayloadCache;
 class ServerScripting;
 class ServerEnvironment;
 struct SimpleSoundSpec;
@@ -290,6 +292,10 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	IRollbackManager *getRollbackManager() { return m_rollback; }
 	virtual EmergeManager *getEmergeManager() { return m_emerge; }
 
+	// Pregenerates the map around spawn and the places visited most,
+	// see EmergeManager::startPregen()
+	void startPregen(s16 radius);
+
 	IWritableItemDefManager* getWritableItemDefManager();
 	IWritableNodeDefManager* getWritableNodeDefManager();
 	IWritableCraftDefManager* getWritableCraftDefManager();
@@ -421,21 +427,27 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 			const v2f &speed);
 	void SendOverrideDayNightRatio(u16 peer_id, bool do_override, float ratio);
 
+	// Node changes of one MapBlock, collected from MapEditEvents
+	struct BlockNodeChanges
+	{
+		NodeChangeMap nodes;
+		// Blocks to send again to clients not getting the changes
+		std::set<v3s16> modified_blocks;
+	};
+
 	/*
-		Send a node removal/addition event to all clients except ignore_id.
-		Additionally, if far_players!=NULL, players further away than
-		far_d_nodes are ignored and their peer_ids are added to far_players
+		Send node changes to all clients, several per packet. Players
+		further away than far_d_nodes and blocks with many changes get
+		the modified blocks sent again instead.
 	*/
-	// Envlock and conlock should be locked when calling these
-	void sendRemoveNode(v3s16 p, u16 ignore_id=0,
-			std::vector<u16> *far_players=NULL, float far_d_nodes=100);
-	void sendAddNode(v3s16 p, MapNode n, u16 ignore_id=0,
-			std::vector<u16> *far_players=NULL, float far_d_nodes=100,
-			bool remove_metadata=true);
+	// Envlock should be locked when calling this
+	void sendNodeChanges(const std::map<v3s16, BlockNodeChanges> &changes,
+			float far_d_nodes);
 	void setBlockNotSent(v3s16 p);
 
 	// Environment and Connection must be locked when called
-	void SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version);
+	void SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u8 codec,
+			u16 net_proto_version);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -534,6 +546,12 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	float m_liquid_transform_every;
 	float m_masterserver_timer;
 	float m_emergethread_trigger_timer;
+	float m_pregen_timer;
+	float m_profiler_histogram_timer;
+	// Centers of the last run started because of pregen_radius
+	std::vector<v3s16> m_pregen_auto_centers;
+	// Spawn and the chunks visited most
+	std::vector<v3s16> getPregenCenters();
 	float m_savemap_timer;
 	IntervalLimiter m_map_timer_and_unload_interval;
 
@@ -553,6 +571,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Emerge manager
 	EmergeManager *m_emerge;
 
+	// Serialized blocks, shared by all clients they are sent to
+	BlockPayloadCache *m_block_payload_cache;
+
 	// Scripting
 	// Envlock and conlock should be locked when using Lua
 	ServerScripting *m_script;
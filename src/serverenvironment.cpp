@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodemetadata.h"
 #include "gamedef.h"
 #include "map.h"
+#include "noise.h"
 #include "profiler.h"
 #include "raycast.h"
 #include "remoteplayer.h"
@@ -34,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "util/basic_macros.h"
 #include "util/pointedthing.h"
+#include "util/thread.h"
 #include "threading/mutex_auto_lock.h"
 #include "filesys.h"
 #include "gameparams.h"
@@ -384,8 +386,17 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_last_clear_objects_time(0),
 	m_recommended_send_interval(0.1),
 	m_max_lag_estimate(0.1),
-	m_player_database(NULL)
+	m_player_database(NULL),
+	m_abm_scan_pool(NULL),
+	m_liquid_pool(NULL)
 {
+	u32 abm_scan_threads = g_settings->getU16("abm_scan_threads");
+	if (abm_scan_threads > 1)
+		m_abm_scan_pool = new WorkerPool("ABMScan", abm_scan_threads);
+	u32 liquid_threads = g_settings->getU16("liquid_threads");
+	if (liquid_threads > 1)
+		m_liquid_pool = new WorkerPool("Liquid", liquid_threads);
+
 	// Determine which database backend to use
 	std::string conf_path = path_world + DIR_DELIM + "world.mt";
 	Settings conf;
@@ -434,6 +445,8 @@ ServerEnvironment::~ServerEnvironment()
 	}
 
 	delete m_player_database;
+	delete m_abm_scan_pool;
+	delete m_liquid_pool;
 }
 
 Map & ServerEnvironment::getMap()
@@ -696,16 +709,154 @@ struct ActiveABM
 	std::set<content_t> required_neighbors;
 };
 
+typedef std::vector<std::vector<ActiveABM> *> ActiveABMList;
+
+struct ABMTrigger
+{
+	ActiveABM *aabm;
+	v3s16 p;
+	MapNode n;
+};
+
+/*
+	Node scan of ABMHandler::applyParallel().
+
+	Each part scans a range of the blocks and collects the nodes that
+	passed the chance and neighbor checks. The map must not be modified
+	while the job runs, so neighbor blocks are looked up beforehand.
+*/
+class ABMScanJob : public ParallelJob
+{
+public:
+	ABMScanJob(const ActiveABMList &aabms, const std::vector<MapBlock *> &blocks,
+		ServerMap *map, bool need_neighbors, u32 num_parts):
+		m_aabms(aabms),
+		m_blocks(blocks),
+		m_num_parts(num_parts),
+		triggers(blocks.size())
+	{
+		// myrand() is not thread-safe, every part gets its own generator
+		for (u32 i = 0; i < num_parts; i++)
+			m_seeds.push_back(((u64)myrand() << 32) | myrand());
+
+		if (!need_neighbors)
+			return;
+
+		m_neighbors.resize(blocks.size() * 27);
+		for (size_t i = 0; i < blocks.size(); i++) {
+			v3s16 blockpos = blocks[i]->getPos();
+			v3s16 d;
+			for (d.Z = -1; d.Z <= 1; d.Z++)
+			for (d.Y = -1; d.Y <= 1; d.Y++)
+			for (d.X = -1; d.X <= 1; d.X++) {
+				MapBlock *block = map->getBlockNoCreateNoEx(blockpos + d);
+				m_neighbors[getNeighborIndex(i, d)] =
+					(block && !block->isDummy()) ? block : NULL;
+			}
+		}
+	}
+
+	void runPart(u32 part)
+	{
+		PcgRandom rand(m_seeds[part]);
+		size_t begin = m_blocks.size() * part / m_num_parts;
+		size_t end = m_blocks.size() * (part + 1) / m_num_parts;
+		for (size_t i = begin; i < end; i++)
+			scanBlock(i, rand);
+	}
+
+private:
+	static size_t getNeighborIndex(size_t i, v3s16 d)
+	{
+		return i * 27 + (d.Z + 1) * 9 + (d.Y + 1) * 3 + (d.X + 1);
+	}
+
+	// p is relative to m_blocks[i] and may be in a neighbor block
+	content_t getContent(size_t i, v3s16 p)
+	{
+		v3s16 d(p.X < 0 ? -1 : (p.X >= MAP_BLOCKSIZE ? 1 : 0),
+			p.Y < 0 ? -1 : (p.Y >= MAP_BLOCKSIZE ? 1 : 0),
+			p.Z < 0 ? -1 : (p.Z >= MAP_BLOCKSIZE ? 1 : 0));
+		MapBlock *block = m_neighbors[getNeighborIndex(i, d)];
+		if (!block)
+			return CONTENT_IGNORE;
+		v3s16 p_in_block = p - d * MAP_BLOCKSIZE;
+		return block->getNodeUnsafe(p_in_block).getContent();
+	}
+
+	void scanBlock(size_t i, PcgRandom &rand)
+	{
+		MapBlock *block = m_blocks[i];
+		v3s16 p0;
+		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
+		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
+		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
+		{
+			const MapNode &n = block->getNodeUnsafe(p0);
+			content_t c = n.getContent();
+
+			if (c >= m_aabms.size() || !m_aabms[c])
+				continue;
+
+			for(std::vector<ActiveABM>::iterator
+				abm = m_aabms[c]->begin(); abm != m_aabms[c]->end(); ++abm) {
+				if(rand.next() % abm->chance != 0)
+					continue;
+
+				if (!abm->required_neighbors.empty() &&
+						!hasRequiredNeighbor(i, p0, abm->required_neighbors))
+					continue;
+
+				ABMTrigger trigger;
+				trigger.aabm = &(*abm);
+				trigger.p = p0 + block->getPosRelative();
+				trigger.n = n;
+				triggers[i].push_back(trigger);
+			}
+		}
+	}
+
+	bool hasRequiredNeighbor(size_t i, v3s16 p0,
+		const std::set<content_t> &required_neighbors)
+	{
+		v3s16 p1;
+		for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
+		for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
+		for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
+		{
+			if(p1 == p0)
+				continue;
+			if (required_neighbors.find(getContent(i, p1)) !=
+					required_neighbors.end())
+				return true;
+		}
+		return false;
+	}
+
+	const ActiveABMList &m_aabms;
+	const std::vector<MapBlock *> &m_blocks;
+	u32 m_num_parts;
+	std::vector<u64> m_seeds;
+	// 3x3x3 blocks around every block, NULL if not loaded
+	std::vector<MapBlock *> m_neighbors;
+
+public:
+	// Triggers per block, in the order apply() would run them
+	std::vector<std::vector<ABMTrigger> > triggers;
+};
+
 class ABMHandler
 {
 private:
 	ServerEnvironment *m_env;
-	std::vector<std::vector<ActiveABM> *> m_aabms;
+	ActiveABMList m_aabms;
+	bool m_need_neighbors;
 public:
 	ABMHandler(std::vector<ABMWithState> &abms,
 		float dtime_s, ServerEnvironment *env,
 		bool use_timers):
-		m_env(env)
+		m_env(env),
+		m_need_neighbors(false)
 	{
 		if(dtime_s < 0.001)
 			return;
@@ -747,6 +898,8 @@ class ABMHandler
 					rn != required_neighbors_s.end(); ++rn) {
 				ndef->getIds(*rn, aabm.required_neighbors);
 			}
+			if (!aabm.required_neighbors.empty())
+				m_need_neighbors = true;
 
 			// Trigger contents
 			const std::set<std::string> &contents_s = abm->getTriggerContents();
@@ -801,11 +954,26 @@ class ABMHandler
 		return active_object_count;
 
 	}
+	// Whether the block contains any node an ABM is registered for
+	bool hasTriggerContent(MapBlock *block)
+	{
+		const std::vector<content_t> &contents = block->getContents();
+		for (size_t i = 0; i < contents.size(); i++) {
+			content_t c = contents[i];
+			if (c < m_aabms.size() && m_aabms[c])
+				return true;
+		}
+		return false;
+	}
+
 	void apply(MapBlock *block)
 	{
 		if(m_aabms.empty() || block->isDummy())
 			return;
 
+		if (!hasTriggerContent(block))
+			return;
+
 		ServerMap *map = &m_env->getServerMap();
 
 		u32 active_object_count_wider;
@@ -874,6 +1042,75 @@ class ABMHandler
 			}
 		}
 	}
+
+	/*
+		Same as calling apply() for every block, but the node scan is
+		spread over the worker pool. The ABMs are triggered afterwards on
+		this thread, in the same order. Since the scan sees the blocks as
+		they were before any ABM ran, triggers on nodes that an earlier
+		ABM has replaced are dropped.
+	*/
+	void applyParallel(const std::vector<MapBlock *> &active_blocks,
+		WorkerPool *pool)
+	{
+		if(m_aabms.empty())
+			return;
+
+		// Only scan blocks that can trigger something
+		std::vector<MapBlock *> blocks;
+		for (size_t i = 0; i < active_blocks.size(); i++) {
+			if (hasTriggerContent(active_blocks[i]))
+				blocks.push_back(active_blocks[i]);
+		}
+		if (blocks.empty())
+			return;
+
+		ServerMap *map = &m_env->getServerMap();
+
+		// Blocks may be unloaded by the ABMs, remember where they were
+		std::vector<v3s16> blockposes;
+		for (size_t i = 0; i < blocks.size(); i++)
+			blockposes.push_back(blocks[i]->getPos());
+
+		u32 num_parts = MYMIN(blocks.size(), pool->getThreadCount() * 4);
+		ABMScanJob job(m_aabms, blocks, map, m_need_neighbors, num_parts);
+		{
+			ScopeProfiler sp(g_profiler, "SEnv: ABM scan avg per interval", SPT_AVG);
+			pool->run(&job, num_parts);
+		}
+
+		for (size_t i = 0; i < blocks.size(); i++) {
+			const std::vector<ABMTrigger> &triggers = job.triggers[i];
+			if (triggers.empty())
+				continue;
+
+			MapBlock *block = map->getBlockNoCreateNoEx(blockposes[i]);
+			if (!block || block->isDummy())
+				continue;
+
+			u32 active_object_count_wider;
+			u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
+			m_env->m_added_objects = 0;
+
+			for (std::vector<ABMTrigger>::const_iterator
+					t = triggers.begin(); t != triggers.end(); ++t) {
+				MapNode n = block->getNodeNoEx(t->p - block->getPosRelative());
+				if (n.getContent() != t->n.getContent())
+					continue;
+
+				// Call all the trigger variations
+				t->aabm->abm->trigger(m_env, t->p, n);
+				t->aabm->abm->trigger(m_env, t->p, n,
+					active_object_count, active_object_count_wider);
+
+				// Count surrounding objects again if the abms added any
+				if(m_env->m_added_objects > 0) {
+					active_object_count = countObjects(block, map, active_object_count_wider);
+					m_env->m_added_objects = 0;
+				}
+			}
+		}
+	}
 };
 
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
@@ -1009,14 +1246,33 @@ bool ServerEnvironment::swapNode(v3s16 p, const MapNode &n)
 
 void ServerEnvironment::getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius)
 {
-	for (ActiveObjectMap::iterator i = m_active_objects.begin();
-		i != m_active_objects.end(); ++i) {
-		ServerActiveObject* obj = i->second;
-		u16 id = i->first;
+	std::vector<u16> candidates;
+	m_active_object_grid.getObjectsInArea(
+		aabb3f(pos - v3f(radius), pos + v3f(radius)), candidates);
+
+	for (std::vector<u16>::iterator i = candidates.begin();
+		i != candidates.end(); ++i) {
+		ServerActiveObject* obj = getActiveObject(*i);
+		if (!obj)
+			continue;
 		v3f objectpos = obj->getBasePosition();
 		if (objectpos.getDistanceFrom(pos) > radius)
 			continue;
-		objects.push_back(id);
+		objects.push_back(*i);
+	}
+}
+
+void ServerEnvironment::getObjectsInArea(std::vector<u16> &objects, const aabb3f &box)
+{
+	std::vector<u16> candidates;
+	m_active_object_grid.getObjectsInArea(box, candidates);
+
+	for (std::vector<u16>::iterator i = candidates.begin();
+		i != candidates.end(); ++i) {
+		ServerActiveObject* obj = getActiveObject(*i);
+		if (!obj || !box.isPointInside(obj->getBasePosition()))
+			continue;
+		objects.push_back(*i);
 	}
 }
 
@@ -1057,6 +1313,7 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 	for (std::vector<u16>::iterator it = objects_to_remove.begin();
 			it != objects_to_remove.end(); ++it) {
 		m_active_objects.erase(*it);
+		m_active_object_grid.remove(*it);
 	}
 
 	// Get list of loaded blocks
@@ -1159,6 +1416,7 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 void ServerEnvironment::step(float dtime)
 {
 	DSTACK(FUNCTION_NAME);
+	PROFILER_ZONE("SEnv::step");
 
 	//TimeTaker timer("ServerEnv step");
 
@@ -1343,6 +1601,9 @@ void ServerEnvironment::step(float dtime)
 			// Initialize handling of ActiveBlockModifiers
 			ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
 
+			// Blocks to scan on the worker pool, if there is one
+			std::vector<MapBlock *> scan_blocks;
+
 			for(std::set<v3s16>::iterator
 				i = m_active_blocks.m_list.begin();
 				i != m_active_blocks.m_list.end(); ++i)
@@ -1360,9 +1621,17 @@ void ServerEnvironment::step(float dtime)
 				block->setTimestampNoChangedFlag(m_game_time);
 
 				/* Handle ActiveBlockModifiers */
-				abmhandler.apply(block);
+				if (m_abm_scan_pool) {
+					if (!block->isDummy())
+						scan_blocks.push_back(block);
+				} else {
+					abmhandler.apply(block);
+				}
 			}
 
+			if (m_abm_scan_pool)
+				abmhandler.applyParallel(scan_blocks, m_abm_scan_pool);
+
 			u32 time_ms = timer.stop(true);
 			u32 max_time_ms = 200;
 			if(time_ms > max_time_ms){
@@ -1527,7 +1796,7 @@ u16 ServerEnvironment::addActiveObject(ServerActiveObject *object)
 */
 void ServerEnvironment::getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 	s16 player_radius,
-	std::set<u16> &current_objects,
+	const ActiveObjectIdSet &current_objects,
 	std::queue<u16> &added_objects)
 {
 	f32 radius_f = radius * BS;
@@ -1536,26 +1805,51 @@ void ServerEnvironment::getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 	if (player_radius_f < 0)
 		player_radius_f = 0;
 	/*
-		Go through the object list,
+		Collect the objects near the player from the grid. With an
+		unlimited player_radius every player is visible, so players are
+		taken from the player list instead.
+	*/
+	v3f player_pos = playersao->getBasePosition();
+	f32 search_radius = MYMAX(radius_f, player_radius_f);
+	std::vector<u16> nearby_objects;
+	m_active_object_grid.getObjectsInArea(aabb3f(
+		player_pos - v3f(search_radius), player_pos + v3f(search_radius)),
+		nearby_objects);
+	size_t grid_objects_count = nearby_objects.size();
+
+	if (player_radius_f == 0) {
+		for (std::vector<RemotePlayer *>::iterator it = m_players.begin();
+			it != m_players.end(); ++it) {
+			PlayerSAO *sao = (*it)->getPlayerSAO();
+			if (sao)
+				nearby_objects.push_back(sao->getId());
+		}
+	}
+
+	/*
+		Go through the nearby objects,
 		- discard removed/deactivated objects,
 		- discard objects that are too far away,
 		- discard objects that are found in current_objects.
 		- add remaining objects to added_objects
 	*/
-	for (ActiveObjectMap::iterator i = m_active_objects.begin();
-		i != m_active_objects.end(); ++i) {
-		u16 id = i->first;
+	for (size_t i = 0; i < nearby_objects.size(); i++) {
+		u16 id = nearby_objects[i];
 
 		// Get object
-		ServerActiveObject *object = i->second;
+		ServerActiveObject *object = getActiveObject(id);
 		if (object == NULL)
 			continue;
 
+		// Players were already added from the player list
+		if (player_radius_f == 0 && i < grid_objects_count &&
+				object->getType() == ACTIVEOBJECT_TYPE_PLAYER)
+			continue;
+
 		if (object->isGone())
 			continue;
 
-		f32 distance_f = object->getBasePosition().
-			getDistanceFrom(playersao->getBasePosition());
+		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
 		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
 			// Discard if too far
 			if (distance_f > player_radius_f && player_radius_f != 0)
@@ -1564,9 +1858,7 @@ void ServerEnvironment::getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 			continue;
 
 		// Discard if already on current_objects
-		std::set<u16>::iterator n;
-		n = current_objects.find(id);
-		if(n != current_objects.end())
+		if (current_objects.contains(id))
 			continue;
 		// Add to added_objects
 		added_objects.push(id);
@@ -1579,7 +1871,7 @@ void ServerEnvironment::getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 */
 void ServerEnvironment::getRemovedActiveObjects(PlayerSAO *playersao, s16 radius,
 	s16 player_radius,
-	std::set<u16> &current_objects,
+	const ActiveObjectIdSet &current_objects,
 	std::queue<u16> &removed_objects)
 {
 	f32 radius_f = radius * BS;
@@ -1595,7 +1887,7 @@ void ServerEnvironment::getRemovedActiveObjects(PlayerSAO *playersao, s16 radius
 		- object has m_removed=true, or
 		- object is too far away
 	*/
-	for(std::set<u16>::iterator
+	for (ActiveObjectIdSet::const_iterator
 		i = current_objects.begin();
 		i != current_objects.end(); ++i)
 	{
@@ -1709,6 +2001,7 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 			<<"added (id="<<object->getId()<<")"<<std::endl;*/
 
 	m_active_objects[object->getId()] = object;
+	m_active_object_grid.insert(object->getId(), object->getBasePosition());
 
 	verbosestream<<"ServerEnvironment::addActiveObjectRaw(): "
 		<<"Added id="<<object->getId()<<"; there are now "
@@ -1826,6 +2119,7 @@ void ServerEnvironment::removeRemovedObjects()
 	for (std::vector<u16>::iterator it = objects_to_remove.begin();
 			it != objects_to_remove.end(); ++it) {
 		m_active_objects.erase(*it);
+		m_active_object_grid.remove(*it);
 	}
 }
 
@@ -2098,6 +2392,7 @@ void ServerEnvironment::deactivateFarObjects(bool _force_delete)
 	for (std::vector<u16>::iterator it = objects_to_remove.begin();
 			it != objects_to_remove.end(); ++it) {
 		m_active_objects.erase(*it);
+		m_active_object_grid.remove(*it);
 	}
 }
 
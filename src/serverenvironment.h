@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SERVER_ENVIRONMENT_HEADER
 
 #include "environment.h"
+#include "activeobjectgrid.h"
 #include "mapnode.h"
 #include "mapblock.h"
 #include <set>
@@ -37,6 +38,7 @@ struct StaticObject;
 class ServerActiveObject;
 class Server;
 class ServerScripting;
+class WorkerPool;
 
 /*
 	{Active, Loading} block modifier interface.
@@ -204,6 +206,9 @@ class ServerEnvironment : public Environment
 
 	ServerMap & getServerMap();
 
+	// Threads for Map::transformLiquids(), NULL if liquids use one thread
+	WorkerPool *getLiquidPool() { return m_liquid_pool; }
+
 	//TODO find way to remove this fct!
 	ServerScripting* getScriptIface()
 	{ return m_script; }
@@ -270,7 +275,7 @@ class ServerEnvironment : public Environment
 	*/
 	void getAddedActiveObjects(PlayerSAO *playersao, s16 radius,
 		s16 player_radius,
-		std::set<u16> &current_objects,
+		const ActiveObjectIdSet &current_objects,
 		std::queue<u16> &added_objects);
 
 	/*
@@ -279,7 +284,7 @@ class ServerEnvironment : public Environment
 	*/
 	void getRemovedActiveObjects(PlayerSAO *playersao, s16 radius,
 		s16 player_radius,
-		std::set<u16> &current_objects,
+		const ActiveObjectIdSet &current_objects,
 		std::queue<u16> &removed_objects);
 
 	/*
@@ -314,6 +319,12 @@ class ServerEnvironment : public Environment
 
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius);
+	// Find all active objects whose base position is inside a box
+	void getObjectsInArea(std::vector<u16> &objects, const aabb3f &box);
+
+	// Called by ServerActiveObject whenever its base position changes
+	void updateActiveObjectPos(u16 id, v3f pos)
+	{ m_active_object_grid.update(id, pos); }
 
 	// Clear objects, loading and going through every MapBlock
 	void clearObjects(ClearObjectsMode mode);
@@ -405,6 +416,8 @@ class ServerEnvironment : public Environment
 	const std::string m_path_world;
 	// Active object list
 	ActiveObjectMap m_active_objects;
+	// Spatial index of m_active_objects
+	ActiveObjectGrid m_active_object_grid;
 	// Outgoing network message buffer for active objects
 	std::queue<ActiveObjectMessage> m_active_object_messages;
 	// Some timers
@@ -438,6 +451,11 @@ class ServerEnvironment : public Environment
 
 	PlayerDatabase *m_player_database;
 
+	// Threads scanning the active blocks for ABMs, NULL if disabled
+	WorkerPool *m_abm_scan_pool;
+	// Threads transforming liquids, NULL if disabled
+	WorkerPool *m_liquid_pool;
+
 	// Particles
 	IntervalLimiter m_particle_management_interval;
 	UNORDERED_MAP<u32, float> m_particle_spawners;
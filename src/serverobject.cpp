@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serverobject.h"
 #include <fstream>
 #include "inventory.h"
+#include "serverenvironment.h"
 #include "constants.h" // BS
 
 ServerActiveObject::ServerActiveObject(ServerEnvironment *env, v3f pos):
@@ -38,6 +39,14 @@ ServerActiveObject::~ServerActiveObject()
 {
 }
 
+void ServerActiveObject::setBasePosition(v3f pos)
+{
+	m_base_position = pos;
+	// Keep the environment's spatial index up to date
+	if (m_env)
+		m_env->updateActiveObjectPos(getId(), pos);
+}
+
 ServerActiveObject* ServerActiveObject::create(ActiveObjectType type,
 		ServerEnvironment *env, u16 id, v3f pos,
 		const std::string &data)
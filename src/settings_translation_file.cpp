@@ -281,8 +281,12 @@ fake_function() {
 	gettext("Enables caching of facedir rotated meshes.");
 	gettext("Mapblock mesh generation delay");
 	gettext("Delay between mesh updates on the client in ms. Increasing this will slow\ndown the rate of mesh updates, thus reducing jitter on slower clients.");
+	gettext("Mapblock mesh generation threads");
+	gettext("Number of threads making the meshes of mapblocks on the client.\n0 uses half of the processors. More threads make the world appear\nfaster after joining or teleporting, on machines with many cores.");
 	gettext("Mapblock mesh generator's MapBlock cache size MB");
 	gettext("Size of the MapBlock cache of the mesh generator. Increasing this will\nincrease the cache hit %, reducing the data being copied from the main\nthread, thus reducing jitter.");
+	gettext("Greedy meshing");
+	gettext("Merges the faces of neighboring nodes with the same texture and light\ninto larger faces in both directions of a surface, not only along rows.\nReduces the vertex count of flat areas, at a small mesh generation cost.");
 	gettext("Minimap");
 	gettext("Enables minimap.");
 	gettext("Round minimap");
@@ -468,12 +472,18 @@ fake_function() {
 	gettext("Maximum number of statically stored objects in a block.");
 	gettext("Synchronous SQLite");
 	gettext("See http://www.sqlite.org/pragma.html#pragma_synchronous");
+	gettext("Map save queue size");
+	gettext("Maximum number of map blocks waiting to be written by the save thread.\nWhen it is full, the server thread waits for the database.\n0 writes blocks on the server thread.");
+	gettext("Map block codec");
+	gettext("Compression of the map blocks written to the database, and of those\nsent to clients that support it. zstd and lz4 need a build with\nENABLE_ZSTD or ENABLE_LZ4, zlib is used otherwise.\nExisting blocks are converted with --recompress-map.");
 	gettext("Dedicated server step");
 	gettext("Length of a server tick and the interval at which objects are generally updated over network.");
 	gettext("Active Block Management interval");
 	gettext("Time in between active block management cycles");
 	gettext("Active Block Modifier interval");
 	gettext("Length of time between ABM execution cycles");
+	gettext("ABM scan threads");
+	gettext("Number of threads scanning the active blocks for ABM nodes.\nThe ABM actions themselves always run on the server thread.\n1 scans on the server thread only.");
 	gettext("NodeTimer interval");
 	gettext("Length of time between NodeTimer execution cycles");
 	gettext("Ignore world errors");
@@ -484,8 +494,14 @@ fake_function() {
 	gettext("The time (in seconds) that the liquids queue may grow beyond processing\ncapacity until an attempt is made to decrease its size by dumping old queue\nitems.  A value of 0 disables the functionality.");
 	gettext("Liquid update tick");
 	gettext("Liquid update interval in seconds.");
+	gettext("Liquid threads");
+	gettext("Number of threads transforming liquids, each working on separate mapblocks.\non_flood callbacks always run on the server thread.\n1 transforms liquids on the server thread only.");
 	gettext("block send optimize distance");
 	gettext("At this distance the server will aggressively optimize which blocks are sent to clients.\nSmall values potentially improve performance a lot, at the expense of visible rendering glitches.\n(some blocks will not be rendered under water and in caves, as well as sometimes on land)\nSetting this to a value greater than max_block_send_distance disables this optimization.\nStated in mapblocks (16 nodes)");
+	gettext("Block prefetch time");
+	gettext("How many seconds ahead blocks are loaded for fast moving players.\nThis only loads blocks that exist already, to avoid holes in the\nterrain in front of flying players or minecarts. 0 disables it.");
+	gettext("Block send cache size");
+	gettext("Memory for keeping serialized mapblocks that were sent to clients, in MB.\nA block sent to several players is then compressed only once.\n0 disables the cache.");
 	gettext("Server side occlusion culling");
 	gettext("If enabled the server will perform map block occlusion culling based on\non the eye position of the player. This can reduce the number of blocks\nsent to the client 50-80%. The client will not longer receive most invisible\nso that the utility of noclip mode is reduced.");
 	gettext("Mapgen");
@@ -512,6 +528,12 @@ fake_function() {
 	gettext("Maximum number of blocks to be queued that are to be generated.\nSet to blank for an appropriate amount to be chosen automatically.");
 	gettext("Number of emerge threads");
 	gettext("Number of emerge threads to use. Make this field blank, or increase this number\nto use multiple threads. On multiprocessor systems, this will improve mapgen speed greatly\nat the cost of slightly buggy caves.");
+	gettext("Number of emerge loader threads");
+	gettext("Number of threads that only load blocks from the database.\nBlocks that are not there yet are passed on to the emerge threads,\nso loading existing terrain does not wait for map generation.\n0 lets the emerge threads load blocks too.");
+	gettext("Pregeneration radius");
+	gettext("Radius in mapchunks to generate around the spawn and the places players\nvisit most while no blocks are requested. 0 disables pregeneration.");
+	gettext("Pregeneration chunk limit");
+	gettext("Maximum number of mapchunks one pregeneration run generates,\nlimiting the disk space it uses. 0 for no limit.");
 	gettext("Biome API temperature and humidity noise parameters");
 	gettext("Heat noise");
 	gettext("Temperature variation for biomes.");
@@ -773,4 +795,6 @@ fake_function() {
 	gettext("Modstore details URL");
 	gettext("Engine profiling data print interval");
 	gettext("Print the engine's profiling data in regular intervals (in seconds). 0 = disable. Useful for developers.");
+	gettext("Profiler histogram interval");
+	gettext("Write the count, times and duration histogram of every profiler zone of the\nserver to profiler_histograms.txt in the world in regular intervals (in\nseconds), each file covering the time since the previous one. 0 = disable.");
 }
@@ -324,6 +324,8 @@ class ShaderSource : public IWritableShaderSource
 
 	// Queued shader fetches (to be processed by the main thread)
 	RequestQueue<std::string, u32, u8, u8> m_get_shader_queue;
+	// Where the waiting threads get their shaders from the main thread
+	ResultQueuePool<std::string, u32, u8, u8> m_shader_result_queues;
 
 	// Global constant setter factories
 	std::vector<IShaderConstantSetterFactory *> m_setter_factories;
@@ -394,19 +396,21 @@ u32 ShaderSource::getShader(const std::string &name,
 
 		// We're gonna ask the result to be put into here
 
-		static ResultQueue<std::string, u32, u8, u8> result_queue;
+		ResultQueue<std::string, u32, u8, u8> *result_queue =
+				m_shader_result_queues.get();
 
 		// Throw a request in
-		m_get_shader_queue.add(name, 0, 0, &result_queue);
+		m_get_shader_queue.add(name, 0, 0, result_queue);
 
 		/* infostream<<"Waiting for shader from main thread, name=\""
 				<<name<<"\""<<std::endl;*/
 
 		while(true) {
 			GetResult<std::string, u32, u8, u8>
-				result = result_queue.pop_frontNoEx();
+				result = result_queue->pop_frontNoEx();
 
 			if (result.key == name) {
+				m_shader_result_queues.put(result_queue);
 				return result.item;
 			}
 			else {
@@ -23,6 +23,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "itemdef.h"
 #include "gamedef.h"
 #include "mods.h"
+#include "mapblock.h"
+#include "mapsector.h"
 
 content_t t_CONTENT_STONE;
 content_t t_CONTENT_GRASS;
@@ -30,6 +32,7 @@ content_t t_CONTENT_TORCH;
 content_t t_CONTENT_WATER;
 content_t t_CONTENT_LAVA;
 content_t t_CONTENT_BRICK;
+content_t t_CONTENT_WATER_FLOWING;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -83,7 +86,15 @@ class TestGameDef : public IGameDef {
 };
 
 
-TestGameDef::TestGameDef()
+TestGameDef::TestGameDef() :
+	m_craftdef(NULL),
+	m_texturesrc(NULL),
+	m_shadersrc(NULL),
+	m_soundmgr(NULL),
+	m_eventmgr(NULL),
+	m_scenemgr(NULL),
+	m_rollbackmgr(NULL),
+	m_emergemgr(NULL)
 {
 	m_itemdef = createItemDefManager();
 	m_nodedef = createNodeDefManager();
@@ -172,6 +183,8 @@ void TestGameDef::defineSomeNodes()
 	f.alpha = 128;
 	f.liquid_type = LIQUID_SOURCE;
 	f.liquid_viscosity = 4;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
 	f.is_ground_content = true;
 	f.groups["liquids"] = 3;
 	for(int i = 0; i < 6; i++)
@@ -219,16 +232,35 @@ void TestGameDef::defineSomeNodes()
 	f.is_ground_content = true;
 	idef->registerItem(itemdef);
 	t_CONTENT_BRICK = ndef->set(f.name, f);
+
+	//// Flowing water
+	itemdef = ItemDefinition();
+	itemdef.type = ITEM_NODE;
+	itemdef.name = "default:water_flowing";
+	itemdef.description = "Flowing Water";
+	f = ContentFeatures();
+	f.name = itemdef.name;
+	f.alpha = 128;
+	f.liquid_type = LIQUID_FLOWING;
+	f.liquid_viscosity = 4;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
+	for(int i = 0; i < 6; i++)
+		f.tiledef[i].name = "default_water.png";
+	idef->registerItem(itemdef);
+	t_CONTENT_WATER_FLOWING = ndef->set(f.name, f);
 }
 
 ////
 //// run_tests
 ////
 
-bool run_tests()
+bool run_tests(bool run_benchmarks)
 {
 	DSTACK(FUNCTION_NAME);
 
+	TestManager::getRunBenchmarks() = run_benchmarks;
+
 	u64 t1 = porting::getTimeMs();
 	TestGameDef gamedef;
 
@@ -313,6 +345,48 @@ std::string TestBase::getTestTempFile()
 	return getTestTempDirectory() + DIR_DELIM + buf + ".tmp";
 }
 
+////
+//// TestMemoryMap
+////
+
+TestMemoryMap::TestMemoryMap(IGameDef *gamedef) :
+	Map(dstream, gamedef)
+{
+}
+
+MapBlock *TestMemoryMap::addBlock(v3s16 blockpos, MapNode n)
+{
+	v2s16 p2d(blockpos.X, blockpos.Z);
+	MapSector *sector = getSectorNoGenerateNoEx(p2d);
+	if (sector == NULL) {
+		sector = new ServerMapSector(this, p2d, m_gamedef);
+		m_sectors[p2d] = sector;
+	}
+
+	MapBlock *block = new MapBlock(this, blockpos, m_gamedef);
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		block->setNodeNoCheck(x, y, z, n);
+	sector->insertBlock(block);
+	return block;
+}
+
+void TestMemoryMap::addBlocks(v3s16 blockpos_min, v3s16 blockpos_max,
+	MapNode n)
+{
+	for (s16 z = blockpos_min.Z; z <= blockpos_max.Z; z++)
+	for (s16 y = blockpos_min.Y; y <= blockpos_max.Y; y++)
+	for (s16 x = blockpos_min.X; x <= blockpos_max.X; x++)
+		addBlock(v3s16(x, y, z), n);
+}
+
+void TestMemoryMap::setContent(v3s16 p, content_t c)
+{
+	MapNode n(c);
+	setNode(p, n);
+}
+
 
 /*
 	NOTE: These tests became non-working then NodeContainer was removed.
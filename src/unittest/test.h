@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "porting.h"
 #include "filesys.h"
 #include "mapnode.h"
+#include "map.h"
 
 class TestFailedException : public std::exception {
 };
@@ -50,6 +51,12 @@ class TestFailedException : public std::exception {
 	rawstream << #fxn << " - " << tdiff << "ms" << std::endl;                 \
 } while (0)
 
+// Runs a benchmark, which prints timings, when benchmarks are enabled
+#define BENCHMARK(fxn, ...) do {                                              \
+	if (TestManager::getRunBenchmarks())                                      \
+		TEST(fxn, __VA_ARGS__);                                               \
+} while (0)
+
 // Asserts the specified condition is true, or fails the current unit test
 #define UASSERT(x) do {                                         \
 	if (!(x)) {                                                 \
@@ -132,6 +139,13 @@ class TestManager {
 	{
 		getTestModules().push_back(module);
 	}
+
+	// Whether the modules also run their benchmarks, see BENCHMARK
+	static bool &getRunBenchmarks()
+	{
+		static bool m_run_benchmarks = false;
+		return m_run_benchmarks;
+	}
 };
 
 // A few item and node definitions for those tests that need them
@@ -141,7 +155,23 @@ extern content_t t_CONTENT_TORCH;
 extern content_t t_CONTENT_WATER;
 extern content_t t_CONTENT_LAVA;
 extern content_t t_CONTENT_BRICK;
+extern content_t t_CONTENT_WATER_FLOWING;
+
+/*
+	A map without a database whose blocks are all created in memory, for
+	those tests that need loaded blocks
+*/
+class TestMemoryMap : public Map {
+public:
+	TestMemoryMap(IGameDef *gamedef);
+
+	// Adds a block filled with n, which must not exist yet
+	MapBlock *addBlock(v3s16 blockpos, MapNode n);
+	// Adds the blocks from blockpos_min to blockpos_max, filled with n
+	void addBlocks(v3s16 blockpos_min, v3s16 blockpos_max, MapNode n);
+	void setContent(v3s16 p, content_t c);
+};
 
-bool run_tests();
+bool run_tests(bool run_benchmarks = false);
 
 #endif
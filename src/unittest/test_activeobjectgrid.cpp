@@ -0,0 +1,144 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "serverenvironment.h"
+
+class TestActiveObjectGrid : public TestBase {
+public:
+	TestActiveObjectGrid() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveObjectGrid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testInsertRemove();
+	void testUpdate();
+	void testLargeArea();
+	void testIdSet();
+};
+
+static TestActiveObjectGrid g_test_instance;
+
+void TestActiveObjectGrid::runTests(IGameDef *gamedef)
+{
+	TEST(testInsertRemove);
+	TEST(testUpdate);
+	TEST(testLargeArea);
+	TEST(testIdSet);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool contains(const std::vector<u16> &ids, u16 id)
+{
+	return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+void TestActiveObjectGrid::testInsertRemove()
+{
+	ActiveObjectGrid grid;
+	grid.insert(1, v3f(0, 0, 0));
+	grid.insert(2, v3f(5, 5, 5) * BS);
+	grid.insert(3, v3f(-100, 20, 300) * BS);
+	UASSERTEQ(size_t, grid.size(), 3);
+
+	std::vector<u16> ids;
+	grid.getObjectsInArea(aabb3f(v3f(-10) * BS, v3f(10) * BS), ids);
+	UASSERT(contains(ids, 1));
+	UASSERT(contains(ids, 2));
+	UASSERT(!contains(ids, 3));
+
+	grid.remove(2);
+	UASSERTEQ(size_t, grid.size(), 2);
+	ids.clear();
+	grid.getObjectsInArea(aabb3f(v3f(-10) * BS, v3f(10) * BS), ids);
+	UASSERT(contains(ids, 1));
+	UASSERT(!contains(ids, 2));
+
+	// Removing an unknown id is harmless
+	grid.remove(42);
+	UASSERTEQ(size_t, grid.size(), 2);
+}
+
+void TestActiveObjectGrid::testUpdate()
+{
+	ActiveObjectGrid grid;
+	grid.insert(1, v3f(0, 0, 0));
+
+	grid.update(1, v3f(1000, 0, 0) * BS);
+	std::vector<u16> ids;
+	grid.getObjectsInArea(aabb3f(v3f(-10) * BS, v3f(10) * BS), ids);
+	UASSERT(ids.empty());
+	grid.getObjectsInArea(aabb3f(v3f(990, -10, -10) * BS,
+		v3f(1010, 10, 10) * BS), ids);
+	UASSERT(contains(ids, 1));
+
+	// Updating an id that is not in the grid does not add it
+	grid.update(2, v3f(0, 0, 0));
+	UASSERTEQ(size_t, grid.size(), 1);
+}
+
+void TestActiveObjectGrid::testLargeArea()
+{
+	ActiveObjectGrid grid;
+	grid.insert(1, v3f(-30000, 0, 0) * BS);
+	grid.insert(2, v3f(30000, 0, 0) * BS);
+	grid.insert(3, v3f(0, 1e9, 0));
+
+	std::vector<u16> ids;
+	grid.getObjectsInArea(aabb3f(v3f(-1e9), v3f(1e9)), ids);
+	UASSERTEQ(size_t, ids.size(), 3);
+}
+
+void TestActiveObjectGrid::testIdSet()
+{
+	ActiveObjectIdSet set;
+	UASSERT(set.empty());
+	UASSERT(set.begin() == set.end());
+	UASSERT(!set.contains(5));
+
+	UASSERT(set.insert(65535));
+	UASSERT(set.insert(5));
+	UASSERT(set.insert(31));
+	UASSERT(set.insert(32));
+	UASSERT(!set.insert(5));
+	UASSERTEQ(size_t, set.size(), 4);
+	UASSERT(set.contains(5));
+	UASSERT(set.contains(65535));
+	UASSERT(!set.contains(6));
+
+	// Iterated in ascending order
+	std::vector<u16> ids;
+	for (ActiveObjectIdSet::const_iterator i = set.begin(); i != set.end(); ++i)
+		ids.push_back(*i);
+	UASSERTEQ(size_t, ids.size(), 4);
+	UASSERTEQ(u16, ids[0], 5);
+	UASSERTEQ(u16, ids[1], 31);
+	UASSERTEQ(u16, ids[2], 32);
+	UASSERTEQ(u16, ids[3], 65535);
+
+	UASSERT(set.erase(31));
+	UASSERT(!set.erase(31));
+	UASSERT(!set.erase(1000));
+	UASSERT(!set.contains(31));
+	UASSERTEQ(size_t, set.size(), 3);
+	UASSERTEQ(u16, *(++set.begin()), 32);
+}
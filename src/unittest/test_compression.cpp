@@ -37,6 +37,8 @@ class TestCompression : public TestBase {
 	void testRLECompression();
 	void testZlibCompression();
 	void testZlibLargeData();
+	void testZlibToBuffer();
+	void testBlockCodecs();
 };
 
 static TestCompression g_test_instance;
@@ -46,6 +48,8 @@ void TestCompression::runTests(IGameDef *gamedef)
 	TEST(testRLECompression);
 	TEST(testZlibCompression);
 	TEST(testZlibLargeData);
+	TEST(testZlibToBuffer);
+	TEST(testBlockCodecs);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -170,3 +174,85 @@ void TestCompression::testZlibLargeData()
 				i, str_decompressed[i], i, data_in[i]);
 	}
 }
+
+void TestCompression::testZlibToBuffer()
+{
+	u32 size = 20000;
+	std::string data_in;
+	data_in.resize(size);
+	PseudoRandom pseudorandom(9421);
+	for (u32 i = 0; i < size; i++)
+		data_in[i] = pseudorandom.range(0, 15);
+
+	// Data following the zlib stream must stay readable
+	std::ostringstream os_compressed(std::ios::binary);
+	compressZlib(data_in, os_compressed);
+	os_compressed << "trailer";
+
+	std::istringstream is_compressed(os_compressed.str(), std::ios::binary);
+	SharedBuffer<u8> out(size);
+	decompressZlib(is_compressed, &out[0], size);
+	UASSERT(memcmp(&out[0], data_in.c_str(), size) == 0);
+
+	std::string trailer;
+	is_compressed >> trailer;
+	UASSERT(trailer == "trailer");
+
+	// Both too much and too little data are errors
+	std::istringstream is_short(os_compressed.str(), std::ios::binary);
+	EXCEPTION_CHECK(SerializationError,
+		decompressZlib(is_short, &out[0], size - 1));
+
+	SharedBuffer<u8> out_long(size + 1);
+	std::istringstream is_long(os_compressed.str(), std::ios::binary);
+	EXCEPTION_CHECK(SerializationError,
+		decompressZlib(is_long, &out_long[0], size + 1));
+}
+
+void TestCompression::testBlockCodecs()
+{
+	UASSERT(block_codec_supported(BLOCK_CODEC_ZLIB));
+	UASSERT(!block_codec_supported(BLOCK_CODEC_COUNT));
+	UASSERTEQ(int, block_codec_from_name("zlib"), BLOCK_CODEC_ZLIB);
+	UASSERTEQ(int, block_codec_from_name("lz4"), BLOCK_CODEC_LZ4);
+	UASSERTEQ(int, block_codec_from_name("gzip"), BLOCK_CODEC_COUNT);
+
+	u32 size = 20000;
+	std::string data_in;
+	data_in.resize(size);
+	PseudoRandom pseudorandom(9421);
+	for (u32 i = 0; i < size; i++)
+		data_in[i] = pseudorandom.range(0, 15);
+
+	for (u8 codec = 0; codec < BLOCK_CODEC_COUNT; codec++) {
+		std::ostringstream os_compressed(std::ios::binary);
+		if (!block_codec_supported(codec)) {
+			EXCEPTION_CHECK(SerializationError,
+				compressBlockData((const u8 *)data_in.c_str(), size,
+					os_compressed, codec));
+			continue;
+		}
+
+		// Data following the compressed data must stay readable
+		compressBlockData((const u8 *)data_in.c_str(), size, os_compressed,
+			codec);
+		os_compressed << "trailer";
+
+		std::istringstream is_compressed(os_compressed.str(), std::ios::binary);
+		SharedBuffer<u8> out(size);
+		decompressBlockData(is_compressed, &out[0], size, codec);
+		UASSERT(memcmp(&out[0], data_in.c_str(), size) == 0);
+		std::string trailer;
+		is_compressed >> trailer;
+		UASSERT(trailer == "trailer");
+
+		std::istringstream is_stream(os_compressed.str(), std::ios::binary);
+		std::ostringstream os_decompressed(std::ios::binary);
+		decompressBlockData(is_stream, os_decompressed, codec);
+		UASSERT(os_decompressed.str() == data_in);
+
+		std::istringstream is_short(os_compressed.str(), std::ios::binary);
+		EXCEPTION_CHECK(SerializationError,
+			decompressBlockData(is_short, &out[0], size - 1, codec));
+	}
+}
@@ -0,0 +1,233 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "porting.h"
+#include "util/thread.h"
+
+class TestLiquid : public TestBase {
+public:
+	TestLiquid() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLiquid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFlow(IGameDef *gamedef);
+	void testThreadCount(IGameDef *gamedef);
+	void testManyBlocks(IGameDef *gamedef);
+	void testThroughput(IGameDef *gamedef);
+};
+
+static TestLiquid g_test_instance;
+
+void TestLiquid::runTests(IGameDef *gamedef)
+{
+	TEST(testFlow, gamedef);
+	TEST(testThreadCount, gamedef);
+	TEST(testManyBlocks, gamedef);
+	BENCHMARK(testThroughput, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A map of size_x * size_y * size_z loaded blocks of air on a stone
+	floor, starting at the block position 0,0,0.
+*/
+class LiquidTestMap : public TestMemoryMap {
+public:
+	LiquidTestMap(IGameDef *gamedef, s16 size_x, s16 size_y, s16 size_z) :
+		TestMemoryMap(gamedef),
+		m_size(size_x * MAP_BLOCKSIZE, size_y * MAP_BLOCKSIZE,
+				size_z * MAP_BLOCKSIZE)
+	{
+		addBlocks(v3s16(0, 0, 0), v3s16(size_x - 1, size_y - 1, size_z - 1),
+				MapNode(CONTENT_AIR));
+
+		MapNode stone(t_CONTENT_STONE);
+		for (s16 z = 0; z < size_z; z++)
+		for (s16 x = 0; x < size_x; x++) {
+			MapBlock *block = getBlockNoCreateNoEx(v3s16(x, 0, z));
+			for (s16 nz = 0; nz < MAP_BLOCKSIZE; nz++)
+			for (s16 nx = 0; nx < MAP_BLOCKSIZE; nx++)
+				block->setNodeNoCheck(nx, 0, nz, stone);
+		}
+	}
+
+	void addSource(v3s16 p)
+	{
+		MapNode n(t_CONTENT_WATER);
+		setNode(p, n);
+		transforming_liquid_add(p);
+	}
+
+	// Transforms liquids until nothing changes, returns the update count
+	u32 settle(WorkerPool *pool, u32 max_updates)
+	{
+		u32 updates = 0;
+		while (transforming_liquid_size() > 0 && updates < max_updates) {
+			std::map<v3s16, MapBlock *> modified_blocks;
+			transformLiquids(modified_blocks, NULL, pool);
+			updates++;
+		}
+		return updates;
+	}
+
+	bool equals(LiquidTestMap &other)
+	{
+		for (s16 z = 0; z < m_size.Z; z++)
+		for (s16 y = 0; y < m_size.Y; y++)
+		for (s16 x = 0; x < m_size.X; x++) {
+			v3s16 p(x, y, z);
+			MapNode n1 = getNodeNoEx(p);
+			MapNode n2 = other.getNodeNoEx(p);
+			if (n1.getContent() != n2.getContent() || n1.param2 != n2.param2)
+				return false;
+		}
+		return true;
+	}
+
+	u32 countFlowing()
+	{
+		u32 count = 0;
+		for (s16 z = 0; z < m_size.Z; z++)
+		for (s16 y = 0; y < m_size.Y; y++)
+		for (s16 x = 0; x < m_size.X; x++)
+			if (getNodeNoEx(v3s16(x, y, z)).getContent() == t_CONTENT_WATER_FLOWING)
+				count++;
+		return count;
+	}
+
+	v3s16 m_size;
+};
+
+// Sources in a grid, so the water spreads over many blocks
+static void add_sources(LiquidTestMap &map, s16 spacing)
+{
+	for (s16 z = spacing / 2; z < map.m_size.Z; z += spacing)
+	for (s16 x = spacing / 2; x < map.m_size.X; x += spacing)
+		map.addSource(v3s16(x, MAP_BLOCKSIZE + 4, z));
+}
+
+void TestLiquid::testFlow(IGameDef *gamedef)
+{
+	WorkerPool pool("TestLiquid", 4);
+	LiquidTestMap serial_map(gamedef, 3, 2, 3);
+	LiquidTestMap parallel_map(gamedef, 3, 2, 3);
+	// On the edge between blocks 1,1,1 and 1,0,1 and falling into the latter
+	v3s16 p(24, MAP_BLOCKSIZE, 24);
+	serial_map.addSource(p);
+	parallel_map.addSource(p);
+
+	u32 updates = serial_map.settle(NULL, 1000);
+	UASSERT(updates < 1000);
+	updates = parallel_map.settle(&pool, 1000);
+	UASSERT(updates < 1000);
+
+	// The water falls onto the floor and spreads on it
+	UASSERT(serial_map.getNodeNoEx(p).getContent() == t_CONTENT_WATER);
+	UASSERT(serial_map.getNodeNoEx(v3s16(24, 1, 24)).getContent() ==
+			t_CONTENT_WATER_FLOWING);
+	UASSERT(serial_map.getNodeNoEx(v3s16(28, 1, 24)).getContent() ==
+			t_CONTENT_WATER_FLOWING);
+	UASSERT(serial_map.getNodeNoEx(v3s16(24, 1, 40)).getContent() ==
+			CONTENT_AIR);
+
+	// Both end up in the same state, whatever order the nodes took
+	UASSERT(serial_map.countFlowing() > 0);
+	UASSERT(parallel_map.equals(serial_map));
+}
+
+void TestLiquid::testThreadCount(IGameDef *gamedef)
+{
+	WorkerPool pool1("TestLiquid", 1);
+	WorkerPool pool4("TestLiquid", 4);
+	LiquidTestMap map1(gamedef, 4, 2, 4);
+	LiquidTestMap map4(gamedef, 4, 2, 4);
+	add_sources(map1, 13);
+	add_sources(map4, 13);
+
+	// Every single update has to give the same nodes
+	for (u32 i = 0; i < 10; i++) {
+		std::map<v3s16, MapBlock *> modified_blocks1;
+		std::map<v3s16, MapBlock *> modified_blocks4;
+		map1.transformLiquids(modified_blocks1, NULL, &pool1);
+		map4.transformLiquids(modified_blocks4, NULL, &pool4);
+		UASSERT(map1.equals(map4));
+		UASSERTEQ(size_t, modified_blocks1.size(), modified_blocks4.size());
+		UASSERTEQ(s32, map1.transforming_liquid_size(),
+				map4.transforming_liquid_size());
+	}
+	UASSERT(map1.countFlowing() > 0);
+}
+
+void TestLiquid::testManyBlocks(IGameDef *gamedef)
+{
+	// Far more blocks with liquid than threads
+	WorkerPool pool("TestLiquid", 4);
+	LiquidTestMap serial_map(gamedef, 6, 2, 6);
+	LiquidTestMap parallel_map(gamedef, 6, 2, 6);
+	add_sources(serial_map, 7);
+	add_sources(parallel_map, 7);
+
+	for (u32 i = 0; i < 10; i++) {
+		std::map<v3s16, MapBlock *> serial_blocks;
+		std::map<v3s16, MapBlock *> parallel_blocks;
+		serial_map.transformLiquids(serial_blocks, NULL, NULL);
+		parallel_map.transformLiquids(parallel_blocks, NULL, &pool);
+		UASSERTEQ(size_t, serial_blocks.size(), parallel_blocks.size());
+		std::map<v3s16, MapBlock *>::const_iterator it;
+		for (it = serial_blocks.begin(); it != serial_blocks.end(); ++it)
+			UASSERT(parallel_blocks.count(it->first) == 1);
+	}
+	UASSERT(serial_map.countFlowing() > 0);
+	UASSERT(parallel_map.equals(serial_map));
+}
+
+#define BENCHMARK_MAP_SIZE 8
+#define BENCHMARK_UPDATES 10
+
+void TestLiquid::testThroughput(IGameDef *gamedef)
+{
+	WorkerPool pool("TestLiquid", 4);
+	for (u32 i = 0; i < 2; i++) {
+		WorkerPool *p = i == 0 ? NULL : &pool;
+		LiquidTestMap map(gamedef, BENCHMARK_MAP_SIZE, 2, BENCHMARK_MAP_SIZE);
+		add_sources(map, 7);
+
+		u32 count = 0;
+		u64 t0 = porting::getTimeUs();
+		for (u32 j = 0; j < BENCHMARK_UPDATES; j++) {
+			count += map.transforming_liquid_size();
+			std::map<v3s16, MapBlock *> modified_blocks;
+			map.transformLiquids(modified_blocks, NULL, p);
+		}
+		u64 t1 = porting::getTimeUs();
+		UASSERT(map.countFlowing() > 0);
+
+		rawstream << "    " << count << " liquid nodes, "
+				<< (p ? pool.getThreadCount() : 1) << " thread(s): "
+				<< (t1 - t0) / 1000 << "ms" << std::endl;
+	}
+}
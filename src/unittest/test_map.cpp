@@ -0,0 +1,224 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "porting.h"
+
+class TestMap : public TestBase {
+public:
+	TestMap() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMap"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFindNodes(IGameDef *gamedef);
+	void testFindNodesIgnore(IGameDef *gamedef);
+	void testFindNodesLarge(IGameDef *gamedef);
+	void testFindNodesThroughput(IGameDef *gamedef);
+};
+
+static TestMap g_test_instance;
+
+void TestMap::runTests(IGameDef *gamedef)
+{
+	TEST(testFindNodes, gamedef);
+	TEST(testFindNodesIgnore, gamedef);
+	TEST(testFindNodesLarge, gamedef);
+	BENCHMARK(testFindNodesThroughput, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A map of size_x * size_y * size_z loaded blocks starting at the block
+	position 0,0,0. The bottom blocks are stone, the others air.
+*/
+class FindTestMap : public TestMemoryMap {
+public:
+	FindTestMap(IGameDef *gamedef, s16 size_x, s16 size_y, s16 size_z) :
+		TestMemoryMap(gamedef)
+	{
+		addBlocks(v3s16(0, 0, 0), v3s16(size_x - 1, 0, size_z - 1),
+				MapNode(t_CONTENT_STONE));
+		if (size_y > 1)
+			addBlocks(v3s16(0, 1, 0),
+					v3s16(size_x - 1, size_y - 1, size_z - 1),
+					MapNode(CONTENT_AIR));
+	}
+
+	// What find_nodes_in_area did before Map::findNodes()
+	void findNodesSlow(v3s16 minp, v3s16 maxp,
+			const std::set<content_t> &filter, std::vector<v3s16> &result)
+	{
+		for (s16 x = minp.X; x <= maxp.X; x++)
+		for (s16 y = minp.Y; y <= maxp.Y; y++)
+		for (s16 z = minp.Z; z <= maxp.Z; z++) {
+			v3s16 p(x, y, z);
+			if (filter.count(getNodeNoEx(p).getContent()) != 0)
+				result.push_back(p);
+		}
+	}
+};
+
+static void check_find_nodes(FindTestMap &map, v3s16 minp, v3s16 maxp,
+		const std::set<content_t> &ids)
+{
+	ContentFilter filter;
+	for (std::set<content_t>::const_iterator it = ids.begin();
+			it != ids.end(); ++it)
+		filter.add(*it);
+
+	std::vector<v3s16> expected;
+	std::vector<v3s16> found;
+	map.findNodesSlow(minp, maxp, ids, expected);
+	map.findNodes(minp, maxp, filter, found);
+	UASSERT(found == expected);
+}
+
+void TestMap::testFindNodes(IGameDef *gamedef)
+{
+	FindTestMap map(gamedef, 3, 2, 3);
+	// Scattered nodes, a few of them on block edges
+	map.setContent(v3s16(0, 0, 0), t_CONTENT_BRICK);
+	map.setContent(v3s16(15, 16, 15), t_CONTENT_BRICK);
+	map.setContent(v3s16(16, 20, 31), t_CONTENT_BRICK);
+	map.setContent(v3s16(40, 3, 7), t_CONTENT_TORCH);
+	map.setContent(v3s16(47, 31, 47), t_CONTENT_TORCH);
+
+	std::set<content_t> ids;
+	ids.insert(t_CONTENT_BRICK);
+	check_find_nodes(map, v3s16(0, 0, 0), v3s16(47, 31, 47), ids);
+	check_find_nodes(map, v3s16(5, 2, 9), v3s16(41, 25, 38), ids);
+	ids.insert(t_CONTENT_TORCH);
+	check_find_nodes(map, v3s16(0, 0, 0), v3s16(47, 31, 47), ids);
+	check_find_nodes(map, v3s16(16, 16, 16), v3s16(16, 20, 31), ids);
+	ids.insert(t_CONTENT_STONE);
+	check_find_nodes(map, v3s16(10, 10, 10), v3s16(30, 20, 30), ids);
+
+	// In x, then y, then z order
+	ContentFilter filter;
+	filter.add(t_CONTENT_BRICK);
+	std::vector<v3s16> found;
+	map.findNodes(v3s16(0, 0, 0), v3s16(47, 31, 47), filter, found);
+	UASSERTEQ(size_t, found.size(), 3);
+	UASSERT(found[0] == v3s16(0, 0, 0));
+	UASSERT(found[1] == v3s16(15, 16, 15));
+	UASSERT(found[2] == v3s16(16, 20, 31));
+
+	// Results are appended
+	map.findNodes(v3s16(0, 0, 0), v3s16(1, 1, 1), filter, found);
+	UASSERTEQ(size_t, found.size(), 4);
+	UASSERT(found[3] == v3s16(0, 0, 0));
+
+	// Removed nodes are not found although the block still lists them
+	map.setContent(v3s16(0, 0, 0), t_CONTENT_STONE);
+	found.clear();
+	map.findNodes(v3s16(0, 0, 0), v3s16(15, 15, 15), filter, found);
+	UASSERT(found.empty());
+}
+
+void TestMap::testFindNodesIgnore(IGameDef *gamedef)
+{
+	// Block 1,0,1 is missing
+	FindTestMap map(gamedef, 1, 1, 1);
+	map.addBlock(v3s16(1, 0, 0), MapNode(t_CONTENT_STONE));
+	map.addBlock(v3s16(0, 0, 1), MapNode(t_CONTENT_STONE));
+
+	std::set<content_t> ids;
+	ids.insert(CONTENT_IGNORE);
+	check_find_nodes(map, v3s16(-2, 0, 0), v3s16(20, 3, 20), ids);
+	ids.insert(t_CONTENT_STONE);
+	check_find_nodes(map, v3s16(10, -1, 10), v3s16(20, 0, 20), ids);
+
+	ContentFilter filter;
+	filter.add(CONTENT_IGNORE);
+	std::vector<v3s16> found;
+	map.findNodes(v3s16(16, 0, 16), v3s16(31, 15, 31), filter, found);
+	UASSERTEQ(size_t, found.size(), 16 * 16 * 16);
+	found.clear();
+	map.findNodes(v3s16(0, 0, 0), v3s16(15, 15, 15), filter, found);
+	UASSERT(found.empty());
+}
+
+// A few ores in the stone, up to maxp
+static void add_ores(FindTestMap &map, v3s16 maxp)
+{
+	for (s16 z = 3; z <= maxp.Z; z += 11)
+	for (s16 x = 5; x <= maxp.X; x += 13)
+		map.setContent(v3s16(x, 7, z), t_CONTENT_BRICK);
+}
+
+void TestMap::testFindNodesLarge(IGameDef *gamedef)
+{
+	FindTestMap map(gamedef, 10, 2, 10);
+	v3s16 maxp = v3s16(10, 2, 10) * MAP_BLOCKSIZE - v3s16(1, 1, 1);
+	add_ores(map, maxp);
+
+	std::set<content_t> ids;
+	ids.insert(t_CONTENT_BRICK);
+	ContentFilter filter;
+	filter.add(t_CONTENT_BRICK);
+
+	std::vector<v3s16> expected;
+	std::vector<v3s16> found;
+	map.findNodesSlow(v3s16(0, 0, 0), maxp, ids, expected);
+	map.findNodes(v3s16(0, 0, 0), maxp, filter, found);
+	UASSERTEQ(size_t, found.size(), 15 * 12);
+	UASSERT(found == expected);
+}
+
+#define BENCHMARK_MAP_SIZE 10
+#define BENCHMARK_RUNS 5
+
+void TestMap::testFindNodesThroughput(IGameDef *gamedef)
+{
+	FindTestMap map(gamedef, BENCHMARK_MAP_SIZE, 2, BENCHMARK_MAP_SIZE);
+	v3s16 maxp = v3s16(BENCHMARK_MAP_SIZE, 2, BENCHMARK_MAP_SIZE) *
+			MAP_BLOCKSIZE - v3s16(1, 1, 1);
+	add_ores(map, maxp);
+
+	std::set<content_t> ids;
+	ids.insert(t_CONTENT_BRICK);
+	ContentFilter filter;
+	filter.add(t_CONTENT_BRICK);
+
+	std::vector<v3s16> expected;
+	std::vector<v3s16> found;
+	u64 t0 = porting::getTimeUs();
+	for (u32 i = 0; i < BENCHMARK_RUNS; i++) {
+		expected.clear();
+		map.findNodesSlow(v3s16(0, 0, 0), maxp, ids, expected);
+	}
+	u64 t1 = porting::getTimeUs();
+	for (u32 i = 0; i < BENCHMARK_RUNS; i++) {
+		found.clear();
+		map.findNodes(v3s16(0, 0, 0), maxp, filter, found);
+	}
+	u64 t2 = porting::getTimeUs();
+	UASSERT(found == expected);
+
+	rawstream << "    " << found.size() << " of "
+			<< (maxp.X + 1) * (maxp.Y + 1) * (maxp.Z + 1) << " nodes, "
+			<< "per node: " << (t1 - t0) / 1000 << "ms, "
+			<< "per block: " << (t2 - t1) / 1000 << "ms" << std::endl;
+}
@@ -0,0 +1,160 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <map>
+#include <set>
+#include "database.h"
+#include "exceptions.h"
+#include "map_save_thread.h"
+
+class TestMapSaveThread : public TestBase {
+public:
+	TestMapSaveThread() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapSaveThread"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFailedBlock();
+	void testFailedCommit();
+};
+
+static TestMapSaveThread g_test_instance;
+
+void TestMapSaveThread::runTests(IGameDef *gamedef)
+{
+	TEST(testFailedBlock);
+	TEST(testFailedCommit);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	Keeps the blocks of committed transactions, and fails the saves and
+	commits it is told to.
+*/
+class FailingMapDatabase : public MapDatabase {
+public:
+	FailingMapDatabase() :
+		in_transaction(false),
+		fail_commits(0),
+		rollbacks(0)
+	{}
+
+	void beginSave()
+	{
+		if (in_transaction)
+			throw DatabaseException("Transaction already open");
+		in_transaction = true;
+		pending.clear();
+	}
+
+	void endSave()
+	{
+		if (fail_commits > 0) {
+			fail_commits--;
+			throw DatabaseException("Commit failed");
+		}
+		for (std::map<v3s16, std::string>::const_iterator
+				it = pending.begin(); it != pending.end(); ++it)
+			blocks[it->first] = it->second;
+		in_transaction = false;
+	}
+
+	void rollbackSave()
+	{
+		in_transaction = false;
+		pending.clear();
+		rollbacks++;
+	}
+
+	bool saveBlock(const v3s16 &pos, const std::string &data)
+	{
+		if (fail_blocks.erase(pos))
+			return false;
+		pending[pos] = data;
+		return true;
+	}
+
+	void loadBlock(const v3s16 &pos, std::string *block)
+	{
+		std::map<v3s16, std::string>::const_iterator it = blocks.find(pos);
+		*block = it == blocks.end() ? "" : it->second;
+	}
+
+	bool deleteBlock(const v3s16 &pos) { return blocks.erase(pos) != 0; }
+	void listAllLoadableBlocks(std::vector<v3s16> &dst) {}
+
+	bool in_transaction;
+	u32 fail_commits;
+	u32 rollbacks;
+	// Each of these fails once
+	std::set<v3s16> fail_blocks;
+	std::map<v3s16, std::string> pending;
+	std::map<v3s16, std::string> blocks;
+};
+
+void TestMapSaveThread::testFailedBlock()
+{
+	FailingMapDatabase db;
+	MapSaveThread thread(&db, 100);
+	v3s16 a(1, 2, 3);
+	v3s16 b(-4, 5, 6);
+	db.fail_blocks.insert(a);
+	thread.saveBlock(a, "a");
+	thread.saveBlock(b, "b");
+	thread.flush();
+	UASSERT(db.blocks.count(a) == 0);
+	UASSERT(db.blocks[b] == "b");
+
+	// The failed block is still readable and written by the next pass
+	std::string data;
+	thread.loadBlock(a, &data);
+	UASSERT(data == "a");
+	thread.flush();
+	UASSERT(db.blocks[a] == "a");
+
+	// Unless newer data of it was queued in the meantime
+	db.fail_blocks.insert(b);
+	thread.saveBlock(b, "b1");
+	thread.flush();
+	thread.saveBlock(b, "b2");
+	thread.flush();
+	UASSERT(db.blocks[b] == "b2");
+}
+
+void TestMapSaveThread::testFailedCommit()
+{
+	FailingMapDatabase db;
+	MapSaveThread thread(&db, 100);
+	v3s16 a(1, 2, 3);
+	db.fail_commits = 1;
+	thread.saveBlock(a, "a");
+	EXCEPTION_CHECK(DatabaseException, thread.flush());
+	UASSERT(!db.in_transaction);
+	UASSERTEQ(u32, db.rollbacks, 1);
+	UASSERT(db.blocks.empty());
+
+	// The next pass opens a new transaction and writes the block
+	thread.saveBlock(v3s16(0, 0, 0), "0");
+	thread.flush();
+	UASSERT(db.blocks[a] == "a");
+	UASSERT(db.blocks[v3s16(0, 0, 0)] == "0");
+}
@@ -0,0 +1,180 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "block_payload_cache.h"
+#include "mapblock.h"
+#include "serialization.h"
+#include "voxel.h"
+
+class TestMapBlock : public TestBase {
+public:
+	TestMapBlock() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlock"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testContents(IGameDef *gamedef);
+	void testContentsCopyFrom(IGameDef *gamedef);
+	void testPayloadCache(IGameDef *gamedef);
+	void testSerializeCodec(IGameDef *gamedef);
+};
+
+static TestMapBlock g_test_instance;
+
+void TestMapBlock::runTests(IGameDef *gamedef)
+{
+	TEST(testContents, gamedef);
+	TEST(testContentsCopyFrom, gamedef);
+	TEST(testPayloadCache, gamedef);
+	TEST(testSerializeCodec, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool contains(const std::vector<content_t> &contents, content_t c)
+{
+	return std::find(contents.begin(), contents.end(), c) != contents.end();
+}
+
+void TestMapBlock::testContents(IGameDef *gamedef)
+{
+	MapBlock dummy(NULL, v3s16(0, 0, 0), gamedef, true);
+	UASSERT(dummy.getContents().empty());
+
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	UASSERTEQ(size_t, block.getContents().size(), 1);
+	UASSERT(contains(block.getContents(), CONTENT_IGNORE));
+
+	MapNode n(CONTENT_AIR);
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		block.setNode(x, y, z, n);
+
+	// Replaced content is kept until the list is rebuilt
+	UASSERTEQ(size_t, block.getContents().size(), 2);
+	UASSERT(contains(block.getContents(), CONTENT_AIR));
+
+	n.setContent(1000);
+	block.setNodeNoCheck(3, 4, 5, n);
+	block.setNode(6, 7, 8, n);
+	UASSERTEQ(size_t, block.getContents().size(), 3);
+	UASSERT(contains(block.getContents(), 1000));
+
+	block.actuallyUpdateContents();
+	UASSERTEQ(size_t, block.getContents().size(), 2);
+	UASSERT(!contains(block.getContents(), CONTENT_IGNORE));
+	UASSERT(contains(block.getContents(), CONTENT_AIR));
+	UASSERT(contains(block.getContents(), 1000));
+}
+
+void TestMapBlock::testContentsCopyFrom(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(1, 0, 0), gamedef);
+	UASSERT(contains(block.getContents(), CONTENT_IGNORE));
+
+	VoxelManipulator vm;
+	v3s16 p0 = block.getPosRelative();
+	VoxelArea area(p0, p0 + v3s16(1, 1, 1) * (MAP_BLOCKSIZE - 1));
+	vm.addArea(area);
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+	for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++)
+		vm.setNodeNoRef(v3s16(x, y, z), MapNode(y % 2 ? 1001 : CONTENT_AIR));
+
+	block.copyFrom(vm);
+	UASSERTEQ(size_t, block.getContents().size(), 2);
+	UASSERT(contains(block.getContents(), CONTENT_AIR));
+	UASSERT(contains(block.getContents(), 1001));
+}
+
+void TestMapBlock::testPayloadCache(IGameDef *gamedef)
+{
+	BlockPayloadCache cache(1024 * 1024);
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	u8 ver = SER_FMT_VER_HIGHEST_WRITE;
+
+	std::string data = cache.get(&block, ver, BLOCK_CODEC_ZLIB, 32);
+	UASSERTEQ(size_t, cache.getEntryCount(), 1);
+	UASSERT(cache.get(&block, ver, BLOCK_CODEC_ZLIB, 32) == data);
+	UASSERTEQ(size_t, cache.getEntryCount(), 1);
+	UASSERTEQ(size_t, cache.getSize(), data.size());
+
+	// Modifications invalidate the entry
+	u32 counter = block.getModifiedCounter();
+	MapNode n(CONTENT_AIR);
+	block.setNode(1, 2, 3, n);
+	UASSERT(block.getModifiedCounter() != counter);
+	UASSERT(cache.get(&block, ver, BLOCK_CODEC_ZLIB, 32) != data);
+	UASSERTEQ(size_t, cache.getEntryCount(), 1);
+
+	// A reloaded block at the same position does not match either
+	MapBlock reloaded(NULL, v3s16(0, 0, 0), gamedef);
+	UASSERT(reloaded.getId() != block.getId());
+	UASSERT(cache.get(&reloaded, ver, BLOCK_CODEC_ZLIB, 32) == data);
+
+	// Each protocol version gets its own entry
+	cache.get(&block, ver, BLOCK_CODEC_ZLIB, 33);
+	UASSERTEQ(size_t, cache.getEntryCount(), 2);
+
+	// Least recently used entries are dropped when over the limit
+	BlockPayloadCache small(1);
+	MapBlock other(NULL, v3s16(1, 0, 0), gamedef);
+	small.get(&block, ver, BLOCK_CODEC_ZLIB, 32);
+	small.get(&other, ver, BLOCK_CODEC_ZLIB, 32);
+	UASSERTEQ(size_t, small.getEntryCount(), 1);
+
+	BlockPayloadCache disabled(0);
+	UASSERT(disabled.get(&reloaded, ver, BLOCK_CODEC_ZLIB, 32) == data);
+	UASSERTEQ(size_t, disabled.getEntryCount(), 0);
+}
+
+void TestMapBlock::testSerializeCodec(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y += 3) {
+		MapNode n(1001, 0, y);
+		block.setNode(5, y, 7, n);
+	}
+
+	// Version 29 has the codec byte after the flags and lighting
+	std::ostringstream os28(std::ios_base::binary);
+	block.serialize(os28, 28, false);
+	std::ostringstream os29(std::ios_base::binary);
+	block.serialize(os29, 29, false, BLOCK_CODEC_ZLIB);
+	std::string data = os29.str();
+	UASSERTEQ(size_t, data.size(), os28.str().size() + 1);
+	UASSERTEQ(int, data[3], BLOCK_CODEC_ZLIB);
+
+	MapBlock loaded(NULL, v3s16(0, 0, 0), gamedef);
+	std::istringstream is(data, std::ios_base::binary);
+	loaded.deSerialize(is, 29, false);
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++) {
+		MapNode n = loaded.getNodeNoEx(v3s16(5, y, 7));
+		UASSERTEQ(int, n.getContent(), y % 3 ? CONTENT_IGNORE : 1001);
+		UASSERTEQ(int, n.param2, y % 3 ? 0 : y);
+	}
+
+	data[3] = BLOCK_CODEC_COUNT;
+	std::istringstream is_unknown(data, std::ios_base::binary);
+	EXCEPTION_CHECK(SerializationError, loaded.deSerialize(is_unknown, 29, false));
+}
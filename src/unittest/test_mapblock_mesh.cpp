@@ -0,0 +1,195 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapblock_mesh.h"
+#include "nodedef.h"
+#include "voxel.h"
+
+class TestMapBlockMesh : public TestBase {
+public:
+	TestMapBlockMesh() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockMesh"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testMergeRows();
+	void testMergeRowsInterrupted();
+
+	void fillData(MeshMakeData *data, INodeDefManager *ndef, bool with_ore);
+	u32 countFaces(INodeDefManager *ndef, bool with_ore, bool merge_rows,
+			std::vector<FastFace> &faces);
+};
+
+static TestMapBlockMesh g_test_instance;
+
+void TestMapBlockMesh::runTests(IGameDef *gamedef)
+{
+	TEST(testMergeRows);
+	TEST(testMergeRowsInterrupted);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static content_t c_stone;
+static content_t c_ore;
+
+/*
+	Node definitions that need no textures: the tiles get texture ids
+	by hand, stone repeats and ore does not.
+*/
+static IWritableNodeDefManager *create_mesh_nodedef()
+{
+	IWritableNodeDefManager *ndef = createNodeDefManager();
+
+	ContentFeatures f;
+	f.name = "air";
+	f.drawtype = NDT_AIRLIKE;
+	f.solidness = 0;
+	f.light_propagates = true;
+	f.walkable = false;
+	ndef->set(f.name, f);
+
+	f = ContentFeatures();
+	f.name = "test:stone";
+	for (int i = 0; i < 6; i++)
+		f.tiles[i].layers[0].texture_id = 1;
+	c_stone = ndef->set(f.name, f);
+
+	f = ContentFeatures();
+	f.name = "test:ore";
+	for (int i = 0; i < 6; i++) {
+		f.tiles[i].layers[0].texture_id = 2;
+		f.tiles[i].layers[0].material_flags = 0;
+	}
+	c_ore = ndef->set(f.name, f);
+
+	return ndef;
+}
+
+/*
+	Fills the block at (0,0,0) and its neighbors from a VoxelManipulator:
+	stone up to y = 7 and air above, so that the block has a flat top.
+*/
+void TestMapBlockMesh::fillData(MeshMakeData *data, INodeDefManager *ndef,
+		bool with_ore)
+{
+	VoxelArea area(v3s16(-1, -1, -1) * MAP_BLOCKSIZE,
+		v3s16(2, 2, 2) * MAP_BLOCKSIZE - v3s16(1, 1, 1));
+	VoxelManipulator vm;
+	vm.addArea(area);
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+	for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+		MapNode n(y <= 7 ? c_stone : CONTENT_AIR);
+		vm.setNode(v3s16(x, y, z), n);
+	}
+	if (with_ore)
+		vm.setNode(v3s16(8, 7, 8), MapNode(c_ore));
+
+	data->m_ndef = ndef;
+	data->fillBlockDataBegin(v3s16(0, 0, 0));
+	VoxelArea block_area(v3s16(0, 0, 0),
+		v3s16(MAP_BLOCKSIZE - 1, MAP_BLOCKSIZE - 1, MAP_BLOCKSIZE - 1));
+	MapNode block_nodes[MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	for (s16 z = -1; z <= 1; z++)
+	for (s16 y = -1; y <= 1; y++)
+	for (s16 x = -1; x <= 1; x++) {
+		v3s16 offset(x, y, z);
+		vm.copyTo(block_nodes, block_area, v3s16(0, 0, 0),
+			offset * MAP_BLOCKSIZE, block_area.getExtent());
+		data->fillBlockData(offset, block_nodes);
+	}
+}
+
+u32 TestMapBlockMesh::countFaces(INodeDefManager *ndef, bool with_ore,
+		bool merge_rows, std::vector<FastFace> &faces)
+{
+	MeshMakeData *data = new MeshMakeData(NULL, false);
+	fillData(data, ndef, with_ore);
+	faces.clear();
+	updateAllFastFaceRows(data, merge_rows, faces);
+	delete data;
+	return faces.size();
+}
+
+// Size of the face along the axes of its texture
+static v2f get_uv_extent(const FastFace &face)
+{
+	v2f min = face.vertices[0].TCoords, max = min;
+	for (u8 i = 1; i < 4; i++) {
+		const v2f &uv = face.vertices[i].TCoords;
+		min.X = MYMIN(min.X, uv.X);
+		min.Y = MYMIN(min.Y, uv.Y);
+		max.X = MYMAX(max.X, uv.X);
+		max.Y = MYMAX(max.Y, uv.Y);
+	}
+	return max - min;
+}
+
+void TestMapBlockMesh::testMergeRows()
+{
+	IWritableNodeDefManager *ndef = create_mesh_nodedef();
+	std::vector<FastFace> faces;
+
+	// One face per row, the texture repeats along the row
+	UASSERTEQ(u32, countFaces(ndef, false, false, faces), MAP_BLOCKSIZE);
+	for (size_t i = 0; i < faces.size(); i++) {
+		UASSERT(faces[i].vertices[0].Normal == v3f(0, 1, 0));
+		UASSERT(get_uv_extent(faces[i]) == v2f(MAP_BLOCKSIZE, 1));
+	}
+
+	// The whole top is a single face, the texture repeats along both axes
+	UASSERTEQ(u32, countFaces(ndef, false, true, faces), 1);
+	const FastFace &face = faces[0];
+	UASSERT(face.vertices[0].Normal == v3f(0, 1, 0));
+	UASSERT(get_uv_extent(face) == v2f(MAP_BLOCKSIZE, MAP_BLOCKSIZE));
+	for (u8 i = 0; i < 4; i++) {
+		const v3f &pos = face.vertices[i].Pos;
+		UASSERT(pos.Y == 7.5f * BS);
+		UASSERT(pos.X == -0.5f * BS || pos.X == (MAP_BLOCKSIZE - 0.5f) * BS);
+		UASSERT(pos.Z == -0.5f * BS || pos.Z == (MAP_BLOCKSIZE - 0.5f) * BS);
+	}
+
+	delete ndef;
+}
+
+void TestMapBlockMesh::testMergeRowsInterrupted()
+{
+	IWritableNodeDefManager *ndef = create_mesh_nodedef();
+	std::vector<FastFace> faces;
+
+	// The ore splits its row into three faces
+	UASSERTEQ(u32, countFaces(ndef, true, false, faces), MAP_BLOCKSIZE + 2);
+
+	// Rows 0 to 7 and 9 to 15 merge, row 8 stays three faces
+	UASSERTEQ(u32, countFaces(ndef, true, true, faces), 5);
+	u32 texels = 0;
+	for (size_t i = 0; i < faces.size(); i++) {
+		v2f extent = get_uv_extent(faces[i]);
+		texels += extent.X * extent.Y;
+		if (faces[i].layer.texture_id == 2)
+			UASSERT(extent == v2f(1, 1));
+	}
+	// Together the faces still cover the top once
+	UASSERTEQ(u32, texels, MAP_BLOCKSIZE * MAP_BLOCKSIZE);
+
+	delete ndef;
+}
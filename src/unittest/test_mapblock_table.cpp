@@ -0,0 +1,300 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapblock_table.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "porting.h"
+
+class TestMapBlockTable : public TestBase {
+public:
+	TestMapBlockTable() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockTable"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testInsertErase(IGameDef *gamedef);
+	void testArea(IGameDef *gamedef);
+	void testMapSectors(IGameDef *gamedef);
+	void testRandomAccess(IGameDef *gamedef);
+	void testCoherentAccess(IGameDef *gamedef);
+	void testRandomAccessThroughput(IGameDef *gamedef);
+	void testCoherentAccessThroughput(IGameDef *gamedef);
+};
+
+static TestMapBlockTable g_test_instance;
+
+void TestMapBlockTable::runTests(IGameDef *gamedef)
+{
+	TEST(testInsertErase, gamedef);
+	TEST(testArea, gamedef);
+	TEST(testMapSectors, gamedef);
+	TEST(testRandomAccess, gamedef);
+	TEST(testCoherentAccess, gamedef);
+	BENCHMARK(testRandomAccessThroughput, gamedef);
+	BENCHMARK(testCoherentAccessThroughput, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A map of size^3 loaded blocks, starting at the block position 0,0,0.
+*/
+class BlockTestMap : public TestMemoryMap {
+public:
+	BlockTestMap(IGameDef *gamedef, s16 size) :
+		TestMemoryMap(gamedef)
+	{
+		for (s16 z = 0; z < size; z++)
+		for (s16 y = 0; y < size; y++)
+		for (s16 x = 0; x < size; x++)
+			addBlock(v3s16(x, y, z));
+	}
+
+	// An air block whose param2 varies with the node position
+	MapBlock *addBlock(v3s16 blockpos)
+	{
+		MapBlock *block = TestMemoryMap::addBlock(blockpos,
+				MapNode(CONTENT_AIR));
+		MapNode n(CONTENT_AIR);
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			n.param2 = x + y + z;
+			block->setNodeNoCheck(x, y, z, n);
+		}
+		return block;
+	}
+
+	void deleteSector(v2s16 p2d)
+	{
+		std::vector<v2s16> sectors;
+		sectors.push_back(p2d);
+		deleteSectors(sectors);
+	}
+};
+
+static bool contains(const MapBlockVect &blocks, MapBlock *block)
+{
+	return std::find(blocks.begin(), blocks.end(), block) != blocks.end();
+}
+
+void TestMapBlockTable::testInsertErase(IGameDef *gamedef)
+{
+	MapBlockTable table;
+	UASSERT(table.get(v3s16(0, 0, 0)) == NULL);
+	UASSERT(!table.erase(v3s16(0, 0, 0)));
+
+	// Dummy blocks have no node data
+	std::vector<MapBlock *> blocks;
+	for (s16 z = -5; z < 5; z++)
+	for (s16 y = -5; y < 5; y++)
+	for (s16 x = -5; x < 5; x++) {
+		MapBlock *block = new MapBlock(NULL, v3s16(x, y, z), gamedef, true);
+		blocks.push_back(block);
+		table.insert(block);
+	}
+	UASSERTEQ(size_t, table.size(), blocks.size());
+
+	for (size_t i = 0; i < blocks.size(); i++)
+		UASSERT(table.get(blocks[i]->getPos()) == blocks[i]);
+	UASSERT(table.get(v3s16(5, 0, 0)) == NULL);
+	UASSERT(table.get(v3s16(-6, -6, -6)) == NULL);
+
+	// Erase every other block, the rest has to stay reachable
+	for (size_t i = 0; i < blocks.size(); i += 2)
+		UASSERT(table.erase(blocks[i]->getPos()));
+	UASSERTEQ(size_t, table.size(), blocks.size() / 2);
+	for (size_t i = 0; i < blocks.size(); i++) {
+		MapBlock *expected = i % 2 ? blocks[i] : NULL;
+		UASSERT(table.get(blocks[i]->getPos()) == expected);
+	}
+	UASSERT(!table.erase(blocks[0]->getPos()));
+
+	MapBlockVect all;
+	table.getBlocks(all);
+	UASSERTEQ(size_t, all.size(), blocks.size() / 2);
+
+	table.clear();
+	UASSERTEQ(size_t, table.size(), 0);
+	UASSERT(table.get(blocks[1]->getPos()) == NULL);
+
+	for (size_t i = 0; i < blocks.size(); i++)
+		delete blocks[i];
+}
+
+void TestMapBlockTable::testArea(IGameDef *gamedef)
+{
+	MapBlockTable table;
+	std::vector<MapBlock *> blocks;
+	for (s16 i = -10; i <= 10; i++) {
+		MapBlock *block = new MapBlock(NULL, v3s16(i, i, -i), gamedef, true);
+		blocks.push_back(block);
+		table.insert(block);
+	}
+
+	// Small areas are looked up, large ones scanned
+	MapBlockVect found;
+	table.getBlocksInArea(v3s16(-1, -1, -1), v3s16(1, 1, 1), found);
+	UASSERTEQ(size_t, found.size(), 3);
+	UASSERT(contains(found, table.get(v3s16(0, 0, 0))));
+	UASSERT(contains(found, table.get(v3s16(1, 1, -1))));
+
+	found.clear();
+	table.getBlocksInArea(v3s16(-100, -100, -100), v3s16(100, 5, 100), found);
+	UASSERTEQ(size_t, found.size(), 16);
+	UASSERT(!contains(found, table.get(v3s16(6, 6, -6))));
+
+	found.clear();
+	table.getBlocksInArea(v3s16(1, 1, 1), v3s16(0, 0, 0), found);
+	UASSERT(found.empty());
+
+	for (size_t i = 0; i < blocks.size(); i++)
+		delete blocks[i];
+}
+
+void TestMapBlockTable::testMapSectors(IGameDef *gamedef)
+{
+	BlockTestMap map(gamedef, 2);
+	UASSERTEQ(size_t, map.getBlockCount(), 8);
+
+	MapBlock *block = map.getBlockNoCreateNoEx(v3s16(1, 0, 1));
+	UASSERT(block != NULL);
+	UASSERT(block->getPos() == v3s16(1, 0, 1));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(2, 0, 1)) == NULL);
+
+	// Deleting from the sector also removes the block from the table
+	map.getSectorNoGenerate(v2s16(1, 1))->deleteBlock(block);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 0, 1)) == NULL);
+	UASSERTEQ(size_t, map.getBlockCount(), 7);
+
+	block = map.addBlock(v3s16(1, 0, 1));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 0, 1)) == block);
+
+	// And so does deleting the whole sector
+	map.deleteSector(v2s16(1, 1));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 0, 1)) == NULL);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 1, 1)) == NULL);
+	UASSERTEQ(size_t, map.getBlockCount(), 6);
+
+	MapBlockVect blocks;
+	map.getBlocksInArea(v3s16(0, 0, 0), v3s16(0, 1, 1), blocks);
+	UASSERTEQ(size_t, blocks.size(), 4);
+}
+
+// In blocks
+#define ACCESS_MAP_SIZE 4
+#define RANDOM_ACCESSES 10000
+
+// The param2 that BlockTestMap::addBlock() gives the node at p
+static u8 node_param2(v3s16 p)
+{
+	return p.X % MAP_BLOCKSIZE + p.Y % MAP_BLOCKSIZE + p.Z % MAP_BLOCKSIZE;
+}
+
+void TestMapBlockTable::testRandomAccess(IGameDef *gamedef)
+{
+	BlockTestMap map(gamedef, ACCESS_MAP_SIZE);
+
+	PcgRandom pr(42);
+	const s32 size = ACCESS_MAP_SIZE * MAP_BLOCKSIZE;
+	for (u32 i = 0; i < RANDOM_ACCESSES; i++) {
+		v3s16 p(pr.range(0, size - 1), pr.range(0, size - 1),
+				pr.range(0, size - 1));
+		UASSERTEQ(u32, map.getNodeNoEx(p).param2, node_param2(p));
+	}
+
+	// Outside of the loaded blocks, also right after a hit in the block cache
+	bool is_valid_position;
+	map.getNodeNoEx(v3s16(0, 0, 0));
+	MapNode n = map.getNodeNoEx(v3s16(-1, 0, 0), &is_valid_position);
+	UASSERT(!is_valid_position);
+	UASSERT(n.getContent() == CONTENT_IGNORE);
+	n = map.getNodeNoEx(v3s16(0, size, 0), &is_valid_position);
+	UASSERT(!is_valid_position);
+}
+
+void TestMapBlockTable::testCoherentAccess(IGameDef *gamedef)
+{
+	BlockTestMap map(gamedef, ACCESS_MAP_SIZE);
+
+	const s16 size = ACCESS_MAP_SIZE * MAP_BLOCKSIZE;
+	// Walk along X like most node loops do, crossing block borders
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = 0; y < size; y++)
+	for (s16 x = 0; x < size; x++) {
+		v3s16 p(x, y, z);
+		UASSERTEQ(u32, map.getNodeNoEx(p).param2, node_param2(p));
+	}
+	UASSERTEQ(u32, map.getNodeNoEx(v3s16(17, 1, 2)).param2, 4);
+}
+
+// In blocks, the coherent benchmark reads every node once
+#define BENCHMARK_MAP_SIZE 8
+#define BENCHMARK_RANDOM_ACCESSES 1000000
+
+void TestMapBlockTable::testRandomAccessThroughput(IGameDef *gamedef)
+{
+	BlockTestMap map(gamedef, BENCHMARK_MAP_SIZE);
+
+	PcgRandom pr(42);
+	const s32 size = BENCHMARK_MAP_SIZE * MAP_BLOCKSIZE;
+	u32 sum = 0;
+	u64 t0 = porting::getTimeUs();
+	for (u32 i = 0; i < BENCHMARK_RANDOM_ACCESSES; i++) {
+		v3s16 p(pr.range(0, size - 1), pr.range(0, size - 1),
+				pr.range(0, size - 1));
+		MapNode n = map.getNodeNoEx(p);
+		sum += n.param2;
+	}
+	u64 t1 = porting::getTimeUs();
+	UASSERT(sum > 0);
+
+	rawstream << "    " << BENCHMARK_RANDOM_ACCESSES << " random node reads: "
+			<< (t1 - t0) / 1000 << "ms" << std::endl;
+}
+
+void TestMapBlockTable::testCoherentAccessThroughput(IGameDef *gamedef)
+{
+	BlockTestMap map(gamedef, BENCHMARK_MAP_SIZE);
+
+	const s16 size = BENCHMARK_MAP_SIZE * MAP_BLOCKSIZE;
+	u32 count = 0;
+	u32 sum = 0;
+	u64 t0 = porting::getTimeUs();
+	// Walk along X like most node loops do
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = 0; y < size; y++)
+	for (s16 x = 0; x < size; x++) {
+		MapNode n = map.getNodeNoEx(v3s16(x, y, z));
+		sum += n.param2;
+		count++;
+	}
+	u64 t1 = porting::getTimeUs();
+	UASSERT(sum > 0);
+
+	rawstream << "    " << count << " coherent node reads: "
+			<< (t1 - t0) / 1000 << "ms" << std::endl;
+}
@@ -0,0 +1,174 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "network/networkpacket.h"
+#include "network/nodechanges.h"
+#include "util/serialize.h"
+
+class TestNodeChanges : public TestBase {
+public:
+	TestNodeChanges() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeChanges"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testMerge();
+	void testRoundTrip();
+	void testAddThenSwap();
+	void testInvalidIndex();
+};
+
+static TestNodeChanges g_test_instance;
+
+void TestNodeChanges::runTests(IGameDef *gamedef)
+{
+	TEST(testMerge);
+	TEST(testRoundTrip);
+	TEST(testAddThenSwap);
+	TEST(testInvalidIndex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A TOCLIENT_NODES_CHANGED packet as the client receives it
+static void make_packet(const std::map<v3s16, NodeChangeMap> &blocks,
+		NetworkPacket *pkt)
+{
+	std::ostringstream os(std::ios_base::binary);
+	writeU16(os, TOCLIENT_NODES_CHANGED);
+	writeU16(os, blocks.size());
+	for (std::map<v3s16, NodeChangeMap>::const_iterator
+			it = blocks.begin(); it != blocks.end(); ++it)
+		serialize_node_changes(os, it->first, it->second);
+
+	std::string raw = os.str();
+	pkt->putRawPacket((u8 *)raw.c_str(), raw.size(), 0);
+}
+
+static bool changes_equal(const NodeChangeMap &a, const NodeChangeMap &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (NodeChangeMap::const_iterator ia = a.begin(), ib = b.begin();
+			ia != a.end(); ++ia, ++ib) {
+		const MapNode &na = ia->second.n;
+		const MapNode &nb = ib->second.n;
+		if (ia->first != ib->first || na.param0 != nb.param0 ||
+				na.param1 != nb.param1 || na.param2 != nb.param2 ||
+				ia->second.remove_metadata != ib->second.remove_metadata)
+			return false;
+	}
+	return true;
+}
+
+void TestNodeChanges::testMerge()
+{
+	NodeChangeMap changes;
+	add_node_change(changes, 5, MapNode(t_CONTENT_STONE), false);
+	add_node_change(changes, 5, MapNode(t_CONTENT_BRICK, 3, 4), false);
+	UASSERTEQ(size_t, changes.size(), 1);
+	UASSERT(changes[5].n.getContent() == t_CONTENT_BRICK);
+	UASSERT(changes[5].n.param2 == 4);
+	UASSERT(!changes[5].remove_metadata);
+
+	// Metadata removed by any of the changes stays removed
+	add_node_change(changes, 7, MapNode(CONTENT_AIR), true);
+	add_node_change(changes, 7, MapNode(t_CONTENT_STONE), false);
+	UASSERT(changes[7].n.getContent() == t_CONTENT_STONE);
+	UASSERT(changes[7].remove_metadata);
+}
+
+void TestNodeChanges::testRoundTrip()
+{
+	std::map<v3s16, NodeChangeMap> blocks;
+	NodeChangeMap &a = blocks[v3s16(0, 0, 0)];
+	add_node_change(a, 0, MapNode(t_CONTENT_STONE), true);
+	add_node_change(a, 17, MapNode(t_CONTENT_BRICK, 15, 3), false);
+	add_node_change(a, 4095, MapNode(CONTENT_AIR), true);
+	NodeChangeMap &b = blocks[v3s16(-3, 100, -2000)];
+	add_node_change(b, 256, MapNode(t_CONTENT_TORCH, 0, 5), false);
+
+	NetworkPacket pkt;
+	make_packet(blocks, &pkt);
+
+	u16 block_count;
+	pkt >> block_count;
+	UASSERTEQ(u16, block_count, 2);
+	for (std::map<v3s16, NodeChangeMap>::const_iterator
+			it = blocks.begin(); it != blocks.end(); ++it) {
+		v3s16 blockpos;
+		NodeChangeMap changes;
+		deserialize_node_changes(&pkt, &blockpos, &changes);
+		UASSERT(blockpos == it->first);
+		UASSERT(changes_equal(changes, it->second));
+	}
+	UASSERTEQ(u32, pkt.getRemainingBytes(), 0);
+}
+
+void TestNodeChanges::testAddThenSwap()
+{
+	// MEET_ADDNODE removes the metadata, a MEET_SWAPNODE of the same
+	// node in the same step does not bring it back
+	std::map<v3s16, NodeChangeMap> blocks;
+	NodeChangeMap &changes = blocks[v3s16(1, 2, 3)];
+	add_node_change(changes, 42, MapNode(t_CONTENT_STONE), true);
+	add_node_change(changes, 42, MapNode(t_CONTENT_BRICK), false);
+
+	NetworkPacket pkt;
+	make_packet(blocks, &pkt);
+
+	u16 block_count;
+	v3s16 blockpos;
+	NodeChangeMap received;
+	pkt >> block_count;
+	deserialize_node_changes(&pkt, &blockpos, &received);
+	UASSERTEQ(size_t, received.size(), 1);
+	UASSERT(received[42].n.getContent() == t_CONTENT_BRICK);
+	UASSERT(received[42].remove_metadata);
+}
+
+void TestNodeChanges::testInvalidIndex()
+{
+	// The index deltas add up to a node beyond the end of the block
+	std::ostringstream os(std::ios_base::binary);
+	writeU16(os, TOCLIENT_NODES_CHANGED);
+	writeU16(os, 1);
+	writeV3S16(os, v3s16(0, 0, 0));
+	writeU16(os, 2);
+	for (u16 i = 0; i < 2; i++) {
+		writeU16(os, 4000);
+		writeU16(os, t_CONTENT_STONE);
+		writeU8(os, 0);
+		writeU8(os, 0);
+		writeU8(os, 1);
+	}
+	std::string raw = os.str();
+	NetworkPacket pkt;
+	pkt.putRawPacket((u8 *)raw.c_str(), raw.size(), 0);
+
+	u16 block_count;
+	v3s16 blockpos;
+	NodeChangeMap changes;
+	pkt >> block_count;
+	EXCEPTION_CHECK(SerializationError,
+		deserialize_node_changes(&pkt, &blockpos, &changes));
+}
@@ -19,8 +19,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include <string.h>
 #include "exceptions.h"
 #include "noise.h"
+#include "noise_simd.h"
+#include "porting.h"
+#include "util/basic_macros.h"
 
 class TestNoise : public TestBase {
 public:
@@ -34,6 +38,11 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testKernelsEqual2d();
+	void testKernelsEqual3d();
+	void testKernelsEqualChunk();
+	void testKernelsThroughput();
+	void testMapCache();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
@@ -48,6 +57,11 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testKernelsEqual2d);
+	TEST(testKernelsEqual3d);
+	TEST(testKernelsEqualChunk);
+	BENCHMARK(testKernelsThroughput);
+	TEST(testMapCache);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -120,6 +134,166 @@ void TestNoise::testNoiseInvalidParams()
 	UASSERT(exception_thrown);
 }
 
+// Eased and not, with absvalue, and spreads below and above the map size
+static NoiseParams kernel_test_params[] = {
+	NoiseParams(0, 1, v3f(250, 250, 250), 5934, 5, 0.6, 2.0),
+	NoiseParams(20, 40, v3f(50, 50, 50), 9, 5, 0.6, 2.0, NOISE_FLAG_EASED),
+	NoiseParams(0, 12, v3f(600, 600, 600), 82341, 5, 0.6, 2.0,
+		NOISE_FLAG_EASED | NOISE_FLAG_ABSVALUE),
+	NoiseParams(0, 1, v3f(7, 13, 3.3), 1, 3, 0.5, 2.3, NOISE_FLAG_ABSVALUE),
+};
+
+void TestNoise::testKernelsEqual2d()
+{
+	// Odd sizes leave rows that are not a multiple of the vector width
+	const u32 sx = 37, sy = 21;
+	float persistence[sx * sy];
+	for (u32 i = 0; i != sx * sy; i++)
+		persistence[i] = 0.3 + (i % 17) * 0.05;
+
+	for (u32 p = 0; p != ARRLEN(kernel_test_params); p++) {
+		Noise reference(&kernel_test_params[p], 1337, sx, sy);
+		reference.kernels = noise_kernels(NOISE_SIMD_NONE);
+		Noise noise(&kernel_test_params[p], 1337, sx, sy);
+
+		for (int l = NOISE_SIMD_NONE + 1; l != NOISE_SIMD_LEVEL_COUNT; l++) {
+			noise.kernels = noise_kernels((NoiseSimdLevel)l);
+			if (!noise.kernels)
+				continue;
+
+			for (s32 c = -2; c != 2; c++) {
+				float x = c * 80 - 32.5, y = c * 31 + 7.25;
+				UASSERT(memcmp(noise.perlinMap2D(x, y),
+					reference.perlinMap2D(x, y), sx * sy * 4) == 0);
+				UASSERT(memcmp(noise.perlinMap2D(x, y, persistence),
+					reference.perlinMap2D(x, y, persistence),
+					sx * sy * 4) == 0);
+			}
+		}
+	}
+}
+
+void TestNoise::testKernelsEqual3d()
+{
+	const u32 sx = 37, sy = 21, sz = 11;
+	float persistence[sx * sy * sz];
+	for (u32 i = 0; i != sx * sy * sz; i++)
+		persistence[i] = 0.3 + (i % 17) * 0.05;
+
+	for (u32 p = 0; p != ARRLEN(kernel_test_params); p++) {
+		Noise reference(&kernel_test_params[p], 42, sx, sy, sz);
+		reference.kernels = noise_kernels(NOISE_SIMD_NONE);
+		Noise noise(&kernel_test_params[p], 42, sx, sy, sz);
+
+		for (int l = NOISE_SIMD_NONE + 1; l != NOISE_SIMD_LEVEL_COUNT; l++) {
+			noise.kernels = noise_kernels((NoiseSimdLevel)l);
+			if (!noise.kernels)
+				continue;
+
+			for (s32 c = -2; c != 2; c++) {
+				float x = c * 80 - 32.5, y = -c * 80.25, z = c * 17;
+				UASSERT(memcmp(noise.perlinMap3D(x, y, z),
+					reference.perlinMap3D(x, y, z),
+					sx * sy * sz * 4) == 0);
+				UASSERT(memcmp(noise.perlinMap3D(x, y, z, persistence),
+					reference.perlinMap3D(x, y, z, persistence),
+					sx * sy * sz * 4) == 0);
+			}
+		}
+	}
+}
+
+// The size of a mapgen chunk, as most mapgens use their 3D noise
+#define CHUNK_SIZE 80
+
+void TestNoise::testKernelsEqualChunk()
+{
+	NoiseParams np(0, 12, v3f(100, 100, 100), 5934, 3, 0.5, 2.0);
+	Noise reference(&np, 1337, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+	reference.kernels = noise_kernels(NOISE_SIMD_NONE);
+	Noise noise(&np, 1337, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+
+	for (int l = NOISE_SIMD_NONE + 1; l != NOISE_SIMD_LEVEL_COUNT; l++) {
+		noise.kernels = noise_kernels((NoiseSimdLevel)l);
+		if (!noise.kernels)
+			continue;
+
+		// Neighboring chunks, as a mapgen asks for them
+		for (s32 c = 0; c != 2; c++) {
+			float x = c * CHUNK_SIZE - 32;
+			UASSERT(memcmp(noise.perlinMap3D(x, -32, 48),
+				reference.perlinMap3D(x, -32, 48),
+				CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 4) == 0);
+		}
+	}
+}
+
+#define BENCHMARK_MAPS 10
+
+void TestNoise::testKernelsThroughput()
+{
+	NoiseParams np(0, 12, v3f(100, 100, 100), 5934, 3, 0.5, 2.0);
+	Noise noise(&np, 1337, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+
+	for (int l = NOISE_SIMD_NONE; l != NOISE_SIMD_LEVEL_COUNT; l++) {
+		noise.kernels = noise_kernels((NoiseSimdLevel)l);
+		if (!noise.kernels)
+			continue;
+
+		u64 t0 = porting::getTimeUs();
+		for (u32 i = 0; i != BENCHMARK_MAPS; i++)
+			noise.perlinMap3D(i * CHUNK_SIZE, 0, 0);
+		u64 t1 = porting::getTimeUs();
+
+		rawstream << "    " << BENCHMARK_MAPS << " 3D maps of "
+				<< CHUNK_SIZE << "^3, " << noise.kernels->name << ": "
+				<< (t1 - t0) / 1000 << "ms" << std::endl;
+	}
+}
+
+void TestNoise::testMapCache()
+{
+	NoiseParams np(0, 12, v3f(100, 100, 100), 5934, 3, 0.5, 2.0);
+	NoiseParams np_other(0, 12, v3f(100, 100, 100), 5935, 3, 0.5, 2.0);
+	NoiseMapCache cache;
+
+	// The first lookup computes the map, the next ones share it
+	const float *map = cache.perlinMap2D(np, 1337, 16, -48, 20, 30);
+	UASSERT(cache.perlinMap2D(np, 1337, 16, -48, 20, 30) == map);
+	UASSERTEQ(u32, cache.hits, 1);
+	UASSERTEQ(u32, cache.misses, 1);
+
+	Noise noise(&np, 1337, 20, 30);
+	noise.perlinMap2D(16, -48);
+	UASSERT(memcmp(map, noise.result, 20 * 30 * sizeof(float)) == 0);
+
+	// Any other key is another map
+	UASSERT(cache.perlinMap2D(np, 1338, 16, -48, 20, 30) != map);
+	UASSERT(cache.perlinMap2D(np, 1337, 17, -48, 20, 30) != map);
+	UASSERT(cache.perlinMap2D(np, 1337, 16, -48, 30, 20) != map);
+	UASSERT(cache.perlinMap2D(np_other, 1337, 16, -48, 20, 30) != map);
+	UASSERT(cache.perlinMap3D(np, 1337, 16, -48, 0, 20, 30, 2) != map);
+	UASSERTEQ(u32, cache.misses, 6);
+
+	// After clear() the buffers are reused for maps of the next chunk
+	cache.clear();
+	UASSERTEQ(u32, cache.hits, 0);
+	const float *map2 = cache.perlinMap2D(np, 1337, 96, -48, 20, 30);
+	UASSERTEQ(u32, cache.misses, 1);
+	noise.perlinMap2D(96, -48);
+	UASSERT(memcmp(map2, noise.result, 20 * 30 * sizeof(float)) == 0);
+
+	// Grids have the values of the single point noise
+	const float *grid = cache.perlinGrid2D(np, 1337, -8, 8, 16, 5, 4);
+	UASSERT(cache.perlinGrid2D(np, 1337, -8, 8, 16, 5, 4) == grid);
+	for (u32 j = 0; j != 4; j++)
+	for (u32 i = 0; i != 5; i++) {
+		float expected = NoisePerlin2D(&np, -8 + 16 * (s32)i,
+			8 + 16 * (s32)j, 1337);
+		UASSERT(grid[j * 5 + i] == expected);
+	}
+}
+
 const float TestNoise::expected_2d_results[10 * 10] = {
 	19.11726, 18.49626, 16.48476, 15.02135, 14.75713, 16.26008, 17.54822,
 	18.06860, 18.57016, 18.48407, 18.49649, 17.89160, 15.94162, 14.54901,
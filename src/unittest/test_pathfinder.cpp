@@ -0,0 +1,239 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "pathfinder.h"
+#include "porting.h"
+
+class TestPathfinder : public TestBase {
+public:
+	TestPathfinder() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testStraight(IGameDef *gamedef);
+	void testObstacles(IGameDef *gamedef);
+	void testHeight(IGameDef *gamedef);
+	void testZigzag(IGameDef *gamedef);
+	void testThroughput(IGameDef *gamedef);
+};
+
+static TestPathfinder g_test_instance;
+
+void TestPathfinder::runTests(IGameDef *gamedef)
+{
+	TEST(testStraight, gamedef);
+	TEST(testObstacles, gamedef);
+	TEST(testHeight, gamedef);
+	TEST(testZigzag, gamedef);
+	BENCHMARK(testThroughput, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A map of size_x * 1 * size_z loaded blocks of air on a stone floor at
+	y = 0, starting at the block position 0,0,0.
+*/
+class PathTestMap : public TestMemoryMap {
+public:
+	PathTestMap(IGameDef *gamedef, s16 size_x, s16 size_z) :
+		TestMemoryMap(gamedef)
+	{
+		addBlocks(v3s16(0, -1, 0), v3s16(size_x - 1, -1, size_z - 1),
+				MapNode(t_CONTENT_STONE));
+		addBlocks(v3s16(0, 0, 0), v3s16(size_x - 1, 1, size_z - 1),
+				MapNode(CONTENT_AIR));
+	}
+
+	// A wall along x from x1 to x2, with the given height
+	void addWallX(s16 x1, s16 x2, s16 z, s16 height)
+	{
+		for (s16 x = x1; x <= x2; x++)
+		for (s16 y = 0; y < height; y++)
+			setContent(v3s16(x, y, z), t_CONTENT_STONE);
+	}
+
+	std::vector<v3s16> findPath(v3s16 source, v3s16 destination,
+			unsigned int searchdistance, unsigned int max_jump,
+			unsigned int max_drop, PathAlgorithm algo)
+	{
+		return get_path(this, m_gamedef->ndef(), source, destination,
+				searchdistance, max_jump, max_drop, algo);
+	}
+};
+
+// Whether every step of path is a single move between neighbors
+static bool is_connected(const std::vector<v3s16> &path)
+{
+	for (size_t i = 1; i < path.size(); i++) {
+		v3s16 d = path[i] - path[i - 1];
+		if (abs(d.X) + abs(d.Z) != 1)
+			return false;
+	}
+	return true;
+}
+
+void TestPathfinder::testStraight(IGameDef *gamedef)
+{
+	PathTestMap map(gamedef, 2, 2);
+	v3s16 source(2, 0, 5);
+	v3s16 destination(12, 0, 5);
+
+	PathAlgorithm algos[] = { PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA };
+	for (u32 i = 0; i < ARRLEN(algos); i++) {
+		std::vector<v3s16> path = map.findPath(source, destination,
+				5, 1, 1, algos[i]);
+		UASSERTEQ(size_t, path.size(), 11);
+		UASSERT(path.front() == source);
+		UASSERT(path.back() == destination);
+		UASSERT(is_connected(path));
+	}
+
+	// The source has to be on the ground
+	UASSERT(map.findPath(v3s16(2, 3, 5), destination,
+			5, 1, 1, PA_PLAIN).empty());
+}
+
+void TestPathfinder::testObstacles(IGameDef *gamedef)
+{
+	PathTestMap map(gamedef, 2, 2);
+	// A wall with a gap at x = 20
+	map.addWallX(0, 19, 10, 3);
+	map.addWallX(21, 31, 10, 3);
+	v3s16 source(5, 0, 5);
+	v3s16 destination(5, 0, 15);
+
+	// All algorithms find a shortest path through the gap
+	PathAlgorithm algos[] = { PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA };
+	for (u32 i = 0; i < ARRLEN(algos); i++) {
+		std::vector<v3s16> path = map.findPath(source, destination,
+				16, 1, 1, algos[i]);
+		UASSERTEQ(size_t, path.size(), 1 + 15 + 10 + 15);
+		UASSERT(is_connected(path));
+		for (size_t j = 0; j < path.size(); j++)
+			UASSERT(path[j].Z != 10 || path[j].X == 20);
+	}
+
+	// The gap is out of reach
+	UASSERT(map.findPath(source, destination, 10, 1, 1, PA_PLAIN).empty());
+
+	// Closed wall
+	map.setContent(v3s16(20, 0, 10), t_CONTENT_STONE);
+	map.setContent(v3s16(20, 1, 10), t_CONTENT_STONE);
+	UASSERT(map.findPath(source, destination, 16, 1, 1, PA_PLAIN).empty());
+}
+
+void TestPathfinder::testHeight(IGameDef *gamedef)
+{
+	PathTestMap map(gamedef, 2, 2);
+	// A step of one node and a wall of two with a platform behind
+	map.addWallX(0, 31, 8, 1);
+	map.addWallX(0, 31, 9, 1);
+	map.addWallX(0, 31, 10, 2);
+	v3s16 source(5, 0, 5);
+
+	// Up the step, which costs more than a move on the same height
+	std::vector<v3s16> path = map.findPath(source, v3s16(5, 1, 9),
+			5, 1, 1, PA_PLAIN);
+	UASSERTEQ(size_t, path.size(), 5);
+	UASSERT(path[3] == v3s16(5, 1, 8));
+	UASSERT(map.findPath(source, v3s16(5, 1, 9), 5, 0, 1, PA_PLAIN).empty());
+
+	// Up both, then down from the wall to the floor
+	path = map.findPath(source, v3s16(5, 0, 13), 5, 1, 2, PA_DIJKSTRA);
+	UASSERTEQ(size_t, path.size(), 9);
+	UASSERT(path[5] == v3s16(5, 2, 10));
+	UASSERT(path[6] == v3s16(5, 0, 11));
+	UASSERT(map.findPath(source, v3s16(5, 0, 13), 5, 1, 1,
+			PA_DIJKSTRA).empty());
+}
+
+// Walls with alternating gaps, so paths have to zigzag
+static void add_zigzag_walls(PathTestMap &map, s16 size)
+{
+	for (s16 z = 6; z < size - 6; z += 6) {
+		if ((z / 6) % 2 == 0)
+			map.addWallX(0, size - 8, z, 2);
+		else
+			map.addWallX(7, size - 1, z, 2);
+	}
+}
+
+void TestPathfinder::testZigzag(IGameDef *gamedef)
+{
+	PathTestMap map(gamedef, 6, 6);
+	s16 size = 6 * MAP_BLOCKSIZE;
+	add_zigzag_walls(map, size);
+
+	// All algorithms find connected paths of the same, shortest length
+	PathAlgorithm algos[] = { PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA };
+	for (u32 j = 0; j < 20; j += 4) {
+		v3s16 source(2 + j, 0, 2);
+		v3s16 destination(size - 3 - j, 0, size - 3);
+		size_t length = 0;
+		for (u32 i = 0; i < ARRLEN(algos); i++) {
+			// Far enough to reach the gaps at both ends
+			std::vector<v3s16> path = map.findPath(source, destination,
+					16, 1, 1, algos[i]);
+			UASSERT(!path.empty());
+			UASSERT(is_connected(path));
+			UASSERT(path.front() == source && path.back() == destination);
+			if (i == 0)
+				length = path.size();
+			UASSERTEQ(size_t, path.size(), length);
+		}
+	}
+}
+
+#define BENCHMARK_MAP_SIZE 6
+#define BENCHMARK_PATHS 20
+
+void TestPathfinder::testThroughput(IGameDef *gamedef)
+{
+	PathTestMap map(gamedef, BENCHMARK_MAP_SIZE, BENCHMARK_MAP_SIZE);
+	s16 size = BENCHMARK_MAP_SIZE * MAP_BLOCKSIZE;
+	add_zigzag_walls(map, size);
+
+	const char *names[] = { "A*_noprefetch", "A*", "Dijkstra" };
+	PathAlgorithm algos[] = { PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA };
+	for (u32 i = 0; i < ARRLEN(algos); i++) {
+		size_t length = 0;
+		u64 t0 = porting::getTimeUs();
+		for (u32 j = 0; j < BENCHMARK_PATHS; j++) {
+			v3s16 source(2 + j, 0, 2);
+			v3s16 destination(size - 3 - j, 0, size - 3);
+			// Far enough to reach the gaps at both ends
+			std::vector<v3s16> path = map.findPath(source, destination,
+					16, 1, 1, algos[i]);
+			UASSERT(!path.empty());
+			length += path.size();
+		}
+		u64 t1 = porting::getTimeUs();
+
+		rawstream << "    " << names[i] << ": " << BENCHMARK_PATHS
+				<< " paths of " << length / BENCHMARK_PATHS << " nodes: "
+				<< (t1 - t0) / 1000 << "ms" << std::endl;
+	}
+}
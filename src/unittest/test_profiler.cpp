@@ -20,6 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "profiler.h"
+#include <fstream>
+#include <json/json.h>
+#include "filesys.h"
+#include "porting.h"
+#include "threading/thread.h"
 
 class TestProfiler : public TestBase
 {
@@ -30,6 +35,9 @@ class TestProfiler : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testProfilerAverage();
+	void testZoneNesting();
+	void testZoneThreads();
+	void testTrace();
 };
 
 static TestProfiler g_test_instance;
@@ -37,6 +45,9 @@ static TestProfiler g_test_instance;
 void TestProfiler::runTests(IGameDef *gamedef)
 {
 	TEST(testProfilerAverage);
+	TEST(testZoneNesting);
+	TEST(testZoneThreads);
+	TEST(testTrace);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -71,3 +82,156 @@ void TestProfiler::testProfilerAverage()
 
 	UASSERT(p.getValue("Test2") == 123.57f);
 }
+
+static void sleep_in_zones(u32 depth)
+{
+	PROFILER_ZONE("TestProfiler: sleep");
+	sleep_ms(2);
+	if (depth > 0)
+		sleep_in_zones(depth - 1);
+}
+
+void TestProfiler::testZoneNesting()
+{
+	g_trace_profiler->setEnabled(true);
+	{
+		PROFILER_ZONE("TestProfiler: outer");
+		sleep_ms(2);
+		for (u32 i = 0; i < 3; i++) {
+			PROFILER_ZONE("TestProfiler: inner");
+			sleep_ms(2);
+		}
+	}
+	g_trace_profiler->setEnabled(false);
+	g_trace_profiler->aggregate();
+
+	TraceZoneStats outer;
+	TraceZoneStats inner;
+	UASSERT(g_trace_profiler->getZoneStats("TestProfiler: outer", outer));
+	UASSERT(g_trace_profiler->getZoneStats("TestProfiler: inner", inner));
+	UASSERTEQ(u32, outer.count, 1);
+	UASSERTEQ(u32, inner.count, 3);
+	UASSERT(inner.total_us >= 6000);
+	UASSERT(inner.self_us == inner.total_us);
+	// The inner scopes count for the outer one, but not for its own time
+	UASSERT(outer.total_us >= inner.total_us + 2000);
+	UASSERTEQ(u64, outer.self_us, outer.total_us - inner.total_us);
+
+	u32 histogram_count = 0;
+	for (u32 i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++)
+		histogram_count += inner.histogram[i];
+	UASSERTEQ(u32, histogram_count, 3);
+	// 2ms and more are beyond the first 10 buckets, bucket 10 ends at 2047us
+	for (u32 i = 0; i < 10; i++)
+		UASSERTEQ(u32, inner.histogram[i], 0);
+
+	// Nothing is recorded while disabled
+	sleep_in_zones(0);
+	g_trace_profiler->aggregate();
+	TraceZoneStats sleep;
+	UASSERT(g_trace_profiler->getZoneStats("TestProfiler: sleep", sleep));
+	UASSERTEQ(u32, sleep.count, 0);
+}
+
+#define ZONE_THREADS 4
+#define ZONE_THREAD_SCOPES 10000
+
+class ZoneTestThread : public Thread {
+public:
+	ZoneTestThread() :
+		Thread("ZoneTest")
+	{
+	}
+
+private:
+	void *run()
+	{
+		for (u32 i = 0; i < ZONE_THREAD_SCOPES; i++) {
+			PROFILER_ZONE("TestProfiler: thread");
+			if (i % 1000 == 0)
+				sleep_ms(1);
+		}
+		return NULL;
+	}
+};
+
+void TestProfiler::testZoneThreads()
+{
+	g_trace_profiler->setEnabled(true);
+	ZoneTestThread threads[ZONE_THREADS];
+	for (u32 i = 0; i < ZONE_THREADS; i++)
+		UASSERT(threads[i].start());
+
+	// Aggregating at the same time as the threads record
+	bool running = true;
+	while (running) {
+		g_trace_profiler->aggregate();
+		running = false;
+		for (u32 i = 0; i < ZONE_THREADS; i++)
+			running |= threads[i].isRunning();
+	}
+	for (u32 i = 0; i < ZONE_THREADS; i++)
+		threads[i].wait();
+	g_trace_profiler->setEnabled(false);
+	g_trace_profiler->aggregate();
+
+	TraceZoneStats stats;
+	UASSERT(g_trace_profiler->getZoneStats("TestProfiler: thread", stats));
+	UASSERTEQ(u32, stats.count + g_trace_profiler->getDroppedCount(),
+		ZONE_THREADS * ZONE_THREAD_SCOPES);
+}
+
+void TestProfiler::testTrace()
+{
+	std::string path = getTestTempFile();
+	g_trace_profiler->setEnabled(true);
+	UASSERT(g_trace_profiler->startTrace(path));
+	UASSERT(!g_trace_profiler->startTrace(path));
+	UASSERT(g_trace_profiler->isTracing());
+	sleep_in_zones(2);
+	for (u32 i = 0; i < 2; i++) {
+		// Scope profilers show up while tracing
+		ScopeProfiler sp(g_profiler, "TestProfiler: scope", SPT_AVG);
+	}
+	UASSERTEQ(u32, g_trace_profiler->stopTrace(), 5);
+	g_trace_profiler->setEnabled(false);
+	UASSERT(!g_trace_profiler->isTracing());
+
+	std::ifstream is(path.c_str(), std::ios_base::binary);
+	Json::Value events;
+	Json::Reader reader;
+	UASSERT(reader.parse(is, events));
+	UASSERT(events.isArray());
+	UASSERTEQ(u32, events.size(), 5);
+
+	// The innermost scope ends first
+	UASSERTEQ(std::string, events[0]["name"].asString(),
+		"TestProfiler: sleep");
+	UASSERTEQ(std::string, events[3]["name"].asString(),
+		"TestProfiler: scope");
+	UASSERTEQ(std::string, events[4]["name"].asString(),
+		"TestProfiler: scope");
+	UASSERTEQ(std::string, events[0]["ph"].asString(), "X");
+	UASSERT(events[0]["tid"].asUInt() == events[1]["tid"].asUInt());
+	UASSERT(events[2]["ts"].asUInt64() <= events[1]["ts"].asUInt64());
+	UASSERT(events[2]["dur"].asUInt() >= events[1]["dur"].asUInt());
+	UASSERT(events[2]["args"]["self_us"].asUInt() <
+		events[2]["dur"].asUInt());
+
+	is.close();
+	fs::DeleteSingleFileOrEmptyDirectory(path);
+
+	// Histograms start over after they are saved
+	std::string histogram_path = getTestTempFile();
+	UASSERT(g_trace_profiler->saveHistograms(histogram_path));
+	TraceZoneStats sleep;
+	UASSERT(g_trace_profiler->getZoneStats("TestProfiler: sleep", sleep));
+	UASSERTEQ(u32, sleep.count, 0);
+	std::ifstream his(histogram_path.c_str(), std::ios_base::binary);
+	std::string histograms((std::istreambuf_iterator<char>(his)),
+		std::istreambuf_iterator<char>());
+	UASSERT(histograms.find("TestProfiler: sleep: 3 ") != std::string::npos);
+	UASSERT(histograms.find("TestProfiler: scope: 2 ") != std::string::npos);
+	his.close();
+	fs::DeleteSingleFileOrEmptyDirectory(histogram_path);
+}
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "threading/atomic.h"
 #include "threading/semaphore.h"
 #include "threading/thread.h"
+#include "util/thread.h"
 
 
 class TestThreading : public TestBase {
@@ -33,6 +34,7 @@ class TestThreading : public TestBase {
 	void testStartStopWait();
 	void testThreadKill();
 	void testAtomicSemaphoreThread();
+	void testWorkerPool();
 };
 
 static TestThreading g_test_instance;
@@ -42,6 +44,7 @@ void TestThreading::runTests(IGameDef *gamedef)
 	TEST(testStartStopWait);
 	TEST(testThreadKill);
 	TEST(testAtomicSemaphoreThread);
+	TEST(testWorkerPool);
 }
 
 class SimpleTestThread : public Thread {
@@ -181,3 +184,51 @@ void TestThreading::testAtomicSemaphoreThread()
 	UASSERT(val == num_threads * 0x10000);
 }
 
+
+
+class CountPartsJob : public ParallelJob {
+public:
+	CountPartsJob(u32 num_parts) :
+		counts(num_parts, 0)
+	{
+	}
+
+	void runPart(u32 part)
+	{
+		counts[part]++;
+		++total;
+	}
+
+	std::vector<u32> counts;
+	Atomic<u32> total;
+};
+
+
+void TestThreading::testWorkerPool()
+{
+	static const u32 num_parts = 100;
+
+	WorkerPool *pool = new WorkerPool("TestPool", 4);
+	UASSERT(pool->getThreadCount() == 4);
+
+	// The pool must be reusable, and every part must run exactly once
+	for (u32 i = 0; i != 5; i++) {
+		CountPartsJob job(num_parts);
+		job.total = 0;
+		pool->run(&job, num_parts);
+
+		UASSERT(job.total == num_parts);
+		for (u32 part = 0; part != num_parts; part++)
+			UASSERT(job.counts[part] == 1);
+	}
+
+	delete pool;
+
+	// A pool of one runs everything on the calling thread
+	WorkerPool single("TestPool", 1);
+	UASSERT(single.getThreadCount() == 1);
+	CountPartsJob job(num_parts);
+	job.total = 0;
+	single.run(&job, num_parts);
+	UASSERT(job.total == num_parts);
+}
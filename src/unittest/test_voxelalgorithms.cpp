@@ -20,7 +20,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "noise.h"
 #include "voxelalgorithms.h"
+#include "util/directiontables.h"
 #include "util/numeric.h"
 
 class TestVoxelAlgorithms : public TestBase {
@@ -33,6 +38,9 @@ class TestVoxelAlgorithms : public TestBase {
 	void testPropogateSunlight(INodeDefManager *ndef);
 	void testClearLightAndCollectSources(INodeDefManager *ndef);
 	void testVoxelLineIterator(INodeDefManager *ndef);
+	void testFaceConnectivity(INodeDefManager *ndef);
+	void testUpdateLightingNodes(IGameDef *gamedef);
+	void testUpdateLightingArea(IGameDef *gamedef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -44,6 +52,167 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 	TEST(testPropogateSunlight, ndef);
 	TEST(testClearLightAndCollectSources, ndef);
 	TEST(testVoxelLineIterator, ndef);
+	TEST(testFaceConnectivity, ndef);
+	TEST(testUpdateLightingNodes, gamedef);
+	TEST(testUpdateLightingArea, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A map of 2x2x2 loaded blocks (32^3 nodes) that is lit from above.
+*/
+class LightTestMap : public TestMemoryMap {
+public:
+	LightTestMap(IGameDef *gamedef) :
+		TestMemoryMap(gamedef)
+	{
+		addBlocks(v3s16(0, 0, 0), v3s16(1, 1, 1), MapNode(CONTENT_AIR));
+	}
+
+	/*
+		Sets the light of every node from scratch: sunlight from the
+		top of the map, and light sources, spread by a flood fill.
+		This is the reference the incremental updates are checked
+		against.
+	*/
+	void computeLighting()
+	{
+		const s16 size = 2 * MAP_BLOCKSIZE;
+		bool is_valid;
+		for (s32 b = 0; b < 2; b++) {
+			LightBank bank = b == 0 ? LIGHTBANK_DAY : LIGHTBANK_NIGHT;
+			std::vector<v3s16> queue[LIGHT_SUN + 1];
+			for (s16 z = 0; z < size; z++)
+			for (s16 x = 0; x < size; x++) {
+				bool sunlight = bank == LIGHTBANK_DAY;
+				for (s16 y = size - 1; y >= 0; y--) {
+					v3s16 p(x, y, z);
+					MapNode n = getNodeNoEx(p);
+					const ContentFeatures &f = m_nodedef->get(n);
+					sunlight = sunlight && f.sunlight_propagates;
+					u8 light = sunlight ? LIGHT_SUN : f.light_source;
+					n.setLight(bank, light, f);
+					setNode(p, n);
+					if (light > 1)
+						queue[light].push_back(p);
+				}
+			}
+			for (s32 light = LIGHT_SUN; light > 1; light--) {
+				for (size_t i = 0; i < queue[light].size(); i++) {
+					v3s16 p = queue[light][i];
+					for (s32 d = 0; d < 6; d++) {
+						v3s16 p2 = p + g_6dirs[d];
+						MapNode n2 = getNodeNoEx(p2, &is_valid);
+						const ContentFeatures &f2 = m_nodedef->get(n2);
+						if (!is_valid || !f2.light_propagates ||
+								n2.getLightRaw(bank, f2) >= light - 1)
+							continue;
+						n2.setLight(bank, light - 1, f2);
+						setNode(p2, n2);
+						queue[light - 1].push_back(p2);
+					}
+				}
+			}
+		}
+	}
+
+	/*
+		Replaces nodes like a mod does: the new nodes get zero light,
+		and the old ones are returned for the lighting update.
+	*/
+	void setNodes(const std::vector<std::pair<v3s16, MapNode> > &nodes,
+		std::vector<std::pair<v3s16, MapNode> > &oldnodes)
+	{
+		for (size_t i = 0; i < nodes.size(); i++) {
+			MapNode n = nodes[i].second;
+			n.setLight(LIGHTBANK_DAY, 0, m_nodedef);
+			n.setLight(LIGHTBANK_NIGHT, 0, m_nodedef);
+			oldnodes.push_back(std::make_pair(nodes[i].first,
+				getNodeNoEx(nodes[i].first)));
+			setNode(nodes[i].first, n);
+		}
+	}
+
+	// Returns the number of nodes whose light differs in the two maps
+	u32 countLightDifferences(LightTestMap &other)
+	{
+		const s16 size = 2 * MAP_BLOCKSIZE;
+		u32 differences = 0;
+		for (s16 z = 0; z < size; z++)
+		for (s16 y = 0; y < size; y++)
+		for (s16 x = 0; x < size; x++) {
+			v3s16 p(x, y, z);
+			MapNode n = getNodeNoEx(p);
+			MapNode n2 = other.getNodeNoEx(p);
+			if (n.getLight(LIGHTBANK_DAY, m_nodedef) !=
+					n2.getLight(LIGHTBANK_DAY, m_nodedef) ||
+					n.getLight(LIGHTBANK_NIGHT, m_nodedef) !=
+					n2.getLight(LIGHTBANK_NIGHT, m_nodedef))
+				differences++;
+		}
+		return differences;
+	}
+};
+
+/*
+	Floor with a roof above one corner, so both sunlight and shadow
+	are around the edits.
+*/
+static void make_light_test_scene(LightTestMap &map)
+{
+	MapNode stone(t_CONTENT_STONE);
+	MapNode lava(t_CONTENT_LAVA);
+	for (s16 z = 0; z < 32; z++)
+	for (s16 x = 0; x < 32; x++) {
+		for (s16 y = 0; y < 4; y++)
+			map.setNode(v3s16(x, y, z), stone);
+		if (x < 12 && z < 12)
+			map.setNode(v3s16(x, 24, z), stone);
+	}
+	map.setNode(v3s16(4, 4, 4), lava);
+	map.computeLighting();
+}
+
+// Returns an area fill, then some scattered nodes, as a mod would set them
+static void make_light_test_edits(
+	std::vector<std::vector<std::pair<v3s16, MapNode> > > &edits)
+{
+	std::vector<std::pair<v3s16, MapNode> > edit;
+	// Put a stone box over the roof edge
+	for (s16 z = 6; z < 20; z++)
+	for (s16 y = 10; y < 28; y++)
+	for (s16 x = 6; x < 20; x++)
+		edit.push_back(std::make_pair(v3s16(x, y, z),
+			MapNode(t_CONTENT_STONE)));
+	edits.push_back(edit);
+	edit.clear();
+	// Hollow it out, with a torch inside
+	for (s16 z = 7; z < 19; z++)
+	for (s16 y = 11; y < 27; y++)
+	for (s16 x = 7; x < 19; x++)
+		edit.push_back(std::make_pair(v3s16(x, y, z),
+			MapNode(CONTENT_AIR)));
+	edit.push_back(std::make_pair(v3s16(12, 12, 12),
+		MapNode(t_CONTENT_TORCH)));
+	edits.push_back(edit);
+	edit.clear();
+	// Scatter light sources and holes
+	PseudoRandom pr(13);
+	content_t contents[] = { t_CONTENT_LAVA, t_CONTENT_TORCH,
+		t_CONTENT_STONE, CONTENT_AIR };
+	for (u32 i = 0; i < 200; i++) {
+		v3s16 p(pr.range(0, 31), pr.range(0, 31), pr.range(0, 31));
+		edit.push_back(std::make_pair(p, MapNode(contents[pr.range(0, 3)])));
+	}
+	edits.push_back(edit);
+	edit.clear();
+	// Open the roof
+	for (s16 z = 0; z < 12; z++)
+	for (s16 x = 0; x < 12; x++)
+		edit.push_back(std::make_pair(v3s16(x, 24, z),
+			MapNode(CONTENT_AIR)));
+	edits.push_back(edit);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -261,3 +430,134 @@ void TestVoxelAlgorithms::testVoxelLineIterator(INodeDefManager *ndef)
 		UASSERTEQ(int, actual_nodecount, nodecount);
 	}
 }
+
+void TestVoxelAlgorithms::testUpdateLightingNodes(IGameDef *gamedef)
+{
+	LightTestMap map(gamedef);
+	LightTestMap reference(gamedef);
+	make_light_test_scene(map);
+	make_light_test_scene(reference);
+	UASSERTEQ(u32, map.countLightDifferences(reference), 0);
+
+	std::vector<std::vector<std::pair<v3s16, MapNode> > > edits;
+	make_light_test_edits(edits);
+
+	// Node by node, like Map::addNodeAndUpdate()
+	for (size_t i = 0; i < edits.size(); i++) {
+		for (size_t j = 0; j < edits[i].size(); j++) {
+			std::vector<std::pair<v3s16, MapNode> > nodes(1, edits[i][j]);
+			std::vector<std::pair<v3s16, MapNode> > oldnodes;
+			std::map<v3s16, MapBlock*> modified_blocks;
+			map.setNodes(nodes, oldnodes);
+			voxalgo::update_lighting_nodes(&map, oldnodes, modified_blocks);
+		}
+		std::vector<std::pair<v3s16, MapNode> > oldnodes;
+		reference.setNodes(edits[i], oldnodes);
+		reference.computeLighting();
+		UASSERTEQ(u32, map.countLightDifferences(reference), 0);
+	}
+}
+
+void TestVoxelAlgorithms::testUpdateLightingArea(IGameDef *gamedef)
+{
+	LightTestMap map(gamedef);
+	LightTestMap nodewise(gamedef);
+	LightTestMap reference(gamedef);
+	make_light_test_scene(map);
+	make_light_test_scene(nodewise);
+	make_light_test_scene(reference);
+
+	std::vector<std::vector<std::pair<v3s16, MapNode> > > edits;
+	make_light_test_edits(edits);
+
+	for (size_t i = 0; i < edits.size(); i++) {
+		// The whole edit at once
+		std::vector<std::pair<v3s16, MapNode> > oldnodes;
+		std::map<v3s16, MapBlock*> modified_blocks;
+		map.setNodes(edits[i], oldnodes);
+		voxalgo::update_lighting_nodes(&map, oldnodes, modified_blocks);
+		UASSERT(!modified_blocks.empty());
+
+		for (size_t j = 0; j < edits[i].size(); j++) {
+			std::vector<std::pair<v3s16, MapNode> > nodes(1, edits[i][j]);
+			std::vector<std::pair<v3s16, MapNode> > oldnodes2;
+			std::map<v3s16, MapBlock*> modified_blocks2;
+			nodewise.setNodes(nodes, oldnodes2);
+			voxalgo::update_lighting_nodes(&nodewise, oldnodes2,
+				modified_blocks2);
+		}
+		UASSERTEQ(u32, map.countLightDifferences(nodewise), 0);
+
+		oldnodes.clear();
+		reference.setNodes(edits[i], oldnodes);
+		reference.computeLighting();
+		UASSERTEQ(u32, map.countLightDifferences(reference), 0);
+	}
+}
+
+void TestVoxelAlgorithms::testFaceConnectivity(INodeDefManager *ndef)
+{
+	const u32 stride = MAP_BLOCKSIZE;
+	MapNode nodes[MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE];
+	u16 top_bottom = voxalgo::face_connection_bit(1, 4);
+	u16 right_left = voxalgo::face_connection_bit(5, 2);
+
+	// Air connects everything, stone nothing
+	for (u32 i = 0; i < ARRLEN(nodes); i++)
+		nodes[i] = MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), FACE_CONNECTIVITY_ALL);
+	for (u32 i = 0; i < ARRLEN(nodes); i++)
+		nodes[i] = MapNode(t_CONTENT_STONE);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), 0);
+
+	// A single open node on an edge touches two faces, in a corner three
+	nodes[(5 * MAP_BLOCKSIZE + 0) * MAP_BLOCKSIZE + 0] = MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), voxalgo::face_connection_bit(4, 5));
+	nodes[(5 * MAP_BLOCKSIZE + 0) * MAP_BLOCKSIZE + 0] =
+		MapNode(t_CONTENT_STONE);
+	nodes[0] = MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), voxalgo::face_connection_bit(3, 4) |
+		voxalgo::face_connection_bit(3, 5) |
+		voxalgo::face_connection_bit(4, 5));
+	nodes[0] = MapNode(t_CONTENT_STONE);
+
+	// A vertical shaft through the stone
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		nodes[(5 * MAP_BLOCKSIZE + y) * MAP_BLOCKSIZE + 5] =
+			MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), top_bottom);
+
+	// A separate horizontal tunnel
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		nodes[(9 * MAP_BLOCKSIZE + 9) * MAP_BLOCKSIZE + x] =
+			MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(nodes, stride,
+		stride * stride, ndef), top_bottom | right_left);
+
+	// A stone floor splits the air above from the air below
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		nodes[(z * MAP_BLOCKSIZE + y) * MAP_BLOCKSIZE + x] =
+			MapNode(y == 7 ? t_CONTENT_STONE : CONTENT_AIR);
+	u16 c = voxalgo::get_face_connectivity(nodes, stride, stride * stride,
+		ndef);
+	UASSERT(!(c & top_bottom));
+	UASSERT(c & right_left);
+	UASSERT(c & voxalgo::face_connection_bit(1, 0));
+	UASSERT(c & voxalgo::face_connection_bit(4, 3));
+
+	// The nodes of a bigger array, as in the snapshot of a mesh
+	const u32 big = MAP_BLOCKSIZE + 2;
+	std::vector<MapNode> snapshot(big * big * big, MapNode(t_CONTENT_STONE));
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		snapshot[((1 + 3) * big + 1 + y) * big + 1 + 3] = MapNode(CONTENT_AIR);
+	UASSERTEQ(u16, voxalgo::get_face_connectivity(
+		&snapshot[(1 * big + 1) * big + 1], big, big * big, ndef),
+		top_bottom);
+}
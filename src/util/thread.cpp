@@ -0,0 +1,96 @@
+/*
+Minetest
+Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3.0 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "thread.h"
+#include "../util/string.h"
+
+/*
+	WorkerPool
+*/
+
+WorkerPool::WorkerPool(const std::string &name, u32 num_threads):
+	m_job(NULL),
+	m_num_parts(0),
+	m_next_part(0)
+{
+	for (u32 i = 1; i < num_threads; i++) {
+		WorkerThread *thread = new WorkerThread(name + itos(i), this);
+		m_threads.push_back(thread);
+		thread->start();
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i]->stop();
+
+	if (!m_threads.empty())
+		m_start_sem.post(m_threads.size());
+
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		m_threads[i]->wait();
+		delete m_threads[i];
+	}
+}
+
+void WorkerPool::run(ParallelJob *job, u32 num_parts)
+{
+	m_job = job;
+	m_num_parts = num_parts;
+	m_next_part = 0;
+
+	if (!m_threads.empty())
+		m_start_sem.post(m_threads.size());
+	work();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_done_sem.wait();
+
+	m_job = NULL;
+}
+
+void WorkerPool::work()
+{
+	for (;;) {
+		u32 part = m_next_part++;
+		if (part >= m_num_parts)
+			break;
+		m_job->runPart(part);
+	}
+}
+
+void *WorkerPool::WorkerThread::run()
+{
+	DSTACK(FUNCTION_NAME);
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	for (;;) {
+		m_pool->m_start_sem.wait();
+		if (stopRequested())
+			break;
+
+		m_pool->work();
+		m_pool->m_done_sem.post();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return NULL;
+}
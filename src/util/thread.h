@@ -24,6 +24,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "../threading/thread.h"
 #include "../threading/mutex.h"
 #include "../threading/mutex_auto_lock.h"
+#include "../threading/semaphore.h"
+#include "../threading/atomic.h"
 #include "porting.h"
 #include "log.h"
 #include "container.h"
@@ -69,6 +71,45 @@ template<typename Key, typename T, typename Caller, typename CallerData>
 class ResultQueue : public MutexedQueue<GetResult<Key, T, Caller, CallerData> > {
 };
 
+/*
+	Hands out a result queue to each thread waiting for a request, so that
+	concurrent waiters can't take each other's results. The queues are
+	reused and live as long as the pool, results that arrive after their
+	waiter has timed out have to be skipped by key.
+*/
+template<typename Key, typename T, typename Caller, typename CallerData>
+class ResultQueuePool {
+public:
+	~ResultQueuePool()
+	{
+		for (size_t i = 0; i < m_queues.size(); i++)
+			delete m_queues[i];
+	}
+
+	ResultQueue<Key, T, Caller, CallerData> *get()
+	{
+		MutexAutoLock lock(m_mutex);
+		if (m_free.empty()) {
+			m_queues.push_back(new ResultQueue<Key, T, Caller, CallerData>());
+			return m_queues.back();
+		}
+		ResultQueue<Key, T, Caller, CallerData> *queue = m_free.back();
+		m_free.pop_back();
+		return queue;
+	}
+
+	void put(ResultQueue<Key, T, Caller, CallerData> *queue)
+	{
+		MutexAutoLock lock(m_mutex);
+		m_free.push_back(queue);
+	}
+
+private:
+	Mutex m_mutex;
+	std::vector<ResultQueue<Key, T, Caller, CallerData> *> m_queues;
+	std::vector<ResultQueue<Key, T, Caller, CallerData> *> m_free;
+};
+
 template<typename Caller, typename Data, typename Key, typename T>
 class CallerInfo {
 public:
@@ -116,7 +157,8 @@ class RequestQueue {
 			MutexAutoLock lock(m_queue.getMutex());
 
 			/*
-				If the caller is already on the list, only update CallerData
+				If the caller is already on the list, only update CallerData.
+				The same caller waiting on another queue is a new caller.
 			*/
 			for (i = m_queue.getQueue().begin(); i != m_queue.getQueue().end(); ++i) {
 				GetRequest<Key, T, Caller, CallerData> &request = *i;
@@ -125,7 +167,7 @@ class RequestQueue {
 
 				for (j = request.callers.begin(); j != request.callers.end(); ++j) {
 					CallerInfo<Caller, CallerData, Key, T> &ca = *j;
-					if (ca.caller == caller) {
+					if (ca.caller == caller && ca.dest == dest) {
 						ca.data = callerdata;
 						return;
 					}
@@ -230,5 +272,58 @@ class UpdateThread : public Thread
 	Semaphore m_update_sem;
 };
 
+/*
+	A job that can be split into independent parts, see WorkerPool.
+*/
+class ParallelJob
+{
+public:
+	virtual ~ParallelJob() {}
+	// Called from several threads at once, with every part exactly once
+	virtual void runPart(u32 part) = 0;
+};
+
+/*
+	A fixed set of threads that run the parts of a ParallelJob.
+	The calling thread works on the job too, and run() only returns
+	once all parts are done, so a pool of 1 thread starts no workers.
+*/
+class WorkerPool
+{
+public:
+	WorkerPool(const std::string &name, u32 num_threads);
+	~WorkerPool();
+
+	void run(ParallelJob *job, u32 num_parts);
+
+	// Number of threads working on a job, including the caller
+	u32 getThreadCount() const { return m_threads.size() + 1; }
+
+private:
+	class WorkerThread : public Thread
+	{
+	public:
+		WorkerThread(const std::string &name, WorkerPool *pool):
+			Thread(name),
+			m_pool(pool)
+		{}
+
+		void *run();
+
+	private:
+		WorkerPool *m_pool;
+	};
+
+	void work();
+
+	std::vector<WorkerThread *> m_threads;
+	Semaphore m_start_sem;
+	Semaphore m_done_sem;
+
+	ParallelJob *m_job;
+	u32 m_num_parts;
+	Atomic<u32> m_next_part;
+};
+
 #endif
 
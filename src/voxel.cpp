@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodedef.h"
 #include "util/timetaker.h"
 #include <string.h>  // memcpy, memset
+#include <algorithm>
 
 /*
 	Debug stuff
@@ -577,3 +578,34 @@ void VoxelManipulator::spreadLight(enum LightBank bank,
 }
 
 //END
+
+void find_nodes_in_data(const MapNode *data, const VoxelArea &data_area,
+		const VoxelArea &area, const ContentFilter &filter,
+		std::vector<v3s16> &result)
+{
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+		u32 i = data_area.index(area.MinEdge.X, y, z);
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++, i++) {
+			if (filter.contains(data[i].getContent()))
+				result.push_back(v3s16(x, y, z));
+		}
+	}
+}
+
+struct PositionLessXYZ
+{
+	bool operator()(const v3s16 &a, const v3s16 &b) const
+	{
+		if (a.X != b.X)
+			return a.X < b.X;
+		if (a.Y != b.Y)
+			return a.Y < b.Y;
+		return a.Z < b.Z;
+	}
+};
+
+void sort_positions_xyz(std::vector<v3s16> &positions, size_t first)
+{
+	std::sort(positions.begin() + first, positions.end(), PositionLessXYZ());
+}
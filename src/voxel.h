@@ -350,6 +350,18 @@ enum VoxelPrintMode
 	VOXELPRINT_LIGHT_DAY,
 };
 
+/*
+	Appends the positions in area of the nodes whose content is in
+	filter, in the order of z, then y, then x. data holds the nodes of
+	data_area, which contains area.
+*/
+void find_nodes_in_data(const MapNode *data, const VoxelArea &data_area,
+		const VoxelArea &area, const ContentFilter &filter,
+		std::vector<v3s16> &result);
+
+// Sorts positions[first..] in the order of x, then y, then z
+void sort_positions_xyz(std::vector<v3s16> &positions, size_t first = 0);
+
 class VoxelManipulator /*: public NodeContainer*/
 {
 public:
@@ -18,9 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "voxelalgorithms.h"
+#include <algorithm>
 #include "nodedef.h"
 #include "mapblock.h"
 #include "map.h"
+#include "util/directiontables.h"
 
 namespace voxalgo
 {
@@ -213,23 +215,49 @@ struct ChangingLight {
  * A fast, priority queue-like container to contain ChangingLights.
  * The ChangingLights are ordered by the given light levels.
  * The brightest ChangingLight is returned first.
+ *
+ * All light levels share one flat pool, each level is a singly
+ * linked list of slots in it. Popped slots are reused, so once the
+ * pool has grown to the working size of an update, pushing does
+ * not allocate.
  */
 struct LightQueue {
-	//! For each light level there is a vector.
-	std::vector<ChangingLight> lights[LIGHT_SUN + 1];
+	//! Marks the end of a list.
+	static const u32 NONE = U32_MAX;
+
+	struct Slot {
+		ChangingLight data;
+		u32 next;
+	};
+
+	//! Storage of all queued ChangingLights.
+	std::vector<Slot> pool;
+	//! For each light level the first slot of its list.
+	u32 heads[LIGHT_SUN + 1];
+	//! First unused slot of the pool.
+	u32 free_head;
 	//! Light of the brightest ChangingLight in the queue.
 	u8 max_light;
 
 	/*!
 	 * Creates a LightQueue.
-	 * \param reserve for each light level that many slots are reserved.
+	 * \param reserve that many slots are reserved in the pool.
 	 */
 	LightQueue(size_t reserve)
 	{
-		max_light = LIGHT_SUN;
+		pool.reserve(reserve);
+		clear();
+	}
+
+	//! Empties the queue, but keeps the pool for reuse.
+	void clear()
+	{
+		pool.clear();
 		for (u8 i = 0; i <= LIGHT_SUN; i++) {
-			lights[i].reserve(reserve);
+			heads[i] = NONE;
 		}
+		free_head = NONE;
+		max_light = 0;
 	}
 
 	/*!
@@ -243,15 +271,19 @@ struct LightQueue {
 	 */
 	bool next(u8 &light, ChangingLight &data)
 	{
-		while (lights[max_light].empty()) {
+		while (heads[max_light] == NONE) {
 			if (max_light == 0) {
 				return false;
 			}
 			max_light--;
 		}
+		u32 i = heads[max_light];
+		Slot &slot = pool[i];
 		light = max_light;
-		data = lights[max_light].back();
-		lights[max_light].pop_back();
+		data = slot.data;
+		heads[max_light] = slot.next;
+		slot.next = free_head;
+		free_head = i;
 		return true;
 	}
 
@@ -265,8 +297,38 @@ struct LightQueue {
 		direction source_dir)
 	{
 		assert(light <= LIGHT_SUN);
-		lights[light].push_back(
-			ChangingLight(rel_pos, block_pos, block, source_dir));
+		u32 i = free_head;
+		if (i == NONE) {
+			i = pool.size();
+			pool.push_back(Slot());
+		} else {
+			free_head = pool[i].next;
+		}
+		Slot &slot = pool[i];
+		slot.data = ChangingLight(rel_pos, block_pos, block, source_dir);
+		slot.next = heads[light];
+		heads[light] = i;
+		if (light > max_light) {
+			max_light = light;
+		}
+	}
+
+	/*!
+	 * Sets the light of every queued node to the level
+	 * it was queued with, up to the given level.
+	 */
+	void applyLights(LightBank bank, u8 maxlight, INodeDefManager *ndef)
+	{
+		bool is_valid_position;
+		for (u8 i = 0; i <= maxlight; i++) {
+			for (u32 j = heads[i]; j != NONE; j = pool[j].next) {
+				const ChangingLight &l = pool[j].data;
+				MapNode n = l.block->getNodeNoCheck(l.rel_position,
+					&is_valid_position);
+				n.setLight(bank, i, ndef);
+				l.block->setNodeNoCheck(l.rel_position, n);
+			}
+		}
 	}
 };
 
@@ -602,6 +664,30 @@ bool is_sunlight_above(Map *map, v3s16 pos, INodeDefManager *ndef)
 
 static const LightBank banks[] = { LIGHTBANK_DAY, LIGHTBANK_NIGHT };
 
+static bool is_node_before(const std::pair<v3s16, MapNode> &a,
+	const std::pair<v3s16, MapNode> &b)
+{
+	return a.first < b.first;
+}
+
+static bool is_same_node(const std::pair<v3s16, MapNode> &a,
+	const std::pair<v3s16, MapNode> &b)
+{
+	return a.first == b.first;
+}
+
+/*!
+ * Orders positions by columns, and downwards inside a column.
+ */
+static bool is_higher_in_column(const v3s16 &a, const v3s16 &b)
+{
+	if (a.X != b.X)
+		return a.X < b.X;
+	if (a.Z != b.Z)
+		return a.Z < b.Z;
+	return a.Y > b.Y;
+}
+
 void update_lighting_nodes(Map *map,
 	std::vector<std::pair<v3s16, MapNode> > &oldnodes,
 	std::map<v3s16, MapBlock*> &modified_blocks)
@@ -610,68 +696,93 @@ void update_lighting_nodes(Map *map,
 	// For node getter functions
 	bool is_valid_position;
 
-	// Process each light bank separately
-	for (s32 i = 0; i < 2; i++) {
-		LightBank bank = banks[i];
-		UnlightQueue disappearing_lights(256);
-		ReLightQueue light_sources(256);
-		// Nodes that are brighter than the brightest modified node was
-		// won't change, since they didn't get their light from a
-		// modified node.
-		u8 min_safe_light = 0;
-		for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
-				oldnodes.begin(); it < oldnodes.end(); ++it) {
-			u8 old_light = it->second.getLight(bank, ndef);
-			if (old_light > min_safe_light) {
-				min_safe_light = old_light;
+	// First queue is for day light, second is for night light.
+	UnlightQueue disappearing_lights[] = { UnlightQueue(256),
+		UnlightQueue(256) };
+	ReLightQueue light_sources[] = { ReLightQueue(256), ReLightQueue(256) };
+	// Changed nodes that start a sunlight column downwards.
+	std::vector<v3s16> sunlit_nodes;
+
+	// An area edit may change a node more than once. Only the first
+	// old node has the light the node had, so drop the others.
+	std::vector<std::pair<v3s16, MapNode> > unique_nodes;
+	if (oldnodes.size() > 1) {
+		unique_nodes = oldnodes;
+		std::stable_sort(unique_nodes.begin(), unique_nodes.end(),
+			is_node_before);
+		unique_nodes.erase(std::unique(unique_nodes.begin(),
+			unique_nodes.end(), is_same_node), unique_nodes.end());
+	}
+	std::vector<std::pair<v3s16, MapNode> > &changed_nodes =
+		oldnodes.size() > 1 ? unique_nodes : oldnodes;
+
+	// Nodes that are brighter than the brightest modified node was
+	// won't change, since they didn't get their light from a
+	// modified node.
+	u8 min_safe_light[] = { 0, 0 };
+	for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
+			changed_nodes.begin(); it < changed_nodes.end(); ++it) {
+		for (s32 i = 0; i < 2; i++) {
+			u8 old_light = it->second.getLight(banks[i], ndef);
+			if (old_light > min_safe_light[i]) {
+				min_safe_light[i] = old_light;
 			}
 		}
-		// If only one node changed, even nodes with the same brightness
-		// didn't get their light from the changed node.
-		if (oldnodes.size() > 1) {
-			min_safe_light++;
+	}
+	// If only one node changed, even nodes with the same brightness
+	// didn't get their light from the changed node.
+	if (changed_nodes.size() > 1) {
+		min_safe_light[0]++;
+		min_safe_light[1]++;
+	}
+	// For each changed node process sunlight and initialize,
+	// both light banks at once.
+	for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
+			changed_nodes.begin(); it < changed_nodes.end(); ++it) {
+		// Get position and block of the changed node
+		v3s16 p = it->first;
+		relative_v3 rel_pos;
+		mapblock_v3 block_pos;
+		getNodeBlockPosWithOffset(p, block_pos, rel_pos);
+		MapBlock *block = map->getBlockNoCreateNoEx(block_pos);
+		if (block == NULL || block->isDummy()) {
+			continue;
 		}
-		// For each changed node process sunlight and initialize
-		for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
-				oldnodes.begin(); it < oldnodes.end(); ++it) {
-			// Get position and block of the changed node
-			v3s16 p = it->first;
-			relative_v3 rel_pos;
-			mapblock_v3 block_pos;
-			getNodeBlockPosWithOffset(p, block_pos, rel_pos);
-			MapBlock *block = map->getBlockNoCreateNoEx(block_pos);
-			if (block == NULL || block->isDummy()) {
-				continue;
-			}
-			// Get the new node
-			MapNode n = block->getNodeNoCheck(rel_pos, &is_valid_position);
-			if (!is_valid_position) {
-				break;
-			}
+		// Get the new node
+		MapNode n = block->getNodeNoCheck(rel_pos, &is_valid_position);
+		if (!is_valid_position) {
+			break;
+		}
+		const ContentFeatures &f = ndef->get(n);
+
+		// Add the block of the added node to modified_blocks
+		modified_blocks[block_pos] = block;
+
+		bool unlit[] = { false, false };
+		for (s32 i = 0; i < 2; i++) {
+			LightBank bank = banks[i];
 
 			// Light of the old node
 			u8 old_light = it->second.getLight(bank, ndef);
 
-			// Add the block of the added node to modified_blocks
-			modified_blocks[block_pos] = block;
-
 			// Get new light level of the node
 			u8 new_light = 0;
-			if (ndef->get(n).light_propagates) {
-				if (bank == LIGHTBANK_DAY && ndef->get(n).sunlight_propagates
+			if (f.light_propagates) {
+				if (bank == LIGHTBANK_DAY && f.sunlight_propagates
 					&& is_sunlight_above(map, p, ndef)) {
 					new_light = LIGHT_SUN;
 				} else {
-					new_light = ndef->get(n).light_source;
-					for (int i = 0; i < 6; i++) {
-						v3s16 p2 = p + neighbor_dirs[i];
+					new_light = f.light_source;
+					for (int d = 0; d < 6; d++) {
+						v3s16 p2 = p + neighbor_dirs[d];
 						bool is_valid;
 						MapNode n2 = map->getNodeNoEx(p2, &is_valid);
 						if (is_valid) {
 							u8 spread = n2.getLight(bank, ndef);
 							// If it is sure that the neighbor won't be
 							// unlighted, its light can spread to this node.
-							if (spread > new_light && spread >= min_safe_light) {
+							if (spread > new_light &&
+									spread >= min_safe_light[i]) {
 								new_light = spread - 1;
 							}
 						}
@@ -679,104 +790,150 @@ void update_lighting_nodes(Map *map,
 				}
 			} else {
 				// If this is an opaque node, it still can emit light.
-				new_light = ndef->get(n).light_source;
+				new_light = f.light_source;
 			}
 
 			if (new_light > 0) {
-				light_sources.push(new_light, rel_pos, block_pos, block, 6);
+				light_sources[i].push(new_light, rel_pos, block_pos, block,
+					6);
 			}
 
 			if (new_light < old_light) {
 				// The node became opaque or doesn't provide as much
 				// light as the previous one, so it must be unlighted.
+				n.setLight(bank, 0, f);
+				unlit[i] = true;
+				disappearing_lights[i].push(old_light, rel_pos, block_pos,
+					block, 6);
+			} else if (new_light > old_light) {
+				// It is sure that the node provides more light than the
+				// previous one, unlighting is not necessary.
+				if (bank == LIGHTBANK_DAY && new_light == LIGHT_SUN)
+					sunlit_nodes.push_back(p);
+			}
+		}
+		if (!unlit[0] && !unlit[1])
+			continue;
 
-				// Add to unlight queue
-				n.setLight(bank, 0, ndef);
-				block->setNodeNoCheck(rel_pos, n);
-				disappearing_lights.push(old_light, rel_pos, block_pos, block,
-					6);
+		// Add to unlight queue
+		block->setNodeNoCheck(rel_pos, n);
 
-				// Remove sunlight, if there was any
-				if (bank == LIGHTBANK_DAY && old_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
+		// Remove sunlight, if there was any
+		if (!unlit[0] || it->second.getLight(LIGHTBANK_DAY, ndef) != LIGHT_SUN)
+			continue;
+		for (s16 y = p.Y - 1;; y--) {
+			v3s16 n2pos(p.X, y, p.Z);
 
-						MapNode n2;
+			MapNode n2;
 
-						n2 = map->getNodeNoEx(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
+			n2 = map->getNodeNoEx(n2pos, &is_valid_position);
+			if (!is_valid_position)
+				break;
 
-						// If this node doesn't have sunlight, the nodes below
-						// it don't have too.
-						if (n2.getLight(LIGHTBANK_DAY, ndef) != LIGHT_SUN) {
-							break;
-						}
-						// Remove sunlight and add to unlight queue.
-						n2.setLight(LIGHTBANK_DAY, 0, ndef);
-						map->setNode(n2pos, n2);
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
-						disappearing_lights.push(LIGHT_SUN, rel_pos2,
-							block_pos2, block2,
-							4 /* The node above caused the change */);
-					}
-				}
-			} else if (new_light > old_light) {
-				// It is sure that the node provides more light than the previous
-				// one, unlighting is not necessary.
-				// Propagate sunlight
-				if (bank == LIGHTBANK_DAY && new_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
-
-						MapNode n2;
-
-						n2 = map->getNodeNoEx(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
-
-						// This should not happen, but if the node has sunlight
-						// then the iteration should stop.
-						if (n2.getLight(LIGHTBANK_DAY, ndef) == LIGHT_SUN) {
-							break;
-						}
-						// If the node terminates sunlight, stop.
-						if (!ndef->get(n2).sunlight_propagates) {
-							break;
-						}
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
-						// Mark node for lighting.
-						light_sources.push(LIGHT_SUN, rel_pos2, block_pos2,
-							block2, 4);
-					}
-				}
+			// If this node doesn't have sunlight, the nodes below
+			// it don't have too.
+			if (n2.getLight(LIGHTBANK_DAY, ndef) != LIGHT_SUN) {
+				break;
 			}
+			// Remove sunlight and add to unlight queue.
+			n2.setLight(LIGHTBANK_DAY, 0, ndef);
+			map->setNode(n2pos, n2);
+			relative_v3 rel_pos2;
+			mapblock_v3 block_pos2;
+			getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
+			MapBlock *block2 = map->getBlockNoCreateNoEx(
+				block_pos2);
+			disappearing_lights[0].push(LIGHT_SUN, rel_pos2,
+				block_pos2, block2,
+				4 /* The node above caused the change */);
+		}
+	}
+
+	// Propagate sunlight. A column is walked only once, from its
+	// highest changed node, even if a whole area was edited.
+	std::sort(sunlit_nodes.begin(), sunlit_nodes.end(), is_higher_in_column);
+	v3s16 walked_to(0, 0, 0);
+	bool has_walked = false;
+	for (std::vector<v3s16>::iterator it = sunlit_nodes.begin();
+			it != sunlit_nodes.end(); ++it) {
+		const v3s16 &p = *it;
+		if (has_walked && p.X == walked_to.X && p.Z == walked_to.Z &&
+				p.Y > walked_to.Y)
+			// The walk from above already got through this node.
+			continue;
+		s16 y = p.Y - 1;
+		for (;; y--) {
+			v3s16 n2pos(p.X, y, p.Z);
+
+			MapNode n2;
 
+			n2 = map->getNodeNoEx(n2pos, &is_valid_position);
+			if (!is_valid_position)
+				break;
+
+			// This should not happen, but if the node has sunlight
+			// then the iteration should stop.
+			if (n2.getLight(LIGHTBANK_DAY, ndef) == LIGHT_SUN) {
+				break;
+			}
+			// If the node terminates sunlight, stop.
+			if (!ndef->get(n2).sunlight_propagates) {
+				break;
+			}
+			relative_v3 rel_pos2;
+			mapblock_v3 block_pos2;
+			getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
+			MapBlock *block2 = map->getBlockNoCreateNoEx(
+				block_pos2);
+			// Mark node for lighting.
+			light_sources[0].push(LIGHT_SUN, rel_pos2, block_pos2,
+				block2, 4);
 		}
-		// Remove lights
-		unspread_light(map, ndef, bank, disappearing_lights, light_sources,
-			modified_blocks);
-		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= LIGHT_SUN; i++) {
-			const std::vector<ChangingLight> &lights = light_sources.lights[i];
-			for (std::vector<ChangingLight>::const_iterator it = lights.begin();
-					it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position,
+		walked_to = v3s16(p.X, y, p.Z);
+		has_walked = true;
+	}
+
+	// Remove lights
+	for (s32 i = 0; i < 2; i++) {
+		unspread_light(map, ndef, banks[i], disappearing_lights[i],
+			light_sources[i], modified_blocks);
+	}
+
+	// When more nodes changed, the light of their neighbors was not
+	// trusted above. After unlighting all remaining light is valid,
+	// so let it spread into the changed nodes.
+	if (changed_nodes.size() > 1) {
+		for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
+				changed_nodes.begin(); it < changed_nodes.end(); ++it) {
+			MapNode n = map->getNodeNoEx(it->first, &is_valid_position);
+			if (!is_valid_position || !ndef->get(n).light_propagates)
+				continue;
+			for (direction d = 0; d < 6; d++) {
+				v3s16 p2 = it->first + neighbor_dirs[d];
+				relative_v3 rel_pos2;
+				mapblock_v3 block_pos2;
+				getNodeBlockPosWithOffset(p2, block_pos2, rel_pos2);
+				MapBlock *block2 = map->getBlockNoCreateNoEx(block_pos2);
+				if (block2 == NULL || block2->isDummy())
+					continue;
+				MapNode n2 = block2->getNodeNoCheck(rel_pos2,
 					&is_valid_position);
-				n.setLight(bank, i, ndef);
-				it->block->setNodeNoCheck(it->rel_position, n);
+				for (s32 i = 0; i < 2; i++) {
+					u8 light = n2.getLight(banks[i], ndef);
+					if (light > 1)
+						light_sources[i].push(light, rel_pos2, block_pos2,
+							block2, 6);
+				}
 			}
 		}
+	}
+
+	for (s32 i = 0; i < 2; i++) {
+		LightBank bank = banks[i];
+		// Initialize light values for light spreading.
+		light_sources[i].applyLights(bank, LIGHT_SUN, ndef);
 		// Spread lights.
-		spread_light(map, ndef, bank, light_sources, modified_blocks);
+		spread_light(map, ndef, bank, light_sources[i], modified_blocks);
 	}
 }
 
@@ -887,16 +1044,7 @@ void update_block_border_lighting(Map *map, MapBlock *block,
 		unspread_light(map, ndef, bank, disappearing_lights, light_sources,
 			modified_blocks);
 		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= LIGHT_SUN; i++) {
-			const std::vector<ChangingLight> &lights = light_sources.lights[i];
-			for (std::vector<ChangingLight>::const_iterator it = lights.begin();
-					it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position,
-					&is_valid_position);
-				n.setLight(bank, i, ndef);
-				it->block->setNodeNoCheck(it->rel_position, n);
-			}
-		}
+		light_sources.applyLights(bank, LIGHT_SUN, ndef);
 		// Spread lights.
 		spread_light(map, ndef, bank, light_sources, modified_blocks);
 	}
@@ -1168,16 +1316,7 @@ void finish_bulk_light_update(Map *map, mapblock_v3 minblock,
 		// Sunlight is already initialized.
 		u8 maxlight = (b == 0) ? LIGHT_MAX : LIGHT_SUN;
 		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= maxlight; i++) {
-			const std::vector<ChangingLight> &lights = relight[b].lights[i];
-			for (std::vector<ChangingLight>::const_iterator it = lights.begin();
-					it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position,
-					&is_valid);
-				n.setLight(bank, i, ndef);
-				it->block->setNodeNoCheck(it->rel_position, n);
-			}
-		}
+		relight[b].applyLights(bank, maxlight, ndef);
 		// Spread lights.
 		spread_light(map, ndef, bank, relight[b], *modified_blocks);
 	}
@@ -1470,5 +1609,70 @@ void VoxelLineIterator::next()
 			|| (m_next_intersection_multi.Z <= 1);
 }
 
+u16 get_face_connectivity(const MapNode *nodes, u32 ystride, u32 zstride,
+	INodeDefManager *ndef)
+{
+	const u32 volume = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+	// Whether the node at each relative position is opaque or visited
+	bool closed[volume];
+	u32 open_count = 0;
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+		const MapNode &n = nodes[z * zstride + y * ystride + x];
+		bool opaque = ndef->get(n).drawtype == NDT_NORMAL;
+		closed[(z * MAP_BLOCKSIZE + y) * MAP_BLOCKSIZE + x] = opaque;
+		if (!opaque)
+			open_count++;
+	}
+
+	if (open_count == volume)
+		return FACE_CONNECTIVITY_ALL;
+	if (open_count == 0)
+		return 0;
+
+	u16 connectivity = 0;
+	u16 stack[volume];
+	for (u32 start = 0; start < volume; start++) {
+		if (closed[start])
+			continue;
+
+		// Find the faces that this region of open nodes touches
+		u8 faces = 0;
+		u32 stack_size = 0;
+		stack[stack_size++] = start;
+		closed[start] = true;
+		while (stack_size > 0) {
+			u32 i = stack[--stack_size];
+			s16 x = i % MAP_BLOCKSIZE;
+			s16 y = (i / MAP_BLOCKSIZE) % MAP_BLOCKSIZE;
+			s16 z = i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE);
+			for (u8 d = 0; d < 6; d++) {
+				v3s16 p = v3s16(x, y, z) + g_6dirs[d];
+				if (p.X < 0 || p.Y < 0 || p.Z < 0 ||
+						p.X >= MAP_BLOCKSIZE || p.Y >= MAP_BLOCKSIZE ||
+						p.Z >= MAP_BLOCKSIZE) {
+					faces |= 1 << d;
+					continue;
+				}
+				u32 j = (p.Z * MAP_BLOCKSIZE + p.Y) * MAP_BLOCKSIZE + p.X;
+				if (closed[j])
+					continue;
+				closed[j] = true;
+				stack[stack_size++] = j;
+			}
+		}
+
+		for (u8 a = 0; a < 6; a++)
+		for (u8 b = a + 1; b < 6; b++) {
+			if ((faces & (1 << a)) && (faces & (1 << b)))
+				connectivity |= face_connection_bit(a, b);
+		}
+		if (connectivity == FACE_CONNECTIVITY_ALL)
+			break;
+	}
+	return connectivity;
+}
+
 } // namespace voxalgo
 
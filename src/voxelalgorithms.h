@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifndef VOXELALGORITHMS_HEADER
 #define VOXELALGORITHMS_HEADER
 
+#include <utility>
 #include "voxel.h"
 #include "mapnode.h"
 #include "util/container.h"
@@ -63,9 +64,12 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
  * no nodes were changed except the given ones.
  * Before calling this procedure make sure that all new nodes on
  * the map have zero light level!
+ * Changing a whole area at once and updating it in a single call
+ * is much faster than updating the nodes one by one.
  *
  * \param oldnodes contains the MapNodes that were replaced by the new
- * MapNodes and their positions
+ * MapNodes and their positions. If a position is listed more than
+ * once, its first entry must be the original node.
  * \param modified_blocks output, contains all map blocks that
  * the function modified
  */
@@ -165,6 +169,35 @@ struct VoxelLineIterator
 	inline bool hasNext() const { return m_has_next; }
 };
 
+/*!
+ * Returns the bit of get_face_connectivity() that tells whether
+ * the faces a and b (indices of g_6dirs, a != b) of a block
+ * are connected.
+ */
+inline u16 face_connection_bit(u8 a, u8 b)
+{
+	if (a > b)
+		std::swap(a, b);
+	return 1 << (a * (11 - a) / 2 + b - a - 1);
+}
+
+//! All faces of a block are connected with each other.
+#define FACE_CONNECTIVITY_ALL 0x7fff
+
+/*!
+ * Flood fills the nodes of a block that can be seen through and
+ * returns which faces of the block are connected through them,
+ * as a mask of face_connection_bit()s.
+ * Only nodes drawn as normal cubes block the view, which is what
+ * Map::isOccluded() assumes, too.
+ *
+ * \param nodes points to the node 0,0,0 of the block
+ * \param ystride the index step of the nodes in the Y direction
+ * \param zstride the index step of the nodes in the Z direction
+ */
+u16 get_face_connectivity(const MapNode *nodes, u32 ystride, u32 zstride,
+	INodeDefManager *ndef);
+
 } // namespace voxalgo
 
 